@@ -3,19 +3,57 @@ import esphome.config_validation as cv
 from esphome.components import climate, sensor, time
 from esphome.components.remote_base import CONF_TRANSMITTER_ID
 from esphome.const import CONF_ID, CONF_TIME_ID, CONF_MAC_ADDRESS, \
-    UNIT_PERCENT, ICON_PERCENT, STATE_CLASS_MEASUREMENT
+    CONF_INTERVAL, CONF_TIMEOUT, UNIT_PERCENT, ICON_PERCENT, STATE_CLASS_MEASUREMENT
+from esphome.core import CORE, TimePeriod
 
 DEPENDENCIES = ['esp32']
-CONFLICTS_WITH = ['eq3_v1', 'esp32_ble_tracker']
+CONFLICTS_WITH = ['eq3_v1']
 DEPENDENCIES = ['esp32', 'time']
 AUTO_LOAD = ['sensor', 'esp32_ble_clients']
 
 CONF_VALVE = 'valve'
 CONF_PIN = 'pin'
 CONF_TEMP = 'temperature_sensor'
+CONF_LINGER = 'linger'
+CONF_CONNECTION = 'connection'
+CONF_IDLE_INTERVAL = 'idle_interval'
+CONF_LATENCY = 'latency'
+CONF_PREFER_2M_PHY = 'prefer_2m_phy'
 
 EQ3Climate = cg.global_ns.class_('EQ3Climate', climate.Climate, cg.PollingComponent)
 
+CONN_INTERVAL = cv.All(cv.positive_time_period_microseconds,
+                       cv.Range(min=TimePeriod(microseconds=7500), max=TimePeriod(seconds=4)))
+
+
+def validate_connection(config):
+    # the link must survive the slowest interval with all events skipped
+    slowest = max(config[CONF_INTERVAL], config.get(CONF_IDLE_INTERVAL, config[CONF_INTERVAL]))
+    if config[CONF_TIMEOUT].total_microseconds <= \
+            2 * (1 + config[CONF_LATENCY]) * slowest.total_microseconds:
+        raise cv.Invalid("timeout has to be longer than 2 * (1 + latency) * interval")
+    return config
+
+
+CONNECTION_SCHEMA = cv.All(cv.Schema({
+    cv.Required(CONF_INTERVAL): CONN_INTERVAL,
+    cv.Optional(CONF_IDLE_INTERVAL): CONN_INTERVAL,
+    cv.Optional(CONF_LATENCY, default=0): cv.int_range(min=0, max=499),
+    cv.Optional(CONF_TIMEOUT, default='6s'): cv.All(
+        cv.positive_time_period_milliseconds,
+        cv.Range(min=TimePeriod(milliseconds=100), max=TimePeriod(seconds=32))),
+    cv.Optional(CONF_PREFER_2M_PHY, default=False): cv.boolean,
+}), validate_connection)
+
+
+def validate_tracker(config):
+    # the tracker owns the GAP callback, the updates would never be seen
+    if CONF_CONNECTION in config and 'esp32_ble_tracker' in CORE.loaded_integrations:
+        raise cv.Invalid("connection parameters are not supported together with esp32_ble_tracker",
+                         path=[CONF_CONNECTION])
+    return config
+
+
 CONFIG_SCHEMA = cv.All(climate.CLIMATE_SCHEMA.extend({
     cv.GenerateID(): cv.declare_id(EQ3Climate),
     cv.GenerateID(CONF_TIME_ID): cv.use_id(time.RealTimeClock),
@@ -27,8 +65,10 @@ CONFIG_SCHEMA = cv.All(climate.CLIMATE_SCHEMA.extend({
         state_class=STATE_CLASS_MEASUREMENT
     ),
     cv.Optional(CONF_PIN): cv.string,
-    cv.Optional(CONF_TEMP): cv.use_id(sensor.Sensor)
-}).extend(cv.polling_component_schema('4h')))
+    cv.Optional(CONF_TEMP): cv.use_id(sensor.Sensor),
+    cv.Optional(CONF_LINGER, default='0s'): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_CONNECTION): CONNECTION_SCHEMA,
+}).extend(cv.polling_component_schema('4h')), validate_tracker)
 
 
 def to_code(config):
@@ -41,6 +81,16 @@ def to_code(config):
     time_ = yield cg.get_variable(config[CONF_TIME_ID])
     cg.add(var.set_time(time_))
 
+    cg.add(var.set_linger(config[CONF_LINGER]))
+
+    if CONF_CONNECTION in config:
+        conf = config[CONF_CONNECTION]
+        interval = conf[CONF_INTERVAL].total_microseconds // 1250
+        idle_interval = conf.get(CONF_IDLE_INTERVAL, conf[CONF_INTERVAL]).total_microseconds // 1250
+        cg.add(var.set_conn_params(interval, idle_interval, conf[CONF_LATENCY],
+                                   conf[CONF_TIMEOUT].total_milliseconds // 10))
+        cg.add(var.set_prefer_2m_phy(conf[CONF_PREFER_2M_PHY]))
+
     if CONF_TEMP in config:
         sens = yield cg.get_variable(config[CONF_TEMP])
         cg.add(var.set_temperature_sensor(sens))
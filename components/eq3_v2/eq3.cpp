@@ -37,7 +37,16 @@ void EQ3Climate::setup() {
 
 }
 
+void EQ3Climate::loop() {
+  finish_transaction();
+}
+
 void EQ3Climate::update() {
+  if (!transactions.empty()) {
+    ESP_LOGW(TAG, "Update of %10llx skipped, previous requests are still pending.", address);
+    return;
+  }
+
   cancel_timeout("update_retry");
   if (!last_id.has_value()) {
     update_id();
@@ -51,55 +60,61 @@ void EQ3Climate::update() {
 void EQ3Climate::update_retry(int tries) {
   ESP_LOGI(TAG, "Requesting update of %10llx...", address);
 
-  bool success = with_connection([this]() {
+  with_connection([this]() {
     return query_state();
+  }, [this, tries](bool success) mutable {
+    if (success) {
+      ESP_LOGI(TAG, "Update of %10llx succeeded.", address);
+    } else if (--tries > 0) {
+      ESP_LOGW(TAG, "Update of %10llx failed. Tries left: %d.", address, tries);
+      set_timeout("update_retry", 3000, [this, tries]() {
+        update_retry(tries);
+      });
+    } else {
+      ESP_LOGW(TAG, "Update of %10llx failed. Too many tries.", address);
+      reset_state();
+    }
   });
-
-  if (success) {
-    ESP_LOGI(TAG, "Update of %10llx succeeded.", address);
-  } else if (--tries > 0) {
-    ESP_LOGW(TAG, "Update of %10llx failed. Tries left: %d.", address, tries);
-    set_timeout("update_retry", 3000, [this, tries]() {
-      update_retry(tries);
-    });
-  } else {
-    ESP_LOGW(TAG, "Update of %10llx failed. Too many tries.", address);
-    reset_state();
-  }
 }
 
 void EQ3Climate::update_id() {
   ESP_LOGI(TAG, "Requesting ID of %10llx...", address);
 
-  bool success = with_connection([this]() {
+  with_connection([this]() {
     return query_id();
+  }, [this](bool success) {
+    if (success) {
+      ESP_LOGI(TAG, "ID of %10llx succeeded.", address);
+    } else {
+      ESP_LOGW(TAG, "ID of %10llx failed. Too many tries.", address);
+    }
   });
-
-  if (success) {
-    ESP_LOGI(TAG, "ID of %10llx succeeded.", address);
-  } else {
-    ESP_LOGW(TAG, "ID of %10llx failed. Too many tries.", address);
-  }
 }
 
 void EQ3Climate::update_schedule() {
   ESP_LOGI(TAG, "Requesting Schedule of %10llx...", address);
 
-  bool success = with_connection([this]() {
+  // decided here, `last_schedule` is only updated by the main loop
+  std::vector<EQ3Day> days;
+  for (int day = EQ3_FirstDay; day < EQ3_LastDay; ++day) {
+    if (!last_schedule[day].has_value()) {
+      days.push_back((EQ3Day)day);
+    }
+  }
+
+  with_connection([this, days]() {
     bool success = false;
-    for (int day = EQ3_FirstDay; day < EQ3_LastDay; ++day) {
-      if (!last_schedule[day].has_value()) {
-        success = query_schedule((EQ3Day)day) || success;
-      }
+    for (auto day : days) {
+      success = query_schedule(day) || success;
     }
     return success;
+  }, [this](bool success) {
+    if (success) {
+      ESP_LOGI(TAG, "Schedule of %10llx succeeded.", address);
+    } else {
+      ESP_LOGW(TAG, "Schedule of %10llx failed. Too many tries.", address);
+    }
   });
-
-  if (success) {
-    ESP_LOGI(TAG, "Schedule of %10llx succeeded.", address);
-  } else {
-    ESP_LOGW(TAG, "Schedule of %10llx failed. Too many tries.", address);
-  }
 }
 
 void EQ3Climate::reset_state() {
@@ -110,16 +125,13 @@ void EQ3Climate::reset_state() {
 
 void EQ3Climate::control(const ClimateCall &call) {
   cancel_timeout("control_retry");
-  ClimateCall call_data = call;
-  defer("control_retry", [this, call]() {
-    control_retry(call, 3);
-  });
+  control_retry(call, 3);
 }
 
 void EQ3Climate::control_retry(ClimateCall call, int tries) {
   ESP_LOGI(TAG, "Requesting climate control of %10llx...", address);
 
-  bool success = with_connection([this, call]() {
+  with_connection([this, call]() {
     int calls = 0;
 
     if (call.get_target_temperature().has_value()) {
@@ -165,18 +177,18 @@ void EQ3Climate::control_retry(ClimateCall call, int tries) {
     }
 
     return calls > 0;
+  }, [this, call, tries](bool success) mutable {
+    if (success) {
+      ESP_LOGW(TAG, "Climate control of %10llx succeeded.", address);
+    } else if (--tries > 0) {
+      ESP_LOGW(TAG, "Climate control of %10llx failed. Tries left: %d.", address, tries);
+      set_timeout("control_retry", 3000, [this, call, tries]() {
+        control_retry(call, tries);
+      });
+    } else {
+      ESP_LOGW(TAG, "Climate control of %10llx failed. Too many tries.", address);
+    }
   });
-
-  if (success) {
-    ESP_LOGW(TAG, "Climate control of %10llx succeeded.", address);
-  } else if (--tries > 0) {
-    ESP_LOGW(TAG, "Climate control of %10llx failed. Tries left: %d.", address, tries);
-    set_timeout("control_retry", 3000, [this, call, tries]() {
-      control_retry(call, tries);
-    });
-  } else {
-    ESP_LOGW(TAG, "Climate control of %10llx failed. Too many tries.", address);
-  }
 }
 
 void EQ3Climate::parse_state(const std::string &data) {
@@ -317,5 +329,12 @@ void EQ3Climate::dump_config() {
   LOG_CLIMATE("", "EQ3-Max Thermostat", this);
   LOG_UPDATE_INTERVAL(this);
   ESP_LOGCONFIG(TAG, "  Mac Address: %10llx", this->address);
+  if (this->conn_interval) {
+    ESP_LOGCONFIG(TAG, "  Connection Interval: %.2fms", this->conn_interval * 1.25f);
+    ESP_LOGCONFIG(TAG, "  Idle Connection Interval: %.2fms", this->idle_conn_interval * 1.25f);
+    ESP_LOGCONFIG(TAG, "  Connection Latency: %d", this->conn_latency);
+    ESP_LOGCONFIG(TAG, "  Supervision Timeout: %dms", this->conn_timeout * 10);
+  }
+  ESP_LOGCONFIG(TAG, "  Prefer 2M PHY: %s", YESNO(this->prefer_2m_phy));
   LOG_SENSOR("  ", "Valve", valve);
 }
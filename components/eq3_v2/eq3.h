@@ -6,7 +6,11 @@
 #include "esphome/components/time/real_time_clock.h"
 
 #ifdef ARDUINO_ARCH_ESP32
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <string>
+#include <vector>
 
 class ESP32BLEClient;
 
@@ -33,6 +37,7 @@ public:
 
 public:
   void setup() override;
+  void loop() override;
   void dump_config() override;
   esphome::climate::ClimateTraits traits();
   float get_setup_priority() const override { return esphome::setup_priority::LATE; }
@@ -40,6 +45,15 @@ public:
   void set_valve(esphome::sensor::Sensor *sensor) { valve = sensor; }
   void set_time(esphome::time::RealTimeClock *clock) { time_clock = clock; }
   void set_temperature_sensor(esphome::sensor::Sensor *sensor) { temperature_sensor = sensor; };
+  void set_linger(uint32_t linger_ms) { linger = linger_ms; }
+  // interval in units of 1.25ms, timeout in units of 10ms
+  void set_conn_params(uint16_t interval, uint16_t idle_interval, uint16_t latency, uint16_t timeout) {
+    conn_interval = interval;
+    idle_conn_interval = idle_interval;
+    conn_latency = latency;
+    conn_timeout = timeout;
+  }
+  void set_prefer_2m_phy(bool prefer) { prefer_2m_phy = prefer; }
 
 public:
   void control(const esphome::climate::ClimateCall &call) override;
@@ -48,9 +62,11 @@ public:
   void update_schedule();
 
 private:
-  bool with_connection(std::function<bool()> handler);
+  void with_connection(std::function<bool()> handler, std::function<void(bool)> done);
+  void start_transaction();
+  void finish_transaction();
   bool connect();
-  void disconnect();
+  void disconnect(bool keep = false);
   bool send_command(void *command, uint16_t length);
   bool wait_for_notify(int timeout_ms = 3000);
   void reset_state();
@@ -81,12 +97,32 @@ private:
   void parse_id(const std::string &data);
 
   uint64_t address{0};
+  uint32_t linger{0};
+  uint16_t conn_interval{0};
+  uint16_t idle_conn_interval{0};
+  uint16_t conn_latency{0};
+  uint16_t conn_timeout{0};
+  bool prefer_2m_phy{false};
   esphome::sensor::Sensor *valve{nullptr};
   esphome::time::RealTimeClock *time_clock{nullptr};
   /// The sensor used for getting the current temperature
   esphome::sensor::Sensor *temperature_sensor{nullptr};
   std::unique_ptr<ESP32BLEClient> ble_client;
 
+  struct Transaction {
+    std::function<bool()> handler;
+    std::function<void(bool)> done;
+  };
+
+  // The front transaction runs on the BLE pool, the rest wait for it
+  std::deque<Transaction> transactions;
+
+  // Owned by the pool task until transaction_done is set
+  std::vector<std::string> received;
+  const char *transaction_error{nullptr};
+  bool transaction_success{false};
+  std::atomic<bool> transaction_done{false};
+
   esphome::optional<bool> last_schedule[EQ3_LastDay];
   esphome::optional<bool> last_id;
 };
@@ -4,10 +4,21 @@
 
 #include "../esp32_ble_clients/esp32_ble.h"
 #include "../esp32_ble_clients/esp32_ble_client.h"
+#include "../esp32_ble_clients/esp32_ble_log.h"
 
 using namespace esphome;
 
 static const char *TAG = "eq3_cmd";
+static const int ACQUIRE_TIMEOUT_MS = 30000;
+
+static ESP32BLEClient::ConnParams conn_params(uint16_t interval, uint16_t latency, uint16_t timeout) {
+  ESP32BLEClient::ConnParams params;
+  params.min_interval = interval;
+  params.max_interval = interval;
+  params.latency = latency;
+  params.timeout = timeout;
+  return params;
+}
 
 static uint8_t temp_to_dev(const float &value) {
   if (value < EQ3BT_MIN_TEMP)
@@ -18,15 +29,64 @@ static uint8_t temp_to_dev(const float &value) {
     return uint8_t(value * 2);
 }
 
-bool EQ3Climate::with_connection(std::function<bool()> handler) {
-  bool success = true;
+void EQ3Climate::with_connection(std::function<bool()> handler, std::function<void(bool)> done) {
+  transactions.push_back(Transaction{handler, done});
+
+  if (transactions.size() == 1) {
+    start_transaction();
+  }
+}
+
+void EQ3Climate::start_transaction() {
+  auto handler = transactions.front().handler;
+
+  received.clear();
+  transaction_error = nullptr;
+  transaction_success = false;
+  transaction_done = false;
+
+  // Other thermostats are talked to by the remaining pool tasks
+  // meanwhile, the result is picked up by `loop()`
+  bool queued = ESP32BLE::instance().queue([this, handler]() {
+    bool success = true;
+
+    success = success && connect();
+    success = success && handler();
+    success = success && wait_for_notify();
+    disconnect(success);
+
+    transaction_success = success;
+    transaction_done = true;
+  });
+
+  if (!queued) {
+    transaction_error = "Cannot queue transaction";
+    transaction_done = true;
+  }
+}
+
+void EQ3Climate::finish_transaction() {
+  if (transactions.empty() || !transaction_done) {
+    return;
+  }
+
+  for (auto iter = received.begin(); iter != received.end(); ++iter) {
+    parse_client_notify(*iter);
+  }
+
+  if (transaction_error) {
+    ESP_LOGW(TAG, "%s for %10llx.", transaction_error, address);
+  }
+
+  bool success = transaction_success;
+  auto done = transactions.front().done;
 
-  success = success && connect();
-  success = success && handler();
-  success = success && wait_for_notify();
-  disconnect();
+  transactions.pop_front();
+  if (!transactions.empty()) {
+    start_transaction();
+  }
 
-  return success;
+  done(success);
 }
 
 bool EQ3Climate::connect() {
@@ -37,25 +97,43 @@ bool EQ3Climate::connect() {
   std::unique_ptr<ESP32BLEClient> new_ble_client;
 
   new_ble_client.swap(ble_client);
-  new_ble_client.reset(ESP32BLE::instance().acquire());
+  new_ble_client.reset(ESP32BLE::instance().acquire(ACQUIRE_TIMEOUT_MS, address));
 
   if (!new_ble_client) {
-    ESP_LOGW(TAG, "Cannot acquire client for %10llx.", address);
+    transaction_error = "Cannot acquire client";
     return false;
   }
 
+  // still open since the last transaction
+  if (new_ble_client->is_connected()) {
+    BLE_LOGD(TAG, "Reusing connection to %10llx.\n", address);
+
+    // back from the idle interval
+    if (conn_interval && idle_conn_interval) {
+      new_ble_client->update_conn_params(conn_params(conn_interval, conn_latency, conn_timeout));
+    }
+
+    new_ble_client.swap(ble_client);
+    return true;
+  }
+
   new_ble_client->set_address(address);
+  new_ble_client->set_linger(linger);
+  new_ble_client->set_prefer_2m_phy(prefer_2m_phy);
+  if (conn_interval) {
+    new_ble_client->set_conn_params(conn_params(conn_interval, conn_latency, conn_timeout));
+  }
 
-  ESP_LOGV(TAG, "Connecting to %10llx...", address);
+  BLE_LOGD(TAG, "Connecting to %10llx...\n", address);
   
   if (!new_ble_client->connect()) {
-    ESP_LOGW(TAG, "Cannot connect to %10llx.", address);
+    transaction_error = "Cannot connect";
     return false;
   }
 
   if (!new_ble_client->request_services()) {
     new_ble_client.reset();
-    ESP_LOGW(TAG, "Cannot request services from %10llx.", address);
+    transaction_error = "Cannot request services";
     return false;
   }
 
@@ -64,25 +142,37 @@ bool EQ3Climate::connect() {
 
   if (!notify_handle) {
     new_ble_client.reset();
-    ESP_LOGE(TAG, "Cannot find notification handle for %10llx.", address);
+    transaction_error = "Cannot find notification handle";
     return false;
   }
 
-  new_ble_client->register_notify(notify_handle, true);
-  new_ble_client->write_notify_desc(notify_handle, true, true);
+  // queued, the first command is sent right after these complete
+  new_ble_client->queue_register_notify(notify_handle, true);
+  new_ble_client->queue_write_notify_desc(notify_handle, true, true);
 
-  ESP_LOGV(TAG, "Connected to %10llx.", address);
+  BLE_LOGD(TAG, "Connected to %10llx.\n", address);
   new_ble_client.swap(ble_client);
   return true;
 }
 
-void EQ3Climate::disconnect() {
+void EQ3Climate::disconnect(bool keep) {
   if (!ble_client) {
     return;
   }
 
-  ble_client.reset();
-  ESP_LOGV(TAG, "Disconnected from %10llx.", address);
+  // a link that did well is kept open for a while, to be reused
+  if (keep) {
+    if (idle_conn_interval) {
+      ble_client->update_conn_params(conn_params(idle_conn_interval, conn_latency, conn_timeout));
+    }
+    BLE_LOGD(TAG, "Connection to %10llx: interval=%d, latency=%d, timeout=%d, phy=%d.\n",
+      address, ble_client->get_conn_interval(), ble_client->get_conn_latency(),
+      ble_client->get_conn_timeout(), ble_client->get_phy());
+    ESP32BLE::instance().park(ble_client.release());
+  } else {
+    ble_client.reset();
+  }
+  BLE_LOGD(TAG, "Disconnected from %10llx.\n", address);
 }
 
 bool EQ3Climate::send_command(void *command, uint16_t length) {
@@ -93,7 +183,7 @@ bool EQ3Climate::send_command(void *command, uint16_t length) {
   uint16_t command_handle = ble_client->get_characteristic(
     PROP_SERVICE_UUID, PROP_COMMAND_CHARACTERISTIC_UUID);
   if (!command_handle) {
-    ESP_LOGE(TAG, "Cannot find command handle for %10llx.", address);
+    transaction_error = "Cannot find command handle";
     return false;
   }
 
@@ -104,10 +194,10 @@ bool EQ3Climate::send_command(void *command, uint16_t length) {
     true);
 
   if (result) {
-    ESP_LOGV(TAG, "Sent of `%s` to %10llx to handle %04x.",
+    BLE_LOGD(TAG, "Sent of `%s` to %10llx to handle %04x.\n",
       format_hex_pretty((const uint8_t*)command, length).c_str(), address, command_handle);
   } else {
-    ESP_LOGV(TAG, "Send of `%s` to %10llx to handle %04x: %d",
+    BLE_LOGD(TAG, "Send of `%s` to %10llx to handle %04x: %d\n",
       format_hex_pretty((const uint8_t*)command, length).c_str(), address, command_handle, result);
   }
 
@@ -119,18 +209,18 @@ bool EQ3Climate::wait_for_notify(int timeout_ms) {
     return false;
   }
 
-  auto notifications = ble_client->wait_for_notifications(timeout_ms);
-
-  for (auto iter = notifications.begin(); iter != notifications.end(); ++iter) {
-    parse_client_notify(iter->data);
-  }
+  // parsed on the main loop once the transaction is done
+  auto count = ble_client->wait_for_notifications(timeout_ms,
+    [this](const ESP32BLEClient::Notification &notification) {
+      received.emplace_back((const char*)notification.get_data(), notification.length);
+    });
 
-  if (notifications.empty()) {
-    ESP_LOGV(TAG, "Did not receive notification for %10llx.", address);
+  if (!count) {
+    transaction_error = "Did not receive notification";
     return false;
   }
 
-  ESP_LOGV(TAG, "Received notification for %10llx.", address);
+  BLE_LOGD(TAG, "Received notification for %10llx.\n", address);
   return true;
 }
 
@@ -141,7 +231,7 @@ bool EQ3Climate::query_id() {
 
 bool EQ3Climate::query_state() {
   if (!time_clock || !time_clock->now().is_valid()) {
-    ESP_LOGE(TAG, "Clock source for %10llx is not valid.", address);
+    transaction_error = "Clock source is not valid";
     return false;
   }
 
@@ -2,7 +2,44 @@ import re
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.const import CONF_ID, CONF_MAC_ADDRESS
-from esphome.core import coroutine
+from esphome.core import coroutine, CORE
 
 DEPENDENCIES = ['esp32']
-CONFLICTS_WITH = ['esp32_ble_tracker', 'esp32_ble_beacon']
+CONFLICTS_WITH = ['esp32_ble_beacon']
+
+CONF_SCAN_PRIORITY = 'scan_priority'
+CONF_MIN_SCAN_TIME = 'min_scan_time'
+CONF_MAX_SCAN_PAUSE = 'max_scan_pause'
+
+ESP32BLEScheduler = cg.global_ns.class_('ESP32BLEScheduler')
+ESP32BLESchedulerComponent = cg.global_ns.class_('ESP32BLESchedulerComponent', cg.Component)
+
+SCAN_PRIORITIES = {
+    'low': 'ESP32BLEScheduler::ScanLow',
+    'normal': 'ESP32BLEScheduler::ScanNormal',
+    'high': 'ESP32BLEScheduler::ScanHigh',
+}
+
+# only used when sharing the radio with `esp32_ble_tracker`
+CONFIG_SCHEMA = cv.Schema({
+    cv.GenerateID(): cv.declare_id(ESP32BLESchedulerComponent),
+    cv.Optional(CONF_SCAN_PRIORITY, default='normal'): cv.one_of(*SCAN_PRIORITIES, lower=True),
+    cv.Optional(CONF_MIN_SCAN_TIME, default='2s'): cv.positive_time_period_milliseconds,
+    cv.Optional(CONF_MAX_SCAN_PAUSE, default='10s'): cv.positive_time_period_milliseconds,
+})
+
+
+def to_code(config):
+    if 'esp32_ble_tracker' not in CORE.loaded_integrations:
+        return
+
+    cg.add_define('USE_ESP32_BLE_CLIENTS_TRACKER')
+
+    # attaches to the tracker, and hands it the scan pauses on the main loop
+    var = cg.new_Pvariable(config[CONF_ID])
+    yield cg.register_component(var, config)
+
+    scheduler = cg.MockObj('ESP32BLEScheduler::instance()', '.')
+    cg.add(scheduler.set_scan_priority(cg.RawExpression(SCAN_PRIORITIES[config[CONF_SCAN_PRIORITY]])))
+    cg.add(scheduler.set_min_scan_time(config[CONF_MIN_SCAN_TIME]))
+    cg.add(scheduler.set_max_scan_pause(config[CONF_MAX_SCAN_PAUSE]))
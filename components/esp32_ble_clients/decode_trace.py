@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Decodes the trace printed by `ESP32BLETrace::dump()`.
+
+Feed it the device log, for example:
+
+    esphome logs device.yaml | tee device.log
+    python3 decode_trace.py device.log
+
+Only the last dump found in the log is decoded.
+"""
+
+import re
+import struct
+import sys
+
+TRACE_VERSION = 1
+
+# keep in sync with `ESP32BLETrace::Entry`
+ENTRY = struct.Struct('<IIHBBiB3x')
+
+ENTRY_TYPES = ['event', 'begin', 'end']
+OPERATIONS = ['connect', 'search', 'write', 'notify']
+RESULTS = ['ok', 'failed', 'timed out']
+
+# `esp_gattc_cb_event_t`
+GATTC_EVENTS = {
+    0: 'REG', 1: 'UNREG', 2: 'OPEN', 3: 'READ_CHAR', 4: 'WRITE_CHAR',
+    5: 'CLOSE', 6: 'SEARCH_CMPL', 7: 'SEARCH_RES', 8: 'READ_DESCR',
+    9: 'WRITE_DESCR', 10: 'NOTIFY', 11: 'PREP_WRITE', 12: 'EXEC',
+    13: 'ACL', 14: 'CANCEL_OPEN', 15: 'SRVC_CHG', 17: 'ENC_CMPL_CB',
+    18: 'CFG_MTU', 24: 'CONGEST', 38: 'REG_FOR_NOTIFY',
+    39: 'UNREG_FOR_NOTIFY', 40: 'CONNECT', 41: 'DISCONNECT',
+    42: 'READ_MULTIPLE', 43: 'QUEUE_FULL', 46: 'DIS_SRVC_CMPL',
+}
+
+HEADER = re.compile(r'TRACE:v(\d+):entries=(\d+):size=(\d+):now=(\d+)')
+LINE = re.compile(r'T:([0-9a-f]+)')
+
+
+def read_dump(lines):
+    header = None
+    data = b''
+
+    for line in lines:
+        match = HEADER.search(line)
+        if match:
+            header = [int(value) for value in match.groups()]
+            data = b''
+            continue
+
+        match = LINE.search(line)
+        if match and header:
+            data += bytes.fromhex(match.group(1))
+
+    if not header:
+        raise ValueError('no trace found')
+
+    version, entries, size, _ = header
+    if version != TRACE_VERSION or size != ENTRY.size:
+        raise ValueError('trace v%d with %d bytes entries is not supported' % (version, size))
+    if len(data) != entries * size:
+        raise ValueError('trace is truncated, %d of %d entries' % (len(data) // size, entries))
+
+    return [ENTRY.unpack_from(data, offset) for offset in range(0, len(data), size)]
+
+
+def name(names, index):
+    if isinstance(names, dict):
+        return names.get(index, str(index))
+    return names[index] if index < len(names) else str(index)
+
+
+def print_trace(entries):
+    if not entries:
+        return
+
+    first_us = entries[0][0]
+    first_heap = entries[0][1]
+
+    for time_us, free_heap, app_id, type, code, value, result in entries:
+        # timestamps wrap every ~71 minutes
+        offset_us = (time_us - first_us) & 0xffffffff
+        prefix = '%10.3fms %+7d app=%-2d' % (offset_us / 1000.0, free_heap - first_heap, app_id)
+
+        if type == 0:
+            print('%s %-6s %s status=%d' % (prefix, 'event', name(GATTC_EVENTS, code), value))
+        elif type == 1:
+            print('%s %-6s %s' % (prefix, 'begin', name(OPERATIONS, code)))
+        else:
+            print('%s %-6s %s %s in %.1fms' % (prefix, name(ENTRY_TYPES, type),
+                                               name(OPERATIONS, code), name(RESULTS, result), value / 1000.0))
+
+
+def main():
+    if len(sys.argv) > 2:
+        print('usage: %s [log]' % sys.argv[0], file=sys.stderr)
+        return 1
+
+    if len(sys.argv) == 2:
+        with open(sys.argv[1], errors='replace') as file:
+            entries = read_dump(file)
+    else:
+        entries = read_dump(sys.stdin)
+
+    print_trace(entries)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,6 +1,7 @@
 #include "esp32_ble_log.h"
 #include "esp32_ble_lock.h"
 #include "esp32_ble_client.h"
+#include "esp32_ble_scheduler.h"
 #include "esp32_ble.h"
 
 #include <nvs_flash.h>
@@ -12,8 +13,26 @@
 #include <esp_coexist.h>
 #include <esp32-hal-bt.h>
 
+#include <algorithm>
+#include <string.h>
+
 static const char *TAG = "esp32_ble";
-static const int MAX_CLIENTS = 1;
+
+// Connections the controller was built for
+#if defined(CONFIG_BTDM_CTRL_BLE_MAX_CONN)
+static const int MAX_CLIENTS = CONFIG_BTDM_CTRL_BLE_MAX_CONN;
+#elif defined(CONFIG_BT_ACL_CONNECTIONS)
+static const int MAX_CLIENTS = CONFIG_BT_ACL_CONNECTIONS;
+#else
+static const int MAX_CLIENTS = 3;
+#endif
+
+// Kept clear of the ids `esp32_ble_tracker` hands out to its clients
+static const uint16_t FIRST_APP_ID = 0x100;
+
+static const int MAX_JOBS = 32;
+static const int WORKER_STACK_SIZE = 6144;
+static const int WORKER_PRIORITY = 1;
 
 using namespace esphome;
 
@@ -25,16 +44,37 @@ ESP32BLE& ESP32BLE::instance() {
 ESP32BLE::ESP32BLE()
 {
   lock = xSemaphoreCreateMutex();
+  max_clients = std::max(1, std::min(MAX_CLIENTS, 9));
+  next_app_id = FIRST_APP_ID;
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+  // The tracker sets up the controller, and owns both callbacks,
+  // GATTC events are handed over by the scheduler. The GAP events
+  // are not, so `eq3_v2` does not take connection parameters then.
+  tracker = true;
+  setup_if();
+#else
   initialized = ble_setup();
 
   if (auto err = esp_ble_gattc_register_callback(esp32_ble_client_event_handler)) {
     ESP_LOGE(TAG, "esp_ble_gattc_register_callback: %x", err);
   }
+
+  if (auto err = esp_ble_gap_register_callback(esp32_ble_gap_event_handler)) {
+    ESP_LOGE(TAG, "esp_ble_gap_register_callback: %x", err);
+  }
+#endif
 }
 
 ESP32BLE::~ESP32BLE()
 {
+  if (tracker) {
+    vSemaphoreDelete(lock);
+    return;
+  }
+
   esp_ble_gattc_register_callback(nullptr);
+  esp_ble_gap_register_callback(nullptr);
 
   if (initialized) {
     esp_bluedroid_disable();
@@ -48,6 +88,11 @@ ESP32BLE::~ESP32BLE()
 
 bool ESP32BLE::ble_setup()
 {
+  // Started by the tracker, only our settings are left
+  if (tracker) {
+    return ble_configure();
+  }
+
   if (btStarted()) {
     return true;
   }
@@ -84,6 +129,37 @@ bool ESP32BLE::ble_setup()
     return false;
   }
 
+  if (!ble_configure()) {
+    return false;
+  }
+
+  // BLE takes some time to be fully set up, 200ms should be more than enough
+  delay(200);  // NOLINT
+
+  ESP_LOGD(TAG, "BT init done.");
+
+  return true;
+}
+
+bool ESP32BLE::setup_if()
+{
+  if (initialized || !tracker) {
+    return initialized;
+  }
+
+  // we might be used before the tracker got set up,
+  // the scheduler attaches to it on the main loop then
+  if (!ESP32BLEScheduler::instance().has_scanner()) {
+    ESP_LOGE(TAG, "esp32_ble_tracker is not attached yet, will retry");
+    return false;
+  }
+
+  initialized = ble_setup();
+  return initialized;
+}
+
+bool ESP32BLE::ble_configure()
+{
   // Empty name
   esp_ble_gap_set_device_name("");
 
@@ -98,33 +174,91 @@ bool ESP32BLE::ble_setup()
     return false;
   }
 
-  // BLE takes some time to be fully set up, 200ms should be more than enough
-  delay(200);  // NOLINT
+  return true;
+}
 
-  ESP_LOGD(TAG, "BT init done.");
+bool ESP32BLE::has_free_client()
+{
+  // wait till we really free gattc_ifs
+  return clients < max_clients && gattc_ifs.size() < (size_t)max_clients;
+}
 
-  return true;
+void ESP32BLE::notify_waiter()
+{
+  // only the longest waiting task may take a free client
+  if (!waiters.empty() && has_free_client()) {
+    xTaskNotifyGive(waiters.front());
+  }
 }
 
-ESP32BLEClient* ESP32BLE::acquire()
+ESP32BLEClient* ESP32BLE::acquire(int timeout_ms, uint64_t address)
 {
   ESP32BLELock lock(this->lock);
 
-  if (!initialized) {
+  if (!setup_if()) {
     return nullptr;
   }
 
-  // wait till we really free gattc_ifs
-  if (gattc_ifs.size() >= MAX_CLIENTS) {
-    return nullptr;
+  // reuse the link kept open for the device
+  for (auto iter = idle_clients.begin(); address && iter != idle_clients.end(); ++iter) {
+    if (iter->client->address64 == address) {
+      auto client = iter->client;
+      idle_clients.erase(iter);
+      return client;
+    }
+  }
+
+  auto self = xTaskGetCurrentTaskHandle();
+  auto start = xTaskGetTickCount();
+  auto timeout = pdMS_TO_TICKS(timeout_ms);
+  bool queued = false;
+
+  // first come, first served
+  while (!has_free_client() || (!waiters.empty() && waiters.front() != self)) {
+    // links kept open give way to other devices, oldest first
+    if (!idle_clients.empty() && (waiters.empty() || waiters.front() == self)) {
+      auto client = idle_clients.front().client;
+      idle_clients.pop_front();
+
+      lock.give();
+      delete client;
+      lock.take();
+      continue;
+    }
+
+    auto waited = xTaskGetTickCount() - start;
+    if (waited >= timeout) {
+      if (queued) {
+        waiters.erase(std::find(waiters.begin(), waiters.end(), self));
+        notify_waiter();
+      }
+      return nullptr;
+    }
+
+    if (!queued) {
+      waiters.push_back(self);
+      queued = true;
+    }
+
+    lock.give();
+    ulTaskNotifyTake(pdTRUE, timeout - waited);
+    lock.take();
+  }
+
+  if (queued) {
+    waiters.pop_front();
   }
 
   // find next free app_id
-  while (app_ids[next_app_id])
+  while (app_ids.find(next_app_id) != app_ids.end())
     next_app_id++;
 
   auto client = new ESP32BLEClient(next_app_id);
   app_ids[next_app_id] = client;
+  clients++;
+
+  // more than one client might have been freed meanwhile
+  notify_waiter();
   return client;
 }
 
@@ -135,6 +269,8 @@ bool ESP32BLE::release(ESP32BLEClient *client)
   for (auto iter = app_ids.begin(); iter != app_ids.end(); ++iter) {
     if (iter->second == client) {
       app_ids.erase(iter);
+      clients--;
+      notify_waiter();
       return true;
     }
   }
@@ -142,6 +278,128 @@ bool ESP32BLE::release(ESP32BLEClient *client)
   return false;
 }
 
+void ESP32BLE::park(ESP32BLEClient *client)
+{
+  if (!client) {
+    return;
+  }
+
+  {
+    ESP32BLELock lock(this->lock);
+
+    // not worth keeping if somebody already waits for the connection
+    if (client->linger_ms > 0 && client->is_connected() &&
+        waiters.empty() && start_workers()) {
+      idle_clients.push_back(IdleClient{client, xTaskGetTickCount()});
+
+      // wake up a worker to close it in time
+      Job *wakeup = nullptr;
+      xQueueSend(jobs, &wakeup, 0);
+      return;
+    }
+  }
+
+  delete client;
+}
+
+TickType_t ESP32BLE::close_idle()
+{
+  while (true) {
+    ESP32BLEClient *expired = nullptr;
+    TickType_t wait = portMAX_DELAY;
+
+    {
+      ESP32BLELock lock(this->lock);
+
+      auto now = xTaskGetTickCount();
+
+      for (auto iter = idle_clients.begin(); iter != idle_clients.end(); ++iter) {
+        auto linger = pdMS_TO_TICKS(iter->client->linger_ms);
+        auto idle = now - iter->since;
+
+        if (idle >= linger || !iter->client->is_connected()) {
+          expired = iter->client;
+          idle_clients.erase(iter);
+          break;
+        }
+
+        wait = std::min(wait, linger - idle);
+      }
+    }
+
+    if (!expired) {
+      return wait;
+    }
+
+    delete expired;
+  }
+}
+
+bool ESP32BLE::start_workers()
+{
+  if (jobs) {
+    return true;
+  }
+
+  jobs = xQueueCreate(MAX_JOBS, sizeof(Job*));
+  if (!jobs) {
+    return false;
+  }
+
+  // one task per connection, more could not do anything but wait
+  for (int i = 0; i < max_clients; i++) {
+    TaskHandle_t worker = nullptr;
+    if (xTaskCreatePinnedToCore(worker_task, "ble_client", WORKER_STACK_SIZE,
+        this, WORKER_PRIORITY, &worker, tskNO_AFFINITY) != pdPASS) {
+      ESP_LOGE(TAG, "Failed to start BLE client task %d", i);
+      break;
+    }
+    workers.push_back(worker);
+  }
+
+  return !workers.empty();
+}
+
+bool ESP32BLE::queue(Job job)
+{
+  {
+    ESP32BLELock lock(this->lock);
+
+    if (!setup_if() || !start_workers()) {
+      return false;
+    }
+  }
+
+  auto pending = new Job(std::move(job));
+  if (xQueueSend(jobs, &pending, 0) != pdPASS) {
+    delete pending;
+    return false;
+  }
+
+  return true;
+}
+
+void ESP32BLE::worker_task(void *arg)
+{
+  auto self = (ESP32BLE*)arg;
+
+  while (true) {
+    // idle links get closed in between jobs
+    auto wait = self->close_idle();
+
+    Job *job = nullptr;
+    if (xQueueReceive(self->jobs, &job, wait) != pdPASS) {
+      continue;
+    }
+
+    // or nothing, if only woken up for a parked client
+    if (job) {
+      (*job)();
+      delete job;
+    }
+  }
+}
+
 void ESP32BLE::esp32_ble_client_event_handler(
   esp_gattc_cb_event_t event,
   esp_gatt_if_t gattc_if,
@@ -160,16 +418,27 @@ void ESP32BLE::client_event_handler(
   {
     ESP32BLELock lock(this->lock);
 
-    // Register gattc_if
-    if (event == ESP_GATTC_REG_EVT) {
+    // Register gattc_if, other apps might share the callback
+    if (event == ESP_GATTC_REG_EVT && param->reg.app_id >= FIRST_APP_ID) {
       gattc_ifs[gattc_if] = param->reg.app_id;
     }
 
-    client = app_ids[gattc_ifs[gattc_if]];
+    // Looked up without inserting, events of unknown
+    // interfaces must not take up a client slot
+    auto gattc_iter = gattc_ifs.find(gattc_if);
+    if (gattc_iter == gattc_ifs.end()) {
+      return;
+    }
+
+    auto app_iter = app_ids.find(gattc_iter->second);
+    if (app_iter != app_ids.end()) {
+      client = app_iter->second;
+    }
 
     // Unregister gattc_if
     if (event == ESP_GATTC_UNREG_EVT) {
       gattc_ifs.erase(gattc_if);
+      notify_waiter();
     }
   }
 
@@ -200,3 +469,53 @@ void ESP32BLE::client_event_handler(
 
   client->client_event_handler(event, gattc_if, param);
 }
+
+void ESP32BLE::esp32_ble_gap_event_handler(
+  esp_gap_ble_cb_event_t event,
+  esp_ble_gap_cb_param_t* param)
+{
+  instance().gap_event_handler(event, param);
+}
+
+void ESP32BLE::gap_event_handler(
+  esp_gap_ble_cb_event_t event,
+  esp_ble_gap_cb_param_t* param)
+{
+  uint8_t *bda = nullptr;
+
+  // Only events of a connection are of interest
+  switch (event) {
+  case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+    bda = param->update_conn_params.bda;
+    break;
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+    bda = param->phy_update.bda;
+    break;
+#endif
+
+  default:
+    return;
+  }
+
+  ESP32BLEClient *client = nullptr;
+
+  {
+    ESP32BLELock lock(this->lock);
+
+    for (auto iter = app_ids.begin(); iter != app_ids.end(); ++iter) {
+      if (iter->second && memcmp(iter->second->address, bda, sizeof(esp_bd_addr_t)) == 0) {
+        client = iter->second;
+        break;
+      }
+    }
+  }
+
+  if (!client) {
+    BLE_LOGD(TAG, "GapEventHandler: event=%x => client not found\n", event);
+    return;
+  }
+
+  client->gap_event_handler(event, param);
+}
@@ -5,11 +5,16 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 #include <esp_gap_ble_api.h>
 #include <esp_gatt_common_api.h>
 #include <esp_gattc_api.h>
 
+#include <deque>
+#include <functional>
 #include <map>
+#include <vector>
 
 class ESP32BLEClient;
 
@@ -22,29 +27,78 @@ public:
   ESP32BLE();
   ~ESP32BLE();
 
+public:
+  typedef std::function<void()> Job;
+
 public:
   bool ble_setup();
-  ESP32BLEClient* acquire();
+  // Whether the controller is shared with `esp32_ble_tracker`
+  bool is_shared() const { return tracker; }
+  int get_max_clients() const { return max_clients; }
+
+  // Waits up to timeout_ms for a free connection, clients
+  // are handed out in the order they were asked for. A link
+  // still kept open for the address is handed out first.
+  ESP32BLEClient* acquire(int timeout_ms = 0, uint64_t address = 0);
   bool release(ESP32BLEClient *client);
 
+  // Takes over a client that is no longer used. It is kept connected
+  // for its linger time, unless another device needs the connection.
+  void park(ESP32BLEClient *client);
+
+  // Runs the job on one of the pool tasks, one per connection,
+  // so that as many peripherals as the controller allows are
+  // talked to at once. Jobs are started in the order queued.
+  bool queue(Job job);
+
 private:
   void client_event_handler(
     esp_gattc_cb_event_t event,
     esp_gatt_if_t gattc_if,
     esp_ble_gattc_cb_param_t* param);
 
+  void gap_event_handler(
+    esp_gap_ble_cb_event_t event,
+    esp_ble_gap_cb_param_t* param);
+
 private:
   static void esp32_ble_client_event_handler(
     esp_gattc_cb_event_t event,
     esp_gatt_if_t gattc_if,
     esp_ble_gattc_cb_param_t* param);
 
+  static void esp32_ble_gap_event_handler(
+    esp_gap_ble_cb_event_t event,
+    esp_ble_gap_cb_param_t* param);
+
+private:
+  bool ble_configure();
+  bool setup_if();
+  bool has_free_client();
+  void notify_waiter();
+  bool start_workers();
+  TickType_t close_idle();
+  static void worker_task(void *arg);
+
 private:
   std::map<uint16_t, ESP32BLEClient*> app_ids;
   std::map<esp_gatt_if_t, uint16_t> gattc_ifs;
-  uint16_t next_app_id{1};
+  uint16_t next_app_id{0};
+  int max_clients{1};
+  int clients{0};
+  std::deque<TaskHandle_t> waiters;
+
+  struct IdleClient {
+    ESP32BLEClient *client;
+    TickType_t since;
+  };
+  std::deque<IdleClient> idle_clients;
+  QueueHandle_t jobs{nullptr};
+  std::vector<TaskHandle_t> workers;
   SemaphoreHandle_t lock{nullptr};
   bool initialized{false};
+  bool tracker{false};
 
   friend class ESP32BLEClient;
+  friend class ESP32BLEScheduler;
 };
@@ -6,10 +6,16 @@
 #include "esp32_ble_log.h"
 #include "esp32_ble_lock.h"
 #include "esp32_ble_client.h"
+#include "esp32_ble_scheduler.h"
 
+#include <nvs.h>
+#include <stdio.h>
 #include <string.h>
 
 static const char *TAG = "esp32_ble_client";
+static const char *HANDLE_CACHE_NAMESPACE = "ble_handles";
+static const uint8_t HANDLE_CACHE_VERSION = 1;
+static const int NOTIFICATION_SLOTS = 8;
 
 using namespace esphome;
 
@@ -33,34 +39,15 @@ static void print_uuid(const char *name, const esp_bt_uuid_t &uuid, uint16_t han
 ESP32BLEClient::ESP32BLEClient(uint16_t app_id)
 {
   this->lock = xSemaphoreCreateMutex();
+  this->events = xEventGroupCreate();
   this->app_id = app_id;
-
-  event_handlers[ESP_GATTC_SEARCH_RES_EVT] = [this](const EventResult &result) {
-    services.push_back(result.param.search_res);
-  };
-
-  event_handlers[ESP_GATTC_CLOSE_EVT] = [this](const EventResult &result) {
-    conn_id.reset();
-    state = Registered;
-  };
-
-  event_handlers[ESP_GATTC_NOTIFY_EVT] = [this](const EventResult &result) {
-    Notification notification;
-    notification.handle = result.param.notify.handle;
-    notification.data.assign((const char*)result.param.notify.value, result.param.notify.value_len);
-    notification.notification = result.param.notify.is_notify;
-    notifications.push_back(notification);
-  };
-
-  event_handlers[ESP_GATTC_CONNECT_EVT] = [this](const EventResult &result) {
-    // Do nothing, do not set-up encryption
-  };
 }
 
 ESP32BLEClient::~ESP32BLEClient()
 {
   disconnect();
   ESP32BLE::instance().release(this);
+  vEventGroupDelete(events);
   vSemaphoreDelete(lock);
 }
 
@@ -73,6 +60,13 @@ void ESP32BLEClient::set_address(uint64_t address)
   this->address[3] = uint8_t(address >> 16);
   this->address[4] = uint8_t(address >> 8);
   this->address[5] = uint8_t(address >> 0);
+  load_handle_cache();
+}
+
+void ESP32BLEClient::set_handle_cache(bool enabled)
+{
+  this->handle_cache_enabled = enabled;
+  load_handle_cache();
 }
 
 void ESP32BLEClient::set_address_type(esp_ble_addr_type_t address_type)
@@ -80,6 +74,11 @@ void ESP32BLEClient::set_address_type(esp_ble_addr_type_t address_type)
   this->address_type = address_type;
 }
 
+void ESP32BLEClient::set_timeout(int timeout_ms)
+{
+  this->timeout_ms = timeout_ms;
+}
+
 esp_err_t ESP32BLEClient::log(const char *reason, esp_err_t code)
 {
   if (code != ESP_OK) {
@@ -107,13 +106,48 @@ bool ESP32BLEClient::is_disconnecting()
   return disconnecting;
 }
 
+ESP32BLETrace::Result ESP32BLEClient::trace_result(bool success) const
+{
+  if (success) {
+    return ESP32BLETrace::Ok;
+  }
+  return timed_out ? ESP32BLETrace::TimedOut : ESP32BLETrace::Failed;
+}
+
 bool ESP32BLEClient::connect()
 {
   ESP32BLELock lock(this->lock);
 
+  auto span = ESP32BLETrace::instance().begin(ESP32BLETrace::Connect, app_id.value_or(0));
+  timed_out = false;
+
+  // a scan of the tracker has to pause first
+  if (!ESP32BLEScheduler::instance().begin_connect(timeout_ms)) {
+    timed_out = true;
+    ESP32BLETrace::instance().end(span, ESP32BLETrace::TimedOut);
+    return false;
+  }
+
   register_if(lock);
   open_if(lock);
   mtu_if(lock);
+
+  ESP32BLEScheduler::instance().end_connect();
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  if (is_connected() && prefer_2m_phy) {
+    GATT_LOG(esp_ble_gap_set_preferred_phy(address, 0,
+      ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+      ESP_BLE_GAP_PHY_OPTIONS_NO_PREF));
+  }
+#endif
+
+  // Nothing is notified before the descriptor gets written
+  if (is_connected() && !notifications.reserve(NOTIFICATION_SLOTS, mtu - 3)) {
+    BLE_LOGE(TAG, "NOTIFY[%10llx]: cannot reserve %d bytes\n", address64, mtu - 3);
+  }
+
+  ESP32BLETrace::instance().end(span, trace_result(is_connected()));
   return is_connected();
 }
 
@@ -123,6 +157,9 @@ void ESP32BLEClient::disconnect()
 
   close_if(lock);
   unregister_if(lock);
+
+  // flash is written once the link is gone
+  save_handle_cache();
 }
 
 bool ESP32BLEClient::wait_for_event(
@@ -131,45 +168,63 @@ bool ESP32BLEClient::wait_for_event(
   int own_timeout_ms,
   EventHandler handler)
 {
-  int end = millis() + own_timeout_ms;
-  volatile bool done = false;
-  volatile bool result = false;
+  if (event >= MAX_EVENTS) {
+    return false;
+  }
 
-  auto previous_event = event_handlers[event];
-  event_handlers[event] = [this,&done,&result,event,handler](const EventResult &event_result) {
-    result = handler(event_result);
-    done = true;
-  };
+  EventWaiter waiter;
+  waiter.handler = handler;
+
+  // Handlers run under the lock, so a completion of an earlier
+  // timed out call can't set the bit once it is cleared here
+  xEventGroupClearBits(events, EventDone);
+
+  auto previous_waiter = event_waiters[event];
+  event_waiters[event] = &waiter;
 
   lock.give();
 
-  while(!done && millis() < end) {
-    delay(10);
+  // Woken up by the GATTC callback as soon as the event arrives
+  auto bits = xEventGroupWaitBits(events, EventDone, pdTRUE, pdFALSE,
+    pdMS_TO_TICKS(own_timeout_ms));
+  bool done = (bits & EventDone) != 0;
+  if (!done) {
+    timed_out = true;
   }
 
-  BLE_LOGD(TAG, "EVENT:%d, !!!! done here? %d => result: %d\n", event, done, result);
-
   lock.take();
-  event_handlers[event] = previous_event;
-  return result;
+  event_waiters[event] = previous_waiter;
+
+  BLE_LOGD(TAG, "EVENT:%d, !!!! done here? %d => result: %d\n", event, done, waiter.result);
+  return waiter.result;
 }
 
-std::vector<ESP32BLEClient::Notification> ESP32BLEClient::wait_for_notifications(
-  int own_timeout_ms)
+int ESP32BLEClient::wait_for_notifications(
+  int own_timeout_ms, const NotificationHandler &handler)
 {
-  ESP32BLELock lock(this->lock);
+  auto span = ESP32BLETrace::instance().begin(ESP32BLETrace::Notify, app_id.value_or(0));
 
-  int end = millis() + own_timeout_ms;
+  if (notifications.empty()) {
+    xEventGroupClearBits(events, EventNotify);
 
-  while(notifications.empty() && millis() < end) {
-    lock.give();
-    delay(10);
-    lock.take();
+    // The bit is set after the push, so checking again after
+    // clearing it can't miss a notification
+    if (notifications.empty()) {
+      xEventGroupWaitBits(events, EventNotify, pdTRUE, pdFALSE,
+        pdMS_TO_TICKS(own_timeout_ms));
+    }
   }
 
-  auto current = notifications;
-  notifications.clear();
-  return current;
+  int count = 0;
+
+  for (auto notification = notifications.front(); notification; notification = notifications.front()) {
+    handler(*notification);
+    notifications.pop();
+    count++;
+  }
+
+  ESP32BLETrace::instance().end(span, count > 0 ? ESP32BLETrace::Ok : ESP32BLETrace::TimedOut);
+  return count;
 }
 
 bool ESP32BLEClient::register_if(ESP32BLELock &lock)
@@ -199,6 +254,13 @@ bool ESP32BLEClient::open_if(ESP32BLELock &lock)
     return false;
   }
 
+  // the connection gets established with these already
+  if (conn_params.max_interval) {
+    GATT_LOG(esp_ble_gap_set_prefer_conn_params(address,
+      conn_params.min_interval, conn_params.max_interval,
+      conn_params.latency, conn_params.timeout));
+  }
+
   auto ret = GATT_LOG(esp_ble_gattc_open(
     *gattc_if, address, address_type, 1));
   if (ret) {
@@ -207,6 +269,10 @@ bool ESP32BLEClient::open_if(ESP32BLELock &lock)
 
   services.clear();
   notifications.clear();
+  conn_interval = 0;
+  conn_latency = 0;
+  conn_timeout = 0;
+  phy = 0;
 
   return wait_for_event(lock, ESP_GATTC_OPEN_EVT, timeout_ms, [this](const EventResult &result) {
     if (GATT_LOG(result.param.open.status) == ESP_GATT_OK) {
@@ -249,6 +315,7 @@ bool ESP32BLEClient::close_if(ESP32BLELock &lock)
   }
 
   notifications.clear();
+  fail_calls(lock);
 
   auto ret = GATT_LOG(esp_ble_gattc_close(*gattc_if, *conn_id));
   if (ret) {
@@ -285,6 +352,25 @@ bool ESP32BLEClient::unregister_if(ESP32BLELock &lock)
   });
 }
 
+bool ESP32BLEClient::update_conn_params(const ConnParams &params)
+{
+  ESP32BLELock lock(this->lock);
+
+  if (state != Ready) {
+    return false;
+  }
+
+  esp_ble_conn_update_params_t update = {};
+  memcpy(update.bda, address, sizeof(esp_bd_addr_t));
+  update.min_int = params.min_interval;
+  update.max_int = params.max_interval;
+  update.latency = params.latency;
+  update.timeout = params.timeout;
+
+  // Answered by ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, not waited for
+  return GATT_LOG(esp_ble_gap_update_conn_params(&update)) == ESP_OK;
+}
+
 bool ESP32BLEClient::request_services(bool force)
 {
   ESP32BLELock lock(this->lock);
@@ -297,17 +383,34 @@ bool ESP32BLEClient::request_services(bool force)
     return true;
   }
 
+  // searched for only once a handle is not known
+  if (handle_cache.count > 0 && !force) {
+    return true;
+  }
+
+  return search_services_if(lock);
+}
+
+bool ESP32BLEClient::search_services_if(ESP32BLELock &lock)
+{
   services.clear();
 
+  auto span = ESP32BLETrace::instance().begin(ESP32BLETrace::Search, *app_id);
+  timed_out = false;
+
   auto ret = GATT_LOG(esp_ble_gattc_search_service(
     *gattc_if, *conn_id, nullptr));
   if (ret != ESP_OK) {
+    ESP32BLETrace::instance().end(span, ESP32BLETrace::Failed);
     return false;
   }
 
-  return wait_for_event(lock, ESP_GATTC_SEARCH_CMPL_EVT, timeout_ms, [this](const EventResult &result) {
+  bool success = wait_for_event(lock, ESP_GATTC_SEARCH_CMPL_EVT, timeout_ms, [this](const EventResult &result) {
     return GATT_LOG(result.param.search_cmpl.status) == ESP_GATT_OK;
   });
+
+  ESP32BLETrace::instance().end(span, trace_result(success));
+  return success;
 }
 
 uint16_t ESP32BLEClient::get_characteristic(const esp_bt_uuid_t &service_uuid, const esp_bt_uuid_t &characteristic_uuid)
@@ -318,6 +421,15 @@ uint16_t ESP32BLEClient::get_characteristic(const esp_bt_uuid_t &service_uuid, c
     return 0;
   }
 
+  auto cached = find_cached_handle(0, service_uuid, characteristic_uuid);
+  if (cached) {
+    return cached;
+  }
+
+  if (services.empty() && !search_services_if(lock)) {
+    return 0;
+  }
+
   // Look for service first
   esp_ble_gattc_cb_param_t::gattc_search_res_evt_param *service = nullptr;
 
@@ -352,6 +464,7 @@ uint16_t ESP32BLEClient::get_characteristic(const esp_bt_uuid_t &service_uuid, c
 
   print_uuid("CHAR", result.uuid, result.char_handle);
   if (compare_uuid(characteristic_uuid, result.uuid)) {
+    cache_handle(0, service_uuid, characteristic_uuid, result.char_handle);
     return result.char_handle;
   }
 
@@ -367,6 +480,16 @@ uint16_t ESP32BLEClient::get_descriptor(
     return 0;
   }
 
+  esp_bt_uuid_t no_service{};
+  auto cached = find_cached_handle(characteristic, no_service, uuid);
+  if (cached) {
+    return cached;
+  }
+
+  if (services.empty() && !search_services_if(lock)) {
+    return 0;
+  }
+
   esp_gattc_descr_elem_t result;
 
   for(uint16_t offset = 0; ; offset++) {
@@ -382,6 +505,7 @@ uint16_t ESP32BLEClient::get_descriptor(
     }
 
     if (compare_uuid(uuid, result.uuid)) {
+      cache_handle(characteristic, no_service, uuid, result.handle);
       return result.handle;
     }
   }
@@ -389,36 +513,84 @@ uint16_t ESP32BLEClient::get_descriptor(
   return 0;
 }
 
+ESP32BLEClient::Call ESP32BLEClient::write_call(
+  WriteType type, uint16_t handle,
+  const void *data, uint16_t data_length, bool response)
+{
+  Call call;
+  std::string payload((const char*)data, data_length);
+
+  call.event = type == Descriptor ? ESP_GATTC_WRITE_DESCR_EVT : ESP_GATTC_WRITE_CHAR_EVT;
+  call.pipelined = !response;
+  call.traced = true;
+  call.start = [this, type, handle, payload, response]() {
+    auto write_func = esp_ble_gattc_write_char;
+    if (type == Descriptor) {
+      write_func = esp_ble_gattc_write_char_descr;
+    }
+
+    auto ret = GATT_LOG(write_func(
+      *gattc_if, *conn_id, handle, payload.size(), (uint8_t*)payload.data(),
+      response ? ESP_GATT_WRITE_TYPE_RSP : ESP_GATT_WRITE_TYPE_NO_RSP,
+      ESP_GATT_AUTH_REQ_NONE
+    ));
+    if (ret != ESP_OK) {
+      invalidate_handle_cache();
+    }
+    return ret;
+  };
+  call.complete = [this](const EventResult &result) {
+    // the handle might no longer be what the device has
+    if (GATT_LOG(result.param.write.status) != ESP_GATT_OK) {
+      invalidate_handle_cache();
+      return false;
+    }
+    return true;
+  };
+  return call;
+}
+
+ESP32BLEClient::Call ESP32BLEClient::register_notify_call(
+  uint16_t handle, bool enable)
+{
+  Call call;
+
+  call.event = enable ? ESP_GATTC_REG_FOR_NOTIFY_EVT : ESP_GATTC_UNREG_FOR_NOTIFY_EVT;
+  call.start = [this, handle, enable]() {
+    auto notify_func = esp_ble_gattc_register_for_notify;
+    if (!enable) {
+      notify_func = esp_ble_gattc_unregister_for_notify;
+    }
+
+    return GATT_LOG(notify_func(
+      *gattc_if, address, handle));
+  };
+  call.complete = [this](const EventResult &result) {
+    return GATT_LOG(result.param.reg_for_notify.status) == ESP_GATT_OK;
+  };
+  return call;
+}
+
 bool ESP32BLEClient::write(
   WriteType type, uint16_t handle,
   void *data, uint16_t data_length, bool response)
 {
   ESP32BLELock lock(this->lock);
 
-  if (state != Ready) {
-    return false;
-  }
-
-  auto write_func = esp_ble_gattc_write_char;
-  auto write_event = ESP_GATTC_WRITE_CHAR_EVT;
-
-  if (type == Descriptor) {
-    write_func = esp_ble_gattc_write_char_descr;
-    write_event = ESP_GATTC_WRITE_DESCR_EVT;
-  }
+  return wait_for_call(lock,
+    write_call(type, handle, data, data_length, response), timeout_ms);
+}
 
-  auto ret = GATT_LOG(write_func(
-    *gattc_if, *conn_id, handle, data_length, (uint8_t*)data,
-    response ? ESP_GATT_WRITE_TYPE_RSP : ESP_GATT_WRITE_TYPE_NO_RSP,
-    ESP_GATT_AUTH_REQ_NONE
-  ));
-  if (ret != ESP_OK) {
-    return false;
-  }
+bool ESP32BLEClient::queue_write(
+  WriteType type, uint16_t handle,
+  const void *data, uint16_t data_length, bool response,
+  Callback done)
+{
+  ESP32BLELock lock(this->lock);
 
-  return wait_for_event(lock, write_event, timeout_ms, [this](const EventResult &result) {
-    return GATT_LOG(result.param.write.status) == ESP_GATT_OK;
-  });
+  auto call = write_call(type, handle, data, data_length, response);
+  call.done = done;
+  return queue_call(lock, call);
 }
 
 bool ESP32BLEClient::register_notify(
@@ -426,36 +598,32 @@ bool ESP32BLEClient::register_notify(
 {
   ESP32BLELock lock(this->lock);
 
-  if (state != Ready) {
-    return false;
-  }
-
-  auto notify_func = esp_ble_gattc_register_for_notify;
-  auto notify_event = ESP_GATTC_REG_FOR_NOTIFY_EVT;
-
-  if (!enable) {
-    notify_func = esp_ble_gattc_unregister_for_notify;
-    notify_event = ESP_GATTC_UNREG_FOR_NOTIFY_EVT;
-  }
+  return wait_for_call(lock,
+    register_notify_call(handle, enable), timeout_ms);
+}
 
-  auto ret = GATT_LOG(notify_func(
-    *gattc_if, address, handle));
-  if (ret != ESP_OK) {
-    return false;
-  }
+bool ESP32BLEClient::queue_register_notify(
+  uint16_t handle, bool enable, Callback done)
+{
+  ESP32BLELock lock(this->lock);
 
-  return wait_for_event(lock, notify_event, timeout_ms, [this](const EventResult &result) {
-    return GATT_LOG(result.param.reg_for_notify.status) == ESP_GATT_OK;
-  });
+  auto call = register_notify_call(handle, enable);
+  call.done = done;
+  return queue_call(lock, call);
 }
 
-bool ESP32BLEClient::write_notify_desc(
-  uint16_t handle, bool enable, bool notifications)
+uint16_t ESP32BLEClient::notify_desc_handle(uint16_t handle)
 {
   std::unique_ptr<esp_bt_uuid_t> uuid(new esp_bt_uuid_t);
   uuid->len = ESP_UUID_LEN_16;
   uuid->uuid.uuid16 = 0x2902;
-  auto desc_handle = get_descriptor(handle, *uuid.get());
+  return get_descriptor(handle, *uuid.get());
+}
+
+bool ESP32BLEClient::write_notify_desc(
+  uint16_t handle, bool enable, bool notifications)
+{
+  auto desc_handle = notify_desc_handle(handle);
   if (!desc_handle) {
     return false;
   }
@@ -467,3 +635,118 @@ bool ESP32BLEClient::write_notify_desc(
 
   return write(Descriptor, desc_handle, desc_val, sizeof(desc_val), false);
 }
+
+bool ESP32BLEClient::queue_write_notify_desc(
+  uint16_t handle, bool enable, bool notifications, Callback done)
+{
+  auto desc_handle = notify_desc_handle(handle);
+  if (!desc_handle) {
+    return false;
+  }
+
+  uint8_t desc_val[] = {
+    uint8_t(enable ? (notifications ? 0x01 : 0x02) : 0x0),
+    0x0
+  };
+
+  return queue_write(Descriptor, desc_handle, desc_val, sizeof(desc_val), false, done);
+}
+
+void ESP32BLEClient::load_handle_cache()
+{
+  handle_cache = HandleCache{};
+  handle_cache_dirty = false;
+
+  if (!handle_cache_enabled || !address64) {
+    return;
+  }
+
+  nvs_handle handle;
+  if (nvs_open(HANDLE_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return;
+  }
+
+  char key[16];
+  snprintf(key, sizeof(key), "%012llx", address64);
+
+  HandleCache cache;
+  size_t length = sizeof(cache);
+  if (nvs_get_blob(handle, key, &cache, &length) == ESP_OK &&
+      length == sizeof(cache) &&
+      cache.version == HANDLE_CACHE_VERSION &&
+      cache.count <= MAX_CACHED_HANDLES) {
+    handle_cache = cache;
+    BLE_LOGD(TAG, "HANDLES[%10llx]: loaded %d\n", address64, cache.count);
+  }
+
+  nvs_close(handle);
+}
+
+void ESP32BLEClient::save_handle_cache()
+{
+  if (!handle_cache_dirty || !handle_cache_enabled || !address64) {
+    return;
+  }
+
+  handle_cache_dirty = false;
+
+  nvs_handle handle;
+  if (nvs_open(HANDLE_CACHE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return;
+  }
+
+  char key[16];
+  snprintf(key, sizeof(key), "%012llx", address64);
+
+  if (handle_cache.count > 0) {
+    handle_cache.version = HANDLE_CACHE_VERSION;
+    nvs_set_blob(handle, key, &handle_cache, sizeof(handle_cache));
+  } else {
+    nvs_erase_key(handle, key);
+  }
+
+  nvs_commit(handle);
+  nvs_close(handle);
+  BLE_LOGD(TAG, "HANDLES[%10llx]: saved %d\n", address64, handle_cache.count);
+}
+
+void ESP32BLEClient::invalidate_handle_cache()
+{
+  if (!handle_cache.count) {
+    return;
+  }
+
+  BLE_LOGW(TAG, "HANDLES[%10llx]: invalidated\n", address64);
+  handle_cache.count = 0;
+  handle_cache_dirty = true;
+}
+
+uint16_t ESP32BLEClient::find_cached_handle(
+  uint16_t parent, const esp_bt_uuid_t &service, const esp_bt_uuid_t &uuid)
+{
+  for (int i = 0; i < handle_cache.count; i++) {
+    const auto &cached = handle_cache.handles[i];
+    if (cached.parent == parent &&
+        compare_uuid(cached.service, service) &&
+        compare_uuid(cached.uuid, uuid)) {
+      return cached.handle;
+    }
+  }
+
+  return 0;
+}
+
+void ESP32BLEClient::cache_handle(
+  uint16_t parent, const esp_bt_uuid_t &service, const esp_bt_uuid_t &uuid, uint16_t handle)
+{
+  if (!handle_cache_enabled || handle_cache.count >= MAX_CACHED_HANDLES) {
+    return;
+  }
+
+  auto &cached = handle_cache.handles[handle_cache.count++];
+  cached.parent = parent;
+  cached.service = service;
+  cached.uuid = uuid;
+  cached.handle = handle;
+  handle_cache_dirty = true;
+}
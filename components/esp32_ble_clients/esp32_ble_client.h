@@ -1,13 +1,18 @@
 #pragma once
 
 #include "esphome/core/component.h"
+#include "esp32_ble_notification_ring.h"
+#include "esp32_ble_trace.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/event_groups.h>
 #include <esp_gattc_api.h>
+#include <esp_gap_ble_api.h>
 
-#include <map>
-#include <queue>
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <memory>
 
 class ESP32BLELock;
@@ -23,6 +28,28 @@ public:
   void set_address_type(esp_ble_addr_type_t address_type);
   void set_timeout(int timeout_ms);
 
+  struct ConnParams {
+    // in units of 1.25ms
+    uint16_t min_interval{0};
+    uint16_t max_interval{0};
+    uint16_t latency{0};
+    // in units of 10ms
+    uint16_t timeout{0};
+  };
+
+  // Asked for when the link gets opened, the controller defaults
+  // are used if not set
+  void set_conn_params(const ConnParams &params) { this->conn_params = params; }
+  void set_prefer_2m_phy(bool prefer) { this->prefer_2m_phy = prefer; }
+
+  // How long the link stays open once handed back to the pool
+  void set_linger(int linger_ms) { this->linger_ms = linger_ms; }
+  int get_linger() const { return linger_ms; }
+
+  // Handles found on the device are kept in NVS, so that
+  // reconnects can skip the service discovery
+  void set_handle_cache(bool enabled);
+
 public:
   enum State {
     Idle,
@@ -43,6 +70,17 @@ public:
   bool connect();
   void disconnect();
 
+public:
+  // Renegotiates the parameters of the open link, the device
+  // might answer with something else, see `get_conn_interval()`
+  bool update_conn_params(const ConnParams &params);
+
+  // As reported for the link, 0 if not known yet
+  uint16_t get_conn_interval() const { return conn_interval; }
+  uint16_t get_conn_latency() const { return conn_latency; }
+  uint16_t get_conn_timeout() const { return conn_timeout; }
+  uint8_t get_phy() const { return phy; }
+
 public:
   bool request_services(bool force = false);
   uint16_t get_characteristic(const esp_bt_uuid_t &service_uuid, const esp_bt_uuid_t &characteristic_uuid);
@@ -68,15 +106,41 @@ public:
     bool enable,
     bool notifications);
 
-  struct Notification {
-    uint16_t handle{0};
-    std::string data;
-    bool notification{false};
-  };
+public:
+  // Called from the GATTC callback task, without the client lock
+  typedef std::function<void(bool)> Callback;
 
-  std::vector<Notification> wait_for_notifications(int own_timeout_ms);
+  // Queued operations are started one after another straight from
+  // the GATTC callback, writes without response a few at a time.
+  // These return as soon as the operation is queued.
+  bool queue_write(
+    WriteType type,
+    uint16_t handle,
+    const void *data, uint16_t data_length,
+    bool response,
+    Callback done = nullptr);
+
+  bool queue_register_notify(
+    uint16_t handle,
+    bool enable,
+    Callback done = nullptr);
+
+  bool queue_write_notify_desc(
+    uint16_t handle,
+    bool enable,
+    bool notifications,
+    Callback done = nullptr);
+
+  typedef ESP32BLENotificationRing::Slot Notification;
+  typedef std::function<void(const Notification&)> NotificationHandler;
+
+  // Waits for the first notification, then passes every queued one
+  // to the handler straight from the ring. Only one task may wait.
+  int wait_for_notifications(int own_timeout_ms, const NotificationHandler &handler);
+  uint32_t get_dropped_notifications() const { return notifications.get_dropped(); }
 
 private:
+  bool search_services_if(ESP32BLELock &lock);
   bool register_if(ESP32BLELock &lock);
   bool open_if(ESP32BLELock &lock);
   bool mtu_if(ESP32BLELock &lock);
@@ -91,6 +155,13 @@ private:
   uint64_t address64{0};
   esp_bd_addr_t address{0,};
   int timeout_ms{5000};
+  int linger_ms{0};
+  ConnParams conn_params;
+  bool prefer_2m_phy{false};
+  uint16_t conn_interval{0};
+  uint16_t conn_latency{0};
+  uint16_t conn_timeout{0};
+  uint8_t phy{0};
   esp_ble_addr_type_t address_type{BLE_ADDR_TYPE_PUBLIC};
   esphome::optional<uint16_t> app_id;
   esphome::optional<esp_gatt_if_t> gattc_if;
@@ -99,16 +170,71 @@ private:
   uint16_t mtu{23};
 
 private:
+  static const int MAX_CACHED_HANDLES = 8;
+
+  struct CachedHandle {
+    // characteristic of a descriptor, 0 for characteristics
+    uint16_t parent;
+    esp_bt_uuid_t service;
+    esp_bt_uuid_t uuid;
+    uint16_t handle;
+  };
+
+  struct HandleCache {
+    uint8_t version;
+    uint8_t count;
+    CachedHandle handles[MAX_CACHED_HANDLES];
+  };
+
+  void load_handle_cache();
+  void save_handle_cache();
+  void invalidate_handle_cache();
+  uint16_t find_cached_handle(uint16_t parent, const esp_bt_uuid_t &service, const esp_bt_uuid_t &uuid);
+  void cache_handle(uint16_t parent, const esp_bt_uuid_t &service, const esp_bt_uuid_t &uuid, uint16_t handle);
+
+  bool handle_cache_enabled{true};
+  bool handle_cache_dirty{false};
+  HandleCache handle_cache{};
+
+private:
+  // Refers to the parameters of the GATTC callback, valid only during it
   struct EventResult {
     esp_gattc_cb_event_t type;
-    esp_ble_gattc_cb_param_t param;
+    const esp_ble_gattc_cb_param_t &param;
   };
 
   typedef std::function<bool(const EventResult&)> EventHandler;
 
-  std::map<esp_gattc_cb_event_t, std::function<void(const EventResult&)> > event_handlers;
-  std::queue<std::function<void()> > calls;
-  std::vector<Notification> notifications;
+  // Task waiting in `wait_for_event`, lives on its stack
+  struct EventWaiter {
+    EventHandler handler;
+    bool result{false};
+  };
+
+  // Above any event id of the GATTC API
+  static const int MAX_EVENTS = 64;
+
+  struct Call {
+    uint32_t id{0};
+    // completes the call
+    esp_gattc_cb_event_t event;
+    std::function<esp_err_t()> start;
+    EventHandler complete;
+    Callback done;
+    // can be in flight together with other pipelined calls
+    bool pipelined{false};
+    bool started{false};
+    // recorded by ESP32BLETrace from the start to the completion
+    bool traced{false};
+    bool timed_out{false};
+    ESP32BLETrace::Span span;
+  };
+
+  EventWaiter *event_waiters[MAX_EVENTS]{};
+  std::deque<Call> calls;
+  uint32_t next_call_id{1};
+  bool congested{false};
+  ESP32BLENotificationRing notifications;
 
 private:
   void client_event_handler(
@@ -116,6 +242,13 @@ private:
     esp_gatt_if_t gattc_if,
     esp_ble_gattc_cb_param_t* param);
 
+  void notify_event(
+    const esp_ble_gattc_cb_param_t::gattc_notify_evt_param &notify);
+
+  void gap_event_handler(
+    esp_gap_ble_cb_event_t event,
+    esp_ble_gap_cb_param_t* param);
+
   esp_err_t log(
     const char *reason,
     esp_err_t code);
@@ -129,8 +262,32 @@ private:
     int own_timeout_ms,
     EventHandler handler);
 
+  // Set by the waits, tells timeouts apart from failures
+  bool timed_out{false};
+  ESP32BLETrace::Result trace_result(bool success) const;
+
+private:
+  Call write_call(WriteType type, uint16_t handle, const void *data, uint16_t data_length, bool response);
+  Call register_notify_call(uint16_t handle, bool enable);
+  uint16_t notify_desc_handle(uint16_t handle);
+
+  bool queue_call(ESP32BLELock &lock, Call call);
+  bool wait_for_call(ESP32BLELock &lock, Call call, int own_timeout_ms);
+  void run_calls(ESP32BLELock &lock);
+  bool process_calls(ESP32BLELock &lock, esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t *param);
+  void fail_calls(ESP32BLELock &lock);
+  void finish_call(ESP32BLELock &lock, const Callback &done, bool success);
+
 private:
   SemaphoreHandle_t lock{nullptr};
 
+  // Set from the GATTC callback to wake up the waiting task
+  enum EventBits {
+    EventDone = 1 << 0,
+    EventNotify = 1 << 1,
+    EventCall = 1 << 2
+  };
+  EventGroupHandle_t events{nullptr};
+
   friend class ESP32BLE;
 };
@@ -0,0 +1,188 @@
+#include "esp32_ble.h"
+#include "esp32_ble_lock.h"
+#include "esp32_ble_log.h"
+#include "esp32_ble_client.h"
+
+#include <algorithm>
+
+static const char *TAG = "esp32_ble_client_calls";
+
+// Writes without response handed to the stack before the first completes
+static const int MAX_PIPELINED = 4;
+
+using namespace esphome;
+
+bool ESP32BLEClient::queue_call(ESP32BLELock &lock, Call call)
+{
+  if (state != Ready) {
+    return false;
+  }
+
+  call.id = next_call_id++;
+  calls.push_back(call);
+  run_calls(lock);
+  return true;
+}
+
+bool ESP32BLEClient::wait_for_call(ESP32BLELock &lock, Call call, int own_timeout_ms)
+{
+  // Outlives the wait, the call might complete after a timeout
+  auto result = std::make_shared<std::atomic<int> >(-1);
+
+  call.done = [this, result](bool success) {
+    *result = success;
+    xEventGroupSetBits(events, EventCall);
+  };
+
+  xEventGroupClearBits(events, EventCall);
+
+  auto id = next_call_id;
+  if (!queue_call(lock, call)) {
+    return false;
+  }
+
+  auto start = xTaskGetTickCount();
+  auto timeout = pdMS_TO_TICKS(own_timeout_ms);
+
+  // Woken up for every call, only ours is waited for
+  while (*result < 0) {
+    auto waited = xTaskGetTickCount() - start;
+    if (waited >= timeout) {
+      break;
+    }
+
+    lock.give();
+    xEventGroupWaitBits(events, EventCall, pdTRUE, pdFALSE, timeout - waited);
+    lock.take();
+  }
+
+  if (*result < 0) {
+    // Not sent yet, must not be sent after the caller gave up
+    auto iter = std::find_if(calls.begin(), calls.end(), [id](const Call &call) {
+      return call.id == id;
+    });
+    if (iter != calls.end() && !iter->started) {
+      calls.erase(iter);
+    } else if (iter != calls.end()) {
+      iter->timed_out = true;
+    }
+
+    BLE_LOGW(TAG, "CALL[%10llx]: %u timed out\n", address64, id);
+    return false;
+  }
+
+  return *result > 0;
+}
+
+void ESP32BLEClient::run_calls(ESP32BLELock &lock)
+{
+  while (state == Ready) {
+    auto next = std::find_if(calls.begin(), calls.end(), [](const Call &call) {
+      return !call.started;
+    });
+    if (next == calls.end()) {
+      return;
+    }
+
+    // Calls in flight are always a prefix of the queue, they are either
+    // a single one, or writes without response that the stack buffers
+    int in_flight = next - calls.begin();
+    if (in_flight > 0) {
+      if (!next->pipelined || !calls.front().pipelined) {
+        return;
+      }
+      if (in_flight >= MAX_PIPELINED || congested) {
+        return;
+      }
+    }
+
+    if (next->traced) {
+      next->span = ESP32BLETrace::instance().begin(ESP32BLETrace::Write, *app_id);
+    }
+
+    if (next->start() == ESP_OK) {
+      next->started = true;
+      continue;
+    }
+
+    if (next->traced) {
+      ESP32BLETrace::instance().end(next->span, ESP32BLETrace::Failed);
+    }
+
+    auto done = next->done;
+    calls.erase(next);
+    finish_call(lock, done, false);
+  }
+}
+
+bool ESP32BLEClient::process_calls(ESP32BLELock &lock,
+  esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t *param)
+{
+  if (!param) {
+    return false;
+  }
+
+  switch (event) {
+  case ESP_GATTC_CONGEST_EVT:
+    congested = param->congest.congested;
+    run_calls(lock);
+    return false;
+
+  case ESP_GATTC_CLOSE_EVT:
+  case ESP_GATTC_DISCONNECT_EVT:
+    congested = false;
+    fail_calls(lock);
+    return false;
+
+  default:
+    break;
+  }
+
+  if (calls.empty() || !calls.front().started || calls.front().event != event) {
+    return false;
+  }
+
+  auto call = calls.front();
+  calls.pop_front();
+
+  bool success = call.complete(EventResult{event, *param});
+
+  if (call.traced) {
+    ESP32BLETrace::instance().end(call.span, success ? ESP32BLETrace::Ok :
+      call.timed_out ? ESP32BLETrace::TimedOut : ESP32BLETrace::Failed);
+  }
+
+  BLE_LOGD(TAG, "CALL[%10llx]: %u => %d, queued: %d\n",
+    address64, call.id, success, (int)calls.size());
+
+  // next one is sent before the caller is told
+  run_calls(lock);
+  finish_call(lock, call.done, success);
+  return true;
+}
+
+void ESP32BLEClient::fail_calls(ESP32BLELock &lock)
+{
+  std::deque<Call> failed;
+  failed.swap(calls);
+
+  for (auto iter = failed.begin(); iter != failed.end(); ++iter) {
+    if (iter->traced && iter->started) {
+      ESP32BLETrace::instance().end(iter->span,
+        iter->timed_out ? ESP32BLETrace::TimedOut : ESP32BLETrace::Failed);
+    }
+    finish_call(lock, iter->done, false);
+  }
+}
+
+void ESP32BLEClient::finish_call(ESP32BLELock &lock, const Callback &done, bool success)
+{
+  if (!done) {
+    return;
+  }
+
+  // Callbacks may queue further calls
+  lock.give();
+  done(success);
+  lock.take();
+}
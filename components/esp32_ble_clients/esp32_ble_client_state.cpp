@@ -4,7 +4,33 @@
 #include "esp32_ble_client.h"
 
 static const char *TAG = "esp32_ble_client_state";
-static const int MAX_EVENTS = 100;
+
+// Events carrying a status, for the trace
+static int event_status(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t *param)
+{
+  switch (event) {
+  case ESP_GATTC_REG_EVT:
+    return param->reg.status;
+  case ESP_GATTC_OPEN_EVT:
+    return param->open.status;
+  case ESP_GATTC_CLOSE_EVT:
+    return param->close.status;
+  case ESP_GATTC_CFG_MTU_EVT:
+    return param->cfg_mtu.status;
+  case ESP_GATTC_SEARCH_CMPL_EVT:
+    return param->search_cmpl.status;
+  case ESP_GATTC_WRITE_CHAR_EVT:
+  case ESP_GATTC_WRITE_DESCR_EVT:
+    return param->write.status;
+  case ESP_GATTC_REG_FOR_NOTIFY_EVT:
+  case ESP_GATTC_UNREG_FOR_NOTIFY_EVT:
+    return param->reg_for_notify.status;
+  case ESP_GATTC_NOTIFY_EVT:
+    return param->notify.value_len;
+  default:
+    return 0;
+  }
+}
 
 using namespace esphome;
 
@@ -27,18 +53,96 @@ void ESP32BLEClient::client_event_handler(esp_gattc_cb_event_t event,
 
   this->gattc_if = gattc_if;
 
-  auto handler = event_handlers[event];
-  if (!handler) {
+  ESP32BLETrace::instance().event(app_id.value_or(0), event,
+    param ? event_status(event, param) : 0);
+
+  if (process_calls(lock, event, param)) {
+    return;
+  }
+
+  if (!param) {
+    BLE_LOGD(TAG, "ProcessingEvent: event=%d => no params.\n", event);
+    return;
+  }
+
+  // A waiting task takes precedence over the default handling
+  auto waiter = event < MAX_EVENTS ? event_waiters[event] : nullptr;
+  if (waiter) {
+    BLE_LOGD(TAG, "ProcessingEvent: event=%d...\n", event);
+    waiter->result = waiter->handler(EventResult{event, *param});
+    xEventGroupSetBits(events, EventDone);
+    return;
+  }
+
+  switch (event) {
+  case ESP_GATTC_SEARCH_RES_EVT:
+    services.push_back(param->search_res);
+    break;
+
+  case ESP_GATTC_CLOSE_EVT:
+    conn_id.reset();
+    state = Registered;
+    break;
+
+  case ESP_GATTC_NOTIFY_EVT:
+    notify_event(param->notify);
+    break;
+
+  case ESP_GATTC_CONNECT_EVT:
+    // Do nothing, do not set-up encryption
+    break;
+
+  case ESP_GATTC_SRVC_CHG_EVT:
+    invalidate_handle_cache();
+    break;
+
+  default:
     BLE_LOGD(TAG, "ProcessingEvent: event=%d => is not handled.\n", event);
+    break;
+  }
+}
+
+void ESP32BLEClient::notify_event(
+  const esp_ble_gattc_cb_param_t::gattc_notify_evt_param &notify)
+{
+  if (!notifications.push(notify.handle, notify.value, notify.value_len, notify.is_notify)) {
+    BLE_LOGW(TAG, "Notification of %d bytes dropped, %u so far.\n",
+      notify.value_len, notifications.get_dropped());
     return;
   }
 
-  BLE_LOGD(TAG, "ProcessingEvent: event=%d...\n", event);
+  xEventGroupSetBits(events, EventNotify);
+}
+
+void ESP32BLEClient::gap_event_handler(esp_gap_ble_cb_event_t event,
+  esp_ble_gap_cb_param_t* param)
+{
+  ESP32BLELock lock(this->lock);
+
+  switch (event) {
+  case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+    if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS) {
+      conn_interval = param->update_conn_params.conn_int;
+      conn_latency = param->update_conn_params.latency;
+      conn_timeout = param->update_conn_params.timeout;
+    }
+
+    BLE_LOGD(TAG, "ConnParams: status=%d, interval=%d, latency=%d, timeout=%d\n",
+      param->update_conn_params.status, conn_interval, conn_latency, conn_timeout);
+    break;
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+    if (param->phy_update.status == ESP_BT_STATUS_SUCCESS) {
+      phy = param->phy_update.tx_phy;
+    }
+
+    BLE_LOGD(TAG, "Phy: status=%d, tx=%d, rx=%d\n",
+      param->phy_update.status, param->phy_update.tx_phy, param->phy_update.rx_phy);
+    break;
+#endif
 
-  std::unique_ptr<EventResult> result(new EventResult());
-  result->type = event;
-  if (param) {
-    result->param = *param;
+  default:
+    break;
   }
-  handler(*result);
 }
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fixed number of notifications, each copied into an inline slot.
+// Pushed to by the GATTC callback task, drained by a single consumer
+// without locking. Slots are only allocated by `reserve()`, once the
+// MTU is known, so a chatty device does not touch the heap.
+class ESP32BLENotificationRing
+{
+public:
+  struct Slot {
+    uint16_t handle;
+    uint16_t length;
+    bool notification;
+
+    // the payload follows the header
+    const uint8_t *get_data() const { return (const uint8_t*)(this + 1); }
+    uint8_t *get_data() { return (uint8_t*)(this + 1); }
+  };
+
+public:
+  ESP32BLENotificationRing() = default;
+  ESP32BLENotificationRing(const ESP32BLENotificationRing &) = delete;
+  ESP32BLENotificationRing &operator=(const ESP32BLENotificationRing &) = delete;
+
+  ~ESP32BLENotificationRing() {
+    free(buffer);
+  }
+
+public:
+  // Neither side may run meanwhile, the buffer only ever grows.
+  // The slot count has to be a power of two.
+  bool reserve(uint16_t new_slots, uint16_t new_slot_size) {
+    size_t new_stride = (sizeof(Slot) + new_slot_size + 3) & ~3;
+
+    if (new_slots * new_stride > capacity) {
+      auto new_buffer = (uint8_t*)malloc(new_slots * new_stride);
+      if (!new_buffer) {
+        return false;
+      }
+      free(buffer);
+      buffer = new_buffer;
+      capacity = new_slots * new_stride;
+    }
+
+    slots = new_slots;
+    stride = new_stride;
+    slot_size = new_slot_size;
+    head = 0;
+    tail = 0;
+    return true;
+  }
+
+  uint16_t get_slot_size() const {
+    return slot_size;
+  }
+
+  uint32_t get_dropped() const {
+    return dropped;
+  }
+
+public:
+  // Producer
+  bool push(uint16_t handle, const uint8_t *data, uint16_t length, bool notification) {
+    auto current_head = head.load(std::memory_order_relaxed);
+    auto current_tail = tail.load(std::memory_order_acquire);
+
+    if (!buffer || current_head - current_tail >= slots || length > slot_size) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    auto slot = get_slot(current_head);
+    slot->handle = handle;
+    slot->length = length;
+    slot->notification = notification;
+    memcpy(slot->get_data(), data, length);
+
+    head.store(current_head + 1, std::memory_order_release);
+    return true;
+  }
+
+public:
+  // Consumer
+  bool empty() const {
+    return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire);
+  }
+
+  const Slot *front() const {
+    if (empty()) {
+      return nullptr;
+    }
+    return get_slot(tail.load(std::memory_order_relaxed));
+  }
+
+  void pop() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  void clear() {
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+private:
+  Slot *get_slot(uint32_t index) const {
+    return (Slot*)(buffer + (index % slots) * stride);
+  }
+
+private:
+  uint8_t *buffer{nullptr};
+  size_t capacity{0};
+  uint16_t slots{0};
+  uint16_t slot_size{0};
+  size_t stride{0};
+
+  // free running counters, wrap around together
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  std::atomic<uint32_t> dropped{0};
+};
@@ -0,0 +1,282 @@
+#include "esp32_ble_log.h"
+#include "esp32_ble_lock.h"
+#include "esp32_ble_scheduler.h"
+#include "esp32_ble.h"
+
+#include <esp_timer.h>
+
+static const char *TAG = "esp32_ble_scheduler";
+
+// How often the waiting connections look if the scan got paused
+static const int POLL_MS = 20;
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+using namespace esphome::esp32_ble_tracker;
+#endif
+
+ESP32BLEScheduler &ESP32BLEScheduler::instance() {
+  static ESP32BLEScheduler scheduler;
+  return scheduler;
+}
+
+ESP32BLEScheduler::ESP32BLEScheduler()
+{
+  lock = xSemaphoreCreateMutex();
+}
+
+ESP32BLEScheduler::~ESP32BLEScheduler()
+{
+  vSemaphoreDelete(lock);
+}
+
+bool ESP32BLEScheduler::attach()
+{
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+  if (attached) {
+    return true;
+  }
+
+  if (!global_esp32_ble_tracker) {
+    ESP_LOGE(TAG, "esp32_ble_tracker is not set up");
+    return false;
+  }
+
+  global_esp32_ble_tracker->register_client(&tracker_client);
+
+  ESP32BLELock lock(this->lock);
+  state_since = esp_timer_get_time();
+  attached = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool ESP32BLEScheduler::can_grant(int64_t now) const
+{
+  if (state != Paused || now - state_since >= (int64_t)max_pause_us) {
+    return false;
+  }
+
+  return scan_priority != ScanHigh || granted == 0;
+}
+
+void ESP32BLEScheduler::set_state(State new_state, int64_t now)
+{
+  auto elapsed = now - state_since;
+
+  // a pause is only asked for, the scan keeps running meanwhile
+  if (new_state == PauseRequested || state == PauseRequested) {
+    state = new_state;
+    if (new_state == Paused) {
+      scanning_us += elapsed;
+      state_since = now;
+    }
+    return;
+  }
+
+  if (state == Scanning) {
+    scanning_us += elapsed;
+  } else {
+    paused_us += elapsed;
+  }
+
+  state = new_state;
+  state_since = now;
+}
+
+void ESP32BLEScheduler::resume_if(int64_t now)
+{
+  if (state != Paused || connecting > 0) {
+    return;
+  }
+
+  // connections still waiting can share the pause, unless it is over
+  if (waiting > 0 && can_grant(now)) {
+    return;
+  }
+
+  set_state(Scanning, now);
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+  // the tracker restarts the scan on its next loop
+  set_tracker_state(ClientState::IDLE);
+#endif
+}
+
+bool ESP32BLEScheduler::begin_connect(int timeout_ms)
+{
+  if (!attached) {
+    return true;
+  }
+
+  ESP32BLELock lock(this->lock);
+
+  auto deadline = esp_timer_get_time() + timeout_ms * 1000ll;
+  waiting++;
+
+  while (true) {
+    auto now = esp_timer_get_time();
+
+    if (can_grant(now)) {
+      waiting--;
+      connecting++;
+      granted++;
+      return true;
+    }
+
+    auto min_scan = scan_priority == ScanLow ? 0 : (int64_t)min_scan_us;
+
+    if (state == Scanning && now - state_since >= min_scan) {
+      set_state(PauseRequested, now);
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+      // the tracker stops the scan and calls `connect()`
+      set_tracker_state(ClientState::DISCOVERED);
+#endif
+    }
+
+    if (now >= deadline) {
+      waiting--;
+
+      if (state == PauseRequested && waiting == 0) {
+        set_state(Scanning, now);
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+        set_tracker_state(ClientState::IDLE);
+#endif
+      }
+
+      resume_if(now);
+      BLE_LOGW(TAG, "SCHEDULER: scan did not pause in %dms\n", timeout_ms);
+      return false;
+    }
+
+    lock.give();
+    vTaskDelay(pdMS_TO_TICKS(POLL_MS));
+    lock.take();
+  }
+}
+
+void ESP32BLEScheduler::end_connect()
+{
+  if (!attached) {
+    return;
+  }
+
+  ESP32BLELock lock(this->lock);
+
+  connecting--;
+  resume_if(esp_timer_get_time());
+}
+
+void ESP32BLEScheduler::scan_paused()
+{
+  ESP32BLELock lock(this->lock);
+
+  auto now = esp_timer_get_time();
+
+  // might have been given up on meanwhile, resumed right away then
+  set_state(Paused, now);
+  pauses++;
+  granted = 0;
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+  // keeps the tracker from restarting the scan
+  set_tracker_state(ClientState::CONNECTING);
+#endif
+
+  resume_if(now);
+}
+
+void ESP32BLEScheduler::loop()
+{
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+  // the pool tasks only ask for the state, the tracker
+  // reads it on the main loop, so it is changed only here
+  auto new_state = tracker_state.load();
+  if (attached && tracker_client.state() != new_state) {
+    tracker_client.set_state(new_state);
+  }
+#endif
+}
+
+void ESP32BLEScheduler::advertisement_seen()
+{
+  // the pool tasks change the state meanwhile, under the lock
+  State current = state.load();
+  if (current == Scanning || current == PauseRequested) {
+    advertisements.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+ESP32BLEScheduler::Stats ESP32BLEScheduler::get_stats()
+{
+  ESP32BLELock lock(this->lock);
+
+  Stats stats = {};
+  stats.pauses = pauses;
+  stats.scanning_us = scanning_us;
+  stats.paused_us = paused_us;
+  stats.advertisements = advertisements.load(std::memory_order_relaxed);
+
+  // include the state we are in right now
+  if (attached) {
+    auto elapsed = esp_timer_get_time() - state_since;
+    if (state == Paused) {
+      stats.paused_us += elapsed;
+    } else {
+      stats.scanning_us += elapsed;
+    }
+  }
+
+  if (stats.scanning_us > 0) {
+    stats.missed_advertisements = stats.advertisements * stats.paused_us / stats.scanning_us;
+  }
+
+  return stats;
+}
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+void ESP32BLEScheduler::TrackerClient::gattc_event_handler(
+  esp_gattc_cb_event_t event,
+  esp_gatt_if_t gattc_if,
+  esp_ble_gattc_cb_param_t *param)
+{
+  // the tracker owns the GATTC callback, and hands out all events
+  ESP32BLE::esp32_ble_client_event_handler(event, gattc_if, param);
+}
+
+bool ESP32BLEScheduler::TrackerClient::parse_device(const ESPBTDevice &device)
+{
+  ESP32BLEScheduler::instance().advertisement_seen();
+  return false;
+}
+
+void ESP32BLEScheduler::TrackerClient::connect()
+{
+  auto &scheduler = ESP32BLEScheduler::instance();
+  scheduler.scan_paused();
+  scheduler.loop();
+}
+
+void ESP32BLEScheduler::set_tracker_state(ClientState new_state)
+{
+  tracker_state.store(new_state);
+}
+
+void ESP32BLESchedulerComponent::setup()
+{
+  ESP32BLEScheduler::instance().attach();
+}
+
+void ESP32BLESchedulerComponent::loop()
+{
+  ESP32BLEScheduler::instance().loop();
+}
+
+float ESP32BLESchedulerComponent::get_setup_priority() const
+{
+  // the tracker registers itself in its own setup
+  return esphome::setup_priority::AFTER_BLUETOOTH;
+}
+#endif
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_gattc_api.h>
+
+#include <atomic>
+#include <stdint.h>
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+#include "esphome/core/component.h"
+#include "esphome/components/esp32_ble_tracker/esp32_ble_tracker.h"
+#endif
+
+// Shares the radio with the scan of `esp32_ble_tracker`, when there is one.
+// The scan gets paused while connections are set up, connections waiting
+// meanwhile are let through in the same pause, and the scan is given
+// some time in between the pauses, depending on its priority.
+class ESP32BLEScheduler
+{
+public:
+  static ESP32BLEScheduler &instance();
+
+public:
+  enum ScanPriority {
+    // connections pause the scan as soon as they ask for it
+    ScanLow,
+    // the scan runs at least `min_scan_time` in between the pauses
+    ScanNormal,
+    // as above, but only a single connection is set up per pause
+    ScanHigh
+  };
+
+  struct Stats {
+    uint32_t pauses;
+    uint64_t scanning_us;
+    uint64_t paused_us;
+    uint32_t advertisements;
+    // the rate seen while scanning, applied to the time it was paused
+    uint32_t missed_advertisements;
+  };
+
+public:
+  ESP32BLEScheduler();
+  ~ESP32BLEScheduler();
+
+public:
+  void set_scan_priority(ScanPriority priority) { scan_priority = priority; }
+  void set_min_scan_time(uint32_t min_scan_time_ms) { min_scan_us = min_scan_time_ms * 1000ull; }
+  void set_max_scan_pause(uint32_t max_scan_pause_ms) { max_pause_us = max_scan_pause_ms * 1000ull; }
+
+  // Hooks into the tracker, which owns the controller and the callbacks,
+  // has to be called on the main loop once the tracker is set up
+  bool attach();
+  bool has_scanner() const { return attached; }
+
+  // Called on the main loop, where the tracker reads the state of its clients
+  void loop();
+
+  // Taken around setting up a connection,
+  // waits up to timeout_ms for the scan to pause
+  bool begin_connect(int timeout_ms);
+  void end_connect();
+
+  Stats get_stats();
+
+private:
+  enum State {
+    Scanning,
+    PauseRequested,
+    Paused
+  };
+
+  bool can_grant(int64_t now) const;
+  void set_state(State new_state, int64_t now);
+  void resume_if(int64_t now);
+
+  // Called by the tracker, on the main loop
+  void scan_paused();
+  void advertisement_seen();
+
+private:
+  SemaphoreHandle_t lock{nullptr};
+  std::atomic<bool> attached{false};
+
+  ScanPriority scan_priority{ScanNormal};
+  uint64_t min_scan_us{2000000};
+  uint64_t max_pause_us{10000000};
+
+  // also read by advertisement_seen() without the lock
+  std::atomic<State> state{Scanning};
+  int64_t state_since{0};
+  int waiting{0};
+  int connecting{0};
+  int granted{0};
+
+  uint32_t pauses{0};
+  uint64_t scanning_us{0};
+  uint64_t paused_us{0};
+  std::atomic<uint32_t> advertisements{0};
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+  // Looks like a single client to the tracker, which stops
+  // the scan and calls `connect()` once it is asked to connect
+  class TrackerClient : public esphome::esp32_ble_tracker::ESPBTClient
+  {
+  public:
+    void gattc_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if,
+      esp_ble_gattc_cb_param_t *param) override;
+    bool parse_device(const esphome::esp32_ble_tracker::ESPBTDevice &device) override;
+    void connect() override;
+  };
+
+  TrackerClient tracker_client;
+
+  void set_tracker_state(esphome::esp32_ble_tracker::ClientState new_state);
+
+  // Set by the pool tasks, handed to the tracker by `loop()`
+  std::atomic<esphome::esp32_ble_tracker::ClientState> tracker_state{
+    esphome::esp32_ble_tracker::ClientState::IDLE};
+#endif
+};
+
+#ifdef USE_ESP32_BLE_CLIENTS_TRACKER
+// Attaches the scheduler once the tracker is set up,
+// and runs it on the main loop
+class ESP32BLESchedulerComponent : public esphome::Component
+{
+public:
+  void setup() override;
+  void loop() override;
+  float get_setup_priority() const override;
+};
+#endif
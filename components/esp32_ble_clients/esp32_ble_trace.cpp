@@ -0,0 +1,191 @@
+#include "esphome/core/log.h"
+
+#include "esp32_ble_lock.h"
+#include "esp32_ble_trace.h"
+
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "esp32_ble_trace";
+
+// Bumped whenever `Entry` changes
+static const int TRACE_VERSION = 1;
+static const int ENTRIES_PER_LINE = 4;
+
+using namespace esphome;
+
+static uint32_t now_us()
+{
+  return (uint32_t)esp_timer_get_time();
+}
+
+static uint32_t free_heap()
+{
+  return heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+ESP32BLETrace &ESP32BLETrace::instance() {
+  static ESP32BLETrace trace;
+  return trace;
+}
+
+ESP32BLETrace::ESP32BLETrace()
+{
+  memset(entries, 0, sizeof(entries));
+  memset(stats, 0, sizeof(stats));
+  lock = xSemaphoreCreateMutex();
+}
+
+ESP32BLETrace::~ESP32BLETrace()
+{
+  vSemaphoreDelete(lock);
+}
+
+const char *ESP32BLETrace::get_operation_name(Operation operation)
+{
+  switch (operation) {
+  case Connect:
+    return "connect";
+  case Search:
+    return "search";
+  case Write:
+    return "write";
+  case Notify:
+    return "notify";
+  default:
+    return "unknown";
+  }
+}
+
+void ESP32BLETrace::record(const Entry &entry)
+{
+  // Claimed slots get overwritten once wrapped, the dump is best effort
+  auto index = next_entry.fetch_add(1, std::memory_order_relaxed);
+  entries[index % MAX_ENTRIES] = entry;
+}
+
+void ESP32BLETrace::event(uint16_t app_id, int event, int status)
+{
+  Entry entry = {};
+  entry.time_us = now_us();
+  entry.free_heap = free_heap();
+  entry.app_id = app_id;
+  entry.type = GattcEvent;
+  entry.code = event;
+  entry.value = status;
+  record(entry);
+}
+
+ESP32BLETrace::Span ESP32BLETrace::begin(Operation operation, uint16_t app_id)
+{
+  Span span;
+  span.operation = operation;
+  span.app_id = app_id;
+  span.start_us = now_us();
+  span.start_heap = free_heap();
+
+  Entry entry = {};
+  entry.time_us = span.start_us;
+  entry.free_heap = span.start_heap;
+  entry.app_id = app_id;
+  entry.type = OperationBegin;
+  entry.code = operation;
+  record(entry);
+
+  return span;
+}
+
+void ESP32BLETrace::end(const Span &span, Result result)
+{
+  Entry entry = {};
+  entry.time_us = now_us();
+  entry.free_heap = free_heap();
+  entry.app_id = span.app_id;
+  entry.type = OperationEnd;
+  entry.code = span.operation;
+  entry.value = entry.time_us - span.start_us;
+  entry.result = result;
+  record(entry);
+
+  uint32_t duration_us = entry.value;
+  int32_t heap_drop = (int32_t)span.start_heap - (int32_t)entry.free_heap;
+
+  int bucket = 0;
+  for (uint32_t ms = duration_us / 1000; ms > 0 && bucket < HISTOGRAM_BUCKETS - 1; ms >>= 1) {
+    bucket++;
+  }
+
+  ESP32BLELock lock(this->lock);
+
+  auto &stat = stats[span.operation];
+  stat.count++;
+  stat.failures += result == Failed;
+  stat.timeouts += result == TimedOut;
+  stat.total_us += duration_us;
+  if (duration_us > stat.max_us) {
+    stat.max_us = duration_us;
+  }
+  if (heap_drop > stat.max_heap_drop) {
+    stat.max_heap_drop = heap_drop;
+  }
+  stat.histogram[bucket]++;
+}
+
+ESP32BLETrace::Stats ESP32BLETrace::get_stats(Operation operation)
+{
+  ESP32BLELock lock(this->lock);
+  return stats[operation];
+}
+
+void ESP32BLETrace::dump()
+{
+  for (int operation = 0; operation < MaxOperations; operation++) {
+    auto stat = get_stats((Operation)operation);
+    if (!stat.count) {
+      continue;
+    }
+
+    ESP_LOGI(TAG, "%s: count=%u failures=%u timeouts=%u avg=%.1fms max=%.1fms heap_drop=%d",
+      get_operation_name((Operation)operation), stat.count, stat.failures, stat.timeouts,
+      stat.total_us / 1000.0f / stat.count, stat.max_us / 1000.0f, stat.max_heap_drop);
+
+    char line[HISTOGRAM_BUCKETS * 16] = {0};
+    int length = 0;
+
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+      if (!stat.histogram[bucket]) {
+        continue;
+      }
+      length += snprintf(line + length, sizeof(line) - length, " %s%ums:%u",
+        bucket == HISTOGRAM_BUCKETS - 1 ? ">=" : "<",
+        bucket == HISTOGRAM_BUCKETS - 1 ? 1u << (bucket - 1) : 1u << bucket,
+        stat.histogram[bucket]);
+    }
+
+    ESP_LOGI(TAG, "%s:%s", get_operation_name((Operation)operation), line);
+  }
+
+  uint32_t next = next_entry.load(std::memory_order_relaxed);
+  uint32_t count = next < MAX_ENTRIES ? next : MAX_ENTRIES;
+
+  // Picked up by `decode_trace.py`, oldest entry first
+  ESP_LOGI(TAG, "TRACE:v%d:entries=%u:size=%u:now=%u",
+    TRACE_VERSION, count, (unsigned)sizeof(Entry), now_us());
+
+  for (uint32_t first = next - count; first != next; ) {
+    char line[ENTRIES_PER_LINE * sizeof(Entry) * 2 + 1];
+    int length = 0;
+
+    for (int i = 0; i < ENTRIES_PER_LINE && first != next; i++, first++) {
+      auto data = (const uint8_t*)&entries[first % MAX_ENTRIES];
+      for (size_t j = 0; j < sizeof(Entry); j++) {
+        length += sprintf(line + length, "%02x", data[j]);
+      }
+    }
+
+    ESP_LOGI(TAG, "T:%s", line);
+  }
+}
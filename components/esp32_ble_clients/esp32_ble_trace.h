@@ -0,0 +1,104 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+#include <stdint.h>
+
+// Binary record of what the clients did, cheap enough to be always on
+// unlike the `BLE_LOG*` printing. Entries get dumped as hex to the log,
+// `decode_trace.py` turns them back into a readable timeline.
+class ESP32BLETrace
+{
+public:
+  static ESP32BLETrace &instance();
+
+public:
+  enum Operation {
+    Connect,
+    Search,
+    Write,
+    Notify,
+    MaxOperations
+  };
+
+  enum Result {
+    Ok,
+    Failed,
+    TimedOut
+  };
+
+  enum EntryType {
+    GattcEvent,
+    OperationBegin,
+    OperationEnd
+  };
+
+  // Keep in sync with `decode_trace.py`
+  struct Entry {
+    uint32_t time_us;
+    uint32_t free_heap;
+    uint16_t app_id;
+    uint8_t type;
+    // event id or operation
+    uint8_t code;
+    // duration in us, or the status of an event
+    int32_t value;
+    uint8_t result;
+    uint8_t reserved[3];
+  };
+
+  // Durations as powers of two of milliseconds, the last is everything longer
+  static const int HISTOGRAM_BUCKETS = 16;
+
+  struct Stats {
+    uint32_t count;
+    uint32_t failures;
+    uint32_t timeouts;
+    uint64_t total_us;
+    uint32_t max_us;
+    // largest drop of free heap during the operation
+    int32_t max_heap_drop;
+    uint32_t histogram[HISTOGRAM_BUCKETS];
+  };
+
+  // Tracks a single operation from its begin to its end
+  struct Span {
+    Operation operation;
+    uint16_t app_id;
+    uint32_t start_us;
+    uint32_t start_heap;
+  };
+
+public:
+  ESP32BLETrace();
+  ~ESP32BLETrace();
+
+public:
+  // Called from the GATTC callback, never blocks
+  void event(uint16_t app_id, int event, int status);
+
+  Span begin(Operation operation, uint16_t app_id);
+  void end(const Span &span, Result result);
+
+  Stats get_stats(Operation operation);
+
+  // Prints the histograms, and the trace as hex lines
+  void dump();
+
+public:
+  static const char *get_operation_name(Operation operation);
+
+private:
+  void record(const Entry &entry);
+
+private:
+  static const int MAX_ENTRIES = 128;
+
+  Entry entries[MAX_ENTRIES];
+  std::atomic<uint32_t> next_entry{0};
+
+  Stats stats[MaxOperations];
+  SemaphoreHandle_t lock{nullptr};
+};
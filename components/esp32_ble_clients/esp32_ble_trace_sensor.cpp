@@ -0,0 +1,85 @@
+#include "esp32_ble_trace_sensor.h"
+#include "esphome/core/log.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+
+using namespace esphome;
+
+static const char *TAG = "esp32_ble_trace";
+
+void ESP32BLETraceSensor::update() {
+  auto &trace = ESP32BLETrace::instance();
+
+  uint32_t total_failures = 0;
+  uint32_t total_timeouts = 0;
+  int32_t max_heap_drop = 0;
+
+  for (int operation = 0; operation < ESP32BLETrace::MaxOperations; operation++) {
+    auto stats = trace.get_stats((ESP32BLETrace::Operation)operation);
+    auto &last = last_stats[operation];
+
+    // the average of only what happened since the previous update,
+    // nothing is published if there was nothing to measure
+    if (latency[operation] && stats.count != last.count) {
+      latency[operation]->publish_state(
+        (stats.total_us - last.total_us) / 1000.0f / (stats.count - last.count));
+    }
+
+    total_failures += stats.failures;
+    total_timeouts += stats.timeouts;
+    if (stats.max_heap_drop > max_heap_drop) {
+      max_heap_drop = stats.max_heap_drop;
+    }
+
+    last = stats;
+  }
+
+  if (failures) {
+    failures->publish_state(total_failures);
+  }
+  if (timeouts) {
+    timeouts->publish_state(total_timeouts);
+  }
+  if (heap_drop) {
+    heap_drop->publish_state(max_heap_drop);
+  }
+
+  // only known when sharing the radio with the tracker
+  auto &scheduler = ESP32BLEScheduler::instance();
+  if (scheduler.has_scanner()) {
+    auto stats = scheduler.get_stats();
+    auto &last = last_scheduler_stats;
+    auto scanning_us = stats.scanning_us - last.scanning_us;
+    auto paused_us = stats.paused_us - last.paused_us;
+
+    if (scan_paused && scanning_us + paused_us > 0) {
+      scan_paused->publish_state(100.0f * paused_us / (scanning_us + paused_us));
+    }
+    if (missed_advertisements) {
+      missed_advertisements->publish_state(stats.missed_advertisements);
+    }
+
+    last = stats;
+  }
+
+  if (dump_trace) {
+    dump();
+  }
+}
+
+void ESP32BLETraceSensor::dump() {
+  ESP32BLETrace::instance().dump();
+}
+
+void ESP32BLETraceSensor::dump_config() {
+  ESP_LOGCONFIG(TAG, "ESP32 BLE Trace:");
+  for (int operation = 0; operation < ESP32BLETrace::MaxOperations; operation++) {
+    if (latency[operation]) {
+      ESP_LOGCONFIG(TAG, "  Latency of %s", ESP32BLETrace::get_operation_name((ESP32BLETrace::Operation)operation));
+    }
+  }
+  ESP_LOGCONFIG(TAG, "  Dump trace: %s", YESNO(dump_trace));
+  ESP_LOGCONFIG(TAG, "  Shared with tracker: %s", YESNO(ESP32BLEScheduler::instance().has_scanner()));
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "esphome/core/component.h"
+#include "esphome/components/sensor/sensor.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32_ble_scheduler.h"
+#include "esp32_ble_trace.h"
+
+class ESP32BLETraceSensor : public esphome::PollingComponent
+{
+public:
+  void update() override;
+  void dump_config() override;
+  float get_setup_priority() const override { return esphome::setup_priority::LATE; }
+
+  void set_latency(ESP32BLETrace::Operation operation, esphome::sensor::Sensor *sensor) { latency[operation] = sensor; }
+  void set_failures(esphome::sensor::Sensor *sensor) { failures = sensor; }
+  void set_timeouts(esphome::sensor::Sensor *sensor) { timeouts = sensor; }
+  void set_heap_drop(esphome::sensor::Sensor *sensor) { heap_drop = sensor; }
+  void set_scan_paused(esphome::sensor::Sensor *sensor) { scan_paused = sensor; }
+  void set_missed_advertisements(esphome::sensor::Sensor *sensor) { missed_advertisements = sensor; }
+  void set_dump_trace(bool dump) { dump_trace = dump; }
+
+public:
+  // Can be called from a lambda, prints what `decode_trace.py` reads
+  void dump();
+
+private:
+  esphome::sensor::Sensor *latency[ESP32BLETrace::MaxOperations]{nullptr};
+  esphome::sensor::Sensor *failures{nullptr};
+  esphome::sensor::Sensor *timeouts{nullptr};
+  esphome::sensor::Sensor *heap_drop{nullptr};
+  esphome::sensor::Sensor *scan_paused{nullptr};
+  esphome::sensor::Sensor *missed_advertisements{nullptr};
+  bool dump_trace{false};
+
+  // what was published by the previous update
+  ESP32BLETrace::Stats last_stats[ESP32BLETrace::MaxOperations]{};
+  ESP32BLEScheduler::Stats last_scheduler_stats{};
+};
+
+#endif
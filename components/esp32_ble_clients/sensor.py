@@ -0,0 +1,81 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import sensor
+from esphome.const import CONF_ID, UNIT_EMPTY, ICON_EMPTY, ICON_TIMER, UNIT_PERCENT, \
+    ICON_PERCENT, STATE_CLASS_MEASUREMENT, STATE_CLASS_TOTAL_INCREASING
+
+DEPENDENCIES = ['esp32']
+
+ESP32BLETraceSensor = cg.global_ns.class_('ESP32BLETraceSensor', cg.PollingComponent)
+
+CONF_CONNECT_LATENCY = 'connect_latency'
+CONF_SEARCH_LATENCY = 'search_latency'
+CONF_WRITE_LATENCY = 'write_latency'
+CONF_NOTIFY_LATENCY = 'notify_latency'
+CONF_FAILURES = 'failures'
+CONF_TIMEOUTS = 'timeouts'
+CONF_HEAP_DROP = 'heap_drop'
+CONF_SCAN_PAUSED = 'scan_paused'
+CONF_MISSED_ADVERTISEMENTS = 'missed_advertisements'
+CONF_DUMP_TRACE = 'dump_trace'
+
+UNIT_MS = 'ms'
+UNIT_BYTES = 'B'
+
+# keys are matched with `ESP32BLETrace::Operation`
+LATENCIES = {
+    CONF_CONNECT_LATENCY: 'ESP32BLETrace::Connect',
+    CONF_SEARCH_LATENCY: 'ESP32BLETrace::Search',
+    CONF_WRITE_LATENCY: 'ESP32BLETrace::Write',
+    CONF_NOTIFY_LATENCY: 'ESP32BLETrace::Notify',
+}
+
+LATENCY_SCHEMA = sensor.sensor_schema(unit_of_measurement=UNIT_MS, icon=ICON_TIMER,
+                                      accuracy_decimals=1, state_class=STATE_CLASS_MEASUREMENT)
+COUNT_SCHEMA = sensor.sensor_schema(unit_of_measurement=UNIT_EMPTY, icon=ICON_EMPTY,
+                                    accuracy_decimals=0, state_class=STATE_CLASS_TOTAL_INCREASING)
+
+CONFIG_SCHEMA = cv.Schema({
+    cv.GenerateID(): cv.declare_id(ESP32BLETraceSensor),
+    cv.Optional(CONF_CONNECT_LATENCY): LATENCY_SCHEMA,
+    cv.Optional(CONF_SEARCH_LATENCY): LATENCY_SCHEMA,
+    cv.Optional(CONF_WRITE_LATENCY): LATENCY_SCHEMA,
+    cv.Optional(CONF_NOTIFY_LATENCY): LATENCY_SCHEMA,
+    cv.Optional(CONF_FAILURES): COUNT_SCHEMA,
+    cv.Optional(CONF_TIMEOUTS): COUNT_SCHEMA,
+    cv.Optional(CONF_HEAP_DROP): sensor.sensor_schema(unit_of_measurement=UNIT_BYTES, icon=ICON_EMPTY,
+                                                      accuracy_decimals=0),
+    # only published when sharing the radio with `esp32_ble_tracker`
+    cv.Optional(CONF_SCAN_PAUSED): sensor.sensor_schema(unit_of_measurement=UNIT_PERCENT, icon=ICON_PERCENT,
+                                                        accuracy_decimals=1, state_class=STATE_CLASS_MEASUREMENT),
+    cv.Optional(CONF_MISSED_ADVERTISEMENTS): COUNT_SCHEMA,
+    cv.Optional(CONF_DUMP_TRACE, default=False): cv.boolean,
+}).extend(cv.polling_component_schema('60s'))
+
+
+def to_code(config):
+    var = cg.new_Pvariable(config[CONF_ID])
+    yield cg.register_component(var, config)
+
+    cg.add(var.set_dump_trace(config[CONF_DUMP_TRACE]))
+
+    for key, operation in LATENCIES.items():
+        if key in config:
+            sens = yield sensor.new_sensor(config[key])
+            cg.add(var.set_latency(cg.RawExpression(operation), sens))
+
+    if CONF_FAILURES in config:
+        sens = yield sensor.new_sensor(config[CONF_FAILURES])
+        cg.add(var.set_failures(sens))
+    if CONF_TIMEOUTS in config:
+        sens = yield sensor.new_sensor(config[CONF_TIMEOUTS])
+        cg.add(var.set_timeouts(sens))
+    if CONF_HEAP_DROP in config:
+        sens = yield sensor.new_sensor(config[CONF_HEAP_DROP])
+        cg.add(var.set_heap_drop(sens))
+    if CONF_SCAN_PAUSED in config:
+        sens = yield sensor.new_sensor(config[CONF_SCAN_PAUSED])
+        cg.add(var.set_scan_paused(sens))
+    if CONF_MISSED_ADVERTISEMENTS in config:
+        sens = yield sensor.new_sensor(config[CONF_MISSED_ADVERTISEMENTS])
+        cg.add(var.set_missed_advertisements(sens))
@@ -0,0 +1,75 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+
+CODEOWNERS = ["@ayufan"]
+DEPENDENCIES = ["esp32_camera"]
+
+CONF_MAX_FRAMERATE = "max_framerate"
+CONF_MAX_FRAME_AGE = "max_frame_age"
+CONF_SKIP_UNCHANGED = "skip_unchanged"
+CONF_THRESHOLD = "threshold"
+CONF_KEEP_ALIVE = "keep_alive"
+CONF_RECORDING = "recording"
+CONF_DURATION = "duration"
+CONF_BUFFER_SIZE = "buffer_size"
+CONF_CONTINUOUS = "continuous"
+
+esp32_camera_stream_ns = cg.esphome_ns.namespace("esp32_camera_stream")
+
+# Options of the shared streaming core, extended by every camera server
+STREAM_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_MAX_FRAMERATE): cv.All(
+            cv.framerate, cv.Range(min=0, min_included=False, max=60)
+        ),
+        cv.Optional(
+            CONF_MAX_FRAME_AGE, default="1s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_SKIP_UNCHANGED): cv.Schema(
+            {
+                cv.Optional(CONF_THRESHOLD, default="2%"): cv.All(
+                    cv.percentage, cv.Range(min=0, min_included=False)
+                ),
+                cv.Optional(
+                    CONF_KEEP_ALIVE, default="2s"
+                ): cv.positive_time_period_milliseconds,
+            }
+        ),
+        cv.Optional(CONF_RECORDING): cv.Schema(
+            {
+                cv.Optional(
+                    CONF_DURATION, default="10s"
+                ): cv.positive_time_period_milliseconds,
+                cv.Optional(CONF_BUFFER_SIZE, default=1048576): cv.int_range(
+                    min=65536
+                ),
+                cv.Optional(CONF_MAX_FRAMERATE, default="5 fps"): cv.All(
+                    cv.framerate, cv.Range(min=0, min_included=False, max=60)
+                ),
+                # Without it only what clients watch is recorded, with it
+                # the camera streams all the time, even with nobody watching
+                cv.Optional(CONF_CONTINUOUS, default=False): cv.boolean,
+            }
+        ),
+    }
+)
+
+
+async def stream_to_code(var, config):
+    if CONF_MAX_FRAMERATE in config:
+        cg.add(var.set_max_framerate(config[CONF_MAX_FRAMERATE]))
+    cg.add(var.set_max_frame_age(config[CONF_MAX_FRAME_AGE]))
+    if CONF_SKIP_UNCHANGED in config:
+        skip_unchanged = config[CONF_SKIP_UNCHANGED]
+        cg.add(var.set_change_threshold(skip_unchanged[CONF_THRESHOLD]))
+        cg.add(var.set_keep_alive(skip_unchanged[CONF_KEEP_ALIVE]))
+    if CONF_RECORDING in config:
+        recording = config[CONF_RECORDING]
+        cg.add(
+            var.set_recording(
+                recording[CONF_DURATION],
+                recording[CONF_BUFFER_SIZE],
+                recording[CONF_MAX_FRAMERATE],
+                recording[CONF_CONTINUOUS],
+            )
+        )
@@ -0,0 +1,54 @@
+#include "frame_pacer.h"
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+void FramePacer::start(uint32_t now) {
+  this->next_frame_ = now;
+  this->has_last_ = false;
+}
+
+FramePacer::Verdict FramePacer::check(uint32_t frame_time, const FrameSignature &signature, uint32_t now) {
+  // the frame is left for the next slot, by then a newer one might replace it
+  if (this->time_to_next(now)) {
+    return WAIT;
+  }
+
+  // a frame that waited too long is not worth the bandwidth,
+  // the next capture is already on its way
+  if (this->max_frame_age_ && now - frame_time > this->max_frame_age_) {
+    return DROP;
+  }
+
+  // a static scene is only resent now and then, so the client
+  // keeps seeing a live stream; the slot stays open for a change
+  if (this->change_threshold_ > 0 && this->has_last_ && now - this->last_sent_ < this->keep_alive_ &&
+      signature.difference(this->last_) < this->change_threshold_) {
+    return SKIP;
+  }
+
+  // a client falling behind restarts pacing instead of bursting to catch up
+  this->next_frame_ += this->frame_interval_;
+  if ((int32_t) (now - this->next_frame_) >= 0)
+    this->next_frame_ = now + this->frame_interval_;
+
+  if (this->change_threshold_ > 0) {
+    this->has_last_ = true;
+    this->last_sent_ = now;
+    this->last_ = signature;
+  }
+
+  return SEND;
+}
+
+bool FramePacer::is_late(uint32_t frame_time, uint32_t now) const {
+  return this->max_frame_age_ && now - frame_time > this->max_frame_age_;
+}
+
+uint32_t FramePacer::time_to_next(uint32_t now) const {
+  int32_t left = this->next_frame_ - now;
+  return left > 0 ? left : 0;
+}
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
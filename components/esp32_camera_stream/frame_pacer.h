@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+#include "frame_signature.h"
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// Per-client pacing policy: hands out at most one frame per slot,
+// refuses frames older than the maximum age and, with a change
+// threshold set, skips frames that look like the last one sent.
+// Servers configure one pacer and copy it for every client.
+class FramePacer {
+ public:
+  enum Verdict { WAIT, DROP, SKIP, SEND };
+
+  void set_max_framerate(float max_framerate) { this->frame_interval_ = max_framerate > 0 ? 1000 / max_framerate : 0; }
+  void set_max_frame_age(uint32_t max_frame_age) { this->max_frame_age_ = max_frame_age; }
+  void set_change_threshold(float change_threshold) { this->change_threshold_ = change_threshold; }
+  void set_keep_alive(uint32_t keep_alive) { this->keep_alive_ = keep_alive; }
+
+  uint32_t get_frame_interval() const { return this->frame_interval_; }
+  uint32_t get_max_frame_age() const { return this->max_frame_age_; }
+  float get_change_threshold() const { return this->change_threshold_; }
+  uint32_t get_keep_alive() const { return this->keep_alive_; }
+
+  void start(uint32_t now);
+  Verdict check(uint32_t frame_time, const FrameSignature &signature, uint32_t now);
+  bool is_late(uint32_t frame_time, uint32_t now) const;
+  // Milliseconds until the next slot, 0 if a frame can be taken right away
+  uint32_t time_to_next(uint32_t now) const;
+
+ protected:
+  uint32_t frame_interval_{0};
+  uint32_t max_frame_age_{0};
+  float change_threshold_{0};
+  uint32_t keep_alive_{0};
+
+  uint32_t next_frame_{0};
+  // the last frame handed out, to compare the next ones against
+  bool has_last_{false};
+  uint32_t last_sent_{0};
+  FrameSignature last_;
+};
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
@@ -0,0 +1,114 @@
+#include "frame_ring.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef USE_ESP32
+#include <esp_heap_caps.h>
+#endif
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// the camera does not go faster than that
+static const uint32_t MAX_CAMERA_FRAMERATE = 30;
+
+bool FrameRing::setup() {
+  if (!this->size_ || !this->duration_)
+    return false;
+
+#ifdef USE_ESP32
+  this->buffer_ = (uint8_t *) heap_caps_malloc(this->size_, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!this->buffer_)
+    this->buffer_ = (uint8_t *) heap_caps_malloc(this->size_, MALLOC_CAP_8BIT);
+#else
+  this->buffer_ = (uint8_t *) malloc(this->size_);
+#endif
+  if (!this->buffer_)
+    return false;
+
+  // enough slots for every frame of the recording
+  uint32_t framerate = this->frame_interval_ ? 1000 / this->frame_interval_ : MAX_CAMERA_FRAMERATE;
+  this->entries_.resize(this->duration_ * framerate / 1000 + 1);
+  return true;
+}
+
+void FrameRing::evict_() {
+  this->head_ = (this->head_ + 1) % this->entries_.size();
+  this->count_--;
+  if (!this->count_)
+    this->write_ = 0;
+}
+
+void FrameRing::push(const uint8_t *data, size_t length, uint32_t time) {
+  if (!this->buffer_ || length > this->size_)
+    return;
+
+  std::lock_guard<std::mutex> guard(this->lock_);
+  if (this->dumping_)
+    return;
+
+  if (this->count_ && time - this->last_time_ < this->frame_interval_)
+    return;
+
+  while (this->count_ && time - this->oldest_().time > this->duration_)
+    this->evict_();
+
+  if (this->count_ == this->entries_.size())
+    this->evict_();
+
+  // Frames are kept whole: a frame that does not fit before the end
+  // starts over at the beginning, the rest of the buffer stays unused
+  size_t offset = this->write_;
+  if (offset + length > this->size_) {
+    // everything behind the write position is older than what is in front
+    while (this->count_ && this->oldest_().offset >= this->write_)
+      this->evict_();
+    offset = 0;
+  }
+
+  // the oldest frames are the ones right in front of the write position
+  while (this->count_ && this->oldest_().offset >= offset && this->oldest_().offset < offset + length)
+    this->evict_();
+
+  memcpy(this->buffer_ + offset, data, length);
+
+  this->entries_[(this->head_ + this->count_) % this->entries_.size()] = Entry{offset, length, time};
+  this->count_++;
+  this->write_ = offset + length;
+  this->last_time_ = time;
+}
+
+bool FrameRing::begin_dump() {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  if (!this->buffer_ || this->dumping_)
+    return false;
+  this->dumping_ = true;
+  return true;
+}
+
+void FrameRing::end_dump() {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  this->dumping_ = false;
+}
+
+size_t FrameRing::get_length() const {
+  size_t length = 0;
+  for (size_t i = 0; i < this->count_; i++) {
+    length += this->entries_[(this->head_ + i) % this->entries_.size()].length;
+  }
+  return length;
+}
+
+bool FrameRing::get_frame(size_t index, const uint8_t **data, size_t *length) const {
+  if (index >= this->count_)
+    return false;
+
+  const Entry &entry = this->entries_[(this->head_ + index) % this->entries_.size()];
+  *data = this->buffer_ + entry.offset;
+  *length = entry.length;
+  return true;
+}
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// Recording of the last seconds of frames, copied into one preallocated
+// buffer (in PSRAM when available) so that the camera buffers are never
+// held. Frames are laid out one after another and wrap around at the end;
+// writing a frame evicts just as many of the oldest ones as needed, so
+// a push costs a copy of the frame and O(1) bookkeeping.
+//
+// A dump freezes the recording, frames captured meanwhile are not kept.
+class FrameRing {
+ public:
+  void set_duration(uint32_t duration) { this->duration_ = duration; }
+  void set_size(size_t size) { this->size_ = size; }
+  void set_max_framerate(float max_framerate) { this->frame_interval_ = max_framerate > 0 ? 1000 / max_framerate : 0; }
+  // Keeps the camera streaming for the recording alone. Otherwise only
+  // the frames captured for clients are recorded.
+  void set_continuous(bool continuous) { this->continuous_ = continuous; }
+
+  bool setup();
+  bool is_enabled() const { return this->buffer_ != nullptr; }
+
+  uint32_t get_duration() const { return this->duration_; }
+  size_t get_size() const { return this->size_; }
+  bool is_continuous() const { return this->continuous_; }
+
+  // Records a frame unless it came too early or a dump is running
+  void push(const uint8_t *data, size_t length, uint32_t time);
+
+  // Frames can only be read between begin_dump() and end_dump()
+  bool begin_dump();
+  void end_dump();
+  size_t get_count() const { return this->count_; }
+  size_t get_length() const;
+  bool get_frame(size_t index, const uint8_t **data, size_t *length) const;
+
+ protected:
+  struct Entry {
+    size_t offset;
+    size_t length;
+    uint32_t time;
+  };
+
+  Entry &oldest_() { return this->entries_[this->head_]; }
+  void evict_();
+
+  uint32_t duration_{0};
+  size_t size_{0};
+  uint32_t frame_interval_{0};
+  bool continuous_{false};
+
+  uint8_t *buffer_{nullptr};
+  size_t write_{0};
+  std::vector<Entry> entries_;
+  size_t head_{0};
+  size_t count_{0};
+  uint32_t last_time_{0};
+
+  std::mutex lock_;
+  bool dumping_{false};
+};
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
@@ -0,0 +1,226 @@
+#ifdef USE_ESP32
+
+#include "frame_scaler.h"
+#include "esphome/core/log.h"
+
+#include <esp_heap_caps.h>
+#include <img_converters.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+static const char *const TAG = "esp32_camera_stream";
+static const uint32_t SCALER_STACK_SIZE = 4096;
+
+bool parse_scale(const char *value, FrameScale *scale) {
+  if (strcmp(value, "1") == 0 || strcmp(value, "1/1") == 0) {
+    *scale = SCALE_1;
+  } else if (strcmp(value, "1/2") == 0) {
+    *scale = SCALE_1_2;
+  } else if (strcmp(value, "1/4") == 0) {
+    *scale = SCALE_1_4;
+  } else if (strcmp(value, "1/8") == 0) {
+    *scale = SCALE_1_8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool get_jpeg_size(const uint8_t *data, size_t length, uint16_t *width, uint16_t *height) {
+  if (length < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    return false;
+
+  // walk the segments up to the frame header
+  size_t pos = 2;
+  while (pos + 4 <= length) {
+    if (data[pos] != 0xFF)
+      return false;
+
+    uint8_t marker = data[pos + 1];
+    if (marker == 0xFF) {
+      pos++;
+      continue;
+    }
+
+    size_t segment = (data[pos + 2] << 8) | data[pos + 3];
+
+    // SOF0..SOF15, except DHT, JPG and DAC, which share the range
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+      if (pos + 9 > length)
+        return false;
+      *height = (data[pos + 5] << 8) | data[pos + 6];
+      *width = (data[pos + 7] << 8) | data[pos + 8];
+      return *width && *height;
+    }
+
+    // image data starts before any frame header was seen
+    if (marker == 0xDA)
+      return false;
+
+    pos += 2 + segment;
+  }
+  return false;
+}
+
+ScaledImage::~ScaledImage() { free(this->data); }
+
+bool FrameScaler::setup() {
+  this->stopped_ = xSemaphoreCreateBinary();
+  if (!this->stopped_) {
+    ESP_LOGE(TAG, "Scale: cannot create semaphore");
+    return false;
+  }
+
+  // same priority as the servers, thumbnails come after the live frames
+  if (xTaskCreate([](void *arg) { ((FrameScaler *) arg)->task_loop_(); }, "esp32_camera_scaler", SCALER_STACK_SIZE,
+                  this, 0, &this->task_) != pdPASS) {
+    ESP_LOGE(TAG, "Scale: cannot create task");
+    this->task_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void FrameScaler::stop() {
+  if (!this->task_)
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->stopping_ = true;
+  }
+  xTaskNotifyGive(this->task_);
+  xSemaphoreTake(this->stopped_, portMAX_DELAY);
+  this->task_ = nullptr;
+}
+
+void FrameScaler::task_loop_() {
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    for (int scale = SCALE_1_2; scale <= SCALE_1_8; scale++) {
+      Entry &entry = this->cache_[scale - 1];
+      std::shared_ptr<const Frame> frame;
+
+      {
+        std::lock_guard<std::mutex> guard(this->lock_);
+        if (this->stopping_)
+          break;
+        frame = std::move(entry.pending);
+        if (!frame)
+          continue;
+        entry.busy_id = frame->id;
+      }
+
+      // clients may ask for the same thumbnail meanwhile, they are
+      // told it is on its way instead of waiting for the lock
+      auto image = this->encode_(*frame, (FrameScale) scale);
+
+      {
+        std::lock_guard<std::mutex> guard(this->lock_);
+        entry.frame_id = frame->id;
+        entry.image = std::move(image);
+        entry.busy_id = 0;
+      }
+
+      for (auto &listener : this->listeners_) {
+        listener();
+      }
+    }
+
+    std::lock_guard<std::mutex> guard(this->lock_);
+    if (this->stopping_)
+      break;
+  }
+
+  xSemaphoreGive(this->stopped_);
+  vTaskDelete(nullptr);
+}
+
+std::shared_ptr<const ScaledImage> FrameScaler::scale(const std::shared_ptr<const Frame> &frame, FrameScale scale) {
+  if (!frame || scale == SCALE_1)
+    return nullptr;
+
+  // scaling is done under the lock, concurrent requests
+  // for the same thumbnail wait for it instead of repeating it
+  std::lock_guard<std::mutex> guard(this->lock_);
+
+  // a frame that failed to scale is not tried again
+  Entry &entry = this->cache_[scale - 1];
+  if (entry.frame_id == frame->id)
+    return entry.image;
+
+  entry.image = this->encode_(*frame, scale);
+  entry.frame_id = frame->id;
+  return entry.image;
+}
+
+bool FrameScaler::scale_async(const std::shared_ptr<const Frame> &frame, FrameScale scale,
+                              std::shared_ptr<const ScaledImage> *image) {
+  if (!frame || scale == SCALE_1 || !this->task_) {
+    *image = this->scale(frame, scale);
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    Entry &entry = this->cache_[scale - 1];
+    if (entry.frame_id == frame->id) {
+      *image = entry.image;
+      return true;
+    }
+    if (entry.busy_id == frame->id)
+      return false;
+    entry.pending = frame;
+  }
+
+  xTaskNotifyGive(this->task_);
+  return false;
+}
+
+std::shared_ptr<const ScaledImage> FrameScaler::encode_(const Frame &frame, FrameScale scale) {
+  uint16_t width, height;
+  if (!get_jpeg_size(frame.get_data(), frame.get_length(), &width, &height)) {
+    ESP_LOGW(TAG, "Scale: not a JPEG frame");
+    return nullptr;
+  }
+
+  // same rounding as the decoder, camera resolutions divide evenly anyway
+  uint16_t scaled_width = width >> scale;
+  uint16_t scaled_height = height >> scale;
+  if (!scaled_width || !scaled_height)
+    return nullptr;
+  size_t rgb_length = (size_t) scaled_width * scaled_height * 2;
+
+  uint8_t *rgb = (uint8_t *) heap_caps_malloc(rgb_length, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!rgb)
+    rgb = (uint8_t *) heap_caps_malloc(rgb_length, MALLOC_CAP_8BIT);
+  if (!rgb) {
+    ESP_LOGW(TAG, "Scale: failed to allocate %u bytes", (unsigned) rgb_length);
+    return nullptr;
+  }
+
+  auto image = std::make_shared<ScaledImage>();
+  bool ok = jpg2rgb565(frame.get_data(), frame.get_length(), rgb, (jpg_scale_t) scale) &&
+            fmt2jpg(rgb, rgb_length, scaled_width, scaled_height, PIXFORMAT_RGB565, this->quality_, &image->data,
+                    &image->length);
+  free(rgb);
+
+  if (!ok) {
+    ESP_LOGW(TAG, "Scale: failed to scale %ux%u frame by 1/%u", width, height, 1u << scale);
+    return nullptr;
+  }
+
+  ESP_LOGD(TAG, "Scale: %ux%u %uB to %ux%u %uB", width, height, (unsigned) frame.get_length(), scaled_width,
+           scaled_height, (unsigned) image->length);
+  return image;
+}
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
+
+#endif  // USE_ESP32
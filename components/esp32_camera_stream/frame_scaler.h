@@ -0,0 +1,94 @@
+#pragma once
+
+#ifdef USE_ESP32
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "frame_source.h"
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// Downscale factors, as powers of two
+enum FrameScale : uint8_t { SCALE_1 = 0, SCALE_1_2 = 1, SCALE_1_4 = 2, SCALE_1_8 = 3 };
+
+// Parses "1", "1/2", "1/4" or "1/8"
+bool parse_scale(const char *value, FrameScale *scale);
+
+// Reads the dimensions from the frame header of a JPEG
+bool get_jpeg_size(const uint8_t *data, size_t length, uint16_t *width, uint16_t *height);
+
+// A downscaled copy of a frame, encoded as JPEG
+struct ScaledImage {
+  uint8_t *data{nullptr};
+  size_t length{0};
+
+  ScaledImage() = default;
+  ScaledImage(const ScaledImage &) = delete;
+  ScaledImage &operator=(const ScaledImage &) = delete;
+  ~ScaledImage();
+};
+
+// Produces thumbnails of the captured frames. The frame is decoded at the
+// reduced size straight away (at 1/8 only the DC coefficient of every block
+// is used, no inverse DCT is run), so that only the small image has to be
+// encoded again. The result is kept per scale until the next frame, since
+// dashboards tend to poll the same thumbnail from several clients.
+//
+// Servers handling all clients from one task can't afford to block on
+// the encoding, they use scale_async() instead, which hands the frame over
+// to a task of the scaler and calls the listeners once it is done.
+class FrameScaler {
+ public:
+  void set_quality(uint8_t quality) { this->quality_ = quality; }
+
+  // Starts the task for scale_async()
+  bool setup();
+  // Waits for the task to finish the thumbnail in progress
+  void stop();
+
+  // Called from the scaler task for every finished thumbnail
+  void add_listener(std::function<void()> &&listener) { this->listeners_.push_back(std::move(listener)); }
+
+  // Returns nullptr if the frame can't be scaled
+  std::shared_ptr<const ScaledImage> scale(const std::shared_ptr<const Frame> &frame, FrameScale scale);
+  // Returns true with the result of scale() once the thumbnail of the
+  // frame is done, otherwise queues it for the task and returns false
+  bool scale_async(const std::shared_ptr<const Frame> &frame, FrameScale scale,
+                   std::shared_ptr<const ScaledImage> *image);
+
+ protected:
+  struct Entry {
+    // frame the image belongs to, the image is nullptr if it failed
+    uint32_t frame_id{0};
+    std::shared_ptr<const ScaledImage> image;
+    // latest frame waiting for the task, and the one being scaled
+    std::shared_ptr<const Frame> pending;
+    uint32_t busy_id{0};
+  };
+
+  std::shared_ptr<const ScaledImage> encode_(const Frame &frame, FrameScale scale);
+  void task_loop_();
+
+  uint8_t quality_{80};
+  std::mutex lock_;
+  Entry cache_[SCALE_1_8];
+  TaskHandle_t task_{nullptr};
+  SemaphoreHandle_t stopped_{nullptr};
+  bool stopping_{false};
+  std::vector<std::function<void()>> listeners_;
+};
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
+
+#endif  // USE_ESP32
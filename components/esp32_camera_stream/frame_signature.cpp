@@ -0,0 +1,90 @@
+#include "frame_signature.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+static const uint8_t MARKER = 0xFF;
+static const uint8_t MARKER_SOI = 0xD8;
+static const uint8_t MARKER_SOS = 0xDA;
+static const uint8_t MARKER_EOI = 0xD9;
+static const uint8_t MARKER_RST0 = 0xD0;
+static const uint8_t MARKER_RST7 = 0xD7;
+
+void FrameSignature::compute(const uint8_t *data, size_t length) {
+  this->count = 0;
+  this->total = 0;
+  memset(this->buckets, 0, sizeof(this->buckets));
+
+  if (length < 4 || data[0] != MARKER || data[1] != MARKER_SOI)
+    return;
+
+  // skip the segments in front of the scan
+  size_t pos = 2;
+  while (true) {
+    if (pos + 4 > length || data[pos] != MARKER)
+      return;
+    uint8_t marker = data[pos + 1];
+    pos += 2 + (data[pos + 2] << 8 | data[pos + 3]);
+    if (marker == MARKER_SOS)
+      break;
+  }
+
+  const uint8_t *start = data + std::min(pos, length);
+  const uint8_t *end = data + length;
+  uint32_t intervals = 0;
+  uint32_t per_bucket = 1;
+
+  auto add_interval = [&](uint32_t size) {
+    uint32_t bucket = intervals++ / per_bucket;
+    // out of buckets, halve the resolution
+    if (bucket == MAX_BUCKETS) {
+      for (int i = 0; i < MAX_BUCKETS / 2; i++)
+        this->buckets[i] = this->buckets[2 * i] + this->buckets[2 * i + 1];
+      memset(this->buckets + MAX_BUCKETS / 2, 0, sizeof(this->buckets) / 2);
+      per_bucket *= 2;
+      bucket /= 2;
+    }
+    this->buckets[bucket] += size;
+    this->count = bucket + 1;
+    this->total += size;
+  };
+
+  // entropy coded data, 0xFF is followed by 0x00 unless it starts a marker
+  const uint8_t *ptr = start;
+  while (ptr < end) {
+    ptr = (const uint8_t *) memchr(ptr, MARKER, end - ptr);
+    if (!ptr || ptr + 1 >= end)
+      break;
+
+    uint8_t marker = ptr[1];
+    if ((marker >= MARKER_RST0 && marker <= MARKER_RST7) || marker == MARKER_EOI) {
+      add_interval(ptr - start);
+      start = ptr + 2;
+      if (marker == MARKER_EOI)
+        return;
+    }
+    ptr += 2;
+  }
+
+  // truncated image
+  add_interval(end - start);
+}
+
+float FrameSignature::difference(const FrameSignature &other) const {
+  if (this->count != other.count || !this->total || !other.total)
+    return 1.0f;
+
+  uint32_t diff = 0;
+  for (int i = 0; i < this->count; i++) {
+    diff += abs((int32_t) this->buckets[i] - (int32_t) other.buckets[i]);
+  }
+
+  return (float) diff / (this->total > other.total ? this->total : other.total);
+}
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// Coarse signature of a JPEG without decoding it: the compressed sizes
+// of its restart intervals folded into a few buckets, or just the size
+// of the scan for images without restart markers. Moving content changes
+// how many bits its part of the image takes, sensor noise barely does.
+struct FrameSignature {
+  static const int MAX_BUCKETS = 32;
+
+  uint32_t buckets[MAX_BUCKETS];
+  uint8_t count{0};
+  uint32_t total{0};
+
+  void compute(const uint8_t *data, size_t length);
+  // Share of the compressed size that differs between the two, 0 to 1
+  float difference(const FrameSignature &other) const;
+};
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
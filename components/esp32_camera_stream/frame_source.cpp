@@ -0,0 +1,133 @@
+#ifdef USE_ESP32
+
+#include "frame_source.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+#include <chrono>
+#include <utility>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+static const char *const TAG = "esp32_camera_stream";
+
+void FrameSource::setup() {
+  esp32_camera::global_esp32_camera->add_image_callback([this](std::shared_ptr<esp32_camera::CameraImage> image) {
+    if (image->was_requested_by(esp32_camera::WEB_REQUESTER)) {
+      this->push(std::move(image));
+    }
+  });
+
+  // servers always pass their ring, it is only used when configured
+  if (this->recording_ != nullptr && this->recording_->get_size()) {
+    if (!this->recording_->setup()) {
+      ESP_LOGE(TAG, "Cannot allocate %u bytes for recording", (unsigned) this->recording_->get_size());
+      this->recording_ = nullptr;
+    } else if (this->recording_->is_continuous()) {
+      // The camera then captures and encodes at its full frame rate
+      // with nobody watching, which costs as much CPU and power as a stream
+      this->acquire(true);
+    }
+  } else {
+    this->recording_ = nullptr;
+  }
+}
+
+void FrameSource::acquire(bool stream) {
+  bool start;
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->clients_++;
+    start = stream && this->streams_++ == 0;
+  }
+
+  if (start && esp32_camera::global_esp32_camera != nullptr) {
+    esp32_camera::global_esp32_camera->start_stream(esp32_camera::WEB_REQUESTER);
+  }
+}
+
+void FrameSource::release(bool stream) {
+  std::shared_ptr<const Frame> frame;
+  bool stop;
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    stop = stream && --this->streams_ == 0;
+    // do not hold on to a camera buffer while nobody is watching
+    if (--this->clients_ == 0)
+      frame.swap(this->frame_);
+  }
+
+  if (stop && esp32_camera::global_esp32_camera != nullptr) {
+    esp32_camera::global_esp32_camera->stop_stream(esp32_camera::WEB_REQUESTER);
+  }
+}
+
+void FrameSource::request_image() {
+  if (esp32_camera::global_esp32_camera != nullptr) {
+    esp32_camera::global_esp32_camera->request_image(esp32_camera::WEB_REQUESTER);
+  }
+}
+
+void FrameSource::push(std::shared_ptr<esp32_camera::CameraImage> image) {
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    if (!this->clients_)
+      return;
+  }
+
+  // fingerprinting happens once per frame, not once per client
+  auto frame = std::make_shared<Frame>();
+  frame->time = millis();
+  if (this->change_detection_)
+    frame->signature.compute(image->get_data_buffer(), image->get_data_length());
+  frame->image = std::move(image);
+
+  // the previous frame is released outside of the lock
+  std::shared_ptr<const Frame> previous;
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    // everybody might have left in the meantime
+    if (!this->clients_)
+      return;
+
+    frame->id = ++this->frame_id_;
+    previous = std::move(this->frame_);
+    this->frame_ = frame;
+  }
+
+  this->cond_.notify_all();
+
+  for (auto &listener : this->listeners_) {
+    listener();
+  }
+
+  // copied only after the live clients got the frame
+  if (this->recording_ != nullptr) {
+    this->recording_->push(frame->get_data(), frame->get_length(), frame->time);
+  }
+}
+
+std::shared_ptr<const Frame> FrameSource::get_frame() {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  return this->frame_;
+}
+
+std::shared_ptr<const Frame> FrameSource::wait_for_frame(uint32_t after_id, uint32_t timeout) {
+  std::unique_lock<std::mutex> guard(this->lock_);
+
+  this->cond_.wait_for(guard, std::chrono::milliseconds(timeout),
+                       [this, after_id]() { return this->frame_ && this->frame_->id != after_id; });
+
+  if (this->frame_ && this->frame_->id != after_id)
+    return this->frame_;
+  return nullptr;
+}
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
+
+#endif  // USE_ESP32
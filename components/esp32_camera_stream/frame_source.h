@@ -0,0 +1,72 @@
+#pragma once
+
+#ifdef USE_ESP32
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "esphome/components/esp32_camera/esp32_camera.h"
+#include "frame_ring.h"
+#include "frame_signature.h"
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// How long a client waits for a frame before giving up
+static const uint32_t FRAME_TIMEOUT = 5000;
+
+// A captured frame together with its sequence number and arrival time
+struct Frame {
+  std::shared_ptr<esp32_camera::CameraImage> image;
+  uint32_t id;
+  uint32_t time;
+  // only computed with change detection enabled
+  FrameSignature signature;
+
+  const uint8_t *get_data() const { return this->image->get_data_buffer(); }
+  size_t get_length() const { return this->image->get_data_length(); }
+};
+
+// Publishes the latest frame captured for web clients to any number of
+// readers. Frames are only kept while at least one client is registered,
+// and the camera streams while at least one of them is a stream.
+class FrameSource {
+ public:
+  void setup();
+  void set_change_detection(bool change_detection) { this->change_detection_ = change_detection; }
+  // Records the published frames into the ring, if one was configured
+  void set_recording(FrameRing *recording) { this->recording_ = recording; }
+
+  // Called from the main loop for every published frame
+  void add_listener(std::function<void()> &&listener) { this->listeners_.push_back(std::move(listener)); }
+
+  void acquire(bool stream);
+  void release(bool stream);
+  void request_image();
+
+  // Publishes a frame, exposed for synthetic frame sources
+  void push(std::shared_ptr<esp32_camera::CameraImage> image);
+
+  std::shared_ptr<const Frame> get_frame();
+  // Waits for a frame other than after_id, returns nullptr on timeout
+  std::shared_ptr<const Frame> wait_for_frame(uint32_t after_id, uint32_t timeout);
+
+ protected:
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::shared_ptr<const Frame> frame_;
+  uint32_t frame_id_{0};
+  uint32_t clients_{0};
+  uint32_t streams_{0};
+  bool change_detection_{false};
+  FrameRing *recording_{nullptr};
+  std::vector<std::function<void()>> listeners_;
+};
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
+
+#endif  // USE_ESP32
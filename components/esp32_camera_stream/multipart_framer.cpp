@@ -0,0 +1,106 @@
+#include "multipart_framer.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+#define PART_BOUNDARY "123456789000000000000987654321"
+#define CONTENT_TYPE "image/jpeg"
+#define CONTENT_LENGTH "Content-Length"
+
+static const char *const STREAM_HEADER = "HTTP/1.0 200 OK\r\n"
+                                         "Access-Control-Allow-Origin: *\r\n"
+                                         "Connection: close\r\n"
+                                         "Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
+                                         "\r\n"
+                                         "--" PART_BOUNDARY "\r\n";
+static const char *const SINGLE_HEADER = "HTTP/1.0 200 OK\r\n"
+                                         "Access-Control-Allow-Origin: *\r\n"
+                                         "Connection: close\r\n"
+                                         "Content-Type: " CONTENT_TYPE "\r\n"
+                                         "Content-Disposition: inline; filename=capture.jpg\r\n"
+                                         CONTENT_LENGTH ": %u\r\n"
+                                         "\r\n";
+static const char *const FILE_HEADER = "HTTP/1.0 200 OK\r\n"
+                                       "Access-Control-Allow-Origin: *\r\n"
+                                       "Connection: close\r\n"
+                                       "Content-Type: video/x-motion-jpeg\r\n"
+                                       "Content-Disposition: attachment; filename=recording.mjpeg\r\n"
+                                       CONTENT_LENGTH ": %u\r\n"
+                                       "\r\n";
+static const char *const STREAM_PART = "Content-Type: " CONTENT_TYPE "\r\n" CONTENT_LENGTH ": %u\r\n\r\n";
+static const char *const STREAM_BOUNDARY = "\r\n"
+                                           "--" PART_BOUNDARY "\r\n";
+
+void MultipartFramer::begin_part(const uint8_t *data, size_t length) {
+  int len = 0;
+
+  if (!this->parts_) {
+    len = snprintf(this->head_, sizeof(this->head_), "%s", STREAM_HEADER);
+  }
+  len += snprintf(this->head_ + len, sizeof(this->head_) - len, STREAM_PART, (unsigned) length);
+
+  this->head_len_ = len;
+  this->data_ = data;
+  this->length_ = length;
+  this->tail_ = STREAM_BOUNDARY;
+  this->tail_len_ = strlen(STREAM_BOUNDARY);
+  this->sent_ = 0;
+  this->parts_++;
+}
+
+void MultipartFramer::begin_single(const uint8_t *data, size_t length) {
+  this->head_len_ = snprintf(this->head_, sizeof(this->head_), SINGLE_HEADER, (unsigned) length);
+  this->data_ = data;
+  this->length_ = length;
+  this->tail_ = nullptr;
+  this->tail_len_ = 0;
+  this->sent_ = 0;
+  this->parts_++;
+}
+
+void MultipartFramer::begin_file(size_t length) {
+  this->head_len_ = snprintf(this->head_, sizeof(this->head_), FILE_HEADER, (unsigned) length);
+  this->data_ = nullptr;
+  this->length_ = 0;
+  this->tail_ = nullptr;
+  this->tail_len_ = 0;
+  this->sent_ = 0;
+}
+
+void MultipartFramer::begin_data(const uint8_t *data, size_t length) {
+  this->head_len_ = 0;
+  this->data_ = data;
+  this->length_ = length;
+  this->tail_ = nullptr;
+  this->tail_len_ = 0;
+  this->sent_ = 0;
+  this->parts_++;
+}
+
+size_t MultipartFramer::get_total_() const { return this->head_len_ + this->length_ + this->tail_len_; }
+
+int MultipartFramer::get_iov(struct iovec *iov) const {
+  const void *bufs[MAX_IOV] = {this->head_, this->data_, this->tail_};
+  size_t lens[MAX_IOV] = {this->head_len_, this->length_, this->tail_len_};
+  size_t skip = this->sent_;
+  int iovcnt = 0;
+
+  for (int i = 0; i < MAX_IOV; i++) {
+    if (skip >= lens[i]) {
+      skip -= lens[i];
+      continue;
+    }
+    iov[iovcnt].iov_base = (uint8_t *) bufs[i] + skip;
+    iov[iovcnt].iov_len = lens[i] - skip;
+    iovcnt++;
+    skip = 0;
+  }
+
+  return iovcnt;
+}
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// Lays out MJPEG responses as up to three buffers: headers, the JPEG
+// straight from the frame buffer and the trailer, to be written with
+// a single gather call. Only offsets are stored, so a framer can be
+// moved around while a frame is partially sent.
+class MultipartFramer {
+ public:
+  static const int MAX_IOV = 3;
+
+  // Queues the next part of a multipart/x-mixed-replace stream, the
+  // response head goes in front of the first one. Every part ends with
+  // the boundary, so clients can show it without waiting for the next.
+  void begin_part(const uint8_t *data, size_t length);
+  // Queues a complete single image response
+  void begin_single(const uint8_t *data, size_t length);
+  // Queues the response head of a concatenated MJPEG file of the given
+  // length, its frames follow with begin_data()
+  void begin_file(size_t length);
+  void begin_data(const uint8_t *data, size_t length);
+
+  // Fills iov with the data still to be sent, returns the iov count
+  int get_iov(struct iovec *iov) const;
+  void consume(size_t len) { this->sent_ += len; }
+  bool is_done() const { return this->sent_ >= this->get_total_(); }
+
+  uint32_t get_parts() const { return this->parts_; }
+
+ protected:
+  size_t get_total_() const;
+
+  char head_[256];
+  size_t head_len_{0};
+  const uint8_t *data_{nullptr};
+  size_t length_{0};
+  const char *tail_{nullptr};
+  size_t tail_len_{0};
+  size_t sent_{0};
+  uint32_t parts_{0};
+};
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
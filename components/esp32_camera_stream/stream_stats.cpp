@@ -0,0 +1,19 @@
+#include "stream_stats.h"
+
+#include <cstdio>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+size_t StreamStats::to_json(char *buf, size_t size) const {
+  int len = snprintf(buf, size,
+                     "{\"clients\":%u,\"connections\":%u,\"frames\":%u,\"dropped\":%u,\"late\":%u,"
+                     "\"skipped\":%u,\"bytes\":%llu}",
+                     (unsigned) this->clients, (unsigned) this->connections, (unsigned) this->frames_sent,
+                     (unsigned) this->frames_dropped, (unsigned) this->frames_late, (unsigned) this->frames_skipped,
+                     (unsigned long long) this->bytes_sent);
+  return len < 0 ? 0 : len;
+}
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
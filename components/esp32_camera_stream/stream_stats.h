@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace esp32_camera_stream {
+
+// Counters shared by all clients of a server, updated from any task
+struct StreamStats {
+  std::atomic<uint32_t> clients{0};
+  std::atomic<uint32_t> connections{0};
+  std::atomic<uint32_t> frames_sent{0};
+  std::atomic<uint32_t> frames_dropped{0};
+  std::atomic<uint32_t> frames_late{0};
+  std::atomic<uint32_t> frames_skipped{0};
+  std::atomic<uint64_t> bytes_sent{0};
+
+  size_t to_json(char *buf, size_t size) const;
+};
+
+}  // namespace esp32_camera_stream
+}  // namespace esphome
@@ -1,11 +1,15 @@
 import esphome.config_validation as cv
 import esphome.codegen as cg
 from esphome.const import CONF_ID, CONF_PORT, CONF_MODE
+from esphome.components import esp32_camera_stream
 
 CODEOWNERS = ["@ayufan"]
 DEPENDENCIES = ["esp32_camera"]
+AUTO_LOAD = ["esp32_camera_stream"]
 MULTI_CONF = True
 
+CONF_MAX_CLIENTS = "max_clients"
+
 esp32_camera_web_server_ns = cg.esphome_ns.namespace("esp32_camera_web_server")
 CameraWebServer = esp32_camera_web_server_ns.class_("CameraWebServer", cg.Component)
 Mode = esp32_camera_web_server_ns.enum("Mode")
@@ -17,12 +21,15 @@ CONFIG_SCHEMA = cv.Schema(
         cv.GenerateID(): cv.declare_id(CameraWebServer),
         cv.Required(CONF_PORT): cv.port,
         cv.Required(CONF_MODE): cv.enum(MODES, upper=True),
+        cv.Optional(CONF_MAX_CLIENTS, default=2): cv.int_range(min=1, max=8),
     },
-).extend(cv.COMPONENT_SCHEMA)
+).extend(esp32_camera_stream.STREAM_SCHEMA).extend(cv.COMPONENT_SCHEMA)
 
 
 async def to_code(config):
     server = cg.new_Pvariable(config[CONF_ID])
     cg.add(server.set_port(config[CONF_PORT]))
     cg.add(server.set_mode(config[CONF_MODE]))
+    cg.add(server.set_max_clients(config[CONF_MAX_CLIENTS]))
+    await esp32_camera_stream.stream_to_code(server, config)
     await cg.register_component(server, config)
@@ -7,37 +7,31 @@
 #include "esphome/core/log.h"
 #include "esphome/core/util.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <esp_http_server.h>
+#include <lwip/sockets.h>
 #include <utility>
 
 namespace esphome {
 namespace esp32_camera_web_server {
 
-static const int IMAGE_REQUEST_TIMEOUT = 5000;
+static const int REQUEST_TIMEOUT = 3000;
+static const int SEND_TIMEOUT = 5000;
+static const int LISTEN_BACKLOG = 2;
+static const int ACCEPT_RETRY_DELAY = 100;
 static const char *const TAG = "esp32_camera_web_server";
 
-#define PART_BOUNDARY "123456789000000000000987654321"
-#define CONTENT_TYPE "image/jpeg"
-#define CONTENT_LENGTH "Content-Length"
-
-static const char *const STREAM_HEADER = "HTTP/1.0 200 OK\r\n"
-                                         "Access-Control-Allow-Origin: *\r\n"
-                                         "Connection: close\r\n"
-                                         "Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
-                                         "\r\n"
-                                         "--" PART_BOUNDARY "\r\n";
-static const char *const SNAPSHOT_HEADER = "HTTP/1.0 200 OK\r\n"
-                                         "Access-Control-Allow-Origin: *\r\n"
-                                         "Connection: close\r\n"
-                                         "Content-Type: " CONTENT_TYPE "\r\n"
-                                         "Content-Disposition: inline; filename=capture.jpg\r\n"
-                                         "\r\n";
+static const char *const STATS_HEADER = "HTTP/1.0 200 OK\r\n"
+                                        "Access-Control-Allow-Origin: *\r\n"
+                                        "Connection: close\r\n"
+                                        "Content-Type: application/json\r\n"
+                                        "\r\n";
+static const char *const BAD_REQUEST_ERROR = "HTTP/1.0 400 Bad Request\r\n\r\n";
 static const char *const NOT_FOUND_ERROR = "HTTP/1.0 404 Not Found\r\n\r\n";
+static const char *const METHOD_NOT_ALLOWED_ERROR = "HTTP/1.0 405 Method Not Allowed\r\n\r\n";
 static const char *const SERVICE_UNAVAILABLE = "HTTP/1.0 503 Service Unavailable\r\n\r\n";
-static const char *const STREAM_PART = "Content-Type: " CONTENT_TYPE "\r\n" CONTENT_LENGTH ": %u\r\n\r\n";
-static const char *const STREAM_BOUNDARY = "\r\n"
-                                           "--" PART_BOUNDARY "\r\n";
 
 CameraWebServer::CameraWebServer() {}
 
@@ -49,16 +43,15 @@ void CameraWebServer::setup() {
     return;
   }
 
-  this->server_.begin(this->port_);
-  this->server_.setTimeout(3);
-
-  if (!this->server_) {
+  // thumbnails are encoded by the scaler task, not by the server loop
+  this->scaler_.add_listener([this]() { this->wakeup_(); });
+  if (!this->listen_() || !this->create_wakeup_() || !this->scaler_.setup()) {
     this->mark_failed();
     return;
   }
 
-  this->semaphore_ = xSemaphoreCreateBinary();
-  
+  this->clients_.reserve(this->max_clients_);
+
   xTaskCreateUniversal(
     [](void *handle) {
       ((CameraWebServer*)handle)->server_loop_();
@@ -71,25 +64,85 @@ void CameraWebServer::setup() {
     CONFIG_ARDUINO_RUNNING_CORE
   );
 
-  esp32_camera::global_esp32_camera->add_image_callback([this](std::shared_ptr<esp32_camera::CameraImage> image) {
-    if (this->client_ && image->was_requested_by(esp32_camera::WEB_REQUESTER)) {
-      this->image_ = std::move(image);
-      xSemaphoreGive(this->semaphore_);
-    }
-  });
+  this->frames_.add_listener([this]() { this->wakeup_(); });
+  this->frames_.set_change_detection(this->pacer_.get_change_threshold() > 0);
+  this->frames_.set_recording(&this->recording_);
+  this->frames_.setup();
+}
+
+bool CameraWebServer::listen_() {
+  this->listen_fd_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (this->listen_fd_ < 0) {
+    ESP_LOGE(TAG, "Cannot create socket: %d", errno);
+    return false;
+  }
+
+  int enable = 1;
+  setsockopt(this->listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(this->port_);
+
+  if (bind(this->listen_fd_, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(this->listen_fd_, LISTEN_BACKLOG) < 0) {
+    ESP_LOGE(TAG, "Cannot listen on %d: %d", this->port_, errno);
+    close(this->listen_fd_);
+    this->listen_fd_ = -1;
+    return false;
+  }
+
+  return true;
+}
+
+bool CameraWebServer::create_wakeup_() {
+  // The image callback runs in the main loop and wakes up select()
+  // by sending a byte over a loopback UDP socket connected to itself
+  this->wakeup_fd_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (this->wakeup_fd_ < 0) {
+    ESP_LOGE(TAG, "Cannot create wakeup socket: %d", errno);
+    return false;
+  }
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(this->port_);
+
+  if (bind(this->wakeup_fd_, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      connect(this->wakeup_fd_, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    ESP_LOGE(TAG, "Cannot bind wakeup socket: %d", errno);
+    close(this->wakeup_fd_);
+    this->wakeup_fd_ = -1;
+    return false;
+  }
+
+  return true;
+}
+
+void CameraWebServer::wakeup_() {
+  uint8_t msg = 0;
+  send(this->wakeup_fd_, &msg, sizeof(msg), MSG_DONTWAIT);
 }
 
 void CameraWebServer::on_shutdown() {
-  this->image_ = nullptr;
-  this->client_.stop();
-  this->server_.stop();
   if (this->task_) {
     vTaskDelete(this->task_);
     this->task_ = nullptr;
   }
-  if (this->semaphore_) {
-    vSemaphoreDelete(this->semaphore_);
-    this->semaphore_ = nullptr;
+  this->scaler_.stop();
+  for (auto &client : this->clients_) {
+    this->close_(client);
+  }
+  this->clients_.clear();
+  if (this->listen_fd_ >= 0) {
+    close(this->listen_fd_);
+    this->listen_fd_ = -1;
+  }
+  if (this->wakeup_fd_ >= 0) {
+    close(this->wakeup_fd_);
+    this->wakeup_fd_ = -1;
   }
 }
 
@@ -100,6 +153,19 @@ void CameraWebServer::dump_config() {
     ESP_LOGCONFIG(TAG, "  Mode: stream");
   else
     ESP_LOGCONFIG(TAG, "  Mode: snapshot");
+  ESP_LOGCONFIG(TAG, "  Max clients: %d", this->max_clients_);
+  if (this->pacer_.get_frame_interval())
+    ESP_LOGCONFIG(TAG, "  Max framerate: %.1f fps", 1000.0 / this->pacer_.get_frame_interval());
+  if (this->pacer_.get_max_frame_age())
+    ESP_LOGCONFIG(TAG, "  Max frame age: %u ms", this->pacer_.get_max_frame_age());
+  if (this->pacer_.get_change_threshold() > 0)
+    ESP_LOGCONFIG(TAG, "  Skip unchanged: below %.1f%%, keep alive %u ms", this->pacer_.get_change_threshold() * 100,
+                  this->pacer_.get_keep_alive());
+  if (this->recording_.get_size())
+    ESP_LOGCONFIG(TAG, "  Recording: %u ms in %u bytes%s%s", this->recording_.get_duration(),
+                  (unsigned) this->recording_.get_size(), this->recording_.is_continuous() ? ", continuous" : "",
+                  this->recording_.is_enabled() ? "" : " (failed)");
+  ESP_LOGCONFIG(TAG, "  Paths: /, /stream, /snapshot, /stats, /recording");
 
   if (this->is_failed()) {
     ESP_LOGE(TAG, "  Setup Failed");
@@ -108,141 +174,417 @@ void CameraWebServer::dump_config() {
 
 float CameraWebServer::get_setup_priority() const { return setup_priority::LATE; }
 
-std::shared_ptr<esphome::esp32_camera::CameraImage> CameraWebServer::wait_for_image_() {
-  std::shared_ptr<esphome::esp32_camera::CameraImage> image;
-  image.swap(this->image_);
+void CameraWebServer::server_loop_() {
+  // This implements a minimalistic web server serving all clients
+  // from a single task: each client is a small state machine advanced
+  // when its socket becomes ready, a new frame arrives or its deadline passes
+  while (this->listen_fd_ >= 0) {
+    fd_set read_set, write_set;
+    FD_ZERO(&read_set);
+    FD_ZERO(&write_set);
+
+    FD_SET(this->wakeup_fd_, &read_set);
+    int max_fd = this->wakeup_fd_;
+
+    // keep further connections in the backlog while all slots are taken
+    if (this->clients_.size() < this->max_clients_) {
+      FD_SET(this->listen_fd_, &read_set);
+      max_fd = std::max(max_fd, this->listen_fd_);
+    }
 
-  if (!image) {
-    // retry as we might still be fetching image
-    xSemaphoreTake(this->semaphore_, IMAGE_REQUEST_TIMEOUT / portTICK_PERIOD_MS);
-    image.swap(this->image_);
-  }
+    uint32_t now = millis();
+    int32_t timeout = -1;
+
+    for (auto &client : this->clients_) {
+      if (client.state == CLIENT_REQUEST) {
+        FD_SET(client.fd, &read_set);
+      } else if (client.state == CLIENT_SEND_FRAME || client.state == CLIENT_SEND_RECORDING) {
+        FD_SET(client.fd, &write_set);
+      }
+      max_fd = std::max(max_fd, client.fd);
+
+      int32_t left = std::max<int32_t>(client.deadline - now, 0);
+      // a paced client also has to wake up for its next slot
+      if (client.state == CLIENT_WAIT_FRAME && client.pacer.time_to_next(now))
+        left = std::min<int32_t>(left, client.pacer.time_to_next(now));
+      if (timeout < 0 || left < timeout)
+        timeout = left;
+    }
 
-  return image;
-}
+    struct timeval tv = {};
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
 
-void CameraWebServer::server_loop_() {
-  // This implements a very minimalistic a single-request web server
-  while (this->server_) {
-    yield();
-
-    if (!this->server_.hasClient()) {
+    // sleeps in lwIP until there is something to do
+    if (select(max_fd + 1, &read_set, &write_set, nullptr, timeout >= 0 ? &tv : nullptr) < 0) {
+      ESP_LOGW(TAG, "Select failed: %d", errno);
+      vTaskDelay(ACCEPT_RETRY_DELAY / portTICK_PERIOD_MS);
       continue;
     }
 
-    this->client_ = this->server_.available();
-    this->handler_();
-    this->client_.stop();
-    this->image_ = nullptr;
+    if (FD_ISSET(this->wakeup_fd_, &read_set)) {
+      uint8_t buf[8];
+      while (recv(this->wakeup_fd_, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+      }
+    }
+
+    for (auto &client : this->clients_) {
+      this->process_(client, FD_ISSET(client.fd, &read_set), FD_ISSET(client.fd, &write_set));
+    }
+
+    this->clients_.erase(std::remove_if(this->clients_.begin(), this->clients_.end(),
+                                        [](const Client &client) { return client.state == CLIENT_CLOSED; }),
+                         this->clients_.end());
+
+    if (FD_ISSET(this->listen_fd_, &read_set)) {
+      this->accept_();
+    }
   }
 }
 
-void CameraWebServer::handler_() {
-  if (!this->check_headers_()) {
+void CameraWebServer::accept_() {
+  int fd = accept(this->listen_fd_, nullptr, nullptr);
+  if (fd < 0) {
+    ESP_LOGW(TAG, "Accept failed: %d", errno);
     return;
   }
 
-  switch (this->mode_) {
-    case STREAM:
-      this->streaming_handler_();
+  // Frames are written in one go, so Nagle would only hold back
+  // the last segment of each frame until the previous one is acked
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+  Client client;
+  client.fd = fd;
+  client.state = CLIENT_REQUEST;
+  client.mode = this->mode_;
+  client.deadline = millis() + REQUEST_TIMEOUT;
+  this->clients_.push_back(std::move(client));
+  this->stats_.connections++;
+}
+
+void CameraWebServer::process_(Client &client, bool readable, bool writable) {
+  if (client.state == CLIENT_REQUEST && readable) {
+    this->read_request_(client);
+  }
+
+  if (client.state == CLIENT_WAIT_FRAME) {
+    this->prepare_frame_(client);
+  }
+
+  if (client.state == CLIENT_WAIT_SCALE) {
+    this->prepare_scaled_(client);
+  }
+
+  // sends never block, a stalled client just gets EAGAIN
+  if (client.state == CLIENT_SEND_FRAME) {
+    this->send_frame_(client);
+  }
+
+  if (client.state == CLIENT_SEND_RECORDING && writable) {
+    this->send_recording_(client);
+  }
+
+  if (client.state == CLIENT_CLOSED || (int32_t) (millis() - client.deadline) < 0) {
+    return;
+  }
+
+  switch (client.state) {
+    case CLIENT_WAIT_FRAME:
+      if (!client.frames) {
+        this->send_all_(client, SERVICE_UNAVAILABLE);
+      }
+      this->close_(client, "failed to acquire frame");
       break;
 
-    case SNAPSHOT:
-      this->snapshot_handler_();
+    case CLIENT_WAIT_SCALE:
+      this->close_(client, "scale timeout");
+      break;
+
+    case CLIENT_SEND_FRAME:
+    case CLIENT_SEND_RECORDING:
+      this->close_(client, "send timeout");
+      break;
+
+    default:
+      this->close_(client);
       break;
   }
 }
 
-bool CameraWebServer::check_headers_() {
-  char buf[20];
-
-  size_t read = this->client_.readBytesUntil('\r', buf, sizeof(buf)-1);
-  buf[read] = 0;
+void CameraWebServer::read_request_(Client &client) {
+  char buf[128];
 
-  if (strcmp(buf, "GET / HTTP/1.0") && strcmp(buf, "GET / HTTP/1.1")) {
-    this->client_.write(NOT_FOUND_ERROR);
-    return false;
+  int ret = recv(client.fd, buf, sizeof(buf), MSG_DONTWAIT);
+  if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  } else if (ret <= 0) {
+    this->close_(client);
+    return;
   }
 
-  return true;
+  // every response closes the connection,
+  // so anything pipelined after the headers is dropped
+  switch (client.request.feed(buf, ret)) {
+    case RequestParser::INCOMPLETE:
+      return;
+
+    case RequestParser::BAD_REQUEST:
+      this->send_all_(client, BAD_REQUEST_ERROR);
+      this->close_(client);
+      return;
+
+    case RequestParser::COMPLETE:
+      this->route_(client);
+      return;
+  }
 }
 
-void CameraWebServer::send_all(const char *buf, size_t buf_len) {
-  int ret;
+void CameraWebServer::route_(Client &client) {
+  const std::string &path = client.request.get_path();
+
+  if (client.request.get_method() != "GET") {
+    this->send_all_(client, METHOD_NOT_ALLOWED_ERROR);
+    this->close_(client);
+    return;
+  }
 
-  while (this->client_ && buf_len > 0) {
-    ret = this->client_.write(buf, buf_len);
-    if (ret == 0) {
-      this->client_.stop(); // send failed, stop
+  ESP_LOGD(TAG, "GET %s", path.c_str());
+
+  if (path == "/") {
+    client.mode = this->mode_;
+  } else if (path == "/stream") {
+    client.mode = STREAM;
+  } else if (path == "/snapshot") {
+    client.mode = SNAPSHOT;
+    std::string scale;
+    if (client.request.get_query_param("scale", &scale) &&
+        !esp32_camera_stream::parse_scale(scale.c_str(), &client.scale)) {
+      this->send_all_(client, BAD_REQUEST_ERROR);
+      this->close_(client);
       return;
     }
-    buf += ret;
-    buf_len -= ret;
+  } else if (path == "/stats") {
+    this->send_stats_(client);
+    this->close_(client);
+    return;
+  } else if (path == "/recording" && this->recording_.is_enabled()) {
+    // a single dump at a time, recording pauses until it is done
+    if (!this->recording_.begin_dump()) {
+      this->send_all_(client, SERVICE_UNAVAILABLE);
+      this->close_(client);
+      return;
+    }
+    client.framer.begin_file(this->recording_.get_length());
+    client.recording_index = 0;
+    client.state = CLIENT_SEND_RECORDING;
+    client.deadline = millis() + SEND_TIMEOUT;
+    return;
+  } else {
+    this->send_all_(client, NOT_FOUND_ERROR);
+    this->close_(client);
+    return;
   }
+
+  this->request_frame_(client);
 }
 
-void CameraWebServer::streaming_handler_() {
-  // This manually constructs HTTP response to avoid chunked encoding
-  // which is not supported by some clients
+void CameraWebServer::send_stats_(Client &client) {
+  char buf[384];
+  size_t len = strlen(STATS_HEADER);
 
-  char part_buf[64];
-  uint32_t last_frame = millis();
-  uint32_t frames = 0;
+  memcpy(buf, STATS_HEADER, len);
+  this->stats_.to_json(buf + len, sizeof(buf) - len);
+  this->send_all_(client, buf);
+}
 
-  if (esp32_camera::global_esp32_camera != nullptr) {
-    esp32_camera::global_esp32_camera->start_stream(esphome::esp32_camera::WEB_REQUESTER);
+void CameraWebServer::request_frame_(Client &client) {
+  // only frames captured after the request are served
+  auto frame = this->frames_.get_frame();
+  client.image_id = frame ? frame->id : 0;
+  client.last_frame = millis();
+  client.pacer = this->pacer_;
+  client.pacer.start(millis());
+  client.state = CLIENT_WAIT_FRAME;
+  client.deadline = millis() + esp32_camera_stream::FRAME_TIMEOUT;
+
+  this->frames_.acquire(client.mode == STREAM);
+  this->stats_.clients++;
+
+  if (client.mode == SNAPSHOT) {
+    this->frames_.request_image();
   }
+}
 
-  while (this->client_) {
-    auto image = this->wait_for_image_();
+void CameraWebServer::prepare_frame_(Client &client) {
+  auto frame = this->frames_.get_frame();
+  if (!frame || frame->id == client.image_id) {
+    return;
+  }
+
+  switch (client.pacer.check(frame->time, frame->signature, millis())) {
+    case esp32_camera_stream::FramePacer::WAIT:
+      return;
+
+    case esp32_camera_stream::FramePacer::DROP:
+      client.image_id = frame->id;
+      this->stats_.frames_dropped++;
+      return;
+
+    case esp32_camera_stream::FramePacer::SKIP:
+      // the camera is alive, the scene just did not change
+      client.image_id = frame->id;
+      client.deadline = millis() + esp32_camera_stream::FRAME_TIMEOUT;
+      this->stats_.frames_skipped++;
+      return;
 
-    if (!image) {
-      ESP_LOGW(TAG, "STREAM: failed to acquire frame");
+    case esp32_camera_stream::FramePacer::SEND:
       break;
-    }
+  }
+
+  client.image_id = frame->id;
+  client.frame = frame;
+
+  switch (client.mode) {
+    case STREAM:
+      client.framer.begin_part(frame->get_data(), frame->get_length());
+      break;
+
+    case SNAPSHOT:
+      if (client.scale != esp32_camera_stream::SCALE_1) {
+        client.state = CLIENT_WAIT_SCALE;
+        client.deadline = millis() + SEND_TIMEOUT;
+        this->prepare_scaled_(client);
+        return;
+      }
+      client.framer.begin_single(frame->get_data(), frame->get_length());
+      break;
+  }
+
+  client.state = CLIENT_SEND_FRAME;
+  client.deadline = millis() + SEND_TIMEOUT;
+}
+
+void CameraWebServer::prepare_scaled_(Client &client) {
+  // the loop keeps serving the other clients while the thumbnail
+  // is encoded, the scaler wakes it up once it is done
+  if (!this->scaler_.scale_async(client.frame, client.scale, &client.scaled)) {
+    return;
+  }
+
+  // the full frame is served if it can't be scaled
+  if (client.scaled) {
+    client.framer.begin_single(client.scaled->data, client.scaled->length);
+  } else {
+    client.framer.begin_single(client.frame->get_data(), client.frame->get_length());
+  }
 
-    if (!frames) {
-      this->send_all(STREAM_HEADER, strlen(STREAM_HEADER));
+  client.state = CLIENT_SEND_FRAME;
+  client.deadline = millis() + SEND_TIMEOUT;
+}
+
+bool CameraWebServer::send_pending_(Client &client) {
+  // a slow client only holds its own frame, the others keep going
+  while (!client.framer.is_done()) {
+    // Hand over head, image and tail in one call, so lwIP fills
+    // full segments across the part boundaries instead of emitting
+    // a small segment for each header
+    struct iovec iov[esp32_camera_stream::MultipartFramer::MAX_IOV];
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = client.framer.get_iov(iov);
+
+    int ret = sendmsg(client.fd, &msg, MSG_DONTWAIT);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return false;
+    } else if (ret <= 0) {
+      this->close_(client, "send failed");
+      return false;
     }
 
-    size_t hlen = snprintf(part_buf, 64, STREAM_PART, image->get_data_length());
-    this->send_all(part_buf, hlen);
-    this->send_all((const char *) image->get_data_buffer(), image->get_data_length());
-    this->send_all(STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
+    client.framer.consume(ret);
+    this->stats_.bytes_sent += ret;
+    client.deadline = millis() + SEND_TIMEOUT;
+  }
 
-    frames++;
-    int64_t frame_time = millis() - last_frame;
-    last_frame = millis();
+  return true;
+}
 
-    ESP_LOGD(TAG, "MJPG: %uB %ums (%.1ffps)", (uint32_t) image->get_data_length(), (uint32_t) frame_time,
-              1000.0 / (uint32_t) frame_time);
+void CameraWebServer::send_frame_(Client &client) {
+  if (!this->send_pending_(client)) {
+    return;
   }
 
-  if (!frames) {
-    this->send_all(SERVICE_UNAVAILABLE, strlen(SERVICE_UNAVAILABLE));
+  auto frame = std::move(client.frame);
+  uint32_t age = millis() - frame->time;
+
+  client.frames++;
+  this->stats_.frames_sent++;
+  if (client.pacer.is_late(frame->time, millis())) {
+    this->stats_.frames_late++;
   }
 
-  if (esp32_camera::global_esp32_camera != nullptr) {
-    esp32_camera::global_esp32_camera->stop_stream(esphome::esp32_camera::WEB_REQUESTER);
+  if (client.mode == SNAPSHOT) {
+    this->close_(client);
+    return;
   }
 
-  ESP_LOGI(TAG, "STREAM: closed. Frames: %u", frames);
+  uint32_t frame_time = millis() - client.last_frame;
+  client.last_frame = millis();
+
+  ESP_LOGD(TAG, "MJPG[%d]: %uB %ums (%.1ffps) age %ums", client.fd, (uint32_t) frame->get_length(), frame_time,
+           1000.0 / frame_time, age);
+
+  client.state = CLIENT_WAIT_FRAME;
+  client.deadline = millis() + esp32_camera_stream::FRAME_TIMEOUT;
 }
 
-void CameraWebServer::snapshot_handler_() {
-  if (esp32_camera::global_esp32_camera != nullptr) {
-    esp32_camera::global_esp32_camera->request_image(esphome::esp32_camera::WEB_REQUESTER);
+void CameraWebServer::send_recording_(Client &client) {
+  // frames are sent straight from the recording, which stays frozen
+  while (this->send_pending_(client)) {
+    const uint8_t *data;
+    size_t length;
+
+    if (!this->recording_.get_frame(client.recording_index++, &data, &length)) {
+      this->close_(client);
+      return;
+    }
+
+    client.framer.begin_data(data, length);
   }
+}
+
+void CameraWebServer::send_all_(Client &client, const char *buf) {
+  // short responses fit into the socket buffer of a fresh connection
+  send(client.fd, buf, strlen(buf), MSG_DONTWAIT);
+}
 
-  auto image = this->wait_for_image_();
-  if (!image) {
-    ESP_LOGW(TAG, "SNAPSHOT: failed to acquire frame");
-    this->send_all(SERVICE_UNAVAILABLE, strlen(SERVICE_UNAVAILABLE));
+void CameraWebServer::close_(Client &client, const char *reason) {
+  if (client.state == CLIENT_CLOSED) {
     return;
   }
 
-  this->send_all(SNAPSHOT_HEADER, strlen(SNAPSHOT_HEADER));
-  this->send_all((const char *) image->get_data_buffer(), image->get_data_length());
+  if (reason) {
+    ESP_LOGW(TAG, "%s: %s", client.mode == STREAM ? "STREAM" : "SNAPSHOT", reason);
+  }
+  if (client.mode == STREAM && client.frames) {
+    ESP_LOGI(TAG, "STREAM: closed. Frames: %u", client.frames);
+  }
+
+  if (client.state == CLIENT_WAIT_FRAME || client.state == CLIENT_WAIT_SCALE || client.state == CLIENT_SEND_FRAME) {
+    this->frames_.release(client.mode == STREAM);
+    this->stats_.clients--;
+  }
+
+  if (client.state == CLIENT_SEND_RECORDING) {
+    this->recording_.end_dump();
+  }
+
+  close(client.fd);
+  client.fd = -1;
+  client.frame = nullptr;
+  client.scaled = nullptr;
+  client.state = CLIENT_CLOSED;
 }
 
 }  // namespace esp32_camera_web_server
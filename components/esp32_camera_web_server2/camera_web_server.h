@@ -3,13 +3,23 @@
 #ifdef USE_ESP32
 
 #include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
-#include <WiFiServer.h>
+#include <freertos/task.h>
+
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "esphome/components/esp32_camera/esp32_camera.h"
+#include "esphome/components/esp32_camera_stream/frame_pacer.h"
+#include "esphome/components/esp32_camera_stream/frame_ring.h"
+#include "esphome/components/esp32_camera_stream/frame_scaler.h"
+#include "esphome/components/esp32_camera_stream/frame_source.h"
+#include "esphome/components/esp32_camera_stream/multipart_framer.h"
+#include "esphome/components/esp32_camera_stream/stream_stats.h"
 #include "esphome/core/component.h"
 #include "esphome/core/helpers.h"
 #include "esphome/core/preferences.h"
+#include "request_parser.h"
 
 namespace esphome {
 namespace esp32_camera_web_server {
@@ -27,23 +37,78 @@ class CameraWebServer : public Component {
   float get_setup_priority() const override;
   void set_port(uint16_t port) { this->port_ = port; }
   void set_mode(Mode mode) { this->mode_ = mode; }
+  void set_max_clients(uint8_t max_clients) { this->max_clients_ = max_clients; }
+  void set_max_framerate(float max_framerate) { this->pacer_.set_max_framerate(max_framerate); }
+  void set_max_frame_age(uint32_t max_frame_age) { this->pacer_.set_max_frame_age(max_frame_age); }
+  void set_change_threshold(float change_threshold) { this->pacer_.set_change_threshold(change_threshold); }
+  void set_keep_alive(uint32_t keep_alive) { this->pacer_.set_keep_alive(keep_alive); }
+  void set_recording(uint32_t duration, uint32_t size, float max_framerate, bool continuous) {
+    this->recording_.set_duration(duration);
+    this->recording_.set_size(size);
+    this->recording_.set_max_framerate(max_framerate);
+    this->recording_.set_continuous(continuous);
+  }
 
  protected:
-  std::shared_ptr<esphome::esp32_camera::CameraImage> wait_for_image_();
+  enum ClientState {
+    CLIENT_REQUEST,
+    CLIENT_WAIT_FRAME,
+    CLIENT_WAIT_SCALE,
+    CLIENT_SEND_FRAME,
+    CLIENT_SEND_RECORDING,
+    CLIENT_CLOSED
+  };
+
+  struct Client {
+    int fd{-1};
+    ClientState state{CLIENT_REQUEST};
+    Mode mode{STREAM};
+    uint32_t deadline{0};
+    RequestParser request;
+    // frame being sent, kept alive until the framer is done with it
+    std::shared_ptr<const esp32_camera_stream::Frame> frame;
+    esp32_camera_stream::FrameScale scale{esp32_camera_stream::SCALE_1};
+    // thumbnail being sent instead of the frame
+    std::shared_ptr<const esp32_camera_stream::ScaledImage> scaled;
+    uint32_t image_id{0};
+    esp32_camera_stream::MultipartFramer framer;
+    esp32_camera_stream::FramePacer pacer;
+    uint32_t frames{0};
+    uint32_t last_frame{0};
+    size_t recording_index{0};
+  };
+
+  bool listen_();
+  bool create_wakeup_();
+  void wakeup_();
   void server_loop_();
-  void handler_();
-  bool check_headers_();
-  void streaming_handler_();
-  void snapshot_handler_();
-  void send_all(const char *buf, size_t buf_len);
+  void accept_();
+  void process_(Client &client, bool readable, bool writable);
+  void read_request_(Client &client);
+  void route_(Client &client);
+  void send_stats_(Client &client);
+  void request_frame_(Client &client);
+  void prepare_frame_(Client &client);
+  void prepare_scaled_(Client &client);
+  void send_frame_(Client &client);
+  void send_recording_(Client &client);
+  bool send_pending_(Client &client);
+  void send_all_(Client &client, const char *buf);
+  void close_(Client &client, const char *reason = nullptr);
 
  protected:
   uint16_t port_{0};
-  WiFiServer server_;
-  WiFiClient client_;
-  SemaphoreHandle_t semaphore_;
-  TaskHandle_t task_;
-  std::shared_ptr<esphome::esp32_camera::CameraImage> image_;
+  uint8_t max_clients_{2};
+  // configured once, copied for every client
+  esp32_camera_stream::FramePacer pacer_;
+  int listen_fd_{-1};
+  int wakeup_fd_{-1};
+  std::vector<Client> clients_;
+  TaskHandle_t task_{nullptr};
+  esp32_camera_stream::FrameSource frames_;
+  esp32_camera_stream::FrameRing recording_;
+  esp32_camera_stream::FrameScaler scaler_;
+  esp32_camera_stream::StreamStats stats_;
   Mode mode_{STREAM};
 };
 
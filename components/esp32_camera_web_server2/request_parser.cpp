@@ -0,0 +1,160 @@
+#include "request_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace esp32_camera_web_server {
+
+static const size_t MAX_REQUEST_LINE = 256;
+static const size_t MAX_REQUEST_SIZE = 4096;
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// '+' only stands for a space in form encoded query values,
+// in the path it is a literal character
+static std::string url_decode(const char *str, size_t len, bool plus_as_space) {
+  std::string out;
+  out.reserve(len);
+
+  for (size_t i = 0; i < len; i++) {
+    if (str[i] == '+' && plus_as_space) {
+      out += ' ';
+    } else if (str[i] == '%' && i + 2 < len && hex_value(str[i + 1]) >= 0 && hex_value(str[i + 2]) >= 0) {
+      out += (char) (hex_value(str[i + 1]) << 4 | hex_value(str[i + 2]));
+      i += 2;
+    } else {
+      out += str[i];
+    }
+  }
+
+  return out;
+}
+
+void RequestParser::reset() {
+  this->state_ = REQUEST_LINE;
+  this->size_ = 0;
+  this->line_.clear();
+  this->method_.clear();
+  this->path_.clear();
+  this->query_.clear();
+}
+
+RequestParser::Result RequestParser::feed(const char *data, size_t len, size_t *consumed) {
+  size_t i = 0;
+
+  while (i < len && this->state_ != DONE && this->state_ != FAILED) {
+    char c = data[i++];
+
+    // bounds the memory and time spent on a single request
+    if (++this->size_ > MAX_REQUEST_SIZE) {
+      this->state_ = FAILED;
+      break;
+    }
+
+    switch (this->state_) {
+      case REQUEST_LINE:
+        if (c == '\n') {
+          // empty lines before the request line are ignored
+          if (this->line_.empty())
+            break;
+          this->state_ = this->parse_request_line_() ? HEADER_START : FAILED;
+        } else if (c != '\r') {
+          if (this->line_.size() >= MAX_REQUEST_LINE) {
+            this->state_ = FAILED;
+            break;
+          }
+          this->line_ += c;
+        }
+        break;
+
+      case HEADER_START:
+        if (c == '\n') {
+          this->state_ = DONE;
+        } else if (c != '\r') {
+          this->state_ = HEADER;
+        }
+        break;
+
+      case HEADER:
+        if (c == '\n') {
+          this->state_ = HEADER_START;
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (consumed)
+    *consumed = i;
+
+  switch (this->state_) {
+    case DONE:
+      return COMPLETE;
+    case FAILED:
+      return BAD_REQUEST;
+    default:
+      return INCOMPLETE;
+  }
+}
+
+bool RequestParser::parse_request_line_() {
+  // METHOD SP request-target SP HTTP-version
+  size_t method_end = this->line_.find(' ');
+  size_t target_end = this->line_.rfind(' ');
+  if (method_end == std::string::npos || method_end == 0 || target_end == method_end)
+    return false;
+
+  const char *version = this->line_.c_str() + target_end + 1;
+  if (strcmp(version, "HTTP/1.0") && strcmp(version, "HTTP/1.1"))
+    return false;
+
+  std::string target = this->line_.substr(method_end + 1, target_end - method_end - 1);
+  if (target.empty() || target[0] != '/')
+    return false;
+
+  size_t query_start = target.find('?');
+  this->method_ = this->line_.substr(0, method_end);
+  this->path_ = url_decode(target.c_str(), std::min(query_start, target.size()), false);
+  this->query_ = query_start != std::string::npos ? target.substr(query_start + 1) : "";
+  this->line_.clear();
+  return true;
+}
+
+bool RequestParser::get_query_param(const char *name, std::string *value) const {
+  size_t name_len = strlen(name);
+  const char *param = this->query_.c_str();
+  const char *end = param + this->query_.size();
+
+  while (param < end) {
+    const char *param_end = strchr(param, '&');
+    if (!param_end)
+      param_end = end;
+
+    const char *eq = (const char *) memchr(param, '=', param_end - param);
+    const char *name_end = eq ? eq : param_end;
+
+    if ((size_t) (name_end - param) == name_len && !strncmp(param, name, name_len)) {
+      if (value)
+        *value = eq ? url_decode(eq + 1, param_end - eq - 1, true) : "";
+      return true;
+    }
+
+    param = param_end + 1;
+  }
+
+  return false;
+}
+
+}  // namespace esp32_camera_web_server
+}  // namespace esphome
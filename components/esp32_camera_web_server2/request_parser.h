@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace esphome {
+namespace esp32_camera_web_server {
+
+// Incremental HTTP/1.x request parser: the request can be fed in
+// arbitrary fragments, headers are drained without being stored,
+// and parsing stops right after the blank line ending the headers
+// so any pipelined data is left to the caller.
+class RequestParser {
+ public:
+  enum Result { INCOMPLETE, COMPLETE, BAD_REQUEST };
+
+  Result feed(const char *data, size_t len, size_t *consumed = nullptr);
+  void reset();
+
+  const std::string &get_method() const { return this->method_; }
+  const std::string &get_path() const { return this->path_; }
+  const std::string &get_query() const { return this->query_; }
+  bool get_query_param(const char *name, std::string *value) const;
+
+ protected:
+  enum State { REQUEST_LINE, HEADER_START, HEADER, DONE, FAILED };
+
+  bool parse_request_line_();
+
+  State state_{REQUEST_LINE};
+  size_t size_{0};
+  std::string line_;
+  std::string method_;
+  std::string path_;
+  std::string query_;
+};
+
+}  // namespace esp32_camera_web_server
+}  // namespace esphome
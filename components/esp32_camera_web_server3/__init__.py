@@ -1,9 +1,11 @@
 import esphome.config_validation as cv
 import esphome.codegen as cg
 from esphome.const import CONF_ID, CONF_PORT, CONF_MODE
+from esphome.components import esp32_camera_stream
 
 CODEOWNERS = ["@ayufan"]
 DEPENDENCIES = ["esp32_camera"]
+AUTO_LOAD = ["esp32_camera_stream"]
 MULTI_CONF = True
 
 esp32_camera_web_server_ns = cg.esphome_ns.namespace("esp32_camera_web_server")
@@ -18,11 +20,12 @@ CONFIG_SCHEMA = cv.Schema(
         cv.Required(CONF_PORT): cv.port,
         cv.Required(CONF_MODE): cv.enum(MODES, upper=True),
     },
-).extend(cv.COMPONENT_SCHEMA)
+).extend(esp32_camera_stream.STREAM_SCHEMA).extend(cv.COMPONENT_SCHEMA)
 
 
 async def to_code(config):
     server = cg.new_Pvariable(config[CONF_ID])
     cg.add(server.set_port(config[CONF_PORT]))
     cg.add(server.set_mode(config[CONF_MODE]))
+    await esp32_camera_stream.stream_to_code(server, config)
     await cg.register_component(server, config)
@@ -3,4 +3,5 @@
 #include "idf/httpd_sess.c"
 #include "idf/httpd_txrx.c"
 #include "idf/httpd_uri.c"
+#include "idf/httpd_ws.c"
 #include "idf/ctrl_sock.c"
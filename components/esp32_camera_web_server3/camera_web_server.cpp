@@ -6,27 +6,27 @@
 #include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
 #include "esphome/core/util.h"
+#include "esphome/components/esp32_camera_stream/frame_pacer.h"
+#include "esphome/components/esp32_camera_stream/multipart_framer.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <algorithm>
 #include <cstdlib>
 #include "idf/esp_http_server.h"
 #include <utility>
+#include <vector>
 
 namespace esphome {
 namespace esp32_camera_web_server {
 
-static const int IMAGE_REQUEST_TIMEOUT = 2000;
 static const char *const TAG = "esp32_camera_web_server";
 
-#define PART_BOUNDARY "123456789000000000000987654321"
 #define CONTENT_TYPE "image/jpeg"
 #define CONTENT_LENGTH "Content-Length"
 
-static const char *const STREAM_HEADER =
-    "HTTP/1.1 200\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY
-    "\r\n";
 static const char *const STREAM_500 = "HTTP/1.1 500\r\nContent-Type: text/plain\r\n\r\nNo frames send.\r\n";
-static const char *const STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char *const STREAM_PART = "Content-Type: " CONTENT_TYPE "\r\n" CONTENT_LENGTH ": %u\r\n\r\n";
 
 CameraWebServer::CameraWebServer() {}
 
@@ -38,14 +38,17 @@ void CameraWebServer::setup() {
     return;
   }
 
-  this->semaphore_ = xSemaphoreCreateBinary();
-
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.server_port = this->port_;
   config.ctrl_port = this->port_;
-  config.max_open_sockets = 1;
+  // streams hold a worker each for as long as they last, the others
+  // keep /stats, /snapshot and /recording responsive meanwhile
+  config.worker_count = 3;
+  config.max_open_sockets = 5;
   config.backlog_conn = 2;
   config.lru_purge_enable = true;
+  config.header_read_timeout = 5;
+  config.idle_timeout = 10;
 
   if (httpd_start(&this->httpd_, &config) != ESP_OK) {
     mark_failed();
@@ -55,26 +58,60 @@ void CameraWebServer::setup() {
   httpd_uri_t uri = {
       .uri = "/",
       .method = HTTP_GET,
-      .handler = [](struct httpd_req *req) { return ((CameraWebServer *) req->user_ctx)->handler_(req); },
-      .user_ctx = this};
+      .handler =
+          [](struct httpd_req *req) {
+            auto *self = (CameraWebServer *) req->user_ctx;
+            return self->handler_(req, self->mode_);
+          },
+      .user_ctx = this,
+      .is_websocket = false};
 
   httpd_register_uri_handler(this->httpd_, &uri);
 
-  esp32_camera::global_esp32_camera->add_image_callback([this](std::shared_ptr<esp32_camera::CameraImage> image) {
-    if (this->running_) {
-      this->image_ = std::move(image);
-      xSemaphoreGive(this->semaphore_);
-    }
-  });
+  httpd_uri_t snapshot_uri = {
+      .uri = "/snapshot",
+      .method = HTTP_GET,
+      .handler = [](struct httpd_req *req) { return ((CameraWebServer *) req->user_ctx)->handler_(req, SNAPSHOT); },
+      .user_ctx = this,
+      .is_websocket = false};
+
+  httpd_register_uri_handler(this->httpd_, &snapshot_uri);
+
+  httpd_uri_t stats_uri = {
+      .uri = "/stats",
+      .method = HTTP_GET,
+      .handler = [](struct httpd_req *req) { return ((CameraWebServer *) req->user_ctx)->stats_handler_(req); },
+      .user_ctx = this,
+      .is_websocket = false};
+
+  httpd_register_uri_handler(this->httpd_, &stats_uri);
+
+  httpd_uri_t recording_uri = {
+      .uri = "/recording",
+      .method = HTTP_GET,
+      .handler = [](struct httpd_req *req) { return ((CameraWebServer *) req->user_ctx)->recording_handler_(req); },
+      .user_ctx = this,
+      .is_websocket = false};
+
+  httpd_register_uri_handler(this->httpd_, &recording_uri);
+
+  httpd_uri_t ws_uri = {
+      .uri = "/ws",
+      .method = HTTP_GET,
+      .handler = [](struct httpd_req *req) { return ((CameraWebServer *) req->user_ctx)->websocket_handler_(req); },
+      .user_ctx = this,
+      .is_websocket = true};
+
+  httpd_register_uri_handler(this->httpd_, &ws_uri);
+
+  this->frames_.set_change_detection(this->pacer_.get_change_threshold() > 0);
+  this->frames_.set_recording(&this->recording_);
+  this->frames_.setup();
 }
 
 void CameraWebServer::on_shutdown() {
-  this->running_ = false;
-  this->image_ = nullptr;
   httpd_stop(this->httpd_);
   this->httpd_ = nullptr;
-  vSemaphoreDelete(this->semaphore_);
-  this->semaphore_ = nullptr;
 }
 
 void CameraWebServer::dump_config() {
@@ -84,6 +121,17 @@ void CameraWebServer::dump_config() {
     ESP_LOGCONFIG(TAG, "  Mode: stream");
   else
     ESP_LOGCONFIG(TAG, "  Mode: snapshot");
+  if (this->pacer_.get_frame_interval())
+    ESP_LOGCONFIG(TAG, "  Max framerate: %.1f fps", 1000.0 / this->pacer_.get_frame_interval());
+  if (this->pacer_.get_max_frame_age())
+    ESP_LOGCONFIG(TAG, "  Max frame age: %u ms", this->pacer_.get_max_frame_age());
+  if (this->pacer_.get_change_threshold() > 0)
+    ESP_LOGCONFIG(TAG, "  Skip unchanged: below %.1f%%, keep alive %u ms", this->pacer_.get_change_threshold() * 100,
+                  this->pacer_.get_keep_alive());
+  if (this->recording_.get_size())
+    ESP_LOGCONFIG(TAG, "  Recording: %u ms in %u bytes%s%s", this->recording_.get_duration(),
+                  (unsigned) this->recording_.get_size(), this->recording_.is_continuous() ? ", continuous" : "",
+                  this->recording_.is_enabled() ? "" : " (failed)");
 
   if (this->is_failed()) {
     ESP_LOGE(TAG, "  Setup Failed");
@@ -92,47 +140,32 @@ void CameraWebServer::dump_config() {
 
 float CameraWebServer::get_setup_priority() const { return setup_priority::LATE; }
 
-void CameraWebServer::loop() {
-  if (!this->running_) {
-    this->image_ = nullptr;
-  }
-}
-
-std::shared_ptr<esphome::esp32_camera::CameraImage> CameraWebServer::wait_for_image_() {
-  std::shared_ptr<esphome::esp32_camera::CameraImage> image;
-  image.swap(this->image_);
-
-  if (!image) {
-    // retry as we might still be fetching image
-    xSemaphoreTake(this->semaphore_, IMAGE_REQUEST_TIMEOUT / portTICK_PERIOD_MS);
-    image.swap(this->image_);
-  }
-
-  return image;
-}
-
-esp_err_t CameraWebServer::handler_(struct httpd_req *req) {
+esp_err_t CameraWebServer::handler_(struct httpd_req *req, Mode mode) {
   esp_err_t res = ESP_FAIL;
 
-  ESP_LOGI(TAG, "CameraWebServer::handler_(mode=%d) open", mode_);
+  ESP_LOGI(TAG, "CameraWebServer::handler_(mode=%d) open", mode);
 
-  this->image_ = nullptr;
-  this->running_ = true;
+  this->stats_.connections++;
+  this->stats_.clients++;
 
-  switch (this->mode_) {
+  switch (mode) {
     case STREAM:
+      this->frames_.acquire(true);
       res = this->streaming_handler_(req);
+      this->frames_.release(true);
       break;
 
     case SNAPSHOT:
+      this->frames_.acquire(false);
       res = this->snapshot_handler_(req);
+      this->frames_.release(false);
       break;
   }
 
-  ESP_LOGI(TAG, "CameraWebServer::handler_(mode=%d) closed", mode_);
+  this->stats_.clients--;
+
+  ESP_LOGI(TAG, "CameraWebServer::handler_(mode=%d) closed", mode);
 
-  this->running_ = false;
-  this->image_ = nullptr;
   return res;
 }
 
@@ -152,70 +185,226 @@ static esp_err_t httpd_send_all(httpd_req_t *r, const char *buf, size_t buf_len)
 
 esp_err_t CameraWebServer::streaming_handler_(struct httpd_req *req) {
   esp_err_t res = ESP_OK;
-  char part_buf[64];
-
-  // This manually constructs HTTP response to avoid chunked encoding
-  // which is not supported by some clients
+  esp32_camera_stream::MultipartFramer framer;
+  esp32_camera_stream::FramePacer pacer = this->pacer_;
 
-  res = httpd_send_all(req, STREAM_HEADER, strlen(STREAM_HEADER));
-  if (res != ESP_OK) {
-    ESP_LOGW(TAG, "STREAM: failed to set HTTP header");
-    return res;
-  }
+  pacer.start(millis());
 
+  // only frames captured after the request are served
+  auto frame = this->frames_.get_frame();
+  uint32_t frame_id = frame ? frame->id : 0;
   uint32_t last_frame = millis();
-  uint32_t frames = 0;
 
-  while (res == ESP_OK && this->running_) {
-    if (esp32_camera::global_esp32_camera != nullptr) {
-      esp32_camera::global_esp32_camera->request_stream();
-    }
-
-    auto image = this->wait_for_image_();
-
-    if (!image) {
+  while (res == ESP_OK) {
+    frame = this->next_frame_(pacer, &frame_id);
+    if (!frame) {
       ESP_LOGW(TAG, "STREAM: failed to acquire frame");
       res = ESP_FAIL;
+      break;
     }
-    if (res == ESP_OK) {
-      res = httpd_send_all(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
+
+    // This manually constructs HTTP response to avoid chunked encoding
+    // which is not supported by some clients, the whole part is sent
+    // at once, straight from the frame buffer
+    struct iovec iov[esp32_camera_stream::MultipartFramer::MAX_IOV];
+    framer.begin_part(frame->get_data(), frame->get_length());
+    int iovcnt = framer.get_iov(iov);
+
+    res = httpd_send_iov(req, iov, iovcnt);
+    if (res != ESP_OK) {
+      break;
     }
-    if (res == ESP_OK) {
-      size_t hlen = snprintf(part_buf, 64, STREAM_PART, image->get_data_length());
-      res = httpd_send_all(req, part_buf, hlen);
+
+    for (int i = 0; i < iovcnt; i++) {
+      this->stats_.bytes_sent += iov[i].iov_len;
     }
-    if (res == ESP_OK) {
-      res = httpd_send_all(req, (const char *) image->get_data_buffer(), image->get_data_length());
+    this->stats_.frames_sent++;
+    if (pacer.is_late(frame->time, millis())) {
+      this->stats_.frames_late++;
     }
-    if (res == ESP_OK) {
-      frames++;
-      int64_t frame_time = millis() - last_frame;
-      last_frame = millis();
 
-      ESP_LOGD(TAG, "MJPG: %uB %ums (%.1ffps)", (uint32_t) image->get_data_length(), (uint32_t) frame_time,
-               1000.0 / (uint32_t) frame_time);
-    }
+    uint32_t frame_time = millis() - last_frame;
+    last_frame = millis();
+
+    ESP_LOGD(TAG, "MJPG: %uB %ums (%.1ffps) age %ums", (uint32_t) frame->get_length(), frame_time,
+             1000.0 / frame_time, (uint32_t) (millis() - frame->time));
   }
 
-  if (!frames) {
+  if (!framer.get_parts()) {
     res = httpd_send_all(req, STREAM_500, strlen(STREAM_500));
   }
 
-  ESP_LOGI(TAG, "STREAM: closed. Frames: %u", frames);
+  ESP_LOGI(TAG, "STREAM: closed. Frames: %u", framer.get_parts());
+
+  return res;
+}
+
+esp_err_t CameraWebServer::websocket_handler_(struct httpd_req *req) {
+  // called with the handshake only, stray messages arriving
+  // after the stream has ended are dropped by the server
+  if (req->method != HTTP_GET) {
+    return ESP_OK;
+  }
+
+  ESP_LOGI(TAG, "CameraWebServer::websocket_handler_ open");
+
+  this->stats_.connections++;
+  this->stats_.clients++;
+
+  this->frames_.acquire(true);
+  esp_err_t res = this->websocket_streaming_handler_(req);
+  this->frames_.release(true);
+
+  this->stats_.clients--;
+
+  ESP_LOGI(TAG, "CameraWebServer::websocket_handler_ closed");
+
+  // the session ends with the stream
+  return res == ESP_OK ? ESP_FAIL : res;
+}
+
+esp_err_t CameraWebServer::websocket_streaming_handler_(struct httpd_req *req) {
+  esp_err_t res = ESP_OK;
+  esp32_camera_stream::FramePacer pacer = this->pacer_;
+  uint32_t frames = 0;
+
+  pacer.start(millis());
+
+  // only frames captured after the request are served
+  auto frame = this->frames_.get_frame();
+  uint32_t frame_id = frame ? frame->id : 0;
+  uint32_t last_frame = millis();
+
+  while (res == ESP_OK) {
+    frame = this->next_frame_(pacer, &frame_id);
+    if (!frame) {
+      ESP_LOGW(TAG, "WS: failed to acquire frame");
+      res = ESP_FAIL;
+      break;
+    }
+
+    // each JPEG is a single binary message
+    httpd_ws_frame_t pkt = {};
+    pkt.final = true;
+    pkt.type = HTTPD_WS_TYPE_BINARY;
+    pkt.payload = (uint8_t *) frame->get_data();
+    pkt.len = frame->get_length();
+
+    res = httpd_ws_send_frame(req, &pkt);
+    if (res != ESP_OK) {
+      break;
+    }
+
+    frames++;
+    this->stats_.bytes_sent += frame->get_length();
+    this->stats_.frames_sent++;
+    if (pacer.is_late(frame->time, millis())) {
+      this->stats_.frames_late++;
+    }
+
+    // one frame in flight: the next one is taken only after the viewer
+    // acknowledged this one, so that a slow viewer gets fresh frames
+    // instead of a backlog queued up in the network
+    res = this->websocket_wait_ack_(req);
+
+    uint32_t frame_time = millis() - last_frame;
+    last_frame = millis();
+
+    ESP_LOGD(TAG, "WS: %uB %ums (%.1ffps) age %ums", (uint32_t) frame->get_length(), frame_time,
+             1000.0 / frame_time, (uint32_t) (millis() - frame->time));
+  }
+
+  ESP_LOGI(TAG, "WS: closed. Frames: %u", frames);
 
   return res;
 }
 
+esp_err_t CameraWebServer::websocket_wait_ack_(struct httpd_req *req) {
+  // acknowledgements are expected to be tiny, anything
+  // bigger than a control frame is treated as a protocol error
+  uint8_t buf[125];
+
+  while (true) {
+    httpd_ws_frame_t pkt = {};
+    esp_err_t res = httpd_ws_recv_frame(req, &pkt, 0);
+    if (res == ESP_OK && pkt.len > sizeof(buf)) {
+      ESP_LOGW(TAG, "WS: message too long: %u", (uint32_t) pkt.len);
+      res = ESP_FAIL;
+    }
+    if (res == ESP_OK) {
+      pkt.payload = buf;
+      res = httpd_ws_recv_frame(req, &pkt, sizeof(buf));
+    }
+    if (res == ESP_ERR_TIMEOUT) {
+      ESP_LOGW(TAG, "WS: frame not acknowledged");
+    }
+    if (res != ESP_OK) {
+      return res;
+    }
+
+    switch (pkt.type) {
+      case HTTPD_WS_TYPE_CLOSE:
+        // echo the status code back
+        pkt.len = std::min<size_t>(pkt.len, 2);
+        httpd_ws_send_frame(req, &pkt);
+        return ESP_FAIL;
+
+      case HTTPD_WS_TYPE_PING:
+        pkt.type = HTTPD_WS_TYPE_PONG;
+        res = httpd_ws_send_frame(req, &pkt);
+        if (res != ESP_OK) {
+          return res;
+        }
+        continue;
+
+      case HTTPD_WS_TYPE_PONG:
+        continue;
+
+      default:
+        // any data message acknowledges the frame
+        return ESP_OK;
+    }
+  }
+}
+
 esp_err_t CameraWebServer::snapshot_handler_(struct httpd_req *req) {
   esp_err_t res = ESP_OK;
 
-  if (esp32_camera::global_esp32_camera != nullptr) {
-    esp32_camera::global_esp32_camera->request_image();
+  esp32_camera_stream::FrameScale scale = esp32_camera_stream::SCALE_1;
+  // sized to the query, dashboards add their own parameters to bust caches
+  std::vector<char> query(httpd_req_get_url_query_len(req) + 1);
+  char value[8];
+  esp_err_t found = ESP_ERR_NOT_FOUND;
+  if (httpd_req_get_url_query_str(req, query.data(), query.size()) == ESP_OK) {
+    found = httpd_query_key_value(query.data(), "scale", value, sizeof(value));
+  }
+  // a value too long to be a scale is not silently ignored
+  if (found == ESP_ERR_HTTPD_RESULT_TRUNC) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid scale");
+  }
+  if (found == ESP_OK) {
+    // the value is not URL decoded, "1/8" and "1%2F8" are both accepted
+    char *slash = strstr(value, "%2F");
+    if (!slash)
+      slash = strstr(value, "%2f");
+    if (slash) {
+      *slash = '/';
+      memmove(slash + 1, slash + 3, strlen(slash + 3) + 1);
+    }
+    if (!esp32_camera_stream::parse_scale(value, &scale)) {
+      return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid scale");
+    }
   }
 
-  auto image = this->wait_for_image_();
+  // only frames captured after the request are served
+  auto frame = this->frames_.get_frame();
+  uint32_t frame_id = frame ? frame->id : 0;
+
+  this->frames_.request_image();
 
-  if (!image) {
+  frame = this->frames_.wait_for_frame(frame_id, esp32_camera_stream::FRAME_TIMEOUT);
+
+  if (!frame) {
     ESP_LOGW(TAG, "SNAPSHOT: failed to acquire frame");
     httpd_resp_send_500(req);
     res = ESP_FAIL;
@@ -230,15 +419,115 @@ esp_err_t CameraWebServer::snapshot_handler_(struct httpd_req *req) {
 
   httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
 
+  const uint8_t *data = frame->get_data();
+  size_t length = frame->get_length();
+
+  // the full frame is served if it can't be scaled
+  std::shared_ptr<const esp32_camera_stream::ScaledImage> scaled;
+  if (scale != esp32_camera_stream::SCALE_1) {
+    scaled = this->scaler_.scale(frame, scale);
+  }
+  if (scaled) {
+    data = scaled->data;
+    length = scaled->length;
+  }
+
+  std::string content_length = esphome::to_string(length);
+  if (res == ESP_OK) {
+    res = httpd_resp_set_hdr(req, CONTENT_LENGTH, content_length.c_str());
+  }
   if (res == ESP_OK) {
-    res = httpd_resp_set_hdr(req, CONTENT_LENGTH, esphome::to_string(image->get_data_length()).c_str());
+    res = httpd_resp_send(req, (const char *) data, length);
   }
   if (res == ESP_OK) {
-    res = httpd_resp_send(req, (const char *) image->get_data_buffer(), image->get_data_length());
+    this->stats_.frames_sent++;
+    this->stats_.bytes_sent += length;
   }
   return res;
 }
 
+esp_err_t CameraWebServer::stats_handler_(struct httpd_req *req) {
+  char buf[256];
+  size_t len = this->stats_.to_json(buf, sizeof(buf));
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, buf, len);
+}
+
+esp_err_t CameraWebServer::recording_handler_(struct httpd_req *req) {
+  if (!this->recording_.is_enabled()) {
+    return httpd_resp_send_404(req);
+  }
+
+  // a single dump at a time, recording pauses until it is done
+  if (!this->recording_.begin_dump()) {
+    return httpd_resp_send_err(req, HTTPD_503_SERVICE_UNAVAILABLE, nullptr);
+  }
+
+  esp_err_t res = ESP_OK;
+  esp32_camera_stream::MultipartFramer framer;
+  framer.begin_file(this->recording_.get_length());
+
+  for (size_t index = 0; res == ESP_OK; index++) {
+    struct iovec iov[esp32_camera_stream::MultipartFramer::MAX_IOV];
+    int iovcnt = framer.get_iov(iov);
+
+    res = httpd_send_iov(req, iov, iovcnt);
+    if (res == ESP_OK) {
+      for (int i = 0; i < iovcnt; i++) {
+        this->stats_.bytes_sent += iov[i].iov_len;
+      }
+    }
+
+    const uint8_t *data;
+    size_t length;
+    if (!this->recording_.get_frame(index, &data, &length)) {
+      break;
+    }
+
+    framer.begin_data(data, length);
+  }
+
+  this->recording_.end_dump();
+  return res;
+}
+
+std::shared_ptr<const esp32_camera_stream::Frame> CameraWebServer::next_frame_(
+    esp32_camera_stream::FramePacer &pacer, uint32_t *frame_id) {
+  while (true) {
+    // sleep until the next slot, the newest frame is taken then
+    uint32_t wait = pacer.time_to_next(millis());
+    if (wait) {
+      vTaskDelay(wait / portTICK_PERIOD_MS);
+    }
+
+    auto frame = this->frames_.wait_for_frame(*frame_id, esp32_camera_stream::FRAME_TIMEOUT);
+    if (!frame) {
+      return nullptr;
+    }
+
+    switch (pacer.check(frame->time, frame->signature, millis())) {
+      case esp32_camera_stream::FramePacer::WAIT:
+        continue;
+
+      case esp32_camera_stream::FramePacer::DROP:
+        *frame_id = frame->id;
+        this->stats_.frames_dropped++;
+        continue;
+
+      case esp32_camera_stream::FramePacer::SKIP:
+        *frame_id = frame->id;
+        this->stats_.frames_skipped++;
+        continue;
+
+      case esp32_camera_stream::FramePacer::SEND:
+        *frame_id = frame->id;
+        return frame;
+    }
+  }
+}
+
 }  // namespace esp32_camera_web_server
 }  // namespace esphome
 
@@ -2,10 +2,16 @@
 
 #ifdef USE_ESP32
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
+#include <esp_err.h>
+
+#include <memory>
 
 #include "esphome/components/esp32_camera/esp32_camera.h"
+#include "esphome/components/esp32_camera_stream/frame_pacer.h"
+#include "esphome/components/esp32_camera_stream/frame_ring.h"
+#include "esphome/components/esp32_camera_stream/frame_scaler.h"
+#include "esphome/components/esp32_camera_stream/frame_source.h"
+#include "esphome/components/esp32_camera_stream/stream_stats.h"
 #include "esphome/core/component.h"
 #include "esphome/core/helpers.h"
 #include "esphome/core/preferences.h"
@@ -28,20 +34,38 @@ class CameraWebServer : public Component {
   float get_setup_priority() const override;
   void set_port(uint16_t port) { this->port_ = port; }
   void set_mode(Mode mode) { this->mode_ = mode; }
-  void loop() override;
+  void set_max_framerate(float max_framerate) { this->pacer_.set_max_framerate(max_framerate); }
+  void set_max_frame_age(uint32_t max_frame_age) { this->pacer_.set_max_frame_age(max_frame_age); }
+  void set_change_threshold(float change_threshold) { this->pacer_.set_change_threshold(change_threshold); }
+  void set_keep_alive(uint32_t keep_alive) { this->pacer_.set_keep_alive(keep_alive); }
+  void set_recording(uint32_t duration, uint32_t size, float max_framerate, bool continuous) {
+    this->recording_.set_duration(duration);
+    this->recording_.set_size(size);
+    this->recording_.set_max_framerate(max_framerate);
+    this->recording_.set_continuous(continuous);
+  }
 
  protected:
-  std::shared_ptr<esphome::esp32_camera::CameraImage> wait_for_image_();
-  esp_err_t handler_(struct httpd_req *req);
+  esp_err_t handler_(struct httpd_req *req, Mode mode);
   esp_err_t streaming_handler_(struct httpd_req *req);
+  esp_err_t websocket_handler_(struct httpd_req *req);
+  esp_err_t websocket_streaming_handler_(struct httpd_req *req);
+  esp_err_t websocket_wait_ack_(struct httpd_req *req);
   esp_err_t snapshot_handler_(struct httpd_req *req);
+  esp_err_t stats_handler_(struct httpd_req *req);
+  esp_err_t recording_handler_(struct httpd_req *req);
+  std::shared_ptr<const esp32_camera_stream::Frame> next_frame_(esp32_camera_stream::FramePacer &pacer,
+                                                                uint32_t *frame_id);
 
  protected:
   uint16_t port_{0};
+  // configured once, copied for every client
+  esp32_camera_stream::FramePacer pacer_;
   void *httpd_{nullptr};
-  SemaphoreHandle_t semaphore_;
-  std::shared_ptr<esphome::esp32_camera::CameraImage> image_;
-  bool running_{false};
+  esp32_camera_stream::FrameSource frames_;
+  esp32_camera_stream::FrameRing recording_;
+  esp32_camera_stream::FrameScaler scaler_;
+  esp32_camera_stream::StreamStats stats_;
   Mode mode_{STREAM};
 };
 
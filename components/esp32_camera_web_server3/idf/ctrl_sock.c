@@ -13,18 +13,49 @@
 // limitations under the License.
 
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#if defined(CONFIG_HTTPD_CTRL_SOCK_UDP)
+/* The UDP socket is forced, e.g. to compare both */
+#elif defined(__linux__)
+#include <sys/eventfd.h>
+#define CS_HAVE_EVENTFD 1
+#elif defined(__has_include)
+#if __has_include(<esp_vfs_eventfd.h>)
+#include <esp_vfs_eventfd.h>
+#define CS_HAVE_EVENTFD 1
+#endif
+#endif
+
 #include "ctrl_sock.h"
 
-/* Control socket, because in some network stacks select can't be woken up any
- * other way
- */
-int cs_create_ctrl_sock(int port)
+/* Tells the UDP socket fallback apart from an eventfd */
+static int cs_is_udp_sock(int fd)
+{
+    int type;
+    socklen_t len = sizeof(type);
+    return getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0 && type == SOCK_DGRAM;
+}
+
+#ifdef CS_HAVE_EVENTFD
+static int cs_create_eventfd(void)
+{
+#ifndef __linux__
+    /* Registering more than once is harmless, it fails with ESP_ERR_INVALID_STATE */
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_vfs_eventfd_register(&config);
+#endif
+    return eventfd(0, 0);
+}
+#endif
+
+static int cs_create_udp_sock(int port)
 {
     int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (fd < 0) {
@@ -45,33 +76,57 @@ int cs_create_ctrl_sock(int port)
     return fd;
 }
 
+int cs_create_ctrl_sock(int port)
+{
+    int fd = -1;
+#ifdef CS_HAVE_EVENTFD
+    fd = cs_create_eventfd();
+#endif
+    if (fd < 0) {
+        fd = cs_create_udp_sock(port);
+    }
+    if (fd >= 0) {
+        /* Draining must never block the server thread */
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+    return fd;
+}
+
 void cs_free_ctrl_sock(int fd)
 {
     close(fd);
 }
 
-int cs_send_to_ctrl_sock(int send_fd, int port, void *data, unsigned int data_len)
+int cs_signal_ctrl_sock(int fd, int port)
 {
     int ret;
-    struct sockaddr_in to_addr;
-    to_addr.sin_family = AF_INET;
-    to_addr.sin_port = htons(port);
-    inet_aton("127.0.0.1", &to_addr.sin_addr);
-    ret = sendto(send_fd, data, data_len, 0, (struct sockaddr *)&to_addr, sizeof(to_addr));
+    if (cs_is_udp_sock(fd)) {
+        struct sockaddr_in to_addr;
+        uint8_t data = 1;
+        memset(&to_addr, 0, sizeof(to_addr));
+        to_addr.sin_family = AF_INET;
+        to_addr.sin_port = htons(port);
+        inet_aton("127.0.0.1", &to_addr.sin_addr);
+        ret = sendto(fd, &data, sizeof(data), 0, (struct sockaddr *)&to_addr, sizeof(to_addr));
+    } else {
+        uint64_t value = 1;
+        ret = write(fd, &value, sizeof(value));
+    }
 
     if (ret < 0) {
         return -1;
     }
-    return ret;
+    return 0;
 }
 
-int cs_recv_from_ctrl_sock(int fd, void *data, unsigned int data_len)
+void cs_drain_ctrl_sock(int fd)
 {
-    int ret;
-    ret = recvfrom(fd, data, data_len, 0, NULL, NULL);
-
-    if (ret < 0) {
-        return -1;
+    if (cs_is_udp_sock(fd)) {
+        uint8_t data[8];
+        while (recv(fd, data, sizeof(data), 0) > 0);
+    } else {
+        /* Reading an eventfd resets its counter */
+        uint64_t value;
+        read(fd, &value, sizeof(value));
     }
-    return ret;
 }
@@ -14,12 +14,16 @@
 
 /**
  * \file ctrl_sock.h
- * \brief Control Socket for select() wakeup
+ * \brief Control descriptor for select() wakeup
  *
- * LWIP doesn't allow an easy mechanism to on-demand wakeup a thread
- * sleeping on select. This is a common requirement for sending
- * control commands to a network server. This control socket API
- * facilitates the same.
+ * Control messages of the server are passed through an in-process
+ * queue. This only provides a descriptor that can be added to the
+ * fd_set in select() and signalled to wake up the server thread,
+ * so that no message has to go through the network stack.
+ *
+ * An eventfd is used where available (Linux host, or ESP-IDF with
+ * the eventfd VFS). Otherwise it falls back to a loopback UDP socket
+ * that sends to itself.
  */
 #ifndef _CTRL_SOCK_H_
 #define _CTRL_SOCK_H_
@@ -29,68 +33,55 @@ extern "C" {
 #endif
 
 /**
- * @brief Create a control socket
- *
- *      LWIP doesn't allow an easy mechanism to on-demand wakeup a thread
- *      sleeping on select. This is a common requirement for sending
- *      control commands to a network server. This control socket API
- *      facilitates the same.
+ * @brief Create a control descriptor
  *
- *      This API will create a UDP control socket on the specified port. It
- *      will return a socket descriptor that can then be added to your
- *      fd_set in select()
+ *      This API will create an eventfd, or if that is not supported
+ *      a UDP control socket on the specified port. It will return a
+ *      descriptor that can then be added to your fd_set in select()
  *
- * @param[in] port the local port on which the control socket will listen
+ * @param[in] port the local port used by the UDP socket fallback
  *
- * @return - the socket descriptor that can be added to the fd_set in select.
+ * @return - the descriptor that can be added to the fd_set in select.
  *         - an error code if less than zero
  */
 int cs_create_ctrl_sock(int port);
 
 /**
- * @brief Free the control socket
+ * @brief Free the control descriptor
  *
- *      This frees up the control socket that was earlier created using
+ *      This frees up the control descriptor that was earlier created using
  *      cs_create_ctrl_sock()
  *
- * @param[in] fd the socket descriptor associated with this control socket
+ * @param[in] fd the descriptor associated with this control socket
  */
 void cs_free_ctrl_sock(int fd);
 
 /**
- * @brief Send data to control socket
+ * @brief Signal the control descriptor
  *
- *      This API sends data to the control socket. If a server is blocked
- *      on select() with the control socket, this call will wake up that
- *      server.
+ *      If a server is blocked on select() with the control descriptor,
+ *      this call will wake up that server. Multiple signals sent before
+ *      the server drains the descriptor may be coalesced into one.
  *
- * @param[in] send_fd the socket for sending ctrl messages
+ * @param[in] fd the descriptor associated with this control socket
  * @param[in] port the port on which the control socket was created
- * @param[in] data pointer to a buffer that contains data to send on the socket
- * @param[in] data_len the length of the data contained in the buffer pointed to be data
  *
- * @return  - the number of bytes sent to the control socket
+ * @return  - zero on success
  *          - an error code if less than zero
  */
-int cs_send_to_ctrl_sock(int send_fd, int port, void *data, unsigned int data_len);
+int cs_signal_ctrl_sock(int fd, int port);
 
 /**
- * @brief Receive data from control socket
+ * @brief Drain the control descriptor
  *
- *      This API receives any data that was sent to the control
- *      socket. This will be typically called from the server thread to
- *      process any commands on this socket.
+ *      This API consumes all the pending signals, so that the
+ *      descriptor is not reported by select() anymore. This will be
+ *      typically called from the server thread before processing
+ *      the queued control messages.
  *
- * @param[in] fd the socket descriptor of the control socket
- * @param[in] data pointer to a buffer that will be used to store
- * received from the control socket
- * @param[in] data_len the maximum length of the data that can be
- * stored in the buffer pointed by data
- *
- * @return  - the number of bytes received from the control socket
- *          - an error code if less than zero
+ * @param[in] fd the descriptor associated with this control socket
  */
-int cs_recv_from_ctrl_sock(int fd, void *data, unsigned int data_len);
+void cs_drain_ctrl_sock(int fd);
 
 #ifdef __cplusplus
 }
@@ -17,12 +17,13 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
+#include <sys/uio.h>
 #include <http_parser.h>
 #include <sdkconfig.h>
 #include <esp_err.h>
 
+#include "osal.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -50,7 +51,15 @@ initializer that should be kept in sync
         .global_transport_ctx_free_fn = NULL,           \
         .open_fn = NULL,                                \
         .close_fn = NULL,                               \
-        .uri_match_fn = NULL                            \
+        .uri_match_fn = NULL,                           \
+        .worker_count = 0,                              \
+        .worker_priority = tskIDLE_PRIORITY+5,          \
+        .worker_stack_size = 4096,                      \
+        .worker_core_id = tskNO_AFFINITY,              \
+        .work_queue_size = 4,                           \
+        .header_read_timeout = 0,                       \
+        .idle_timeout = 0,                              \
+        .min_recv_rate = 0                              \
 }
 
 #define ESP_ERR_HTTPD_BASE              (0xb000)                    /*!< Starting number of HTTPD error codes */
@@ -150,8 +159,10 @@ typedef struct httpd_config {
     uint16_t    server_port;
 
     /**
-     * UDP Port number for asynchronously exchanging control signals
-     * between various components of the server
+     * UDP Port number for waking up the server on control signals
+     * between various components of the server. Only used when
+     * eventfd is not available, the signals themselves are passed
+     * through an in-process queue
      */
     uint16_t    ctrl_port;
 
@@ -239,6 +250,40 @@ typedef struct httpd_config {
      * of the `httpd_uri_match_func_t` function prototype)
      */
     httpd_uri_match_func_t uri_match_fn;
+
+    /**
+     * Number of worker tasks executing URI handlers.
+     *
+     * When 0, every URI handler runs inline in the server task, so a long
+     * running handler (e.g. a stream) blocks all other sessions.
+     *
+     * When set, parsed requests are handed over to one of the workers and
+     * the server task continues to accept and parse other sessions. The
+     * session of a request owned by a worker is not polled, nor purged by
+     * LRU, until the handler returns. If all workers are busy the request
+     * waits in the work queue, and once the queue is full it is answered
+     * with `503 Service Unavailable`.
+     */
+    uint16_t    worker_count;
+    unsigned    worker_priority;    /*!< Priority of FreeRTOS tasks which run the URI handlers */
+    size_t      worker_stack_size;  /*!< The maximum stack size allowed for each worker task */
+    BaseType_t  worker_core_id;     /*!< The core the worker tasks will run on */
+    uint16_t    work_queue_size;    /*!< Requests waiting for a free worker (0 for worker_count) */
+
+    /**
+     * Session deadlines, protecting the few available sockets from clients
+     * that connect and then trickle data slowly (or send nothing at all).
+     * Offending sessions are closed. A value of 0 disables the check.
+     *
+     * The request line and headers are buffered per session without
+     * blocking the server task, and parsed once complete. Their deadline
+     * counts from the first byte and is enforced by the server loop, the
+     * client gets a `408 Request Timeout` (custom error handlers are not
+     * called, as there is no request yet).
+     */
+    uint16_t    header_read_timeout;    /*!< Time to receive a complete request line and headers (in seconds) */
+    uint16_t    idle_timeout;           /*!< Time a session can stay idle before or between requests (in seconds) */
+    uint32_t    min_recv_rate;          /*!< Minimum rate of receiving request body (in bytes per second) */
 } httpd_config_t;
 
 /**
@@ -399,6 +444,14 @@ typedef struct httpd_uri {
      * Pointer to user context data which will be available to handler
      */
     void *user_ctx;
+
+    /**
+     * Flag for indicating a WebSocket endpoint.
+     * If this flag is true, then method must be HTTP_GET. Otherwise the handshake will not be handled.
+     * The handler is invoked once with method HTTP_GET after the handshake has been answered,
+     * and then for every following data frame with method 0.
+     */
+    bool is_websocket;
 } httpd_uri_t;
 
 /**
@@ -546,6 +599,9 @@ typedef enum {
     /* Headers section larger than CONFIG_HTTPD_MAX_REQ_HDR_LEN */
     HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE,
 
+    /* When all worker tasks are busy executing other requests */
+    HTTPD_503_SERVICE_UNAVAILABLE,
+
     /* Used internally for retrieving the total count of errors */
     HTTPD_ERR_CODE_MAX
 } httpd_err_code_t;
@@ -1284,6 +1340,36 @@ static inline esp_err_t httpd_resp_send_500(httpd_req_t *r) {
  */
 int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len);
 
+/**
+ * @brief   Raw HTTP send of multiple buffers
+ *
+ * Same as httpd_send(), but gathers all the buffers into a single
+ * sendmsg() call, so that e.g. a multipart header and the frame which
+ * follows it are passed to the network stack at once, directly from
+ * where they are stored, without staging them in an intermediate buffer.
+ * Partial sends are retried until all data is out.
+ *
+ * If the send override function is set, the buffers are passed
+ * one by one to that function instead.
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid.
+ *  - The iov array is modified to track the progress of sending.
+ *  - Buffers must stay valid until this call returns.
+ *
+ * @param[in] r         The request being responded to
+ * @param[in] iov       Array of buffers to send in order
+ * @param[in] iovcnt    Number of buffers in the array
+ *
+ * @return
+ *  - ESP_OK : On successfully sending all buffers
+ *  - ESP_ERR_INVALID_ARG : Null arguments
+ *  - ESP_ERR_HTTPD_RESP_SEND   : Error in raw send
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request pointer
+ */
+esp_err_t httpd_send_iov(httpd_req_t *r, struct iovec *iov, int iovcnt);
+
 /** End of Request / Response
  * @}
  */
@@ -1452,6 +1538,78 @@ esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *ar
  * @}
  */
 
+/* ************** Group: WebSocket ************** */
+/** @name WebSocket
+ * Functions and structs for WebSocket server
+ * @{
+ */
+
+/**
+ * @brief Enum for WebSocket packet types (Opcode in the header)
+ * @note Please refer to RFC6455 Section 5.4 for more details
+ */
+typedef enum {
+    HTTPD_WS_TYPE_CONTINUE   = 0x0,
+    HTTPD_WS_TYPE_TEXT       = 0x1,
+    HTTPD_WS_TYPE_BINARY     = 0x2,
+    HTTPD_WS_TYPE_CLOSE      = 0x8,
+    HTTPD_WS_TYPE_PING       = 0x9,
+    HTTPD_WS_TYPE_PONG       = 0xA
+} httpd_ws_type_t;
+
+/**
+ * @brief WebSocket frame format
+ */
+typedef struct httpd_ws_frame {
+    bool final;                 /*!< Final frame */
+    httpd_ws_type_t type;       /*!< WebSocket frame type */
+    uint8_t *payload;           /*!< Pre-allocated data buffer */
+    size_t len;                 /*!< Length of the WebSocket data */
+} httpd_ws_frame_t;
+
+/**
+ * @brief Receive and parse a WebSocket frame
+ *
+ * The frame header is received on the first call. If max_len is 0, only
+ * the type and the length of the frame are filled in, so that a buffer
+ * can be provided for the payload in a following call.
+ *
+ * @note    Calling httpd_ws_recv_frame() with max_len as 0 will give
+ *          the actual frame size in pkt->len.
+ *
+ * @param[in]   req         Current request
+ * @param[out]  pkt         WebSocket packet
+ * @param[in]   max_len     Maximum length for receive
+ * @return
+ *  - ESP_OK                    : On successful
+ *  - ESP_ERR_INVALID_SIZE      : Payload does not fit into max_len
+ *  - ESP_ERR_INVALID_ARG       : Argument is invalid
+ *  - ESP_ERR_TIMEOUT           : No frame received within the receive timeout
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request
+ *  - ESP_FAIL                  : Socket errors or protocol violation
+ */
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+
+/**
+ * @brief Construct and send a WebSocket frame
+ *
+ * The header and the payload are passed to the network stack
+ * together, the payload is sent directly from pkt->payload.
+ *
+ * @param[in]   req     Current request
+ * @param[in]   pkt     WebSocket frame
+ * @return
+ *  - ESP_OK                    : On successful
+ *  - ESP_ERR_INVALID_ARG       : Argument is invalid
+ *  - ESP_ERR_HTTPD_RESP_SEND   : Error in raw send
+ *  - ESP_ERR_HTTPD_INVALID_REQ : Invalid request
+ */
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt);
+
+/** End of WebSocket related stuff
+ * @}
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,6 +38,9 @@ extern "C" {
 /* Calculate the maximum size needed for the scratch buffer */
 #define HTTPD_SCRATCH_BUF  MAX(HTTPD_MAX_REQ_HDR_LEN, HTTPD_MAX_URI_LEN)
 
+/* Number of control messages (queued work) that can be pending at once */
+#define HTTPD_CTRL_QUEUE_LEN  16
+
 /* Formats a log string to prepend context function name */
 #define LOG_FMT(x)      "%s: " x, __func__
 
@@ -69,8 +72,14 @@ struct sock_db {
     httpd_recv_func_t recv_fn;              /*!< Receive function for this socket */
     httpd_pending_func_t pending_fn;        /*!< Pending function for this socket */
     uint64_t lru_counter;                   /*!< LRU Counter indicating when the socket was last used */
-    char pending_data[PARSER_BLOCK_SIZE];   /*!< Buffer for pending data to be received */
+    char pending_data[HTTPD_SCRATCH_BUF + 1]; /*!< Buffer for pending data to be received, large enough for a request head */
     size_t pending_len;                     /*!< Length of pending data to be received */
+    bool for_async_req;                     /*!< Set while a worker owns the request of this socket */
+    int64_t last_active_us;                 /*!< Time of accepting or completing the last request, for idle timeout */
+    int64_t head_start_us;                  /*!< Time of receiving the first byte of an incomplete request head, or 0 */
+    bool ws_handshake_done;                 /*!< True if it has done WebSocket handshake (if this socket is a valid WS) */
+    esp_err_t (*ws_handler)(httpd_req_t *r);   /*!< WebSocket handler, leave to null if it's not WebSocket */
+    void *ws_user_ctx;                      /*!< WebSocket user context */
 };
 
 /**
@@ -91,6 +100,33 @@ struct httpd_req_aux {
         const char *value;
     } *resp_hdrs;                                   /*!< Additional headers in response packet */
     struct http_parser_url url_parse_res;           /*!< URL parsing result, used for retrieving URL elements */
+    int64_t         body_start_us;                  /*!< Time of receiving the first body byte, for minimum receive rate */
+    size_t          body_recv_len;                  /*!< Length of body received so far, for minimum receive rate */
+    bool            ws_handshake_detect;            /*!< WebSocket handshake detection flag */
+    bool            ws_header_read;                 /*!< Header of the current WebSocket frame has been received */
+    httpd_ws_type_t ws_type;                        /*!< WebSocket frame type */
+    bool            ws_final;                       /*!< WebSocket FIN bit (final frame or not) */
+    size_t          ws_len;                         /*!< WebSocket payload length */
+    uint8_t         ws_mask_key[4];                 /*!< WebSocket frame mask key */
+};
+
+/**
+ * @brief   A worker task executing URI handlers
+ */
+struct httpd_worker {
+    struct thread_data td;                  /*!< Information for the worker thread */
+    struct httpd_data *hd;                  /*!< Server instance owning this worker */
+};
+
+/**
+ * @brief   Request handed over to a worker. Holds copies of the request
+ *          and auxiliary data, followed by max_resp_headers response headers.
+ */
+struct httpd_async_req {
+    httpd_req_t req;                        /*!< Copy of the request passed to the handler */
+    struct httpd_req_aux aux;               /*!< Copy of the auxiliary data of the request */
+    esp_err_t (*handler)(httpd_req_t *r);   /*!< URI handler to execute */
+    esp_err_t result;                       /*!< Result of handler execution */
 };
 
 /**
@@ -100,13 +136,16 @@ struct httpd_req_aux {
 struct httpd_data {
     httpd_config_t config;                  /*!< HTTPD server configuration */
     int listen_fd;                          /*!< Server listener FD */
-    int ctrl_fd;                            /*!< Ctrl message receiver FD */
-    int msg_fd;                             /*!< Ctrl message sender FD */
+    int ctrl_fd;                            /*!< Ctrl message wakeup FD */
+    oqueue_t hd_ctrl_queue;                 /*!< Ctrl messages waiting for the HTTPD thread */
     struct thread_data hd_td;               /*!< Information for the HTTPD thread */
     struct sock_db *hd_sd;                  /*!< The socket database */
     httpd_uri_t **hd_calls;                 /*!< Registered URI handlers */
     struct httpd_req hd_req;                /*!< The current HTTPD request */
     struct httpd_req_aux hd_req_aux;        /*!< Additional data about the HTTPD request kept unexposed */
+    struct httpd_worker *hd_workers;        /*!< Worker tasks executing URI handlers */
+    oqueue_t hd_work_queue;                 /*!< Requests waiting for a worker */
+    volatile bool hd_workers_stopping;      /*!< Set by httpd_stop(), no requests are handed over since */
 
     /* Array of registered error handler functions */
     httpd_err_handler_func_t *err_handler_fns;
@@ -242,7 +281,8 @@ bool httpd_is_sess_available(struct httpd_data *hd);
  * then it would not be processed until further data is
  * received on the socket. This is when this function
  * comes in use, as it checks the socket's pending data
- * buffer.
+ * buffer. For HTTP sessions, only a complete request
+ * head counts, as it is buffered without blocking.
  *
  * @param[in] hd  Server instance data
  * @param[in] fd  Client descriptor
@@ -266,6 +306,47 @@ bool httpd_sess_pending(struct httpd_data *hd, int fd);
  */
 esp_err_t httpd_sess_close_lru(struct httpd_data *hd);
 
+/**
+ * @brief   Returns the earliest time at which a session expires, either
+ *          its request head deadline or its idle timeout, to be used as
+ *          select() timeout
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return
+ *  - Time in microseconds of the earliest expiry, or now if a session
+ *    has pending data to be processed
+ *  - -1 if no session can expire
+ */
+int64_t httpd_sess_next_deadline(struct httpd_data *hd);
+
+/**
+ * @brief   Closes the sessions that did not complete the request head
+ *          in time (after sending them 408), and those that stayed idle
+ *          for longer than the configured idle timeout
+ *
+ * @param[in] hd  Server instance data
+ */
+void httpd_sess_close_idle(struct httpd_data *hd);
+
+/**
+ * @brief   Updates the session once its request is complete, either by
+ *          the server thread or by a worker
+ *
+ * @param[in] sd  Session of the request
+ */
+void httpd_sess_request_done(struct sock_db *sd);
+
+/**
+ * @brief   Checks if any session can be closed by LRU purge. Sessions
+ *          with a request owned by a worker are never purged.
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return True if there is a session that can be purged
+ */
+bool httpd_is_sess_purgeable(struct httpd_data *hd);
+
 /** End of Group : Session Management
  * @}
  */
@@ -368,6 +449,33 @@ esp_err_t httpd_req_delete(struct httpd_data *hd);
  */
 esp_err_t httpd_req_handle_err(httpd_req_t *req, httpd_err_code_t error);
 
+/**
+ * @brief   Hands over the current HTTP request to a worker task
+ *
+ * The request is copied, together with the body remaining to be received,
+ * and the session is excluded from polling until the worker finishes and
+ * the server thread completes the request.
+ *
+ * @param[in] hd      Server instance data
+ * @param[in] handler URI handler to be executed by the worker
+ *
+ * When the work queue is full the request is answered with 503 (and 500
+ * on allocation failure) instead, as by httpd_req_handle_err().
+ *
+ * @return
+ *  - ESP_OK    : if request was queued for a worker, or the error was sent
+ *  - ESP_FAIL  : if the error could not be sent and the session is to be closed
+ */
+esp_err_t httpd_req_async_dispatch(struct httpd_data *hd, esp_err_t (*handler)(httpd_req_t *r));
+
+/**
+ * @brief   Executes the handler of a request previously handed over to
+ *          a worker and queues its completion in the server thread.
+ *
+ * @param[in] async   Request to be processed
+ */
+void httpd_req_async_process(struct httpd_async_req *async);
+
 /** End of Group : Parsing
  * @}
  */
@@ -416,9 +524,10 @@ int httpd_recv_with_opt(httpd_req_t *r, char *buf, size_t buf_len, bool halt_aft
 /**
  * @brief   For un-receiving HTTP request data
  *
- * This function copies data into internal buffer pending_data so that
- * when httpd_recv is called, it first fetches this pending data and
- * then only starts receiving from the socket
+ * This function copies data into internal buffer pending_data, in front
+ * of the data still pending there, so that when httpd_recv is called, it
+ * first fetches this pending data and then only starts receiving from
+ * the socket
  *
  * @note    If data is too large for the internal buffer then only
  *          part of the data is unreceived, reflected in the returned
@@ -471,6 +580,43 @@ int httpd_default_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len,
  * @}
  */
 
+/****************** Group : WebSocket ********************/
+/** @name WebSocket
+ * Functions for WebSocket header parsing
+ * @{
+ */
+
+/**
+ * @brief   This function is for responding a WebSocket handshake
+ *
+ * @param[in] req    Pointer to handshake request that will be handled
+ *
+ * @return
+ *  - ESP_OK                  : When handshake is sucessful
+ *  - ESP_ERR_NOT_FOUND       : When some headers (Sec-WebSocket-*) are not found
+ *  - ESP_ERR_INVALID_VERSION : The WebSocket version is not "13"
+ *  - ESP_ERR_INVALID_STATE   : Handshake was done beforehand
+ *  - ESP_ERR_INVALID_ARG     : Argument is invalid (null or non-WebSocket)
+ *  - ESP_FAIL                : Socket failures
+ */
+esp_err_t httpd_ws_respond_server_handshake(httpd_req_t *req);
+
+/**
+ * @brief   Receives the next frame of an upgraded session and invokes the
+ *          WebSocket handler for it. Control frames are answered here.
+ *
+ * @param[in] hd  Server instance data
+ *
+ * @return
+ *  - ESP_OK    : if the frame was processed
+ *  - ESP_FAIL  : if the session needs to be closed
+ */
+esp_err_t httpd_ws_process_frame(struct httpd_data *hd);
+
+/** End of WebSocket related functions
+ * @}
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -80,6 +80,22 @@ struct httpd_ctrl_data {
     void *hc_work_arg;
 };
 
+static esp_err_t httpd_send_ctrl_msg(struct httpd_data *hd, const struct httpd_ctrl_data *msg)
+{
+    /* The HTTPD thread can't wait for itself to drain the queue */
+    int wait = (httpd_os_thread_handle() == hd->hd_td.handle) ? 0 : -1;
+    if (httpd_os_queue_send(hd->hd_ctrl_queue, msg, wait) != OS_SUCCESS) {
+        return ESP_FAIL;
+    }
+
+    /* The message is queued and owned by the server thread from now on,
+     * it is processed with the next signal even if this one is lost */
+    if (cs_signal_ctrl_sock(hd->ctrl_fd, hd->config.ctrl_port) < 0) {
+        ESP_LOGW(TAG, LOG_FMT("failed to signal ctrl socket (%d)"), errno);
+    }
+    return ESP_OK;
+}
+
 esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
 {
     if (handle == NULL || work == NULL) {
@@ -87,14 +103,18 @@ esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *ar
     }
 
     struct httpd_data *hd = (struct httpd_data *) handle;
+    if (hd->hd_td.status == THREAD_STOPPING || hd->hd_td.status == THREAD_STOPPED) {
+        ESP_LOGW(TAG, LOG_FMT("server is not running"));
+        return ESP_FAIL;
+    }
+
     struct httpd_ctrl_data msg = {
         .hc_msg = HTTPD_CTRL_WORK,
         .hc_work = work,
         .hc_work_arg = arg,
     };
 
-    int ret = cs_send_to_ctrl_sock(hd->msg_fd, hd->config.ctrl_port, &msg, sizeof(msg));
-    if (ret < 0) {
+    if (httpd_send_ctrl_msg(hd, &msg) != ESP_OK) {
         ESP_LOGW(TAG, LOG_FMT("failed to queue work"));
         return ESP_FAIL;
     }
@@ -122,32 +142,43 @@ static void httpd_close_all_sessions(struct httpd_data *hd)
     }
 }
 
+/* Executed in the server thread when stopping: handlers still running
+ * in workers fail on the next send/recv, as their sessions are shut down */
+static void httpd_shutdown_async_sessions(void *arg)
+{
+    struct httpd_data *hd = (struct httpd_data *) arg;
+    int i;
+    for (i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->hd_sd[i].fd != -1 && hd->hd_sd[i].for_async_req) {
+            ESP_LOGD(TAG, LOG_FMT("shutting down socket %d owned by worker"), hd->hd_sd[i].fd);
+            shutdown(hd->hd_sd[i].fd, SHUT_RDWR);
+        }
+    }
+}
+
 static void httpd_process_ctrl_msg(struct httpd_data *hd)
 {
     struct httpd_ctrl_data msg;
-    int ret = recv(hd->ctrl_fd, &msg, sizeof(msg), 0);
-    if (ret <= 0) {
-        ESP_LOGW(TAG, LOG_FMT("error in recv (%d)"), errno);
-        return;
-    }
-    if (ret != sizeof(msg)) {
-        ESP_LOGW(TAG, LOG_FMT("incomplete msg"));
-        return;
-    }
 
-    switch (msg.hc_msg) {
-    case HTTPD_CTRL_WORK:
-        if (msg.hc_work) {
-            ESP_LOGD(TAG, LOG_FMT("work"));
-            (*msg.hc_work)(msg.hc_work_arg);
+    /* Drain before processing, so that a message queued
+     * meanwhile signals the descriptor again */
+    cs_drain_ctrl_sock(hd->ctrl_fd);
+
+    while (httpd_os_queue_recv(hd->hd_ctrl_queue, &msg, 0) == OS_SUCCESS) {
+        switch (msg.hc_msg) {
+        case HTTPD_CTRL_WORK:
+            if (msg.hc_work) {
+                ESP_LOGD(TAG, LOG_FMT("work"));
+                (*msg.hc_work)(msg.hc_work_arg);
+            }
+            break;
+        case HTTPD_CTRL_SHUTDOWN:
+            ESP_LOGD(TAG, LOG_FMT("shutdown"));
+            hd->hd_td.status = THREAD_STOPPING;
+            return;
+        default:
+            break;
         }
-        break;
-    case HTTPD_CTRL_SHUTDOWN:
-        ESP_LOGD(TAG, LOG_FMT("shutdown"));
-        hd->hd_td.status = THREAD_STOPPING;
-        break;
-    default:
-        break;
     }
 }
 
@@ -156,10 +187,11 @@ static esp_err_t httpd_server(struct httpd_data *hd)
 {
     fd_set read_set;
     FD_ZERO(&read_set);
-    if (hd->config.lru_purge_enable || httpd_is_sess_available(hd)) {
+    if ((hd->config.lru_purge_enable && httpd_is_sess_purgeable(hd)) ||
+        httpd_is_sess_available(hd)) {
         /* Only listen for new connections if server has capacity to
          * handle more (or when LRU purge is enabled, in which case
-         * older connections will be closed) */
+         * older connections not owned by a worker will be closed) */
         FD_SET(hd->listen_fd, &read_set);
     }
     FD_SET(hd->ctrl_fd, &read_set);
@@ -170,8 +202,18 @@ static esp_err_t httpd_server(struct httpd_data *hd)
     tmp_max_fd = maxfd;
     maxfd = MAX(hd->ctrl_fd, tmp_max_fd);
 
+    /* Wake up in time to close the first session going idle */
+    struct timeval tv, *timeout = NULL;
+    int64_t deadline = httpd_sess_next_deadline(hd);
+    if (deadline >= 0) {
+        int64_t wait = MAX(deadline - httpd_os_time_us(), 0);
+        tv.tv_sec = wait / 1000000;
+        tv.tv_usec = wait % 1000000;
+        timeout = &tv;
+    }
+
     ESP_LOGD(TAG, LOG_FMT("doing select maxfd+1 = %d"), maxfd + 1);
-    int active_cnt = select(maxfd + 1, &read_set, NULL, NULL, NULL);
+    int active_cnt = select(maxfd + 1, &read_set, NULL, NULL, timeout);
     if (active_cnt < 0) {
         ESP_LOGE(TAG, LOG_FMT("error in select (%d)"), errno);
         httpd_sess_delete_invalid(hd);
@@ -204,7 +246,11 @@ static esp_err_t httpd_server(struct httpd_data *hd)
         }
     }
 
-    /* Case2: Do we have any incoming connection requests to
+    /* Case2: Do we have any sessions that stayed idle for
+     * too long? Closing them frees slots for new connections */
+    httpd_sess_close_idle(hd);
+
+    /* Case3: Do we have any incoming connection requests to
      * process? */
     if (FD_ISSET(hd->listen_fd, &read_set)) {
         ESP_LOGD(TAG, LOG_FMT("processing listen socket %d"), hd->listen_fd);
@@ -231,7 +277,6 @@ static void httpd_thread(void *arg)
     }
 
     ESP_LOGD(TAG, LOG_FMT("web server exiting"));
-    close(hd->msg_fd);
     cs_free_ctrl_sock(hd->ctrl_fd);
     httpd_close_all_sessions(hd);
     close(hd->listen_fd);
@@ -239,6 +284,64 @@ static void httpd_thread(void *arg)
     httpd_os_thread_delete();
 }
 
+/* The worker thread executing URI handlers */
+static void httpd_worker_thread(void *arg)
+{
+    struct httpd_worker *worker = (struct httpd_worker *) arg;
+    struct httpd_async_req *async = NULL;
+
+    /* NULL request is a request to stop */
+    while (httpd_os_queue_recv(worker->hd->hd_work_queue, &async, -1) == OS_SUCCESS && async) {
+        httpd_req_async_process(async);
+    }
+
+    worker->td.status = THREAD_STOPPED;
+    httpd_os_thread_delete();
+}
+
+static void httpd_workers_stop(struct httpd_data *hd)
+{
+    struct httpd_async_req *stop = NULL;
+    int i;
+
+    for (i = 0; i < hd->config.worker_count; i++) {
+        if (hd->hd_workers[i].td.status != THREAD_IDLE) {
+            httpd_os_queue_send(hd->hd_work_queue, &stop, -1);
+        }
+    }
+
+    for (i = 0; i < hd->config.worker_count; i++) {
+        if (hd->hd_workers[i].td.status == THREAD_IDLE) {
+            continue;
+        }
+        while (hd->hd_workers[i].td.status != THREAD_STOPPED) {
+            httpd_os_thread_sleep(100);
+        }
+        hd->hd_workers[i].td.status = THREAD_IDLE;
+    }
+}
+
+static esp_err_t httpd_workers_start(struct httpd_data *hd)
+{
+    int i;
+    for (i = 0; i < hd->config.worker_count; i++) {
+        hd->hd_workers[i].hd = hd;
+        /* Marked as running before creation, so that a stop
+         * right after start waits for the worker to exit */
+        hd->hd_workers[i].td.status = THREAD_RUNNING;
+        if (httpd_os_thread_create(&hd->hd_workers[i].td.handle, "httpd_worker",
+                                   hd->config.worker_stack_size,
+                                   hd->config.worker_priority,
+                                   httpd_worker_thread, &hd->hd_workers[i],
+                                   hd->config.worker_core_id) != OS_SUCCESS) {
+            hd->hd_workers[i].td.status = THREAD_IDLE;
+            httpd_workers_stop(hd);
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
 static esp_err_t httpd_server_init(struct httpd_data *hd)
 {
     int fd = socket(PF_INET6, SOCK_STREAM, 0);
@@ -284,17 +387,8 @@ static esp_err_t httpd_server_init(struct httpd_data *hd)
         return ESP_FAIL;
     }
 
-    int msg_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (msg_fd < 0) {
-        ESP_LOGE(TAG, LOG_FMT("error in creating msg socket (%d)"), errno);
-        close(fd);
-        close(ctrl_fd);
-        return ESP_FAIL;
-    }
-
     hd->listen_fd = fd;
     hd->ctrl_fd = ctrl_fd;
-    hd->msg_fd  = msg_fd;
     return ESP_OK;
 }
 
@@ -337,6 +431,36 @@ static struct httpd_data *httpd_create(const httpd_config_t *config)
         free(hd);
         return NULL;
     }
+    hd->hd_ctrl_queue = httpd_os_queue_create(HTTPD_CTRL_QUEUE_LEN, sizeof(struct httpd_ctrl_data));
+    if (!hd->hd_ctrl_queue) {
+        ESP_LOGE(TAG, LOG_FMT("Failed to allocate memory for HTTP control queue"));
+        free(hd->err_handler_fns);
+        free(ra->resp_hdrs);
+        free(hd->hd_sd);
+        free(hd->hd_calls);
+        free(hd);
+        return NULL;
+    }
+    if (config->worker_count) {
+        hd->hd_workers = calloc(config->worker_count, sizeof(struct httpd_worker));
+        /* Requests wait here for a worker, those beyond are answered with 503 */
+        int queue_size = config->work_queue_size ? config->work_queue_size : config->worker_count;
+        hd->hd_work_queue = httpd_os_queue_create(queue_size, sizeof(struct httpd_async_req *));
+        if (!hd->hd_workers || !hd->hd_work_queue) {
+            ESP_LOGE(TAG, LOG_FMT("Failed to allocate memory for HTTP workers"));
+            if (hd->hd_work_queue) {
+                httpd_os_queue_delete(hd->hd_work_queue);
+            }
+            httpd_os_queue_delete(hd->hd_ctrl_queue);
+            free(hd->hd_workers);
+            free(hd->err_handler_fns);
+            free(ra->resp_hdrs);
+            free(hd->hd_sd);
+            free(hd->hd_calls);
+            free(hd);
+            return NULL;
+        }
+    }
     /* Save the configuration for this instance */
     hd->config = *config;
     return hd;
@@ -346,6 +470,11 @@ static void httpd_delete(struct httpd_data *hd)
 {
     struct httpd_req_aux *ra = &hd->hd_req_aux;
     /* Free memory of httpd instance data */
+    if (hd->hd_work_queue) {
+        httpd_os_queue_delete(hd->hd_work_queue);
+    }
+    httpd_os_queue_delete(hd->hd_ctrl_queue);
+    free(hd->hd_workers);
     free(hd->err_handler_fns);
     free(ra->resp_hdrs);
     free(hd->hd_sd);
@@ -366,18 +495,20 @@ esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
      * maximum number of open sockets sufficient for the server. Though,
      * this check doesn't guarantee that many sockets will actually be
      * available at runtime as other processes may use up some sockets.
-     * Note that server also uses 3 sockets for its internal use :
+     * Note that server also uses up to 2 sockets for its internal use :
      *     1) listening for new TCP connections
-     *     2) for sending control messages over UDP
-     *     3) for receiving control messages over UDP
-     * So the total number of required sockets is max_open_sockets + 3
+     *     2) for waking up on control messages over UDP, only
+     *        when eventfd is not available
+     * So the total number of required sockets is max_open_sockets + 2
      */
-    if (CONFIG_LWIP_MAX_SOCKETS < config->max_open_sockets + 3) {
+#ifdef CONFIG_LWIP_MAX_SOCKETS
+    if (CONFIG_LWIP_MAX_SOCKETS < config->max_open_sockets + 2) {
         ESP_LOGE(TAG, "Configuration option max_open_sockets is too large (max allowed %d)\n\t"
                       "Either decrease this or configure LWIP_MAX_SOCKETS to a larger value",
-                      CONFIG_LWIP_MAX_SOCKETS - 3);
+                      CONFIG_LWIP_MAX_SOCKETS - 2);
         return ESP_ERR_INVALID_ARG;
     }
+#endif
 
     struct httpd_data *hd = httpd_create(config);
     if (hd == NULL) {
@@ -391,12 +522,21 @@ esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
     }
 
     httpd_sess_init(hd);
+    if (httpd_workers_start(hd) != ESP_OK) {
+        /* Failed to launch worker tasks */
+        cs_free_ctrl_sock(hd->ctrl_fd);
+        close(hd->listen_fd);
+        httpd_delete(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+
     if (httpd_os_thread_create(&hd->hd_td.handle, "httpd",
                                hd->config.stack_size,
                                hd->config.task_priority,
                                httpd_thread, hd,
                                hd->config.core_id) != ESP_OK) {
         /* Failed to launch task */
+        httpd_workers_stop(hd);
         httpd_delete(hd);
         return ESP_ERR_HTTPD_TASK;
     }
@@ -413,9 +553,23 @@ esp_err_t httpd_stop(httpd_handle_t handle)
     }
 
     struct httpd_ctrl_data msg;
+    memset(&msg, 0, sizeof(msg));
+
+    /* Workers are stopped first, while the server thread still owns
+     * the sessions and completes the requests returned by them */
+    if (hd->config.worker_count) {
+        hd->hd_workers_stopping = true;
+        msg.hc_msg = HTTPD_CTRL_WORK;
+        msg.hc_work = httpd_shutdown_async_sessions;
+        msg.hc_work_arg = hd;
+        httpd_send_ctrl_msg(hd, &msg);
+        httpd_workers_stop(hd);
+        ESP_LOGD(TAG, LOG_FMT("workers stopped"));
+    }
+
     memset(&msg, 0, sizeof(msg));
     msg.hc_msg = HTTPD_CTRL_SHUTDOWN;
-    cs_send_to_ctrl_sock(hd->msg_fd, hd->config.ctrl_port, &msg, sizeof(msg));
+    httpd_send_ctrl_msg(hd, &msg);
 
     ESP_LOGD(TAG, LOG_FMT("sent control msg to stop server"));
     while (hd->hd_td.status != THREAD_STOPPED) {
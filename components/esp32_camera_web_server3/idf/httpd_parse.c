@@ -375,12 +375,9 @@ static esp_err_t cb_headers_complete(http_parser *parser)
     ESP_LOGD(TAG, LOG_FMT("content length = %zu"), r->content_len);
 
     if (parser->upgrade) {
-        ESP_LOGW(TAG, LOG_FMT("upgrade from HTTP not supported"));
-        /* There is no specific HTTP error code to notify the client that
-         * upgrade is not supported, thus sending 400 Bad Request */
-        parser_data->error = HTTPD_400_BAD_REQUEST;
-        parser_data->status = PARSING_FAILED;
-        return ESP_FAIL;
+        ESP_LOGD(TAG, LOG_FMT("Got an upgrade request"));
+        /* If there's an "Upgrade" header field, then httpd_uri will check if it's a WebSocket handshake */
+        ra->ws_handshake_detect = true;
     }
 
     parser_data->status = PARSING_BODY;
@@ -667,6 +664,10 @@ static void init_req_aux(struct httpd_req_aux *ra, httpd_config_t *config)
     ra->first_chunk_sent = 0;
     ra->req_hdrs_count = 0;
     ra->resp_hdrs_count = 0;
+    ra->body_start_us = 0;
+    ra->body_recv_len = 0;
+    ra->ws_handshake_detect = false;
+    ra->ws_header_read = false;
     memset(ra->resp_hdrs, 0, config->max_resp_headers * sizeof(struct resp_hdr));
 }
 
@@ -710,19 +711,24 @@ esp_err_t httpd_req_new(struct httpd_data *hd, struct sock_db *sd)
     r->sess_ctx = sd->ctx;
     r->free_ctx = sd->free_ctx;
     r->ignore_sess_ctx_changes = sd->ignore_sess_ctx_changes;
-    /* Parse request */
-    esp_err_t err = httpd_parse_req(hd);
+    esp_err_t err;
+    if (sd->ws_handshake_done) {
+        /* Upgraded sessions carry WebSocket frames instead of requests */
+        err = httpd_ws_process_frame(hd);
+    } else {
+        /* Parse request */
+        err = httpd_parse_req(hd);
+    }
     if (err != ESP_OK) {
         httpd_req_cleanup(r);
     }
     return err;
 }
 
-/* Function that resets the http request data
+/* Function that finishes off reading any leftover data of the request
  */
-esp_err_t httpd_req_delete(struct httpd_data *hd)
+static esp_err_t httpd_req_purge(httpd_req_t *r)
 {
-    httpd_req_t *r = &hd->hd_req;
     struct httpd_req_aux *ra = r->aux;
 
     /* Finish off reading any pending/leftover data */
@@ -733,7 +739,6 @@ esp_err_t httpd_req_delete(struct httpd_data *hd)
         int recv_len = MIN(sizeof(dummy), ra->remaining_len);
         recv_len = httpd_req_recv(r, dummy, recv_len);
         if (recv_len < 0) {
-            httpd_req_cleanup(r);
             return ESP_FAIL;
         }
 
@@ -748,11 +753,101 @@ esp_err_t httpd_req_delete(struct httpd_data *hd)
         ESP_LOGD(TAG, "===============================================");
 #endif
     }
+    return ESP_OK;
+}
 
+/* Function that resets the http request data
+ */
+esp_err_t httpd_req_delete(struct httpd_data *hd)
+{
+    httpd_req_t *r = &hd->hd_req;
+    esp_err_t err = httpd_req_purge(r);
     httpd_req_cleanup(r);
+    return err;
+}
+
+/* Function that hands over the current request to a worker.
+ * The copy takes over the remaining body, so that the server
+ * thread does not try to purge it in httpd_req_delete().
+ * If the request can't be queued, it is answered right away.
+ */
+esp_err_t httpd_req_async_dispatch(struct httpd_data *hd, esp_err_t (*handler)(httpd_req_t *r))
+{
+    httpd_req_t *r = &hd->hd_req;
+    struct httpd_req_aux *ra = r->aux;
+
+    size_t resp_hdrs_size = hd->config.max_resp_headers * sizeof(struct resp_hdr);
+    struct httpd_async_req *async = malloc(sizeof(struct httpd_async_req) + resp_hdrs_size);
+    if (!async) {
+        ESP_LOGE(TAG, LOG_FMT("Failed to allocate memory for async request"));
+        return httpd_req_handle_err(r, HTTPD_500_INTERNAL_SERVER_ERROR);
+    }
+
+    memcpy(&async->req, r, sizeof(async->req));
+    memcpy(&async->aux, ra, sizeof(async->aux));
+    async->aux.resp_hdrs = (struct resp_hdr *) (async + 1);
+    memcpy(async->aux.resp_hdrs, ra->resp_hdrs, resp_hdrs_size);
+    async->req.aux = &async->aux;
+    async->handler = handler;
+    async->result = ESP_FAIL;
+
+    if (hd->hd_workers_stopping ||
+        httpd_os_queue_send(hd->hd_work_queue, &async, 0) != OS_SUCCESS) {
+        ESP_LOGW(TAG, LOG_FMT("all workers are busy"));
+        free(async);
+        return httpd_req_handle_err(r, HTTPD_503_SERVICE_UNAVAILABLE);
+    }
+
+    ra->remaining_len = 0;
+    ra->sd->for_async_req = true;
     return ESP_OK;
 }
 
+/* Executed in the server thread once the worker is done with the request */
+static void httpd_req_async_complete(void *arg)
+{
+    struct httpd_async_req *async = (struct httpd_async_req *) arg;
+    struct httpd_data *hd = (struct httpd_data *) async->req.handle;
+    struct sock_db *sd = async->aux.sd;
+    int fd = sd->fd;
+
+    sd->for_async_req = false;
+    httpd_req_cleanup(&async->req);
+
+    if (async->result != ESP_OK) {
+        ESP_LOGD(TAG, LOG_FMT("closing socket %d"), fd);
+        httpd_sess_delete(hd, fd);
+        close(fd);
+    } else {
+        httpd_sess_request_done(sd);
+    }
+    free(async);
+}
+
+void httpd_req_async_process(struct httpd_async_req *async)
+{
+    httpd_req_t *r = &async->req;
+    struct httpd_data *hd = (struct httpd_data *) r->handle;
+
+    /* Requests still queued when the server stops are dropped */
+    if (hd->hd_workers_stopping) {
+        async->result = ESP_FAIL;
+    } else {
+        async->result = async->handler(r);
+    }
+    if (async->result != ESP_OK) {
+        /* Handler returns error, this socket should be closed */
+        ESP_LOGW(TAG, LOG_FMT("uri handler execution failed"));
+    } else {
+        async->result = httpd_req_purge(r);
+    }
+
+    if (httpd_queue_work(r->handle, httpd_req_async_complete, async) != ESP_OK) {
+        /* The server is stopping and closes all sessions on its own */
+        free(async);
+    }
+}
+
 /* Validates the request to prevent users from calling APIs, that are to
  * be called only inside URI handler, outside the handler context
  */
@@ -763,9 +858,17 @@ bool httpd_validate_req_ptr(httpd_req_t *r)
         if (hd) {
             /* Check if this function is running in the context of
              * the correct httpd server thread */
-            if (httpd_os_thread_handle() == hd->hd_td.handle) {
+            othread_t handle = httpd_os_thread_handle();
+            if (handle == hd->hd_td.handle) {
                 return true;
             }
+            /* or of one of its workers */
+            int i;
+            for (i = 0; i < hd->config.worker_count; i++) {
+                if (handle == hd->hd_workers[i].td.handle) {
+                    return true;
+                }
+            }
         }
     }
     return false;
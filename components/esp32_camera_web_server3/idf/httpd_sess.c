@@ -73,6 +73,7 @@ esp_err_t httpd_sess_new(struct httpd_data *hd, int newfd)
             hd->hd_sd[i].handle = (httpd_handle_t) hd;
             hd->hd_sd[i].send_fn = httpd_default_send;
             hd->hd_sd[i].recv_fn = httpd_default_recv;
+            hd->hd_sd[i].last_active_us = httpd_os_time_us();
 
             /* Call user-defined session opening function */
             if (hd->config.open_fn) {
@@ -184,7 +185,8 @@ void httpd_sess_set_descriptors(struct httpd_data *hd,
     int i;
     *maxfd = -1;
     for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd != -1) {
+        /* Sockets owned by a worker are not polled until the request is complete */
+        if (hd->hd_sd[i].fd != -1 && !hd->hd_sd[i].for_async_req) {
             FD_SET(hd->hd_sd[i].fd, fdset);
             if (hd->hd_sd[i].fd > *maxfd) {
                 *maxfd = hd->hd_sd[i].fd;
@@ -271,6 +273,61 @@ void httpd_sess_init(struct httpd_data *hd)
     }
 }
 
+/* The head of the next request is complete in the pending data (it ends
+ * with an empty line), or it fills the buffer and the parser rejects it */
+static bool httpd_sess_head_ready(struct sock_db *sd)
+{
+    if (sd->pending_len == sizeof(sd->pending_data)) {
+        return true;
+    }
+
+    const char *data = sd->pending_data + sizeof(sd->pending_data) - sd->pending_len;
+    size_t i;
+    for (i = 1; i < sd->pending_len; i++) {
+        if (data[i] == '\n' && (data[i - 1] == '\n' ||
+                (i >= 2 && data[i - 1] == '\r' && data[i - 2] == '\n'))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Appends what the socket has to the pending data, without blocking.
+ * The request is parsed only once its head is ready, so that a client
+ * trickling it can't hold the server thread, only its own session.
+ */
+static esp_err_t httpd_sess_read_head(struct httpd_data *hd, struct sock_db *sd, bool *ready)
+{
+    *ready = httpd_sess_head_ready(sd);
+    if (*ready) {
+        return ESP_OK;
+    }
+
+    /* The scratch buffer is not in use between requests */
+    char *buf = hd->hd_req_aux.scratch;
+    size_t space = sizeof(sd->pending_data) - sd->pending_len;
+    int len = sd->recv_fn(hd, sd->fd, buf, space, MSG_DONTWAIT);
+    if (len == HTTPD_SOCK_ERR_TIMEOUT) {
+        return ESP_OK;
+    }
+    if (len <= 0) {
+        ESP_LOGD(TAG, LOG_FMT("connection closed"));
+        return ESP_FAIL;
+    }
+
+    /* Pending data is right aligned in the buffer */
+    char *start = sd->pending_data + space;
+    memmove(start - len, start, sd->pending_len);
+    memcpy(sd->pending_data + sizeof(sd->pending_data) - len, buf, len);
+    sd->pending_len += len;
+    if (!sd->head_start_us) {
+        sd->head_start_us = httpd_os_time_us();
+    }
+
+    *ready = httpd_sess_head_ready(sd);
+    return ESP_OK;
+}
+
 bool httpd_sess_pending(struct httpd_data *hd, int fd)
 {
     struct sock_db *sd = httpd_sess_get(hd, fd);
@@ -278,13 +335,29 @@ bool httpd_sess_pending(struct httpd_data *hd, int fd)
         return ESP_FAIL;
     }
 
+    if (sd->for_async_req) {
+        return false;
+    }
+
     if (sd->pending_fn) {
         // test if there's any data to be read (besides read() function, which is handled by select() in the main httpd loop)
         // this should check e.g. for the SSL data buffer
         if (sd->pending_fn(hd, fd) > 0) return true;
     }
 
-    return (sd->pending_len != 0);
+    /* WebSocket frames are read as they come, requests once the head is ready */
+    if (sd->ws_handshake_done) {
+        return (sd->pending_len != 0);
+    }
+    return httpd_sess_head_ready(sd);
+}
+
+void httpd_sess_request_done(struct sock_db *sd)
+{
+    sd->lru_counter = httpd_sess_get_lru_counter();
+    sd->last_active_us = httpd_os_time_us();
+    /* Pipelined data starts the head of the next request */
+    sd->head_start_us = sd->pending_len ? sd->last_active_us : 0;
 }
 
 /* This MUST return ESP_OK on successful execution. If any other
@@ -298,6 +371,17 @@ esp_err_t httpd_sess_process(struct httpd_data *hd, int newfd)
         return ESP_FAIL;
     }
 
+    if (!sd->ws_handshake_done) {
+        bool ready;
+        if (httpd_sess_read_head(hd, sd, &ready) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (!ready) {
+            ESP_LOGD(TAG, LOG_FMT("request head incomplete (%d bytes)"), sd->pending_len);
+            return ESP_OK;
+        }
+    }
+
     ESP_LOGD(TAG, LOG_FMT("httpd_req_new"));
     if (httpd_req_new(hd, sd) != ESP_OK) {
         return ESP_FAIL;
@@ -307,7 +391,10 @@ esp_err_t httpd_sess_process(struct httpd_data *hd, int newfd)
         return ESP_FAIL;
     }
     ESP_LOGD(TAG, LOG_FMT("success"));
-    sd->lru_counter = httpd_sess_get_lru_counter();
+    /* A worker owns the session now and completes the request */
+    if (!sd->for_async_req) {
+        httpd_sess_request_done(sd);
+    }
     return ESP_OK;
 }
 
@@ -342,6 +429,10 @@ esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
         if (hd->hd_sd[i].fd == -1) {
             return ESP_OK;
         }
+        /* Sessions owned by a worker can't be closed */
+        if (hd->hd_sd[i].for_async_req) {
+            continue;
+        }
         if (hd->hd_sd[i].lru_counter < lru_counter) {
             lru_counter = hd->hd_sd[i].lru_counter;
             lru_fd = hd->hd_sd[i].fd;
@@ -351,6 +442,84 @@ esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
     return httpd_sess_trigger_close(hd, lru_fd);
 }
 
+int64_t httpd_sess_next_deadline(struct httpd_data *hd)
+{
+    /* The number of sessions is small, so a linear scan
+     * is cheaper than keeping them sorted by expiry */
+    int64_t deadline = -1;
+    int i;
+    for (i = 0; i < hd->config.max_open_sockets; i++) {
+        struct sock_db *sd = &hd->hd_sd[i];
+        if (sd->fd == -1 || sd->for_async_req) {
+            continue;
+        }
+        /* Data waiting to be processed, with nothing left to select() */
+        if (httpd_sess_pending(hd, sd->fd)) {
+            return httpd_os_time_us();
+        }
+
+        int64_t expiry;
+        if (sd->head_start_us && hd->config.header_read_timeout) {
+            expiry = sd->head_start_us + hd->config.header_read_timeout * 1000000LL;
+        } else if (hd->config.idle_timeout) {
+            expiry = sd->last_active_us + hd->config.idle_timeout * 1000000LL;
+        } else {
+            continue;
+        }
+        if (deadline < 0 || expiry < deadline) {
+            deadline = expiry;
+        }
+    }
+    return deadline;
+}
+
+void httpd_sess_close_idle(struct httpd_data *hd)
+{
+    static const char resp_408[] = "HTTP/1.1 408 Request Timeout\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n\r\n";
+
+    if (!hd->config.header_read_timeout && !hd->config.idle_timeout) {
+        return;
+    }
+
+    int64_t now = httpd_os_time_us();
+    int i;
+    for (i = 0; i < hd->config.max_open_sockets; i++) {
+        struct sock_db *sd = &hd->hd_sd[i];
+        int fd = sd->fd;
+        if (fd == -1 || sd->for_async_req) {
+            continue;
+        }
+        if (sd->head_start_us && hd->config.header_read_timeout) {
+            if (now - sd->head_start_us >= hd->config.header_read_timeout * 1000000LL) {
+                /* Sent as is, as there is no request to answer through.
+                 * The send must not block either, it's the last word anyway */
+                ESP_LOGW(TAG, LOG_FMT("request head not received in time on socket %d"), fd);
+                sd->send_fn(hd, fd, resp_408, sizeof(resp_408) - 1, MSG_DONTWAIT);
+                httpd_sess_delete(hd, fd);
+                close(fd);
+            }
+        } else if (hd->config.idle_timeout &&
+                   now - sd->last_active_us >= hd->config.idle_timeout * 1000000LL) {
+            ESP_LOGD(TAG, LOG_FMT("closing idle socket %d"), fd);
+            httpd_sess_delete(hd, fd);
+            close(fd);
+        }
+    }
+}
+
+bool httpd_is_sess_purgeable(struct httpd_data *hd)
+{
+    int i;
+    for (i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->hd_sd[i].fd != -1 && !hd->hd_sd[i].for_async_req) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int httpd_sess_iterate(struct httpd_data *hd, int start_fd)
 {
     int start_index = 0;
@@ -383,6 +552,12 @@ static void httpd_sess_close(void *arg)
             return;
         }
         int fd = sock_db->fd;
+        if (sock_db->for_async_req) {
+            /* Worker fails on the next send/recv and completes the closure */
+            ESP_LOGD(TAG, "Shutting down session %d owned by worker", fd);
+            shutdown(fd, SHUT_RDWR);
+            return;
+        }
         struct httpd_data *hd = (struct httpd_data *) sock_db->handle;
         httpd_sess_delete(hd, fd);
         close(fd);
@@ -152,15 +152,16 @@ int httpd_recv(httpd_req_t *r, char *buf, size_t buf_len)
 size_t httpd_unrecv(struct httpd_req *r, const char *buf, size_t buf_len)
 {
     struct httpd_req_aux *ra = r->aux;
-    /* Truncate if external buf_len is greater than pending_data buffer size */
-    ra->sd->pending_len = MIN(sizeof(ra->sd->pending_data), buf_len);
-
-    /* Copy data into internal pending_data buffer with the exact offset
-     * such that it is right aligned inside the buffer */
+    /* The data goes in front of what is still pending, as it was received
+     * before it. Truncate if it does not fit into the pending_data buffer */
     size_t offset = sizeof(ra->sd->pending_data) - ra->sd->pending_len;
-    memcpy(ra->sd->pending_data + offset, buf, ra->sd->pending_len);
+    buf_len = MIN(offset, buf_len);
+
+    /* Pending data is right aligned inside the buffer */
+    memcpy(ra->sd->pending_data + offset - buf_len, buf, buf_len);
+    ra->sd->pending_len += buf_len;
     ESP_LOGD(TAG, LOG_FMT("length = %d"), ra->sd->pending_len);
-    return ra->sd->pending_len;
+    return buf_len;
 }
 
 /**
@@ -423,6 +424,10 @@ esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const ch
             status = "431 Request Header Fields Too Large";
             msg    = "Header fields are too long for server to interpret";
             break;
+        case HTTPD_503_SERVICE_UNAVAILABLE:
+            status = "503 Service Unavailable";
+            msg    = "Server is busy handling other requests";
+            break;
         case HTTPD_500_INTERNAL_SERVER_ERROR:
         default:
             status = "500 Internal Server Error";
@@ -525,12 +530,30 @@ int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
         return buf_len;
     }
 
+    /* Give up on clients sending the body slower than allowed,
+     * after a grace period of one second */
+    struct httpd_data *hd = (struct httpd_data *) r->handle;
+    if (hd->config.min_recv_rate) {
+        int64_t now = httpd_os_time_us();
+        if (!ra->body_start_us) {
+            ra->body_start_us = now;
+        }
+        int64_t elapsed = now - ra->body_start_us;
+        if (elapsed > 1000000 &&
+            ra->body_recv_len < (uint64_t) hd->config.min_recv_rate * elapsed / 1000000) {
+            ESP_LOGW(TAG, LOG_FMT("receive rate too low (%d bytes in %d ms)"),
+                     ra->body_recv_len, (int) (elapsed / 1000));
+            return HTTPD_SOCK_ERR_TIMEOUT;
+        }
+    }
+
     int ret = httpd_recv(r, buf, buf_len);
     if (ret < 0) {
         ESP_LOGD(TAG, LOG_FMT("error in httpd_recv"));
         return ret;
     }
     ra->remaining_len -= ret;
+    ra->body_recv_len += ret;
     ESP_LOGD(TAG, LOG_FMT("received length = %d"), ret);
     return ret;
 }
@@ -599,3 +622,49 @@ int httpd_default_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len,
     }
     return ret;
 }
+
+esp_err_t httpd_send_iov(httpd_req_t *r, struct iovec *iov, int iovcnt)
+{
+    if (r == NULL || iov == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    while (iovcnt > 0) {
+        int ret;
+        if (ra->sd->send_fn == httpd_default_send) {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            ret = sendmsg(ra->sd->fd, &msg, 0);
+            if (ret < 0) {
+                ret = httpd_sock_err("sendmsg", ra->sd->fd);
+            }
+        } else {
+            /* Send overrides (e.g. for SSL) only take a single buffer */
+            ret = ra->sd->send_fn(ra->sd->handle, ra->sd->fd, iov->iov_base, iov->iov_len, 0);
+        }
+        if (ret < 0) {
+            ESP_LOGD(TAG, LOG_FMT("error in send_fn"));
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        ESP_LOGD(TAG, LOG_FMT("sent = %d"), ret);
+
+        /* Skip buffers sent completely and advance into the partially sent one */
+        while (iovcnt > 0 && (size_t) ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    return ESP_OK;
+}
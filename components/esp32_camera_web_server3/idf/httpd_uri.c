@@ -172,6 +172,7 @@ esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
             hd->hd_calls[i]->method   = uri_handler->method;
             hd->hd_calls[i]->handler  = uri_handler->handler;
             hd->hd_calls[i]->user_ctx = uri_handler->user_ctx;
+            hd->hd_calls[i]->is_websocket = uri_handler->is_websocket;
             ESP_LOGD(TAG, LOG_FMT("[%d] installed %s"), i, uri_handler->uri);
             return ESP_OK;
         }
@@ -307,6 +308,24 @@ esp_err_t httpd_uri(struct httpd_data *hd)
     /* Attach user context data (passed during URI registration) into request */
     req->user_ctx = uri->user_ctx;
 
+    /* Answer the WebSocket handshake before the handler takes over the session */
+    struct httpd_req_aux *aux = req->aux;
+    if (uri->is_websocket && aux->ws_handshake_detect && uri->method == HTTP_GET) {
+        ESP_LOGD(TAG, LOG_FMT("Responding WS handshake to sock %d"), aux->sd->fd);
+        if (httpd_ws_respond_server_handshake(req) != ESP_OK) {
+            return httpd_req_handle_err(req, HTTPD_400_BAD_REQUEST);
+        }
+
+        aux->sd->ws_handshake_done = true;
+        aux->sd->ws_handler = uri->handler;
+        aux->sd->ws_user_ctx = uri->user_ctx;
+    }
+
+    /* Hand over to a worker, so that the server keeps serving other sessions */
+    if (hd->config.worker_count) {
+        return httpd_req_async_dispatch(hd, uri->handler);
+    }
+
     /* Invoke handler */
     if (uri->handler(req) != ESP_OK) {
         /* Handler returns error, this socket should be closed */
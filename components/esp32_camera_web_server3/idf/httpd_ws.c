@@ -0,0 +1,464 @@
+// Copyright 2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <esp_log.h>
+#include <esp_err.h>
+
+#include "esp_http_server.h"
+#include "esp_httpd_priv.h"
+
+static const char *TAG = "httpd_ws";
+
+/*
+ * Bit masks for WebSocket frames.
+ * Please refer to RFC6455 Section 5.2 for more details.
+ */
+#define HTTPD_WS_FIN_BIT                0x80U
+#define HTTPD_WS_OPCODE_BITS            0x0fU
+#define HTTPD_WS_MASK_BIT               0x80U
+#define HTTPD_WS_LENGTH_BITS            0x7fU
+
+/* Control frames can't carry more than this, see RFC6455 Section 5.5 */
+#define HTTPD_WS_MAX_CONTROL_LEN        125U
+
+/* Header of a server frame: 2 bytes, and up to 8 bytes of extended length */
+#define HTTPD_WS_MAX_HEADER_LEN         10U
+
+/* Size of the Sec-WebSocket-Key value, a base64 encoded 16 byte nonce */
+#define HTTPD_WS_KEY_LEN                24U
+
+/* Size of the Sec-WebSocket-Accept value, a base64 encoded SHA-1 digest */
+#define HTTPD_WS_ACCEPT_LEN             28U
+
+static const char ws_magic_uuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/* Minimal SHA-1 (FIPS 180-1), only used for the handshake, so that
+ * the server stays free of a crypto library dependency */
+struct ws_sha1 {
+    uint32_t state[5];
+    uint64_t length;
+    uint8_t block[64];
+    size_t used;
+};
+
+static inline uint32_t ws_rol(uint32_t value, unsigned bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void ws_sha1_block(struct ws_sha1 *ctx)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) ctx->block[i * 4] << 24) | ((uint32_t) ctx->block[i * 4 + 1] << 16) |
+               ((uint32_t) ctx->block[i * 4 + 2] << 8) | ctx->block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = ws_rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2];
+    uint32_t d = ctx->state[3], e = ctx->state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = ws_rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ws_rol(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+}
+
+static void ws_sha1_init(struct ws_sha1 *ctx)
+{
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xEFCDAB89;
+    ctx->state[2] = 0x98BADCFE;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xC3D2E1F0;
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void ws_sha1_update(struct ws_sha1 *ctx, const uint8_t *data, size_t len)
+{
+    ctx->length += len;
+    while (len--) {
+        ctx->block[ctx->used++] = *data++;
+        if (ctx->used == sizeof(ctx->block)) {
+            ws_sha1_block(ctx);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void ws_sha1_finish(struct ws_sha1 *ctx, uint8_t digest[20])
+{
+    uint64_t bits = ctx->length * 8;
+    uint8_t pad = 0x80;
+    ws_sha1_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56) {
+        ws_sha1_update(ctx, &pad, 1);
+    }
+    for (int i = 7; i >= 0; i--) {
+        ctx->block[ctx->used++] = (uint8_t) (bits >> (i * 8));
+    }
+    ws_sha1_block(ctx);
+
+    for (int i = 0; i < 20; i++) {
+        digest[i] = (uint8_t) (ctx->state[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+static void ws_base64_encode(const uint8_t *src, size_t len, char *dst)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t n = (uint32_t) src[i] << 16;
+        if (i + 1 < len) {
+            n |= (uint32_t) src[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            n |= src[i + 2];
+        }
+        *dst++ = table[(n >> 18) & 0x3f];
+        *dst++ = table[(n >> 12) & 0x3f];
+        *dst++ = (i + 1 < len) ? table[(n >> 6) & 0x3f] : '=';
+        *dst++ = (i + 2 < len) ? table[n & 0x3f] : '=';
+    }
+    *dst = '\0';
+}
+
+esp_err_t httpd_ws_respond_server_handshake(httpd_req_t *req)
+{
+    /* Probe if input parameters are valid or not */
+    if (!req || !req->aux) {
+        ESP_LOGW(TAG, LOG_FMT("Argument is invalid"));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Detect handshake - reject if handshake was ALREADY performed */
+    struct httpd_req_aux *req_aux = req->aux;
+    if (req_aux->sd->ws_handshake_done) {
+        ESP_LOGW(TAG, LOG_FMT("State is invalid - Handshake has been performed"));
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* Detect WebSocket protocol */
+    char upgrade[16];
+    if (httpd_req_get_hdr_value_str(req, "Upgrade", upgrade, sizeof(upgrade)) != ESP_OK ||
+        strcasecmp(upgrade, "websocket") != 0) {
+        ESP_LOGW(TAG, LOG_FMT("Upgrade header is not \"websocket\""));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Detect WebSocket version (only version 13 is supported) */
+    char version[4];
+    if (httpd_req_get_hdr_value_str(req, "Sec-WebSocket-Version", version, sizeof(version)) != ESP_OK) {
+        ESP_LOGW(TAG, LOG_FMT("Sec-WebSocket-Version header is missing"));
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (strcmp(version, "13") != 0) {
+        ESP_LOGW(TAG, LOG_FMT("Sec-WebSocket-Version is not 13"));
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    /* Grab Sec-WebSocket-Key (client key) from the header */
+    char key[HTTPD_WS_KEY_LEN + 1];
+    if (httpd_req_get_hdr_value_str(req, "Sec-WebSocket-Key", key, sizeof(key)) != ESP_OK) {
+        ESP_LOGW(TAG, LOG_FMT("Cannot find client key"));
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Prepare server key (Sec-WebSocket-Accept), concat the string */
+    uint8_t digest[20];
+    struct ws_sha1 sha1;
+    ws_sha1_init(&sha1);
+    ws_sha1_update(&sha1, (const uint8_t *) key, strlen(key));
+    ws_sha1_update(&sha1, (const uint8_t *) ws_magic_uuid, strlen(ws_magic_uuid));
+    ws_sha1_finish(&sha1, digest);
+
+    char accept[HTTPD_WS_ACCEPT_LEN + 1];
+    ws_base64_encode(digest, sizeof(digest), accept);
+    ESP_LOGD(TAG, LOG_FMT("Generated server key: %s"), accept);
+
+    /* Prepare the Switching Protocol response */
+    char response[160];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 101 Switching Protocols\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: %s\r\n"
+                       "\r\n", accept);
+
+    /* Send off the response */
+    struct iovec iov = { .iov_base = response, .iov_len = len };
+    if (httpd_send_iov(req, &iov, 1) != ESP_OK) {
+        ESP_LOGW(TAG, LOG_FMT("Failed to send the response"));
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/* Receives exactly len bytes, unlike httpd_recv() which returns early */
+static esp_err_t httpd_ws_recv_all(httpd_req_t *req, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        int ret = httpd_recv_with_opt(req, (char *) buf, len, false);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            return ESP_ERR_TIMEOUT;
+        } else if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t httpd_ws_recv_header(httpd_req_t *req)
+{
+    struct httpd_req_aux *aux = req->aux;
+    uint8_t header[8];
+
+    esp_err_t ret = httpd_ws_recv_all(req, header, 2);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    aux->ws_final = (header[0] & HTTPD_WS_FIN_BIT) != 0;
+    aux->ws_type = (httpd_ws_type_t) (header[0] & HTTPD_WS_OPCODE_BITS);
+
+    /* Frames from the client are always masked, see RFC6455 Section 5.1 */
+    if (!(header[1] & HTTPD_WS_MASK_BIT)) {
+        ESP_LOGW(TAG, LOG_FMT("Client frame is not masked"));
+        return ESP_FAIL;
+    }
+
+    uint8_t length = header[1] & HTTPD_WS_LENGTH_BITS;
+    if (length < 126) {
+        aux->ws_len = length;
+    } else if (length == 126) {
+        /* Length is a 16 bit integer */
+        if ((ret = httpd_ws_recv_all(req, header, 2)) != ESP_OK) {
+            return ret;
+        }
+        aux->ws_len = ((size_t) header[0] << 8) | header[1];
+    } else {
+        /* Length is a 64 bit integer, frames that large can't be stored anyway */
+        if ((ret = httpd_ws_recv_all(req, header, 8)) != ESP_OK) {
+            return ret;
+        }
+        if (header[0] | header[1] | header[2] | header[3]) {
+            ESP_LOGW(TAG, LOG_FMT("Frame too large"));
+            return ESP_FAIL;
+        }
+        aux->ws_len = ((size_t) header[4] << 24) | ((size_t) header[5] << 16) |
+                      ((size_t) header[6] << 8) | header[7];
+    }
+
+    if ((aux->ws_type & 0x08) && aux->ws_len > HTTPD_WS_MAX_CONTROL_LEN) {
+        ESP_LOGW(TAG, LOG_FMT("Control frame too large"));
+        return ESP_FAIL;
+    }
+
+    if ((ret = httpd_ws_recv_all(req, aux->ws_mask_key, sizeof(aux->ws_mask_key))) != ESP_OK) {
+        return ret;
+    }
+
+    aux->ws_header_read = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *frame, size_t max_len)
+{
+    if (!frame || !req || !req->aux) {
+        ESP_LOGW(TAG, LOG_FMT("Argument is invalid"));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(req)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *aux = req->aux;
+    if (!aux->ws_header_read) {
+        esp_err_t ret = httpd_ws_recv_header(req);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    frame->final = aux->ws_final;
+    frame->type = aux->ws_type;
+    frame->len = aux->ws_len;
+
+    /* Only the header was asked for, the payload is received by the next call */
+    if (max_len == 0) {
+        return ESP_OK;
+    }
+
+    if (frame->len > max_len || !frame->payload) {
+        ESP_LOGW(TAG, LOG_FMT("Not enough room for payload of %d bytes"), frame->len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t ret = httpd_ws_recv_all(req, frame->payload, frame->len);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /* Unmask payload */
+    for (size_t i = 0; i < frame->len; i++) {
+        frame->payload[i] ^= aux->ws_mask_key[i % 4];
+    }
+
+    aux->ws_header_read = false;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *frame)
+{
+    if (!frame || !req || (frame->len && !frame->payload)) {
+        ESP_LOGW(TAG, LOG_FMT("Argument is invalid"));
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(req)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    /* Server frames are never masked, see RFC6455 Section 5.1 */
+    uint8_t header[HTTPD_WS_MAX_HEADER_LEN];
+    size_t header_len = 2;
+
+    header[0] = (frame->final ? HTTPD_WS_FIN_BIT : 0) | (frame->type & HTTPD_WS_OPCODE_BITS);
+    if (frame->len < 126) {
+        header[1] = frame->len;
+    } else if (frame->len <= 0xffff) {
+        header[1] = 126;
+        header[2] = (frame->len >> 8) & 0xff;
+        header[3] = frame->len & 0xff;
+        header_len = 4;
+    } else {
+        header[1] = 127;
+        uint64_t len = frame->len;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (len >> (56 - i * 8)) & 0xff;
+        }
+        header_len = 10;
+    }
+
+    /* Send header and payload at once, payload straight from the caller's buffer */
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = header_len },
+        { .iov_base = frame->payload, .iov_len = frame->len },
+    };
+    return httpd_send_iov(req, iov, frame->len ? 2 : 1);
+}
+
+/* Receives and drops the payload of a frame not consumed by the handler */
+static esp_err_t httpd_ws_discard_payload(httpd_req_t *req)
+{
+    struct httpd_req_aux *aux = req->aux;
+    uint8_t dummy[CONFIG_HTTPD_PURGE_BUF_LEN];
+
+    while (aux->ws_len) {
+        size_t len = MIN(sizeof(dummy), aux->ws_len);
+        if (httpd_ws_recv_all(req, dummy, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        aux->ws_len -= len;
+    }
+    aux->ws_header_read = false;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_process_frame(struct httpd_data *hd)
+{
+    httpd_req_t *req = &hd->hd_req;
+    struct httpd_req_aux *aux = req->aux;
+    struct sock_db *sd = aux->sd;
+
+    if (httpd_ws_recv_header(req) != ESP_OK) {
+        ESP_LOGD(TAG, LOG_FMT("Failed to receive frame header of sock %d"), sd->fd);
+        return ESP_FAIL;
+    }
+
+    /* Control frames are answered by the server */
+    if (aux->ws_type & 0x08) {
+        uint8_t payload[HTTPD_WS_MAX_CONTROL_LEN];
+        httpd_ws_frame_t frame = { .payload = payload };
+        if (httpd_ws_recv_frame(req, &frame, sizeof(payload)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+
+        switch (frame.type) {
+            case HTTPD_WS_TYPE_CLOSE:
+                /* Echo the status code back and close the session */
+                ESP_LOGD(TAG, LOG_FMT("Got a WS CLOSE frame on sock %d"), sd->fd);
+                frame.final = true;
+                frame.len = MIN(frame.len, 2);
+                httpd_ws_send_frame(req, &frame);
+                return ESP_FAIL;
+            case HTTPD_WS_TYPE_PING:
+                ESP_LOGD(TAG, LOG_FMT("Got a WS PING frame, replying PONG"));
+                frame.final = true;
+                frame.type = HTTPD_WS_TYPE_PONG;
+                return httpd_ws_send_frame(req, &frame) == ESP_OK ? ESP_OK : ESP_FAIL;
+            default:
+                return ESP_OK;
+        }
+    }
+
+    /* Data frames are passed to the handler with method 0, to tell them apart from the handshake */
+    req->user_ctx = sd->ws_user_ctx;
+    if (sd->ws_handler(req) != ESP_OK) {
+        ESP_LOGW(TAG, LOG_FMT("ws handler execution failed"));
+        return ESP_FAIL;
+    }
+
+    /* Keep the stream in sync if the handler did not take the payload */
+    if (aux->ws_header_read) {
+        return httpd_ws_discard_payload(req);
+    }
+    return ESP_OK;
+}
@@ -15,11 +15,27 @@
 #ifndef _OSAL_H_
 #define _OSAL_H_
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
 #include <unistd.h>
 #include <stdint.h>
+
+/* Builds outside of ESP-IDF (like a Linux host) run the server
+ * on top of pthreads, instead of FreeRTOS tasks and queues */
+#ifndef ESP_PLATFORM
+#define HTTPD_OS_POSIX 1
+#endif
+
+#ifdef HTTPD_OS_POSIX
+#include <pthread.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#else
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
 #include <esp_timer.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,7 +44,167 @@ extern "C" {
 #define OS_SUCCESS ESP_OK
 #define OS_FAIL    ESP_FAIL
 
+#ifdef HTTPD_OS_POSIX
+
+/* Priority and core affinity are accepted for the sake
+ * of httpd_config_t, but are ignored by the host */
+typedef int BaseType_t;
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY   INT_MAX
+
+typedef pthread_t othread_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    unsigned        length;
+    unsigned        item_size;
+    unsigned        head;
+    unsigned        count;
+    char            items[];
+} *oqueue_t;
+
+struct httpd_os_thread_start {
+    void (*thread_routine)(void *arg);
+    void *arg;
+};
+
+static inline void *httpd_os_thread_trampoline(void *data)
+{
+    struct httpd_os_thread_start start = *(struct httpd_os_thread_start *) data;
+    free(data);
+    start.thread_routine(start.arg);
+    return NULL;
+}
+
+static inline int httpd_os_thread_create(othread_t *thread,
+                                 const char *name, uint16_t stacksize, int prio,
+                                 void (*thread_routine)(void *arg), void *arg,
+                                 BaseType_t core_id)
+{
+    struct httpd_os_thread_start *start = (struct httpd_os_thread_start *) malloc(sizeof(*start));
+    if (!start) {
+        return OS_FAIL;
+    }
+    start->thread_routine = thread_routine;
+    start->arg = arg;
+
+    /* Stack sizes are tuned for the device, the host default is used instead */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(thread, &attr, httpd_os_thread_trampoline, start);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        free(start);
+        return OS_FAIL;
+    }
+    return OS_SUCCESS;
+}
+
+/* Only self delete is supported */
+static inline void httpd_os_thread_delete(void)
+{
+    pthread_exit(NULL);
+}
+
+static inline void httpd_os_thread_sleep(int msecs)
+{
+    usleep(msecs * 1000);
+}
+
+static inline othread_t httpd_os_thread_handle(void)
+{
+    return pthread_self();
+}
+
+static inline int64_t httpd_os_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline oqueue_t httpd_os_queue_create(unsigned length, unsigned item_size)
+{
+    oqueue_t queue = (oqueue_t) calloc(1, sizeof(*queue) + length * item_size);
+    if (!queue) {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+static inline void httpd_os_queue_delete(oqueue_t queue)
+{
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
+
+/* Waits on cond for up to msecs, or forever if negative */
+static inline int httpd_os_queue_wait(oqueue_t queue, pthread_cond_t *cond, int msecs)
+{
+    if (msecs < 0) {
+        return pthread_cond_wait(cond, &queue->lock);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msecs / 1000;
+    ts.tv_nsec += (msecs % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(cond, &queue->lock, &ts);
+}
+
+/* Negative msecs blocks until the item is queued */
+static inline int httpd_os_queue_send(oqueue_t queue, const void *item, int msecs)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (msecs == 0 || httpd_os_queue_wait(queue, &queue->not_full, msecs) != 0) {
+            pthread_mutex_unlock(&queue->lock);
+            return OS_FAIL;
+        }
+    }
+    unsigned tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return OS_SUCCESS;
+}
+
+/* Negative msecs blocks until an item is received */
+static inline int httpd_os_queue_recv(oqueue_t queue, void *item, int msecs)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (msecs == 0 || httpd_os_queue_wait(queue, &queue->not_empty, msecs) != 0) {
+            pthread_mutex_unlock(&queue->lock);
+            return OS_FAIL;
+        }
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return OS_SUCCESS;
+}
+
+#else /* HTTPD_OS_POSIX */
+
 typedef TaskHandle_t othread_t;
+typedef QueueHandle_t oqueue_t;
 
 static inline int httpd_os_thread_create(othread_t *thread,
                                  const char *name, uint16_t stacksize, int prio,
@@ -58,6 +234,43 @@ static inline othread_t httpd_os_thread_handle(void)
     return xTaskGetCurrentTaskHandle();
 }
 
+static inline int64_t httpd_os_time_us(void)
+{
+    return esp_timer_get_time();
+}
+
+static inline oqueue_t httpd_os_queue_create(unsigned length, unsigned item_size)
+{
+    return xQueueCreate(length, item_size);
+}
+
+static inline void httpd_os_queue_delete(oqueue_t queue)
+{
+    vQueueDelete(queue);
+}
+
+/* Negative msecs blocks until the item is queued */
+static inline int httpd_os_queue_send(oqueue_t queue, const void *item, int msecs)
+{
+    TickType_t ticks = msecs < 0 ? portMAX_DELAY : msecs / portTICK_RATE_MS;
+    if (xQueueSend(queue, item, ticks) == pdTRUE) {
+        return OS_SUCCESS;
+    }
+    return OS_FAIL;
+}
+
+/* Negative msecs blocks until an item is received */
+static inline int httpd_os_queue_recv(oqueue_t queue, void *item, int msecs)
+{
+    TickType_t ticks = msecs < 0 ? portMAX_DELAY : msecs / portTICK_RATE_MS;
+    if (xQueueReceive(queue, item, ticks) == pdTRUE) {
+        return OS_SUCCESS;
+    }
+    return OS_FAIL;
+}
+
+#endif /* HTTPD_OS_POSIX */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,207 @@
+// Queued GATT operations of a client against a simulated peripheral:
+// callers do not block, completions come in order, writes without
+// response share connection events, and a closed link fails the rest
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "esp_bt_host.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble_client.h"
+#include "http_client.h"
+
+namespace {
+
+const uint64_t ADDRESS = 0x001a22000002ull;
+const uint16_t SERVICE_UUID = 0x3e70;
+const uint16_t COMMAND_UUID = 0x3fc1;
+const uint32_t INTERVAL_US = 7500;
+
+esp_bt_uuid_t uuid16(uint16_t value) {
+  esp_bt_uuid_t uuid = {};
+  uuid.len = ESP_UUID_LEN_16;
+  uuid.uuid.uuid16 = value;
+  return uuid;
+}
+
+// Results of the callbacks, in the order they were called
+class Completions {
+ public:
+  ESP32BLEClient::Callback add(int id) {
+    return [this, id](bool success) {
+      std::lock_guard<std::mutex> guard(this->lock_);
+      this->ids_.push_back(id);
+      this->results_.push_back(success);
+      this->cond_.notify_all();
+    };
+  }
+
+  bool wait(size_t count, int timeout_ms = 2000) {
+    std::unique_lock<std::mutex> guard(this->lock_);
+    return this->cond_.wait_for(guard, std::chrono::milliseconds(timeout_ms),
+                                [this, count]() { return this->ids_.size() >= count; });
+  }
+
+  std::vector<int> ids() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return this->ids_;
+  }
+
+  std::vector<bool> results() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return this->results_;
+  }
+
+ protected:
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::vector<int> ids_;
+  std::vector<bool> results_;
+};
+
+class ESP32BLECallQueueTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    host_bt_reset();
+    HostBTPeripheral peripheral;
+    peripheral.address = ADDRESS;
+    peripheral.service_uuid = SERVICE_UUID;
+    peripheral.characteristics = {COMMAND_UUID};
+    peripheral.interval_us = INTERVAL_US;
+    peripheral.on_write = [this](uint16_t handle, const HostBTPeripheral::Value &value) {
+      std::lock_guard<std::mutex> guard(this->lock_);
+      this->written_.push_back(value[0]);
+      return std::vector<HostBTPeripheral::Value>();
+    };
+    host_bt_add_peripheral(peripheral);
+
+    this->client_.reset(ESP32BLE::instance().acquire(1000, ADDRESS));
+    ASSERT_TRUE(this->client_);
+    this->client_->set_address(ADDRESS);
+    this->client_->set_handle_cache(false);
+    ASSERT_TRUE(this->client_->connect());
+    this->command_ = this->client_->get_characteristic(uuid16(SERVICE_UUID), uuid16(COMMAND_UUID));
+    ASSERT_NE(this->command_, 0);
+  }
+
+  void TearDown() override { this->client_.reset(); }
+
+  // Queues count writes of their index, returns how long queueing took in ms
+  double queue_writes(int count, bool response, Completions *completions) {
+    int64_t start = test::now_us();
+    for (int i = 0; i < count; i++) {
+      uint8_t value = (uint8_t) i;
+      EXPECT_TRUE(this->client_->queue_write(ESP32BLEClient::Characteristic, this->command_, &value, 1, response,
+                                             completions->add(i)));
+    }
+    return (test::now_us() - start) / 1000.0;
+  }
+
+  std::vector<uint8_t> written() {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    return this->written_;
+  }
+
+  std::unique_ptr<ESP32BLEClient> client_;
+  uint16_t command_{0};
+  std::mutex lock_;
+  std::vector<uint8_t> written_;
+};
+
+std::vector<int> sequence(int count) {
+  std::vector<int> ids;
+  for (int i = 0; i < count; i++)
+    ids.push_back(i);
+  return ids;
+}
+
+TEST_F(ESP32BLECallQueueTest, QueueDoesNotBlock) {
+  Completions completions;
+  double queued = this->queue_writes(10, true, &completions);
+  int64_t start = test::now_us();
+  ASSERT_TRUE(completions.wait(10));
+  double completed = (test::now_us() - start) / 1000.0;
+
+  // one after another, each on the event after the previous answer
+  printf("10 writes with response: queued in %.3f ms, completed after %.1f ms\n", queued, completed);
+  EXPECT_LT(queued, 5);
+  EXPECT_GT(completed, 10 * INTERVAL_US / 1000.0);
+  EXPECT_EQ(completions.ids(), sequence(10));
+  EXPECT_EQ(completions.results(), std::vector<bool>(10, true));
+  EXPECT_EQ(this->written(), std::vector<uint8_t>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+TEST_F(ESP32BLECallQueueTest, PipelinedWrites) {
+  Completions with_response, without_response;
+
+  int64_t start = test::now_us();
+  this->queue_writes(16, true, &with_response);
+  ASSERT_TRUE(with_response.wait(16));
+  double serial = (test::now_us() - start) / 1000.0;
+
+  start = test::now_us();
+  this->queue_writes(16, false, &without_response);
+  ASSERT_TRUE(without_response.wait(16));
+  double pipelined = (test::now_us() - start) / 1000.0;
+
+  // a few writes without response go out on every connection event
+  printf("16 writes: %.1f ms with response, %.1f ms without response, pipelined\n", serial, pipelined);
+  EXPECT_LT(pipelined, 6 * INTERVAL_US / 1000.0);
+  EXPECT_LT(pipelined * 4, serial);
+  EXPECT_EQ(without_response.ids(), sequence(16));
+  EXPECT_EQ(without_response.results(), std::vector<bool>(16, true));
+
+  auto written = this->written();
+  ASSERT_EQ(written.size(), 32u);
+  for (int i = 0; i < 32; i++)
+    EXPECT_EQ(written[i], i % 16);
+}
+
+TEST_F(ESP32BLECallQueueTest, CallbacksQueueMore) {
+  // each completion queues the next write, as a command sequence does
+  Completions completions;
+  std::function<void(int)> queue_next = [&](int i) {
+    uint8_t value = (uint8_t) i;
+    auto done = completions.add(i);
+    EXPECT_TRUE(this->client_->queue_write(ESP32BLEClient::Characteristic, this->command_, &value, 1, true,
+                                           [&, done, i](bool success) {
+                                             done(success);
+                                             if (i < 4)
+                                               queue_next(i + 1);
+                                           }));
+  };
+  queue_next(0);
+
+  ASSERT_TRUE(completions.wait(5));
+  EXPECT_EQ(completions.ids(), sequence(5));
+  EXPECT_EQ(this->written(), std::vector<uint8_t>({0, 1, 2, 3, 4}));
+}
+
+TEST_F(ESP32BLECallQueueTest, DisconnectFailsQueued) {
+  Completions completions;
+  this->queue_writes(8, true, &completions);
+  this->client_->disconnect();
+
+  // every callback is called once, the ones not sent as failed
+  ASSERT_TRUE(completions.wait(8));
+  auto results = completions.results();
+  EXPECT_EQ(completions.ids(), sequence(8));
+  EXPECT_FALSE(results.back());
+  EXPECT_LT(this->written().size(), 8u);
+
+  uint8_t value = 0;
+  EXPECT_FALSE(this->client_->queue_write(ESP32BLEClient::Characteristic, this->command_, &value, 1, true,
+                                          completions.add(8)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(completions.ids().size(), 8u);
+}
+
+}  // namespace
@@ -0,0 +1,242 @@
+// The notification ring on its own, with one producer and one consumer
+// thread, and how many notifications a client takes in per second from
+// a simulated peripheral
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "esp_bt_host.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble_client.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble_notification_ring.h"
+#include "http_client.h"
+
+namespace {
+
+const uint64_t ADDRESS = 0x001a22000003ull;
+const uint16_t SERVICE_UUID = 0x3e70;
+const uint16_t NOTIFY_UUID = 0x3fc2;
+// as reserved by the client
+const int SLOTS = 8;
+
+esp_bt_uuid_t uuid16(uint16_t value) {
+  esp_bt_uuid_t uuid = {};
+  uuid.len = ESP_UUID_LEN_16;
+  uuid.uuid.uuid16 = value;
+  return uuid;
+}
+
+bool push_value(ESP32BLENotificationRing &ring, uint32_t value, uint16_t length = sizeof(uint32_t)) {
+  std::vector<uint8_t> data(length);
+  memcpy(data.data(), &value, std::min<size_t>(length, sizeof(value)));
+  return ring.push(0x25, data.data(), length, true);
+}
+
+uint32_t front_value(const ESP32BLENotificationRing &ring) {
+  uint32_t value = 0;
+  memcpy(&value, ring.front()->get_data(), sizeof(value));
+  return value;
+}
+
+TEST(ESP32BLENotificationRingTest, PushAndPop) {
+  ESP32BLENotificationRing ring;
+  EXPECT_FALSE(push_value(ring, 1));
+  EXPECT_EQ(ring.get_dropped(), 1u);
+
+  ASSERT_TRUE(ring.reserve(4, 20));
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.front(), nullptr);
+
+  ASSERT_TRUE(push_value(ring, 42));
+  ASSERT_FALSE(ring.empty());
+  EXPECT_EQ(ring.front()->handle, 0x25);
+  EXPECT_EQ(ring.front()->length, sizeof(uint32_t));
+  EXPECT_TRUE(ring.front()->notification);
+  EXPECT_EQ(front_value(ring), 42u);
+  ring.pop();
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(ESP32BLENotificationRingTest, WrapsAround) {
+  ESP32BLENotificationRing ring;
+  ASSERT_TRUE(ring.reserve(4, 20));
+
+  // a few times around the slots, never more than three queued
+  for (uint32_t i = 0; i < 64; i++) {
+    ASSERT_TRUE(push_value(ring, i));
+    if (i >= 2) {
+      EXPECT_EQ(front_value(ring), i - 2);
+      ring.pop();
+    }
+  }
+  EXPECT_EQ(ring.get_dropped(), 0u);
+}
+
+TEST(ESP32BLENotificationRingTest, DropsWhenFull) {
+  ESP32BLENotificationRing ring;
+  ASSERT_TRUE(ring.reserve(4, 20));
+
+  for (uint32_t i = 0; i < 4; i++)
+    ASSERT_TRUE(push_value(ring, i));
+  EXPECT_FALSE(push_value(ring, 4));
+  EXPECT_FALSE(push_value(ring, 5, 21));
+  EXPECT_EQ(ring.get_dropped(), 2u);
+
+  // the ones queued stay as they were
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_EQ(front_value(ring), i);
+    ring.pop();
+  }
+
+  // one exactly the slot size fits
+  EXPECT_TRUE(push_value(ring, 6, 20));
+  EXPECT_EQ(ring.front()->length, 20);
+}
+
+TEST(ESP32BLENotificationRingTest, Clear) {
+  ESP32BLENotificationRing ring;
+  ASSERT_TRUE(ring.reserve(4, 20));
+  for (uint32_t i = 0; i < 3; i++)
+    push_value(ring, i);
+
+  ring.clear();
+  EXPECT_TRUE(ring.empty());
+  ASSERT_TRUE(push_value(ring, 7));
+  EXPECT_EQ(front_value(ring), 7u);
+}
+
+TEST(ESP32BLENotificationRingTest, Reserve) {
+  ESP32BLENotificationRing ring;
+  ASSERT_TRUE(ring.reserve(4, 20));
+  push_value(ring, 1);
+
+  // a larger MTU after reconnecting starts over with bigger slots
+  ASSERT_TRUE(ring.reserve(8, 244));
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.get_slot_size(), 244);
+  EXPECT_TRUE(push_value(ring, 2, 244));
+  EXPECT_EQ(front_value(ring), 2u);
+}
+
+TEST(ESP32BLENotificationRingTest, ProducerAndConsumer) {
+  const uint32_t COUNT = 200000;
+  ESP32BLENotificationRing ring;
+  ASSERT_TRUE(ring.reserve(SLOTS, 20));
+
+  // the producer retries until there is a slot, so that nothing is lost
+  // and every value has to come out once and in order
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < COUNT; i++) {
+      uint8_t data[20];
+      for (size_t j = 0; j < sizeof(data); j++)
+        data[j] = (uint8_t) (i + j);
+      while (!ring.push(0x25, data, 1 + i % sizeof(data), true))
+        std::this_thread::yield();
+    }
+  });
+
+  uint32_t received = 0, corrupted = 0;
+  int64_t start = test::now_us();
+  while (received < COUNT) {
+    auto slot = ring.front();
+    if (!slot) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (slot->length != 1 + received % 20)
+      corrupted++;
+    for (size_t j = 0; j < slot->length; j++) {
+      if (slot->get_data()[j] != (uint8_t) (received + j)) {
+        corrupted++;
+        break;
+      }
+    }
+    ring.pop();
+    received++;
+  }
+  double elapsed = (test::now_us() - start) / 1e6;
+  producer.join();
+
+  printf("ring of %d slots, two threads: %u notifications, %.0f per second, found full %u times\n", SLOTS, COUNT,
+         COUNT / elapsed, ring.get_dropped());
+  EXPECT_EQ(corrupted, 0u);
+  EXPECT_TRUE(ring.empty());
+}
+
+class ESP32BLENotificationRateBench : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    host_bt_reset();
+    HostBTPeripheral peripheral;
+    peripheral.address = ADDRESS;
+    peripheral.service_uuid = SERVICE_UUID;
+    peripheral.characteristics = {NOTIFY_UUID};
+    host_bt_add_peripheral(peripheral);
+
+    this->client_.reset(ESP32BLE::instance().acquire(1000, ADDRESS));
+    ASSERT_TRUE(this->client_);
+    this->client_->set_address(ADDRESS);
+    this->client_->set_handle_cache(false);
+    ASSERT_TRUE(this->client_->connect());
+    this->notify_ = this->client_->get_characteristic(uuid16(SERVICE_UUID), uuid16(NOTIFY_UUID));
+    ASSERT_NE(this->notify_, 0);
+    ASSERT_TRUE(this->client_->register_notify(this->notify_, true));
+  }
+
+  void TearDown() override { this->client_.reset(); }
+
+  // Notifies count at once and takes them in, returns how many came
+  int burst(int count, const std::vector<uint8_t> &value) {
+    host_bt_notify(ADDRESS, this->notify_, value, count);
+    int received = 0;
+    while (received < count) {
+      int taken = this->client_->wait_for_notifications(100, [&](const ESP32BLEClient::Notification &notification) {
+        EXPECT_EQ(notification.length, value.size());
+        EXPECT_EQ(memcmp(notification.get_data(), value.data(), value.size()), 0);
+      });
+      if (!taken)
+        break;
+      received += taken;
+    }
+    return received;
+  }
+
+  std::unique_ptr<ESP32BLEClient> client_;
+  uint16_t notify_{0};
+};
+
+TEST_F(ESP32BLENotificationRateBench, BurstsOfRingSize) {
+  const int BURSTS = 500;
+  std::vector<uint8_t> value(244, 0x5a);
+
+  int received = 0;
+  int64_t start = test::now_us();
+  for (int i = 0; i < BURSTS; i++)
+    received += this->burst(SLOTS, value);
+  double elapsed = (test::now_us() - start) / 1e6;
+
+  printf("%d bursts of %d notifications of %zu bytes: %.0f per second, %u dropped\n", BURSTS, SLOTS, value.size(),
+         received / elapsed, this->client_->get_dropped_notifications());
+  EXPECT_EQ(received, BURSTS * SLOTS);
+  EXPECT_EQ(this->client_->get_dropped_notifications(), 0u);
+}
+
+TEST_F(ESP32BLENotificationRateBench, LongerBurst) {
+  // more at once than there are slots: the ones that do not fit are
+  // counted as dropped, nothing else goes missing
+  const int COUNT = 4 * SLOTS;
+  int received = this->burst(COUNT, {0x01, 0x02, 0x03});
+  uint32_t dropped = this->client_->get_dropped_notifications();
+
+  printf("burst of %d notifications into %d slots: %d received, %u dropped\n", COUNT, SLOTS, received, dropped);
+  EXPECT_GE(received, SLOTS);
+  EXPECT_EQ(received + (int) dropped, COUNT);
+}
+
+}  // namespace
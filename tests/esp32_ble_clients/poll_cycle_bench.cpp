@@ -0,0 +1,140 @@
+// Time to poll every one of N simulated thermostats, one after another
+// against the connection pool, and with one of them slow to answer
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "esp_bt_host.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble_client.h"
+#include "http_client.h"
+
+namespace {
+
+const uint16_t SERVICE_UUID = 0x3e70;
+const uint16_t COMMAND_UUID = 0x3fc1;
+const uint32_t INTERVAL_US = 7500;
+const int PERIPHERALS = 12;
+
+esp_bt_uuid_t uuid16(uint16_t value) {
+  esp_bt_uuid_t uuid = {};
+  uuid.len = ESP_UUID_LEN_16;
+  uuid.uuid.uuid16 = value;
+  return uuid;
+}
+
+class ESP32BLEPollCycleBench : public ::testing::Test {
+ protected:
+  void SetUp() override { host_bt_reset(); }
+
+  // Peripherals of the test get addresses of their own, as handles of
+  // earlier ones stay cached
+  uint64_t add_peripheral(uint32_t interval_us) {
+    static uint64_t next_address = 0x001a22100000ull;
+    HostBTPeripheral peripheral;
+    peripheral.address = next_address++;
+    peripheral.service_uuid = SERVICE_UUID;
+    peripheral.characteristics = {COMMAND_UUID};
+    peripheral.interval_us = interval_us;
+    peripheral.on_write = [](uint16_t handle, const HostBTPeripheral::Value &value) {
+      return std::vector<HostBTPeripheral::Value>{value};
+    };
+    host_bt_add_peripheral(peripheral);
+    return peripheral.address;
+  }
+
+  // What a thermostat update does: connect, send a command, wait for the answer
+  static bool poll(uint64_t address) {
+    std::unique_ptr<ESP32BLEClient> client(ESP32BLE::instance().acquire(30000, address));
+    if (!client)
+      return false;
+    client->set_address(address);
+    client->set_timeout(5000);
+    if (!client->connect() || !client->request_services())
+      return false;
+
+    auto command = client->get_characteristic(uuid16(SERVICE_UUID), uuid16(COMMAND_UUID));
+    if (!command || !client->queue_register_notify(command, true))
+      return false;
+
+    uint8_t query[] = {0x03};
+    if (!client->write(ESP32BLEClient::Characteristic, command, query, sizeof(query), false))
+      return false;
+    return client->wait_for_notifications(5000, [](const ESP32BLEClient::Notification &) {}) > 0;
+  }
+
+  // Polls every address from the pool tasks, returns when each was done, in ms
+  std::vector<double> poll_all(const std::vector<uint64_t> &addresses) {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<double> done(addresses.size(), -1);
+    size_t remaining = addresses.size();
+
+    int64_t start = test::now_us();
+    for (size_t i = 0; i < addresses.size(); i++) {
+      auto address = addresses[i];
+      EXPECT_TRUE(ESP32BLE::instance().queue([&, i, address]() {
+        bool success = poll(address);
+        std::lock_guard<std::mutex> guard(lock);
+        EXPECT_TRUE(success) << "peripheral " << i;
+        done[i] = (test::now_us() - start) / 1000.0;
+        remaining--;
+        cond.notify_all();
+      }));
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    cond.wait(guard, [&]() { return remaining == 0; });
+    return done;
+  }
+};
+
+TEST_F(ESP32BLEPollCycleBench, SerialAndPooled) {
+  // separate ones for each run, both start without cached handles
+  std::vector<uint64_t> serial_addresses, pooled_addresses;
+  for (int i = 0; i < PERIPHERALS; i++) {
+    serial_addresses.push_back(this->add_peripheral(INTERVAL_US));
+    pooled_addresses.push_back(this->add_peripheral(INTERVAL_US));
+  }
+
+  // one after another, as with a single client
+  int64_t start = test::now_us();
+  for (auto address : serial_addresses)
+    ASSERT_TRUE(poll(address));
+  double serial = (test::now_us() - start) / 1000.0;
+
+  auto done = this->poll_all(pooled_addresses);
+  double pooled = *std::max_element(done.begin(), done.end());
+
+  printf("%d peripherals at %.1f ms interval: serial %.0f ms, pooled %.0f ms on %d connections, "
+         "at most %d open\n",
+         PERIPHERALS, INTERVAL_US / 1000.0, serial, pooled, ESP32BLE::instance().get_max_clients(),
+         host_bt_get_max_connections());
+  EXPECT_EQ(host_bt_get_max_connections(), ESP32BLE::instance().get_max_clients());
+  EXPECT_LT(pooled, serial / 2);
+}
+
+TEST_F(ESP32BLEPollCycleBench, SlowPeripheral) {
+  // the first one queued takes seconds, with a 200 ms interval
+  std::vector<uint64_t> addresses;
+  addresses.push_back(this->add_peripheral(200000));
+  for (int i = 1; i < PERIPHERALS; i++)
+    addresses.push_back(this->add_peripheral(INTERVAL_US));
+
+  auto done = this->poll_all(addresses);
+  double slow = done[0];
+  double others = *std::max_element(done.begin() + 1, done.end());
+
+  // the others share the remaining connections meanwhile
+  printf("%d peripherals, the first at 200 ms interval: it took %.0f ms, the others were done after %.0f ms\n",
+         PERIPHERALS, slow, others);
+  EXPECT_LT(others, slow);
+}
+
+}  // namespace
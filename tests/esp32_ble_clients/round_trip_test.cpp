@@ -0,0 +1,141 @@
+// GATT round trips of a client against a simulated peripheral: how long
+// the caller takes to wake up once the GATTC event arrives, and timeouts
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "esp_bt_host.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble.h"
+#include "esphome/components/esp32_ble_clients/esp32_ble_client.h"
+#include "http_client.h"
+
+namespace {
+
+const uint64_t ADDRESS = 0x001a22000001ull;
+const uint16_t SERVICE_UUID = 0x3e70;
+const uint16_t COMMAND_UUID = 0x3fc1;
+const uint16_t NOTIFY_UUID = 0x3fc2;
+const uint32_t INTERVAL_US = 7500;
+
+esp_bt_uuid_t uuid16(uint16_t value) {
+  esp_bt_uuid_t uuid = {};
+  uuid.len = ESP_UUID_LEN_16;
+  uuid.uuid.uuid16 = value;
+  return uuid;
+}
+
+class ESP32BLERoundTripTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    host_bt_reset();
+    this->peripheral_.address = ADDRESS;
+    this->peripheral_.service_uuid = SERVICE_UUID;
+    this->peripheral_.characteristics = {COMMAND_UUID, NOTIFY_UUID};
+    this->peripheral_.interval_us = INTERVAL_US;
+    // answers every command with a notification, as thermostats do
+    this->peripheral_.on_write = [](uint16_t handle, const HostBTPeripheral::Value &value) {
+      return std::vector<HostBTPeripheral::Value>{value};
+    };
+    host_bt_add_peripheral(this->peripheral_);
+
+    this->client_.reset(ESP32BLE::instance().acquire(1000, ADDRESS));
+    ASSERT_TRUE(this->client_);
+    this->client_->set_address(ADDRESS);
+    this->client_->set_handle_cache(false);
+    this->client_->set_timeout(1000);
+    ASSERT_TRUE(this->client_->connect());
+
+    this->command_ = this->client_->get_characteristic(uuid16(SERVICE_UUID), uuid16(COMMAND_UUID));
+    this->notify_ = this->client_->get_characteristic(uuid16(SERVICE_UUID), uuid16(NOTIFY_UUID));
+    ASSERT_NE(this->command_, 0);
+    ASSERT_NE(this->notify_, 0);
+  }
+
+  void TearDown() override { this->client_.reset(); }
+
+  HostBTPeripheral peripheral_;
+  std::unique_ptr<ESP32BLEClient> client_;
+  uint16_t command_{0};
+  uint16_t notify_{0};
+};
+
+TEST_F(ESP32BLERoundTripTest, WriteWithResponse) {
+  std::vector<double> round_trips, wake_ups;
+  for (int i = 0; i < 100; i++) {
+    uint8_t command[] = {0x03, (uint8_t) i};
+    int64_t start = test::now_us();
+    ASSERT_TRUE(this->client_->write(ESP32BLEClient::Characteristic, this->command_, command, sizeof(command), true));
+    int64_t end = test::now_us();
+    round_trips.push_back((end - start) / 1000.0);
+    wake_ups.push_back((end - host_bt_get_last_event_us()) / 1000.0);
+  }
+
+  // the request waits for the next connection event, the response comes
+  // on the one after, the caller is woken up by the event itself, where
+  // polling every 10 ms added 5 ms on average. On a single core the
+  // tail still waits for the CPU now and then.
+  double wake_up = test::percentile(wake_ups, 0.9);
+  double round_trip = test::percentile(round_trips, 0.9);
+  printf("write with response at %.1f ms interval: round trip p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, "
+         "wake up p50 %.3f ms, p90 %.3f ms, p99 %.3f ms\n",
+         INTERVAL_US / 1000.0, test::percentile(round_trips, 0.5), round_trip, test::percentile(round_trips, 0.99),
+         test::percentile(wake_ups, 0.5), wake_up, test::percentile(wake_ups, 0.99));
+  EXPECT_LT(wake_up, 1);
+  EXPECT_LT(round_trip, 2 * INTERVAL_US / 1000.0 + 1);
+}
+
+TEST_F(ESP32BLERoundTripTest, CommandAndNotification) {
+  ASSERT_TRUE(this->client_->register_notify(this->notify_, true));
+  ASSERT_TRUE(this->client_->write_notify_desc(this->notify_, true, true));
+
+  // the thermostat answers on the characteristic written to
+  ASSERT_TRUE(this->client_->register_notify(this->command_, true));
+
+  std::vector<double> round_trips, wake_ups;
+  for (int i = 0; i < 100; i++) {
+    uint8_t command[] = {0x03, (uint8_t) i};
+    int64_t start = test::now_us();
+    ASSERT_TRUE(this->client_->write(ESP32BLEClient::Characteristic, this->command_, command, sizeof(command), false));
+
+    int received = 0;
+    ASSERT_EQ(this->client_->wait_for_notifications(1000,
+                                                   [&](const ESP32BLEClient::Notification &notification) {
+                                                     EXPECT_EQ(notification.length, sizeof(command));
+                                                     EXPECT_EQ(notification.get_data()[1], (uint8_t) i);
+                                                     received++;
+                                                   }),
+              1);
+    int64_t end = test::now_us();
+    round_trips.push_back((end - start) / 1000.0);
+    wake_ups.push_back((end - host_bt_get_last_event_us()) / 1000.0);
+  }
+
+  double wake_up = test::percentile(wake_ups, 0.9);
+  printf("command and notification at %.1f ms interval: round trip p50 %.2f ms, p99 %.2f ms, "
+         "wake up p50 %.3f ms, p90 %.3f ms, p99 %.3f ms\n",
+         INTERVAL_US / 1000.0, test::percentile(round_trips, 0.5), test::percentile(round_trips, 0.99),
+         test::percentile(wake_ups, 0.5), wake_up, test::percentile(wake_ups, 0.99));
+  EXPECT_LT(wake_up, 1);
+  EXPECT_EQ(this->client_->get_dropped_notifications(), 0u);
+}
+
+TEST_F(ESP32BLERoundTripTest, Timeout) {
+  // the device stops answering, the link stays up
+  this->peripheral_.unresponsive = true;
+  host_bt_add_peripheral(this->peripheral_);
+  this->client_->set_timeout(200);
+
+  uint8_t command[] = {0x03};
+  int64_t start = test::now_us();
+  EXPECT_FALSE(this->client_->write(ESP32BLEClient::Characteristic, this->command_, command, sizeof(command), true));
+  int64_t elapsed = test::now_us() - start;
+
+  printf("write without an answer: gave up after %.1f ms\n", elapsed / 1000.0);
+  EXPECT_GE(elapsed, 200000);
+  EXPECT_LT(elapsed, 260000);
+}
+
+}  // namespace
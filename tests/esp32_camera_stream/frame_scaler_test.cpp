@@ -0,0 +1,161 @@
+// Thumbnails of the frame scaler decoded again: their size and content
+// against the full frame at every scale, and what scaling costs per frame
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "esphome/components/esp32_camera/esp32_camera.h"
+#include "esphome/components/esp32_camera_stream/frame_scaler.h"
+#include "esphome/components/esp32_camera_stream/frame_source.h"
+#include "http_client.h"
+
+using esphome::esp32_camera::CameraImage;
+using esphome::esp32_camera::ESP32Camera;
+using esphome::esp32_camera_stream::Frame;
+using esphome::esp32_camera_stream::FrameScale;
+using esphome::esp32_camera_stream::FrameScaler;
+using esphome::esp32_camera_stream::ScaledImage;
+
+namespace {
+
+const uint16_t WIDTH = 640;
+const uint16_t HEIGHT = 480;
+const int ITERATIONS = 50;
+
+struct Image {
+  int width{0};
+  int height{0};
+  std::vector<uint8_t> rgb;
+
+  const uint8_t *at(int x, int y) const { return &this->rgb[((size_t) y * this->width + x) * 3]; }
+};
+
+bool decode(const uint8_t *data, size_t length, Image *image) {
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr err;
+
+  cinfo.err = jpeg_std_error(&err);
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, data, length);
+  if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  cinfo.out_color_space = JCS_RGB;
+  jpeg_start_decompress(&cinfo);
+
+  image->width = cinfo.output_width;
+  image->height = cinfo.output_height;
+  image->rgb.resize((size_t) image->width * image->height * 3);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = &image->rgb[(size_t) cinfo.output_scanline * image->width * 3];
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+// Mean difference per channel against the full image averaged over blocks of factor x factor
+double mean_difference(const Image &full, const Image &scaled, int factor) {
+  double sum = 0;
+  for (int y = 0; y < scaled.height; y++) {
+    for (int x = 0; x < scaled.width; x++) {
+      for (int c = 0; c < 3; c++) {
+        int average = 0;
+        for (int dy = 0; dy < factor; dy++) {
+          for (int dx = 0; dx < factor; dx++)
+            average += full.at(x * factor + dx, y * factor + dy)[c];
+        }
+        average /= factor * factor;
+        sum += std::abs(average - scaled.at(x, y)[c]);
+      }
+    }
+  }
+  return sum / ((double) scaled.width * scaled.height * 3);
+}
+
+class FrameScalerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // the square of the synthetic camera is at the left edge in the first frame
+    this->jpeg_ = std::make_shared<const std::vector<uint8_t>>(ESP32Camera::generate_frame(WIDTH, HEIGHT, 80, 0));
+    ASSERT_FALSE(this->jpeg_->empty());
+    ASSERT_TRUE(decode(this->jpeg_->data(), this->jpeg_->size(), &this->full_));
+  }
+
+  // The same image under a new id, so that the scaler does not answer from its cache
+  std::shared_ptr<const Frame> next_frame() {
+    auto frame = std::make_shared<Frame>();
+    frame->image = std::make_shared<CameraImage>(this->jpeg_, 0);
+    frame->id = ++this->frame_id_;
+    frame->time = 0;
+    return frame;
+  }
+
+  std::shared_ptr<const std::vector<uint8_t>> jpeg_;
+  Image full_;
+  uint32_t frame_id_{0};
+};
+
+const FrameScale SCALES[] = {esphome::esp32_camera_stream::SCALE_1_2, esphome::esp32_camera_stream::SCALE_1_4,
+                             esphome::esp32_camera_stream::SCALE_1_8};
+
+TEST_F(FrameScalerTest, Decodes) {
+  FrameScaler scaler;
+  for (auto scale : SCALES) {
+    int factor = 1 << scale;
+    auto image = scaler.scale(this->next_frame(), scale);
+    ASSERT_TRUE(image) << "1/" << factor;
+
+    Image scaled;
+    ASSERT_TRUE(decode(image->data, image->length, &scaled)) << "1/" << factor;
+    EXPECT_EQ(scaled.width, WIDTH / factor);
+    EXPECT_EQ(scaled.height, HEIGHT / factor);
+
+    // the middle of the red square, and the gradient on the right
+    const uint8_t *square = scaled.at(60 / factor, 240 / factor);
+    EXPECT_GT(square[0], 200) << "1/" << factor;
+    EXPECT_LT(square[1], 110) << "1/" << factor;
+    EXPECT_LT(square[2], 80) << "1/" << factor;
+    const uint8_t *gradient = scaled.at(480 / factor, 60 / factor);
+    const uint8_t *expected = this->full_.at(480, 60);
+    for (int c = 0; c < 3; c++)
+      EXPECT_NEAR(gradient[c], expected[c], 24) << "1/" << factor << " channel " << c;
+
+    double difference = mean_difference(this->full_, scaled, factor);
+    printf("1/%d: %dx%d, %zu bytes, mean difference %.2f per channel\n", factor, scaled.width, scaled.height,
+           image->length, difference);
+    EXPECT_LT(difference, 8) << "1/" << factor;
+  }
+}
+
+TEST_F(FrameScalerTest, Bench) {
+  FrameScaler scaler;
+  printf("scaling a %dx%d frame of %zu bytes:\n", WIDTH, HEIGHT, this->jpeg_->size());
+  for (auto scale : SCALES) {
+    int64_t start = test::now_us();
+    for (int i = 0; i < ITERATIONS; i++)
+      ASSERT_TRUE(scaler.scale(this->next_frame(), scale));
+    double per_frame = (double) (test::now_us() - start) / ITERATIONS;
+
+    // a second request for the same frame is answered from the cache
+    auto frame = this->next_frame();
+    scaler.scale(frame, scale);
+    start = test::now_us();
+    for (int i = 0; i < ITERATIONS; i++)
+      scaler.scale(frame, scale);
+    double cached = (double) (test::now_us() - start) / ITERATIONS;
+
+    printf("  1/%d: %.0f us per frame, %.2f us cached\n", 1 << scale, per_frame, cached);
+    EXPECT_LT(cached, per_frame);
+  }
+}
+
+}  // namespace
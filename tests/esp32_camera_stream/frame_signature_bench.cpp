@@ -0,0 +1,184 @@
+// Change detection on JPEG sequences: how many bytes skipping unchanged
+// frames saves, how far moving content gets before it is sent, and what
+// the signature costs per frame
+//
+// The sequences are rendered rather than recorded: a static scene, slow,
+// fast and bursty motion, all with sensor noise, encoded as the sensor
+// does with a restart marker every MCU row. Unlike a recording, every frame is known
+// to have changed or not, so the drift of what clients see can be told.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "esphome/components/esp32_camera_stream/frame_pacer.h"
+#include "esphome/components/esp32_camera_stream/frame_signature.h"
+
+using esphome::esp32_camera_stream::FramePacer;
+using esphome::esp32_camera_stream::FrameSignature;
+
+namespace {
+
+const uint16_t WIDTH = 640;
+const uint16_t HEIGHT = 480;
+const int FRAMES = 100;
+const uint32_t FRAME_INTERVAL = 40;
+
+struct Position {
+  int left;
+  int top;
+};
+
+// Encoded with a restart marker every MCU row, as the sensor does
+std::vector<uint8_t> encode(const std::vector<uint8_t> &rgb) {
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr err;
+  unsigned char *buffer = nullptr;
+  unsigned long length = 0;
+
+  cinfo.err = jpeg_std_error(&err);
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &buffer, &length);
+  cinfo.image_width = WIDTH;
+  cinfo.image_height = HEIGHT;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 80, TRUE);
+  cinfo.restart_in_rows = 1;
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < HEIGHT) {
+    JSAMPROW row = (JSAMPROW) &rgb[cinfo.next_scanline * WIDTH * 3];
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+
+  std::vector<uint8_t> data(buffer, buffer + length);
+  free(buffer);
+  return data;
+}
+
+// A tiled wall, the same in every frame, a square in front of it
+// and sensor noise of +-noise
+std::vector<uint8_t> render(Position position, int noise, unsigned *seed) {
+  std::vector<uint8_t> rgb((size_t) WIDTH * HEIGHT * 3);
+  const uint16_t size = HEIGHT / 4;
+  for (uint16_t y = 0; y < HEIGHT; y++) {
+    for (uint16_t x = 0; x < WIDTH; x++) {
+      bool square = x >= position.left && x < position.left + size && y >= position.top && y < position.top + size;
+      int base[3] = {x * 255 / WIDTH, y * 255 / HEIGHT, ((x / 16 + y / 16) % 2) * 64 + 64};
+      if (square) {
+        base[0] = 240;
+        base[1] = 40;
+        base[2] = 40;
+      }
+      for (int c = 0; c < 3; c++) {
+        int value = base[c] + (noise ? (int) (rand_r(seed) % (2 * noise + 1)) - noise : 0);
+        rgb[((size_t) y * WIDTH + x) * 3 + c] = (uint8_t) std::min(std::max(value, 0), 255);
+      }
+    }
+  }
+  return rgb;
+}
+
+struct Sequence {
+  const char *name;
+  // position of the square in frame i
+  std::function<Position(int)> position;
+};
+
+class FrameSignatureBench : public ::testing::Test {
+ protected:
+  void run(const Sequence &sequence) {
+    unsigned seed = 1;
+    std::vector<std::vector<uint8_t>> frames;
+    for (int i = 0; i < FRAMES; i++)
+      frames.push_back(encode(render(sequence.position(i), 3, &seed)));
+
+    FramePacer pacer;
+    pacer.set_change_threshold(0.02f);
+    pacer.set_keep_alive(2000);
+    pacer.start(0);
+
+    size_t total = 0, sent = 0;
+    int frames_sent = 0, drift = 0;
+    Position last = {-1, -1};
+    std::chrono::nanoseconds cpu{0};
+
+    for (int i = 0; i < FRAMES; i++) {
+      auto &frame = frames[i];
+      auto start = std::chrono::steady_clock::now();
+      // once per frame in FrameSource, once per client in the pacer
+      FrameSignature signature;
+      signature.compute(frame.data(), frame.size());
+      auto verdict = pacer.check(i * FRAME_INTERVAL, signature, i * FRAME_INTERVAL);
+      cpu += std::chrono::steady_clock::now() - start;
+
+      total += frame.size();
+      if (verdict == FramePacer::SEND) {
+        sent += frame.size();
+        frames_sent++;
+        last = sequence.position(i);
+      } else {
+        // how far the client's picture is behind the scene
+        Position now = sequence.position(i);
+        drift = std::max(drift, abs(now.left - last.left) + abs(now.top - last.top));
+      }
+    }
+
+    this->saved_ = 1.0 - (double) sent / total;
+    this->drift_ = drift;
+    printf("%-10s: %3d of %d frames sent, %4.1f%% of %4zu kB saved, skipped up to %2d px of motion, "
+           "%.1f us per %zu kB frame\n",
+           sequence.name, frames_sent, FRAMES, this->saved_ * 100, total / 1024, drift,
+           cpu.count() / 1000.0 / FRAMES, total / FRAMES / 1024);
+  }
+
+  double saved_{0};
+  int drift_{0};
+};
+
+// The threshold is a share of the compressed size, so the 120 px square
+// has to move by some pixels before a frame is sent. Motion adds up
+// against the last frame sent, so it is delayed, not lost.
+
+TEST_F(FrameSignatureBench, Static) {
+  // only the sensor noise changes, a frame is resent every keep alive
+  this->run({"static", [](int i) { return Position{100, 160}; }});
+  EXPECT_GT(this->saved_, 0.9);
+}
+
+TEST_F(FrameSignatureBench, Vertical) {
+  this->run({"vertical", [](int i) { return Position{100, 2 * i}; }});
+  EXPECT_LE(this->drift_, 16);
+}
+
+TEST_F(FrameSignatureBench, Burst) {
+  // still, then half a second of motion, then still again
+  this->run({"burst", [](int i) { return Position{100, 100 + 8 * std::min(std::max(i - 40, 0), 12)}; }});
+  EXPECT_LE(this->drift_, 16);
+  EXPECT_GT(this->saved_, 0.7);
+}
+
+TEST_F(FrameSignatureBench, Slow) {
+  this->run({"slow", [](int i) { return Position{100, 100 + i}; }});
+  EXPECT_LE(this->drift_, 16);
+  EXPECT_GT(this->saved_, 0.5);
+}
+
+TEST_F(FrameSignatureBench, Horizontal) {
+  // restart intervals are rows of blocks, this is only seen through
+  // the background the square covers and uncovers
+  this->run({"horizontal", [](int i) { return Position{4 * i, 160}; }});
+  EXPECT_LE(this->drift_, 16);
+}
+
+}  // namespace
@@ -0,0 +1,153 @@
+// Multipart frames written with a single gather call against a write per
+// buffer, with and without Nagle, over loopback
+
+#include <gtest/gtest.h>
+// the kernel header, as the one of glibc lacks the segment counters
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "esphome/components/esp32_camera_stream/multipart_framer.h"
+#include "http_client.h"
+
+using esphome::esp32_camera_stream::MultipartFramer;
+
+namespace {
+
+// about a 640x480 frame of the camera
+const size_t FRAME_SIZE = 20000;
+// TCP_MSS of lwIP in ESP-IDF, instead of the 64k of loopback
+const int MSS = 1436;
+
+struct Result {
+  double fps{0};
+  double p50{0};
+  double p99{0};
+  double segments{0};
+  double syscalls{0};
+};
+
+class MultipartFramerBench : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    this->frame_.resize(FRAME_SIZE);
+    for (size_t i = 0; i < FRAME_SIZE; i++)
+      this->frame_[i] = (uint8_t) i;
+  }
+
+  // Sends frames, every interval us or back to back, and reads them as parts
+  Result run(bool gather, bool nodelay, int frames, int64_t interval) {
+    uint16_t port = test::free_port();
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    setsockopt(listen_fd, IPPROTO_TCP, TCP_MAXSEG, &MSS, sizeof(MSS));
+    EXPECT_EQ(bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    EXPECT_EQ(listen(listen_fd, 1), 0);
+
+    test::Connection conn;
+    EXPECT_TRUE(conn.connect(port));
+    int fd = accept(listen_fd, nullptr, nullptr);
+    close(listen_fd);
+    int enable = nodelay;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    std::vector<std::atomic<int64_t>> started(frames);
+    std::atomic<int> syscalls{0};
+    std::thread sender([&]() {
+      MultipartFramer framer;
+      for (int i = 0; i < frames; i++) {
+        if (interval)
+          std::this_thread::sleep_for(std::chrono::microseconds(interval));
+        started[i] = test::now_us();
+        framer.begin_part(this->frame_.data(), this->frame_.size());
+
+        while (!framer.is_done()) {
+          struct iovec iov[MultipartFramer::MAX_IOV];
+          int iovcnt = framer.get_iov(iov);
+          // one write for what is left of the first buffer otherwise
+          struct msghdr msg = {};
+          msg.msg_iov = iov;
+          msg.msg_iovlen = gather ? iovcnt : 1;
+          int ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
+          syscalls++;
+          if (ret <= 0)
+            return;
+          framer.consume(ret);
+        }
+      }
+    });
+
+    Result result;
+    std::vector<double> latencies;
+    test::Response response;
+    EXPECT_TRUE(test::read_response_head(conn, &response));
+    test::MultipartReader reader(conn);
+    std::string part;
+    int64_t start = test::now_us();
+    for (int i = 0; i < frames; i++) {
+      if (!reader.next_part(&part) || part.size() != FRAME_SIZE) {
+        ADD_FAILURE() << "part " << i;
+        break;
+      }
+      latencies.push_back((test::now_us() - started[i]) / 1000.0);
+    }
+    double elapsed = (test::now_us() - start) / 1e6;
+    sender.join();
+
+    struct tcp_info info = {};
+    socklen_t len = sizeof(info);
+    getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    close(fd);
+
+    result.fps = frames / elapsed;
+    result.p50 = test::percentile(latencies, 0.5);
+    result.p99 = test::percentile(latencies, 0.99);
+    result.segments = (double) info.tcpi_segs_out / frames;
+    result.syscalls = (double) syscalls / frames;
+    printf("%-6s %-7s: %7.0f fps, latency p50 %6.2f ms, p99 %6.2f ms, %.1f segments and %.1f calls per frame\n",
+           gather ? "gather" : "writes", nodelay ? "nodelay" : "nagle", result.fps, result.p50, result.p99,
+           result.segments, result.syscalls);
+    return result;
+  }
+
+  std::vector<uint8_t> frame_;
+};
+
+TEST_F(MultipartFramerBench, BackToBack) {
+  // bound by the reader, latencies only show the queue in front of it
+  for (bool nodelay : {true, false}) {
+    Result gather = this->run(true, nodelay, 2000, 0);
+    Result writes = this->run(false, nodelay, 2000, 0);
+    EXPECT_LT(gather.syscalls, writes.syscalls);
+  }
+}
+
+TEST_F(MultipartFramerBench, Paced) {
+  // at the 25 fps of the camera, every frame starts on an idle connection
+  Result results[2][2];
+  for (bool nodelay : {true, false}) {
+    results[1][nodelay] = this->run(true, nodelay, 25, 40000);
+    results[0][nodelay] = this->run(false, nodelay, 25, 40000);
+  }
+
+  // head and boundary share the segments of the image,
+  // instead of going out in small segments of their own
+  size_t full = (FRAME_SIZE + 200 + MSS - 1) / MSS;
+  EXPECT_LE(results[1][true].segments, full + 0.5);
+  EXPECT_GE(results[0][true].segments, full + 1);
+  EXPECT_LT(results[1][true].p99, 10);
+}
+
+}  // namespace
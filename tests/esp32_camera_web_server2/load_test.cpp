@@ -0,0 +1,273 @@
+// Idle CPU and first-byte latency of the single task camera web server,
+// serving the synthetic camera of the shims over loopback
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "esphome/components/esp32_camera/esp32_camera.h"
+#include "esphome/components/esp32_camera_stream/frame_scaler.h"
+#include "esphome/components/esp32_camera_web_server2/camera_web_server.h"
+#include "http_client.h"
+
+using esphome::esp32_camera::ESP32Camera;
+using esphome::esp32_camera_web_server::CameraWebServer;
+
+namespace {
+
+// CPU time in us of the threads of this process with the given name,
+// -1 if there is none
+int64_t thread_cpu_us(const std::string &name) {
+  int64_t ticks = -1;
+  DIR *dir = opendir("/proc/self/task");
+  while (struct dirent *entry = readdir(dir)) {
+    std::string path = std::string("/proc/self/task/") + entry->d_name;
+    std::string comm;
+    std::ifstream(path + "/comm") >> comm;
+    if (comm != name)
+      continue;
+
+    // utime and stime are fields 14 and 15, counted after the
+    // parenthesized command name, which may contain spaces
+    std::string stat;
+    std::getline(std::ifstream(path + "/stat"), stat);
+    std::string fields = stat.substr(stat.rfind(')') + 2);
+    unsigned long utime = 0, stime = 0;
+    sscanf(fields.c_str(), "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+    ticks = std::max<int64_t>(ticks, 0) + utime + stime;
+  }
+  closedir(dir);
+  if (ticks < 0)
+    return -1;
+  return ticks * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+bool is_jpeg(const std::string &data) {
+  return data.size() > 4 && (uint8_t) data[0] == 0xFF && (uint8_t) data[1] == 0xD8 &&
+         (uint8_t) data[data.size() - 2] == 0xFF && (uint8_t) data[data.size() - 1] == 0xD9;
+}
+
+class CameraWebServer2Test : public ::testing::Test {
+ protected:
+  // name of the server task, as truncated for the thread
+  static constexpr const char *TASK_NAME = "esp32_camera_we";
+
+  void SetUp() override {
+    this->port_ = test::free_port();
+    this->camera_.set_resolution(this->width_, this->height_);
+    this->camera_.set_max_framerate(25);
+    this->camera_.setup();
+    this->server_.set_port(this->port_);
+    this->server_.set_mode(esphome::esp32_camera_web_server::STREAM);
+    if (this->recording_)
+      this->server_.set_recording(10000, 1 << 20, 5, this->continuous_);
+    this->server_.setup();
+    ASSERT_FALSE(this->server_.is_failed());
+  }
+
+  void TearDown() override {
+    this->server_.on_shutdown();
+    this->camera_.on_shutdown();
+  }
+
+  uint16_t port_{0};
+  uint16_t width_{320};
+  uint16_t height_{240};
+  bool recording_{false};
+  bool continuous_{false};
+  ESP32Camera camera_;
+  CameraWebServer server_;
+};
+
+// Frames large enough for the thumbnails to take a while
+class CameraWebServer2ScaleTest : public CameraWebServer2Test {
+ protected:
+  void SetUp() override {
+    this->width_ = 1600;
+    this->height_ = 1200;
+    CameraWebServer2Test::SetUp();
+  }
+};
+
+// With a recording of the last seconds, fed with what clients watch
+class CameraWebServer2RecordingTest : public CameraWebServer2Test {
+ protected:
+  void SetUp() override {
+    this->recording_ = true;
+    CameraWebServer2Test::SetUp();
+  }
+
+  // Number of JPEGs in the recording
+  int get_recorded() {
+    auto response = test::get(this->port_, "/recording");
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.headers["content-type"], "video/x-motion-jpeg");
+    int frames = 0;
+    for (size_t pos = 0; (pos = response.body.find("\xFF\xD8\xFF", pos)) != std::string::npos; pos++)
+      frames++;
+    return frames;
+  }
+
+  void stream(int frames) {
+    test::Connection conn;
+    ASSERT_TRUE(conn.connect(this->port_));
+    ASSERT_TRUE(conn.send_all("GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+    test::Response response;
+    ASSERT_TRUE(test::read_response_head(conn, &response));
+    test::MultipartReader reader(conn);
+    std::string part;
+    for (int i = 0; i < frames; i++)
+      ASSERT_TRUE(reader.next_part(&part));
+  }
+};
+
+// Recording with nobody watching, at the cost of a stream
+class CameraWebServer2ContinuousTest : public CameraWebServer2RecordingTest {
+ protected:
+  void SetUp() override {
+    this->continuous_ = true;
+    CameraWebServer2RecordingTest::SetUp();
+  }
+};
+
+TEST_F(CameraWebServer2Test, IdleCpu) {
+  // the task sleeps in select() until a connection or a frame arrives
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  int64_t cpu = thread_cpu_us(TASK_NAME);
+  ASSERT_GE(cpu, 0);
+  int64_t start = test::now_us();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  double load = (thread_cpu_us(TASK_NAME) - cpu) * 100.0 / (test::now_us() - start);
+
+  printf("idle: server task at %.2f%% cpu, %u frames captured\n", load, this->camera_.get_frames_captured());
+  EXPECT_LT(load, 1);
+  EXPECT_EQ(this->camera_.get_frames_captured(), 0u);
+}
+
+TEST_F(CameraWebServer2Test, Stats) {
+  std::vector<double> latencies;
+  for (int i = 0; i < 200; i++) {
+    auto response = test::get(this->port_, "/stats");
+    ASSERT_EQ(response.status, 200);
+    ASSERT_EQ(response.body.front(), '{');
+    latencies.push_back(response.first_byte / 1000.0);
+  }
+
+  double p99 = test::percentile(latencies, 0.99);
+  printf("stats: p50 %.2f ms, p99 %.2f ms\n", test::percentile(latencies, 0.5), p99);
+  EXPECT_LT(p99, 50);
+}
+
+TEST_F(CameraWebServer2Test, Snapshot) {
+  std::vector<double> latencies;
+  int64_t start = test::now_us();
+  for (int i = 0; i < 25; i++) {
+    auto response = test::get(this->port_, "/snapshot");
+    ASSERT_EQ(response.status, 200);
+    ASSERT_TRUE(is_jpeg(response.body));
+    latencies.push_back(response.first_byte / 1000.0);
+  }
+  double elapsed = (test::now_us() - start) / 1e6;
+
+  // every snapshot waits for a new frame, so this is bound by the camera frame rate
+  double p99 = test::percentile(latencies, 0.99);
+  printf("snapshot: %.1f req/s, p50 %.2f ms, p99 %.2f ms\n", latencies.size() / elapsed,
+         test::percentile(latencies, 0.5), p99);
+  EXPECT_LT(p99, 200);
+}
+
+TEST_F(CameraWebServer2Test, IdleCpuAfterStream) {
+  {
+    test::Connection conn;
+    ASSERT_TRUE(conn.connect(this->port_));
+    ASSERT_TRUE(conn.send_all("GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+    test::Response response;
+    ASSERT_TRUE(test::read_response_head(conn, &response));
+    test::MultipartReader reader(conn);
+    std::string part;
+    for (int i = 0; i < 10; i++)
+      ASSERT_TRUE(reader.next_part(&part));
+  }
+
+  // the closed stream releases the camera, the task is back to sleep
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  uint32_t frames = this->camera_.get_frames_captured();
+  int64_t cpu = thread_cpu_us(TASK_NAME);
+  ASSERT_GE(cpu, 0);
+  int64_t start = test::now_us();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  double load = (thread_cpu_us(TASK_NAME) - cpu) * 100.0 / (test::now_us() - start);
+
+  printf("idle after stream: server task at %.2f%% cpu, %u frames captured\n", load,
+         this->camera_.get_frames_captured() - frames);
+  EXPECT_LT(load, 1);
+  EXPECT_LE(this->camera_.get_frames_captured() - frames, 1u);
+}
+
+TEST_F(CameraWebServer2ScaleTest, ScaledSnapshotDoesNotBlockStats) {
+  std::atomic<bool> stop{false};
+  std::atomic<int> snapshots{0};
+  std::thread snapshot([&]() {
+    while (!stop) {
+      auto response = test::get(this->port_, "/snapshot?scale=1/2");
+      uint16_t width = 0, height = 0;
+      ASSERT_EQ(response.status, 200);
+      ASSERT_TRUE(esphome::esp32_camera_stream::get_jpeg_size((const uint8_t *) response.body.data(),
+                                                              response.body.size(), &width, &height));
+      ASSERT_EQ(width, 800);
+      ASSERT_EQ(height, 600);
+      snapshots++;
+    }
+  });
+
+  // thumbnails are encoded by the scaler task, the loop keeps answering
+  std::vector<double> latencies;
+  for (int i = 0; i < 200; i++) {
+    auto response = test::get(this->port_, "/stats");
+    ASSERT_EQ(response.status, 200);
+    latencies.push_back(response.first_byte / 1000.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  stop = true;
+  snapshot.join();
+
+  // a thumbnail takes a few ms, which the loop used to add to about
+  // every tenth request, on a single core the tail still shares the CPU
+  double p90 = test::percentile(latencies, 0.9);
+  printf("stats during scaled snapshots: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, %d snapshots\n",
+         test::percentile(latencies, 0.5), p90, test::percentile(latencies, 0.99), snapshots.load());
+  EXPECT_LT(p90, 1);
+  EXPECT_GT(snapshots, 0);
+}
+
+TEST_F(CameraWebServer2RecordingTest, RecordsWhatClientsWatch) {
+  // the camera stays idle until somebody watches
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  EXPECT_EQ(this->camera_.get_frames_captured(), 0u);
+
+  this->stream(25);
+  int recorded = this->get_recorded();
+  printf("recording: %d frames of a 1 s stream\n", recorded);
+  EXPECT_GE(recorded, 3);
+  EXPECT_LE(recorded, 7);
+}
+
+TEST_F(CameraWebServer2ContinuousTest, RecordsWithoutClients) {
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  uint32_t captured = this->camera_.get_frames_captured();
+  int recorded = this->get_recorded();
+  printf("continuous recording: %u frames captured and %d recorded in 1 s without clients\n", captured, recorded);
+  EXPECT_GT(captured, 20u);
+  EXPECT_GE(recorded, 3);
+}
+
+}  // namespace
@@ -0,0 +1,203 @@
+// Incremental request parser of server2, fed in fragments as recv() returns them
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "esphome/components/esp32_camera_stream/frame_scaler.h"
+#include "esphome/components/esp32_camera_web_server2/request_parser.h"
+
+using esphome::esp32_camera_web_server::RequestParser;
+namespace stream = esphome::esp32_camera_stream;
+
+namespace {
+
+const std::string REQUEST = "GET /snapshot?scale=1/4&name=a%20b HTTP/1.1\r\n"
+                            "Host: localhost\r\n"
+                            "User-Agent: test\r\n"
+                            "\r\n";
+
+void expect_snapshot(const RequestParser &parser) {
+  std::string value;
+  EXPECT_EQ(parser.get_method(), "GET");
+  EXPECT_EQ(parser.get_path(), "/snapshot");
+  EXPECT_EQ(parser.get_query(), "scale=1/4&name=a%20b");
+  EXPECT_TRUE(parser.get_query_param("scale", &value));
+  EXPECT_EQ(value, "1/4");
+}
+
+TEST(RequestParserTest, Complete) {
+  RequestParser parser;
+  size_t consumed = 0;
+  ASSERT_EQ(parser.feed(REQUEST.data(), REQUEST.size(), &consumed), RequestParser::COMPLETE);
+  EXPECT_EQ(consumed, REQUEST.size());
+  expect_snapshot(parser);
+}
+
+TEST(RequestParserTest, EverySplit) {
+  // split once at every position, within the request line, a header and the terminator
+  for (size_t split = 1; split < REQUEST.size(); split++) {
+    RequestParser parser;
+    ASSERT_EQ(parser.feed(REQUEST.data(), split), RequestParser::INCOMPLETE) << "split at " << split;
+    ASSERT_EQ(parser.feed(REQUEST.data() + split, REQUEST.size() - split), RequestParser::COMPLETE)
+        << "split at " << split;
+    expect_snapshot(parser);
+  }
+}
+
+TEST(RequestParserTest, ByteByByte) {
+  RequestParser parser;
+  for (size_t i = 0; i + 1 < REQUEST.size(); i++)
+    ASSERT_EQ(parser.feed(&REQUEST[i], 1), RequestParser::INCOMPLETE) << "at " << i;
+  ASSERT_EQ(parser.feed(&REQUEST.back(), 1), RequestParser::COMPLETE);
+  expect_snapshot(parser);
+}
+
+TEST(RequestParserTest, BareLineFeeds) {
+  RequestParser parser;
+  std::string request = "\r\n\nGET /stream HTTP/1.0\nHost: localhost\n\n";
+  ASSERT_EQ(parser.feed(request.data(), request.size()), RequestParser::COMPLETE);
+  EXPECT_EQ(parser.get_path(), "/stream");
+  EXPECT_EQ(parser.get_query(), "");
+}
+
+TEST(RequestParserTest, Pipelined) {
+  std::string data = REQUEST + "GET /stats HTTP/1.1\r\n\r\nGET /";
+  RequestParser parser;
+  size_t consumed = 0;
+
+  // parsing stops after the headers, the rest is left to the caller
+  ASSERT_EQ(parser.feed(data.data(), data.size(), &consumed), RequestParser::COMPLETE);
+  EXPECT_EQ(consumed, REQUEST.size());
+  expect_snapshot(parser);
+
+  // nothing more is consumed until the parser is reset
+  size_t more = 0;
+  EXPECT_EQ(parser.feed(data.data() + consumed, data.size() - consumed, &more), RequestParser::COMPLETE);
+  EXPECT_EQ(more, 0u);
+
+  parser.reset();
+  size_t offset = consumed;
+  ASSERT_EQ(parser.feed(data.data() + offset, data.size() - offset, &consumed), RequestParser::COMPLETE);
+  EXPECT_EQ(parser.get_path(), "/stats");
+  EXPECT_EQ(parser.get_query(), "");
+
+  parser.reset();
+  offset += consumed;
+  EXPECT_EQ(parser.feed(data.data() + offset, data.size() - offset, &consumed), RequestParser::INCOMPLETE);
+  EXPECT_EQ(offset + consumed, data.size());
+}
+
+TEST(RequestParserTest, LongRequestLine) {
+  RequestParser parser;
+  std::string request = "GET /" + std::string(300, 'a') + " HTTP/1.1\r\n\r\n";
+  // rejected as soon as the line is too long, not at its end
+  size_t consumed = 0;
+  EXPECT_EQ(parser.feed(request.data(), request.size(), &consumed), RequestParser::BAD_REQUEST);
+  EXPECT_LT(consumed, 300u);
+}
+
+TEST(RequestParserTest, OversizedHeaders) {
+  std::string head = "GET / HTTP/1.1\r\n";
+  std::string header = "X-Padding: " + std::string(100, 'p') + "\r\n";
+
+  // headers are drained without being stored, but bounded in total
+  RequestParser below;
+  std::string request = head;
+  while (request.size() + header.size() + 2 <= 4096)
+    request += header;
+  request += "\r\n";
+  EXPECT_EQ(below.feed(request.data(), request.size()), RequestParser::COMPLETE);
+
+  RequestParser above;
+  request = head;
+  while (request.size() <= 4096)
+    request += header;
+  request += "\r\n";
+  size_t consumed = 0;
+  EXPECT_EQ(above.feed(request.data(), request.size(), &consumed), RequestParser::BAD_REQUEST);
+  EXPECT_EQ(consumed, 4097u);
+
+  // and stays failed
+  EXPECT_EQ(above.feed("\r\n", 2), RequestParser::BAD_REQUEST);
+}
+
+TEST(RequestParserTest, BadRequestLines) {
+  const char *lines[] = {
+      "GET\r\n",
+      "GET /\r\n",
+      " / HTTP/1.1\r\n",
+      "GET / HTTP/2.0\r\n",
+      "GET / http/1.1\r\n",
+      "GET snapshot HTTP/1.1\r\n",
+      "GET  HTTP/1.1\r\n",
+  };
+  for (const char *line : lines) {
+    RequestParser parser;
+    EXPECT_EQ(parser.feed(line, strlen(line)), RequestParser::BAD_REQUEST) << line;
+  }
+}
+
+TEST(RequestParserTest, Reset) {
+  RequestParser parser;
+  ASSERT_EQ(parser.feed("GET / HTTP/2.0\r\n", 16), RequestParser::BAD_REQUEST);
+  parser.reset();
+  EXPECT_EQ(parser.get_path(), "");
+  ASSERT_EQ(parser.feed(REQUEST.data(), REQUEST.size()), RequestParser::COMPLETE);
+  expect_snapshot(parser);
+}
+
+TEST(RequestParserTest, PathDecoding) {
+  RequestParser parser;
+  std::string request = "GET /a%2Fb+c%zz%4 HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(parser.feed(request.data(), request.size()), RequestParser::COMPLETE);
+  // invalid escapes are kept as they are, '+' is no space outside of the query
+  EXPECT_EQ(parser.get_path(), "/a/b+c%zz%4");
+}
+
+TEST(RequestParserTest, QueryParams) {
+  RequestParser parser;
+  std::string request = "GET /?scales=1&scale=1%2F8&empty=&flag&plus=a%2Bb&last=x+y HTTP/1.1\r\n\r\n";
+  ASSERT_EQ(parser.feed(request.data(), request.size()), RequestParser::COMPLETE);
+
+  std::string value = "unchanged";
+  EXPECT_TRUE(parser.get_query_param("scale", &value));
+  EXPECT_EQ(value, "1/8");
+  EXPECT_TRUE(parser.get_query_param("scales", &value));
+  EXPECT_EQ(value, "1");
+  EXPECT_TRUE(parser.get_query_param("empty", &value));
+  EXPECT_EQ(value, "");
+  value = "unchanged";
+  EXPECT_TRUE(parser.get_query_param("flag", &value));
+  EXPECT_EQ(value, "");
+  EXPECT_TRUE(parser.get_query_param("last", &value));
+  EXPECT_EQ(value, "x y");
+  EXPECT_TRUE(parser.get_query_param("plus", &value));
+  EXPECT_EQ(value, "a+b");
+  EXPECT_TRUE(parser.get_query_param("flag", nullptr));
+
+  value = "unchanged";
+  EXPECT_FALSE(parser.get_query_param("sca", &value));
+  EXPECT_FALSE(parser.get_query_param("missing", &value));
+  EXPECT_EQ(value, "unchanged");
+}
+
+TEST(RequestParserTest, ParseScale) {
+  stream::FrameScale scale;
+  const std::pair<const char *, stream::FrameScale> valid[] = {
+      {"1", stream::SCALE_1},       {"1/1", stream::SCALE_1},     {"1/2", stream::SCALE_1_2},
+      {"1/4", stream::SCALE_1_4},   {"1/8", stream::SCALE_1_8},
+  };
+  for (auto &entry : valid) {
+    EXPECT_TRUE(stream::parse_scale(entry.first, &scale)) << entry.first;
+    EXPECT_EQ(scale, entry.second) << entry.first;
+  }
+
+  const char *invalid[] = {"", "0", "2", "1/3", "1/16", "1/", "1/4 ", "0.25"};
+  for (const char *value : invalid)
+    EXPECT_FALSE(stream::parse_scale(value, &scale)) << value;
+}
+
+}  // namespace
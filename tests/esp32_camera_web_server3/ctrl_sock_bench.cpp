@@ -0,0 +1,122 @@
+// Round trip of httpd_queue_work() into the server thread, built once
+// with the eventfd wakeup and once with the UDP socket fallback
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "esp_http_server.h"
+#include "http_client.h"
+
+#ifdef EXPECT_UDP
+#define CTRL_SOCK_TEST CtrlSockUdp
+#else
+#define CTRL_SOCK_TEST CtrlSockEventfd
+#endif
+
+namespace {
+
+// Number of eventfd descriptors open in this process
+int count_eventfds() {
+  int count = 0;
+  DIR *dir = opendir("/proc/self/fd");
+  while (struct dirent *entry = readdir(dir)) {
+    char target[64] = {};
+    std::string path = std::string("/proc/self/fd/") + entry->d_name;
+    if (readlink(path.c_str(), target, sizeof(target) - 1) > 0 && std::string(target) == "anon_inode:[eventfd]")
+      count++;
+  }
+  closedir(dir);
+  return count;
+}
+
+class CTRL_SOCK_TEST : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    this->eventfds_ = count_eventfds();
+    uint16_t port = test::free_port();
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = port;
+    config.ctrl_port = port;
+    ASSERT_EQ(httpd_start(&this->httpd_, &config), ESP_OK);
+  }
+
+  void TearDown() override { httpd_stop(this->httpd_); }
+
+  static void work(void *arg) {
+    auto *self = (CTRL_SOCK_TEST *) arg;
+    {
+      std::lock_guard<std::mutex> guard(self->lock_);
+      self->done_++;
+    }
+    self->cond_.notify_all();
+  }
+
+  bool wait_done(int count) {
+    std::unique_lock<std::mutex> guard(this->lock_);
+    return this->cond_.wait_for(guard, std::chrono::seconds(5), [this, count]() { return this->done_ >= count; });
+  }
+
+  int eventfds_{0};
+  httpd_handle_t httpd_{nullptr};
+  std::mutex lock_;
+  std::condition_variable cond_;
+  int done_{0};
+};
+
+TEST_F(CTRL_SOCK_TEST, Descriptor) {
+#ifdef EXPECT_UDP
+  EXPECT_EQ(count_eventfds(), this->eventfds_);
+#else
+  EXPECT_EQ(count_eventfds(), this->eventfds_ + 1);
+#endif
+}
+
+TEST_F(CTRL_SOCK_TEST, QueueWorkRoundTrip) {
+  const int iterations = 10000;
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+
+  int64_t start = test::now_us();
+  for (int i = 0; i < iterations; i++) {
+    int64_t begin = test::now_us();
+    ASSERT_EQ(httpd_queue_work(this->httpd_, work, this), ESP_OK);
+    ASSERT_TRUE(this->wait_done(i + 1));
+    latencies.push_back((test::now_us() - begin) / 1.0);
+  }
+  double elapsed = (test::now_us() - start) / 1e6;
+
+  printf("%s round trip: %.0f/s, p50 %.1f us, p99 %.1f us\n",
+#ifdef EXPECT_UDP
+         "udp",
+#else
+         "eventfd",
+#endif
+         iterations / elapsed, test::percentile(latencies, 0.5), test::percentile(latencies, 0.99));
+}
+
+TEST_F(CTRL_SOCK_TEST, ConcurrentProducers) {
+  // more messages than the control queue holds, all are executed
+  const int threads = 4, per_thread = 1000;
+  std::vector<std::thread> producers;
+  for (int t = 0; t < threads; t++) {
+    producers.emplace_back([this]() {
+      for (int i = 0; i < per_thread; i++)
+        httpd_queue_work(this->httpd_, work, this);
+    });
+  }
+  for (auto &producer : producers)
+    producer.join();
+
+  ASSERT_TRUE(this->wait_done(threads * per_thread));
+  EXPECT_EQ(this->done_, threads * per_thread);
+}
+
+}  // namespace
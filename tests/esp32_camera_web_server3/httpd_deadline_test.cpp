@@ -0,0 +1,165 @@
+// Request head deadline and idle timeout of the esp-idf based http
+// server, with slow clients over loopback
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "esp_http_server.h"
+#include "http_client.h"
+
+namespace {
+
+class HttpdDeadlineTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    this->port_ = test::free_port();
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = this->port_;
+    config.ctrl_port = this->port_;
+    config.header_read_timeout = 1;
+    config.idle_timeout = 2;
+    ASSERT_EQ(httpd_start(&this->httpd_, &config), ESP_OK);
+
+    httpd_uri_t uri = {};
+    uri.uri = "/uri";
+    uri.method = HTTP_GET;
+    uri.handler = [](httpd_req_t *req) {
+      char value[64] = {};
+      httpd_req_get_hdr_value_str(req, "X-Value", value, sizeof(value));
+      return httpd_resp_sendstr(req, (std::string(req->uri) + " " + value).c_str());
+    };
+    ASSERT_EQ(httpd_register_uri_handler(this->httpd_, &uri), ESP_OK);
+
+    uri.uri = "/body";
+    uri.method = HTTP_POST;
+    uri.handler = [](httpd_req_t *req) {
+      std::string body(req->content_len, 0);
+      size_t received = 0;
+      while (received < body.size()) {
+        int ret = httpd_req_recv(req, &body[received], body.size() - received);
+        if (ret <= 0)
+          return ESP_FAIL;
+        received += ret;
+      }
+      return httpd_resp_sendstr(req, body.c_str());
+    };
+    ASSERT_EQ(httpd_register_uri_handler(this->httpd_, &uri), ESP_OK);
+  }
+
+  void TearDown() override { httpd_stop(this->httpd_); }
+
+  uint16_t port_{0};
+  httpd_handle_t httpd_{nullptr};
+};
+
+TEST_F(HttpdDeadlineTest, SlowHeadersDoNotBlockOthers) {
+  // a byte every 100 ms, the head never completes
+  std::atomic<int64_t> closed_after{0};
+  std::string slow_response;
+  std::thread slow([&]() {
+    test::Connection conn;
+    ASSERT_TRUE(conn.connect(this->port_));
+    int64_t start = test::now_us();
+    std::string head = "GET /uri HTTP/1.1\r\nHost: localhost\r\nX-Value: ";
+    ASSERT_TRUE(conn.send_all(head));
+    while (conn.send_all("a"))
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    conn.read_until_close(&slow_response);
+    closed_after = test::now_us() - start;
+  });
+
+  std::vector<double> latencies;
+  for (int i = 0; i < 100; i++) {
+    auto response = test::get(this->port_, "/uri", "X-Value: fast\r\n");
+    ASSERT_EQ(response.status, 200);
+    ASSERT_EQ(response.body, "/uri fast");
+    latencies.push_back(response.first_byte / 1000.0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  slow.join();
+
+  double p99 = test::percentile(latencies, 0.99);
+  printf("with a slow client: p50 %.2f ms, p99 %.2f ms, slow client closed after %.0f ms\n",
+         test::percentile(latencies, 0.5), p99, closed_after / 1000.0);
+  EXPECT_LT(p99, 50);
+  EXPECT_EQ(slow_response.compare(0, 12, "HTTP/1.1 408"), 0);
+  EXPECT_GE(closed_after, 1000000);
+  EXPECT_LT(closed_after, 1500000);
+}
+
+TEST_F(HttpdDeadlineTest, HeadInPieces) {
+  test::Connection conn;
+  ASSERT_TRUE(conn.connect(this->port_));
+  // longer than a parser block, split within the request line and a header
+  std::string value(40, 'v');
+  std::string head = "GET /uri HTTP/1.1\r\nHost: localhost\r\nX-Padding: " + std::string(200, 'p') +
+                     "\r\nX-Value: " + value + "\r\n\r\n";
+  std::vector<size_t> splits = {5, 60, 250, 270, head.size()};
+  size_t offset = 0;
+  for (size_t split : splits) {
+    ASSERT_TRUE(conn.send_all(head.substr(offset, split - offset)));
+    offset = split;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  test::Response response;
+  ASSERT_TRUE(test::read_response(conn, &response));
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "/uri " + value);
+}
+
+TEST_F(HttpdDeadlineTest, PipelinedRequests) {
+  test::Connection conn;
+  ASSERT_TRUE(conn.connect(this->port_));
+  std::string requests;
+  for (int i = 0; i < 3; i++) {
+    requests += "GET /uri?" + std::to_string(i) + " HTTP/1.1\r\nHost: localhost\r\nX-Value: " + std::string(60, 'a' + i) +
+                "\r\n\r\n";
+  }
+  requests += "POST /body HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\nhello";
+  ASSERT_TRUE(conn.send_all(requests));
+
+  for (int i = 0; i < 3; i++) {
+    test::Response response;
+    ASSERT_TRUE(test::read_response(conn, &response));
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.body, "/uri?" + std::to_string(i) + " " + std::string(60, 'a' + i));
+  }
+  test::Response response;
+  ASSERT_TRUE(test::read_response(conn, &response));
+  EXPECT_EQ(response.body, "hello");
+}
+
+TEST_F(HttpdDeadlineTest, HeadTooLarge) {
+  test::Connection conn;
+  ASSERT_TRUE(conn.connect(this->port_));
+  int64_t start = test::now_us();
+  ASSERT_TRUE(conn.send_all("GET /uri HTTP/1.1\r\nX-Value: " + std::string(1000, 'x')));
+
+  // rejected once the buffer is full, not at the deadline
+  test::Response response;
+  ASSERT_TRUE(test::read_response_head(conn, &response));
+  EXPECT_EQ(response.status, 431);
+  EXPECT_LT(test::now_us() - start, 500000);
+}
+
+TEST_F(HttpdDeadlineTest, IdleSession) {
+  test::Connection conn;
+  ASSERT_TRUE(conn.connect(this->port_, 5000));
+  int64_t start = test::now_us();
+  std::string data;
+  conn.read_until_close(&data);
+  int64_t elapsed = test::now_us() - start;
+
+  // closed silently, there was no request
+  EXPECT_TRUE(data.empty());
+  EXPECT_GE(elapsed, 1900000);
+  EXPECT_LT(elapsed, 2500000);
+}
+
+}  // namespace
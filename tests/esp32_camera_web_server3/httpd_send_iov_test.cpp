@@ -0,0 +1,155 @@
+// Gather sends of httpd_send_iov(), with partial sends forced by
+// small socket buffers and by a send override taking a few bytes
+
+#include <gtest/gtest.h>
+#include <dlfcn.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "esp_http_server.h"
+#include "http_client.h"
+
+static std::atomic<int> sendmsg_calls{0};
+
+// Counts the calls made by the server
+extern "C" ssize_t sendmsg(int fd, const struct msghdr *msg, int flags) {
+  static auto *real = (ssize_t(*)(int, const struct msghdr *, int)) dlsym(RTLD_NEXT, "sendmsg");
+  sendmsg_calls++;
+  return real(fd, msg, flags);
+}
+
+namespace {
+
+// Buffers of varied sizes, including empty ones, each with its own pattern
+std::vector<std::string> make_buffers() {
+  std::vector<std::string> buffers;
+  const size_t sizes[] = {0, 1, 37, 0, 1500, 65536, 3, 200000, 0, 4097};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    std::string buffer(sizes[i], 0);
+    for (size_t j = 0; j < sizes[i]; j++)
+      buffer[j] = (char) ('a' + (i * 7 + j) % 26);
+    buffers.push_back(buffer);
+  }
+  return buffers;
+}
+
+class HttpdSendIovTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    this->buffers_ = make_buffers();
+    for (auto &buffer : this->buffers_)
+      this->expected_ += buffer;
+
+    this->port_ = test::free_port();
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = this->port_;
+    config.ctrl_port = this->port_;
+    ASSERT_EQ(httpd_start(&this->httpd_, &config), ESP_OK);
+
+    httpd_uri_t uri = {};
+    uri.uri = "/iov";
+    uri.method = HTTP_GET;
+    uri.handler = [](httpd_req_t *req) {
+      auto *self = (HttpdSendIovTest *) req->user_ctx;
+      int fd = httpd_req_to_sockfd(req);
+      // a blocking send returns what was sent by the timeout, so
+      // with a slow reader, sends are partial
+      int size = 16384;
+      setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+      struct timeval tv = {0, 20000};
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+      if (self->override_)
+        httpd_sess_set_send_override(req->handle, fd, send_few);
+
+      std::vector<struct iovec> iov;
+      for (auto &buffer : self->buffers_)
+        iov.push_back({(void *) buffer.data(), buffer.size()});
+      self->result_ = httpd_send_iov(req, iov.data(), iov.size());
+      self->done_ = true;
+      return self->result_;
+    };
+    uri.user_ctx = this;
+    ASSERT_EQ(httpd_register_uri_handler(this->httpd_, &uri), ESP_OK);
+  }
+
+  void TearDown() override { httpd_stop(this->httpd_); }
+
+  static int send_few(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    int ret = send(sockfd, buf, std::min<size_t>(buf_len, 7), flags);
+    return ret < 0 ? HTTPD_SOCK_ERR_FAIL : ret;
+  }
+
+  // Reads the response slowly, in small pieces
+  std::string receive() {
+    test::Connection conn;
+    EXPECT_TRUE(conn.connect(this->port_));
+    EXPECT_TRUE(conn.send_all("GET /iov HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+
+    std::string received, piece;
+    while (received.size() < this->expected_.size()) {
+      size_t length = std::min<size_t>(this->expected_.size() - received.size(), 3000);
+      if (!conn.read_exact(length, &piece))
+        break;
+      received += piece;
+      if (received.size() % 30000 < 3000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return received;
+  }
+
+  uint16_t port_{0};
+  httpd_handle_t httpd_{nullptr};
+  std::vector<std::string> buffers_;
+  std::string expected_;
+  bool override_{false};
+  std::atomic<bool> done_{false};
+  esp_err_t result_{ESP_FAIL};
+};
+
+TEST_F(HttpdSendIovTest, PartialSends) {
+  sendmsg_calls = 0;
+  std::string received = this->receive();
+  EXPECT_EQ(received.size(), this->expected_.size());
+  EXPECT_TRUE(received == this->expected_) << "bytes out of order";
+  for (int i = 0; i < 1000 && !this->done_; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(this->result_, ESP_OK);
+  printf("send_iov: %zu bytes in %zu buffers, %d sendmsg calls\n", this->expected_.size(), this->buffers_.size(),
+         sendmsg_calls.load());
+  EXPECT_GT(sendmsg_calls, 1);
+}
+
+TEST_F(HttpdSendIovTest, SendOverride) {
+  this->override_ = true;
+  sendmsg_calls = 0;
+  std::string received = this->receive();
+  EXPECT_EQ(received.size(), this->expected_.size());
+  EXPECT_TRUE(received == this->expected_) << "bytes out of order";
+  for (int i = 0; i < 1000 && !this->done_; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(this->result_, ESP_OK);
+  // buffers are sent one by one through the override
+  EXPECT_EQ(sendmsg_calls, 0);
+}
+
+TEST_F(HttpdSendIovTest, PeerClosed) {
+  test::Connection conn;
+  ASSERT_TRUE(conn.connect(this->port_));
+  ASSERT_TRUE(conn.send_all("GET /iov HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+  std::string piece;
+  ASSERT_TRUE(conn.read_exact(100, &piece));
+  conn.close();
+
+  for (int i = 0; i < 5000 && !this->done_; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_TRUE(this->done_);
+  EXPECT_EQ(this->result_, ESP_ERR_HTTPD_RESP_SEND);
+}
+
+}  // namespace
@@ -0,0 +1,131 @@
+// Worker pool of the esp-idf based http server, driven over loopback
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "esp_http_server.h"
+#include "http_client.h"
+
+namespace {
+
+class HttpdWorkersTest : public ::testing::Test {
+ protected:
+  void start(uint16_t worker_count, uint16_t work_queue_size) {
+    this->port_ = test::free_port();
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = this->port_;
+    config.ctrl_port = this->port_;
+    config.worker_count = worker_count;
+    config.work_queue_size = work_queue_size;
+    ASSERT_EQ(httpd_start(&this->httpd_, &config), ESP_OK);
+
+    this->add("/block", [](httpd_req_t *req) {
+      auto *self = (HttpdWorkersTest *) req->user_ctx;
+      self->running_++;
+      while (!self->release_)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return httpd_resp_sendstr(req, "released");
+    });
+    this->add("/echo", [](httpd_req_t *req) {
+      // request APIs validate they are called from a handler
+      char value[32];
+      if (httpd_req_get_hdr_value_str(req, "X-Echo", value, sizeof(value)) != ESP_OK)
+        return httpd_resp_send_500(req);
+      return httpd_resp_sendstr(req, value);
+    });
+    this->add("/stream", [](httpd_req_t *req) {
+      auto *self = (HttpdWorkersTest *) req->user_ctx;
+      self->running_++;
+      // runs until the session fails
+      while (httpd_resp_send_chunk(req, "chunk", 5) == ESP_OK)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      return ESP_FAIL;
+    });
+  }
+
+  void add(const char *path, esp_err_t (*handler)(httpd_req_t *req)) {
+    httpd_uri_t uri = {};
+    uri.uri = path;
+    uri.method = HTTP_GET;
+    uri.handler = handler;
+    uri.user_ctx = this;
+    ASSERT_EQ(httpd_register_uri_handler(this->httpd_, &uri), ESP_OK);
+  }
+
+  void TearDown() override {
+    this->release_ = true;
+    if (this->httpd_)
+      httpd_stop(this->httpd_);
+  }
+
+  // Waits for the number of handlers to be running
+  bool wait_running(int count) {
+    for (int i = 0; i < 1000 && this->running_ < count; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return this->running_ >= count;
+  }
+
+  uint16_t port_{0};
+  httpd_handle_t httpd_{nullptr};
+  std::atomic<int> running_{0};
+  std::atomic<bool> release_{false};
+};
+
+TEST_F(HttpdWorkersTest, RequestApisInWorker) {
+  this->start(2, 0);
+  auto response = test::get(this->port_, "/echo", "X-Echo: hello\r\n");
+  EXPECT_EQ(response.status, 200);
+  EXPECT_EQ(response.body, "hello");
+}
+
+TEST_F(HttpdWorkersTest, ServiceUnavailableWhenQueueIsFull) {
+  this->start(1, 1);
+
+  // the worker is busy, the second request waits in the queue
+  test::Connection busy, queued;
+  ASSERT_TRUE(busy.connect(this->port_));
+  ASSERT_TRUE(busy.send_all("GET /block HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+  ASSERT_TRUE(this->wait_running(1));
+  ASSERT_TRUE(queued.connect(this->port_));
+  ASSERT_TRUE(queued.send_all("GET /block HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto response = test::get(this->port_, "/echo", "X-Echo: hello\r\n");
+  EXPECT_EQ(response.status, 503);
+
+  this->release_ = true;
+  test::Response first, second;
+  ASSERT_TRUE(test::read_response(busy, &first));
+  ASSERT_TRUE(test::read_response(queued, &second));
+  EXPECT_EQ(first.body, "released");
+  EXPECT_EQ(second.body, "released");
+}
+
+TEST_F(HttpdWorkersTest, StopWithRunningHandlers) {
+  this->start(2, 0);
+
+  test::Connection first, second;
+  ASSERT_TRUE(first.connect(this->port_));
+  ASSERT_TRUE(first.send_all("GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+  ASSERT_TRUE(second.connect(this->port_));
+  ASSERT_TRUE(second.send_all("GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+  ASSERT_TRUE(this->wait_running(2));
+
+  // handlers run until their sessions are shut down by the stop
+  int64_t start = test::now_us();
+  ASSERT_EQ(httpd_stop(this->httpd_), ESP_OK);
+  this->httpd_ = nullptr;
+  double elapsed = (test::now_us() - start) / 1000.0;
+
+  std::string data;
+  EXPECT_TRUE(first.read_until_close(&data));
+  EXPECT_TRUE(second.read_until_close(&data));
+  printf("stop: %.1f ms with 2 running handlers\n", elapsed);
+  EXPECT_LT(elapsed, 1000);
+}
+
+}  // namespace
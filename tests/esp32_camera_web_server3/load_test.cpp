@@ -0,0 +1,373 @@
+// Loopback load generator for the esp-idf based camera web server,
+// serving the synthetic camera of the shims
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jpeglib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "esphome/components/esp32_camera/esp32_camera.h"
+#include "esphome/components/esp32_camera_stream/frame_scaler.h"
+#include "esphome/components/esp32_camera_web_server3/camera_web_server.h"
+#include "http_client.h"
+
+using esphome::esp32_camera::ESP32Camera;
+using esphome::esp32_camera_web_server::CameraWebServer;
+
+namespace {
+
+bool is_jpeg(const std::string &data) {
+  return data.size() > 4 && (uint8_t) data[0] == 0xFF && (uint8_t) data[1] == 0xD8 &&
+         (uint8_t) data[data.size() - 2] == 0xFF && (uint8_t) data[data.size() - 1] == 0xD9;
+}
+
+void set_recv_timeout(test::Connection &conn, uint32_t timeout) {
+  struct timeval tv = {(time_t) (timeout / 1000), (suseconds_t) (timeout % 1000) * 1000};
+  setsockopt(conn.get_fd(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// Decodes a JPEG into RGB, false if libjpeg can't
+bool decode_jpeg(const std::string &data, int *width, int *height, std::vector<uint8_t> *rgb) {
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr err;
+
+  cinfo.err = jpeg_std_error(&err);
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, (const unsigned char *) data.data(), data.size());
+  if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  cinfo.out_color_space = JCS_RGB;
+  jpeg_start_decompress(&cinfo);
+
+  *width = cinfo.output_width;
+  *height = cinfo.output_height;
+  rgb->resize((size_t) *width * *height * 3);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = &(*rgb)[(size_t) cinfo.output_scanline * *width * 3];
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+// A stream viewer reading parts in the background, as a browser would
+class StreamViewer {
+ public:
+  bool start(uint16_t port) {
+    if (!this->conn_.connect(port) || !this->conn_.send_all("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"))
+      return false;
+    test::Response response;
+    if (!test::read_response_head(this->conn_, &response) || response.status != 200)
+      return false;
+    this->thread_ = std::thread([this]() {
+      test::MultipartReader reader(this->conn_);
+      std::string part;
+      while (!this->stop_ && reader.next_part(&part))
+        this->frames_++;
+    });
+    return true;
+  }
+
+  ~StreamViewer() {
+    this->stop_ = true;
+    if (this->thread_.joinable())
+      this->thread_.join();
+  }
+
+  int get_frames() const { return this->frames_; }
+
+ protected:
+  test::Connection conn_;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::atomic<int> frames_{0};
+};
+
+class CameraWebServer3Test : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    this->port_ = test::free_port();
+    this->camera_.set_max_framerate(25);
+    this->camera_.setup();
+    this->server_.set_port(this->port_);
+    this->server_.set_mode(esphome::esp32_camera_web_server::STREAM);
+    this->server_.setup();
+    ASSERT_FALSE(this->server_.is_failed());
+  }
+
+  void TearDown() override {
+    this->server_.on_shutdown();
+    this->camera_.on_shutdown();
+  }
+
+  uint16_t port_{0};
+  ESP32Camera camera_;
+  CameraWebServer server_;
+};
+
+TEST_F(CameraWebServer3Test, Stats) {
+  std::vector<double> latencies;
+  for (int i = 0; i < 200; i++) {
+    auto response = test::get(this->port_, "/stats");
+    ASSERT_EQ(response.status, 200);
+    ASSERT_EQ(response.body.front(), '{');
+    latencies.push_back(response.first_byte / 1000.0);
+  }
+
+  printf("stats: p50 %.2f ms, p99 %.2f ms\n", test::percentile(latencies, 0.5), test::percentile(latencies, 0.99));
+}
+
+TEST_F(CameraWebServer3Test, Snapshot) {
+  std::vector<double> latencies;
+  int64_t start = test::now_us();
+  for (int i = 0; i < 25; i++) {
+    auto response = test::get(this->port_, "/snapshot");
+    ASSERT_EQ(response.status, 200);
+    ASSERT_EQ(response.headers["content-type"], "image/jpeg");
+    ASSERT_TRUE(is_jpeg(response.body));
+    latencies.push_back(response.first_byte / 1000.0);
+  }
+  double elapsed = (test::now_us() - start) / 1e6;
+
+  // every snapshot waits for a new frame, so this is bound by the camera frame rate
+  printf("snapshot: %.1f req/s, p50 %.2f ms, p99 %.2f ms\n", latencies.size() / elapsed,
+         test::percentile(latencies, 0.5), test::percentile(latencies, 0.99));
+}
+
+TEST_F(CameraWebServer3Test, Stream) {
+  test::Connection conn;
+  ASSERT_TRUE(conn.connect(this->port_));
+  ASSERT_TRUE(conn.send_all("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+
+  test::Response response;
+  ASSERT_TRUE(test::read_response_head(conn, &response));
+  ASSERT_EQ(response.status, 200);
+  ASSERT_EQ(response.headers["content-type"].compare(0, 25, "multipart/x-mixed-replace"), 0);
+
+  test::MultipartReader reader(conn);
+  std::string part;
+  ASSERT_TRUE(reader.next_part(&part));
+
+  const int frames = 50;
+  int64_t start = test::now_us();
+  size_t bytes = conn.get_received();
+  for (int i = 0; i < frames; i++) {
+    ASSERT_TRUE(reader.next_part(&part));
+    ASSERT_TRUE(is_jpeg(part));
+  }
+  double elapsed = (test::now_us() - start) / 1e6;
+  bytes = conn.get_received() - bytes;
+
+  printf("stream: %.1f fps, %.1f kB/s\n", frames / elapsed, bytes / elapsed / 1024);
+  EXPECT_GT(frames / elapsed, 20);
+}
+
+TEST_F(CameraWebServer3Test, StatsDuringStream) {
+  StreamViewer viewer;
+  ASSERT_TRUE(viewer.start(this->port_));
+
+  std::vector<double> latencies;
+  for (int i = 0; i < 200; i++) {
+    auto response = test::get(this->port_, "/stats");
+    ASSERT_EQ(response.status, 200);
+    latencies.push_back(response.first_byte / 1000.0);
+  }
+
+  double p99 = test::percentile(latencies, 0.99);
+  printf("stats during stream: p50 %.2f ms, p99 %.2f ms, %d frames streamed\n", test::percentile(latencies, 0.5),
+         p99, viewer.get_frames());
+  EXPECT_LT(p99, 50);
+  EXPECT_GT(viewer.get_frames(), 0);
+}
+
+TEST_F(CameraWebServer3Test, SnapshotDuringStream) {
+  StreamViewer viewer;
+  ASSERT_TRUE(viewer.start(this->port_));
+
+  std::vector<double> latencies;
+  for (int i = 0; i < 25; i++) {
+    auto response = test::get(this->port_, "/snapshot");
+    ASSERT_EQ(response.status, 200);
+    ASSERT_TRUE(is_jpeg(response.body));
+    latencies.push_back(response.first_byte / 1000.0);
+  }
+
+  // bound by the frame interval of 40 ms, as every snapshot waits for a new frame
+  double p99 = test::percentile(latencies, 0.99);
+  printf("snapshot during stream: p50 %.2f ms, p99 %.2f ms\n", test::percentile(latencies, 0.5), p99);
+  EXPECT_LT(p99, 200);
+}
+
+TEST_F(CameraWebServer3Test, TwoStreams) {
+  StreamViewer first, second;
+  ASSERT_TRUE(first.start(this->port_));
+  ASSERT_TRUE(second.start(this->port_));
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  printf("two streams: %d and %d frames in 1 s\n", first.get_frames(), second.get_frames());
+  EXPECT_GT(first.get_frames(), 15);
+  EXPECT_GT(second.get_frames(), 15);
+}
+
+TEST_F(CameraWebServer3Test, WebSocketDuringStream) {
+  StreamViewer viewer;
+  ASSERT_TRUE(viewer.start(this->port_));
+
+  test::WebSocketClient ws;
+  ASSERT_TRUE(ws.connect(this->port_, "/ws"));
+
+  // a ping between frames is answered, then every frame is acknowledged
+  ASSERT_TRUE(ws.send(test::WebSocketClient::PING, "ping"));
+  test::WebSocketClient::Opcode opcode;
+  std::string payload;
+  bool pong = false;
+  const int frames = 25;
+  int received = 0, streamed = viewer.get_frames();
+  int64_t start = test::now_us();
+  while (received < frames) {
+    ASSERT_TRUE(ws.recv(&opcode, &payload));
+    if (opcode == test::WebSocketClient::PONG) {
+      EXPECT_EQ(payload, "ping");
+      pong = true;
+      continue;
+    }
+    ASSERT_EQ(opcode, test::WebSocketClient::BINARY);
+    ASSERT_TRUE(is_jpeg(payload));
+    received++;
+    ASSERT_TRUE(ws.send(test::WebSocketClient::TEXT, "ack"));
+  }
+  double elapsed = (test::now_us() - start) / 1e6;
+  streamed = viewer.get_frames() - streamed;
+
+  printf("websocket during stream: %.1f fps, stream at %.1f fps meanwhile\n", frames / elapsed, streamed / elapsed);
+  EXPECT_TRUE(pong);
+  EXPECT_GT(frames / elapsed, 15);
+  EXPECT_GT(streamed / elapsed, 15);
+
+  // closed with the status code echoed back
+  ASSERT_TRUE(ws.send(test::WebSocketClient::CLOSE, std::string("\x03\xe8", 2)));
+  do {
+    ASSERT_TRUE(ws.recv(&opcode, &payload));
+  } while (opcode != test::WebSocketClient::CLOSE);
+  EXPECT_EQ(payload, std::string("\x03\xe8", 2));
+}
+
+TEST_F(CameraWebServer3Test, WebSocketHoldsFrameUntilAck) {
+  test::WebSocketClient ws;
+  ASSERT_TRUE(ws.connect(this->port_, "/ws"));
+
+  test::WebSocketClient::Opcode opcode;
+  std::string payload;
+  ASSERT_TRUE(ws.recv(&opcode, &payload));
+  ASSERT_EQ(opcode, test::WebSocketClient::BINARY);
+  ASSERT_TRUE(is_jpeg(payload));
+  std::string first = payload;
+
+  // one frame in flight: nothing follows for several frame intervals of 40 ms
+  set_recv_timeout(ws.get_connection(), 400);
+  int64_t start = test::now_us();
+  EXPECT_FALSE(ws.recv(&opcode, &payload));
+  EXPECT_GE(test::now_us() - start, 390000);
+
+  // the acknowledgement lets the latest frame through, captured meanwhile
+  set_recv_timeout(ws.get_connection(), 5000);
+  ASSERT_TRUE(ws.send(test::WebSocketClient::TEXT, "ack"));
+  start = test::now_us();
+  ASSERT_TRUE(ws.recv(&opcode, &payload));
+  double latency = (test::now_us() - start) / 1000.0;
+  ASSERT_EQ(opcode, test::WebSocketClient::BINARY);
+  ASSERT_TRUE(is_jpeg(payload));
+  EXPECT_NE(payload, first);
+
+  printf("websocket: next frame %.2f ms after the acknowledgement\n", latency);
+  EXPECT_LT(latency, 200);
+}
+
+TEST_F(CameraWebServer3Test, WebSocketWithoutAck) {
+  test::WebSocketClient ws;
+  ASSERT_TRUE(ws.connect(this->port_, "/ws"));
+
+  test::WebSocketClient::Opcode opcode;
+  std::string payload;
+  ASSERT_TRUE(ws.recv(&opcode, &payload));
+  ASSERT_EQ(opcode, test::WebSocketClient::BINARY);
+
+  // a viewer that never acknowledges is dropped after recv_wait_timeout of 5 s,
+  // the client waits longer than that, so a timeout here means it was kept
+  set_recv_timeout(ws.get_connection(), 10000);
+  int64_t start = test::now_us();
+  EXPECT_FALSE(ws.recv(&opcode, &payload));
+  double elapsed = (test::now_us() - start) / 1e6;
+
+  printf("websocket without acknowledgement: closed after %.2f s\n", elapsed);
+  EXPECT_GE(elapsed, 4.5);
+  EXPECT_LT(elapsed, 8);
+}
+
+TEST_F(CameraWebServer3Test, ScaledSnapshotDuringStream) {
+  StreamViewer viewer;
+  ASSERT_TRUE(viewer.start(this->port_));
+
+  std::vector<double> latencies;
+  int streamed = viewer.get_frames();
+  int64_t start = test::now_us();
+  for (int i = 0; i < 24; i++) {
+    // 1/2, 1/4 and 1/8 in turn, each decoded again
+    int factor = 2 << (i % 3);
+    auto response = test::get(this->port_, "/snapshot?scale=1/" + std::to_string(factor));
+    ASSERT_EQ(response.status, 200);
+    int width = 0, height = 0;
+    std::vector<uint8_t> rgb;
+    ASSERT_TRUE(decode_jpeg(response.body, &width, &height, &rgb)) << "1/" << factor;
+    ASSERT_EQ(width, 320 / factor);
+    ASSERT_EQ(height, 240 / factor);
+
+    // the bottom right corner is never covered by the square: red and
+    // green follow the gradient of the synthetic camera, blue is constant
+    const uint8_t *corner = &rgb[((size_t) (height - 1) * width + width - 1) * 3];
+    EXPECT_GT(corner[0], 200) << "1/" << factor;
+    EXPECT_GT(corner[1], 200) << "1/" << factor;
+    EXPECT_NEAR(corner[2], 128, 24) << "1/" << factor;
+    latencies.push_back(response.first_byte / 1000.0);
+  }
+  double elapsed = (test::now_us() - start) / 1e6;
+  streamed = viewer.get_frames() - streamed;
+
+  // like full snapshots, bound by the frame interval of 40 ms
+  double p99 = test::percentile(latencies, 0.99);
+  printf("scaled snapshot during stream: p50 %.2f ms, p99 %.2f ms, stream at %.1f fps meanwhile\n",
+         test::percentile(latencies, 0.5), p99, streamed / elapsed);
+  EXPECT_LT(p99, 200);
+  EXPECT_GT(streamed / elapsed, 15);
+
+  auto response = test::get(this->port_, "/snapshot?scale=1/3");
+  EXPECT_EQ(response.status, 400);
+
+  // a value longer than any scale is not cut down to one
+  response = test::get(this->port_, "/snapshot?scale=1/8xxxxxxx");
+  EXPECT_EQ(response.status, 400);
+}
+
+TEST_F(CameraWebServer3Test, ScaledSnapshotLongQuery) {
+  // as dashboards request it, with parameters of their own to bust caches
+  auto response = test::get(this->port_, "/snapshot?entity_id=camera.front_door&token=0123456789abcdef0123456789abcdef"
+                                         "&_=1699999999999&scale=1%2F4");
+  ASSERT_EQ(response.status, 200);
+  uint16_t width = 0, height = 0;
+  ASSERT_TRUE(esphome::esp32_camera_stream::get_jpeg_size((const uint8_t *) response.body.data(),
+                                                          response.body.size(), &width, &height));
+  EXPECT_EQ(width, 80);
+  EXPECT_EQ(height, 60);
+}
+
+}  // namespace
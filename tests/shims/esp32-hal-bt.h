@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for the Bluetooth helpers of the Arduino core
+
+#include <stdbool.h>
+
+#include "esp32-hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Whether the controller is enabled
+bool btStarted(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,11 @@
+#include "esp32-hal.h"
+
+#include <time.h>
+
+void delay(uint32_t ms)
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Host stand-in for the timing helpers of the Arduino core
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void delay(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+// Host stand-in for the Bluetooth controller of ESP-IDF, its
+// connections are simulated by esp_bt_host.h
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ESP_BT_MODE_IDLE = 0x00,
+  ESP_BT_MODE_BLE = 0x01,
+  ESP_BT_MODE_CLASSIC_BT = 0x02,
+  ESP_BT_MODE_BTDM = 0x03,
+} esp_bt_mode_t;
+
+typedef enum {
+  ESP_BT_CONTROLLER_STATUS_IDLE = 0,
+  ESP_BT_CONTROLLER_STATUS_INITED,
+  ESP_BT_CONTROLLER_STATUS_ENABLED,
+} esp_bt_controller_status_t;
+
+typedef struct {
+  uint8_t mode;
+  uint8_t ble_max_conn;
+} esp_bt_controller_config_t;
+
+#define BT_CONTROLLER_INIT_CONFIG_DEFAULT() \
+  { ESP_BT_MODE_BLE, CONFIG_BTDM_CTRL_BLE_MAX_CONN }
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg);
+esp_err_t esp_bt_controller_deinit(void);
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode);
+esp_err_t esp_bt_controller_disable(void);
+esp_bt_controller_status_t esp_bt_controller_get_status(void);
+
+#ifdef __cplusplus
+}
+#endif
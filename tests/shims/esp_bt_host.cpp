@@ -0,0 +1,709 @@
+#include "esp_bt_host.h"
+
+#include "esp32-hal-bt.h"
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_gap_ble_api.h"
+#include "esp_gatt_common_api.h"
+#include "esp_gattc_api.h"
+#include "esp_timer.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Gattc interfaces are handed out from here on, as by Bluedroid
+const esp_gatt_if_t FIRST_GATTC_IF = 3;
+const int MAX_APPS = 32;
+// Packets a connection event carries in each direction
+const int MAX_PACKETS_PER_EVENT = 4;
+// Connection events a link to a device that does not advertise is tried for
+const int OPEN_ATTEMPT_EVENTS = 40;
+// Request and responses a service discovery takes
+const int DISCOVERY_ROUND_TRIPS = 3;
+
+struct Connection {
+  uint16_t conn_id;
+  esp_gatt_if_t gattc_if;
+  uint64_t address;
+  uint16_t mtu{23};
+  bool open{false};
+  int64_t opened_at{0};
+  uint32_t interval_us{0};
+  // the last connection event anything was sent on, and how much
+  int64_t event_at{0};
+  int event_packets{0};
+  std::set<uint16_t> notify_handles;
+};
+
+struct Host {
+  std::mutex lock;
+  std::condition_variable cond;
+  // run at the time in the order scheduled, the second is the sequence
+  std::map<std::pair<int64_t, uint64_t>, std::function<void()>> events;
+  uint64_t next_sequence{0};
+  bool running{false};
+
+  bool controller_enabled{false};
+  esp_gattc_cb_t gattc_callback{nullptr};
+  esp_gap_ble_cb_t gap_callback{nullptr};
+  uint16_t local_mtu{23};
+
+  std::map<uint64_t, HostBTPeripheral> peripherals;
+  std::map<uint64_t, uint32_t> preferred_intervals;
+  std::map<esp_gatt_if_t, uint16_t> apps;
+  std::map<uint16_t, Connection> connections;
+  uint16_t next_conn_id{0};
+  int max_connections{0};
+
+  std::atomic<int64_t> last_event_us{0};
+};
+
+// Never freed, the callback thread runs for as long as the process
+Host &host() {
+  static Host *host = new Host();
+  return *host;
+}
+
+uint64_t to_address(const esp_bd_addr_t bda) {
+  uint64_t address = 0;
+  for (int i = 0; i < ESP_BD_ADDR_LEN; i++)
+    address = (address << 8) | bda[i];
+  return address;
+}
+
+void to_bda(uint64_t address, esp_bd_addr_t bda) {
+  for (int i = ESP_BD_ADDR_LEN - 1; i >= 0; i--, address >>= 8)
+    bda[i] = (uint8_t) address;
+}
+
+// Value handles of characteristic i, declaration, value and CCC descriptor
+uint16_t value_handle(size_t index) { return (uint16_t) (3 + index * 3); }
+uint16_t service_end_handle(const HostBTPeripheral &peripheral) {
+  return (uint16_t) (1 + peripheral.characteristics.size() * 3);
+}
+
+int open_connections(Host &host) {
+  int count = 0;
+  for (auto &entry : host.connections)
+    count += entry.second.open || entry.second.opened_at == 0;
+  return count;
+}
+
+void run_events() {
+  auto &host = ::host();
+  pthread_setname_np(pthread_self(), "BTC_TASK");
+  std::unique_lock<std::mutex> guard(host.lock);
+  while (true) {
+    if (host.events.empty()) {
+      host.cond.wait(guard);
+      continue;
+    }
+    auto first = host.events.begin();
+    int64_t wait = first->first.first - esp_timer_get_time();
+    if (wait > 0) {
+      host.cond.wait_for(guard, std::chrono::microseconds(wait));
+      continue;
+    }
+    auto event = std::move(first->second);
+    host.events.erase(first);
+    // callbacks call back into the stack
+    guard.unlock();
+    event();
+    guard.lock();
+  }
+}
+
+// With the lock held
+void schedule(Host &host, int64_t at, std::function<void()> event) {
+  if (!host.running) {
+    host.running = true;
+    std::thread(run_events).detach();
+  }
+  host.events.emplace(std::make_pair(at, host.next_sequence++), std::move(event));
+  host.cond.notify_all();
+}
+
+// The connection event a packet sent after the time goes out on, with the lock held
+int64_t next_event(Connection &connection, int64_t after) {
+  int64_t since = std::max<int64_t>(after - connection.opened_at, 0);
+  int64_t events = (since + connection.interval_us - 1) / connection.interval_us;
+  int64_t at = std::max(connection.opened_at + events * connection.interval_us, connection.event_at);
+  if (at == connection.event_at && connection.event_packets >= MAX_PACKETS_PER_EVENT)
+    at += connection.interval_us;
+  if (at != connection.event_at) {
+    connection.event_at = at;
+    connection.event_packets = 0;
+  }
+  connection.event_packets++;
+  return at;
+}
+
+void gattc_event(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param) {
+  auto &host = ::host();
+  esp_gattc_cb_t callback;
+  {
+    std::lock_guard<std::mutex> guard(host.lock);
+    callback = host.gattc_callback;
+  }
+  host.last_event_us = esp_timer_get_time();
+  if (callback)
+    callback(event, gattc_if, param);
+}
+
+void gap_event(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+  auto &host = ::host();
+  esp_gap_ble_cb_t callback;
+  {
+    std::lock_guard<std::mutex> guard(host.lock);
+    callback = host.gap_callback;
+  }
+  if (callback)
+    callback(event, param);
+}
+
+void notify_event(esp_gatt_if_t gattc_if, uint16_t conn_id, uint64_t address, uint16_t handle,
+                  std::vector<uint8_t> value) {
+  esp_ble_gattc_cb_param_t param = {};
+  param.notify.conn_id = conn_id;
+  to_bda(address, param.notify.remote_bda);
+  param.notify.handle = handle;
+  param.notify.value_len = (uint16_t) value.size();
+  param.notify.value = value.data();
+  param.notify.is_notify = true;
+  gattc_event(ESP_GATTC_NOTIFY_EVT, gattc_if, &param);
+}
+
+// Schedules the notifications of a value, on connection events after the time,
+// with the lock held
+void schedule_notifications(Host &host, Connection &connection, uint16_t handle, int64_t after,
+                            const std::vector<HostBTPeripheral::Value> &values) {
+  if (!connection.notify_handles.count(handle))
+    return;
+  for (auto &value : values) {
+    auto gattc_if = connection.gattc_if;
+    auto conn_id = connection.conn_id;
+    auto address = connection.address;
+    schedule(host, next_event(connection, after),
+             [=]() { notify_event(gattc_if, conn_id, address, handle, value); });
+  }
+}
+
+Connection *find_connection(Host &host, esp_gatt_if_t gattc_if, uint16_t conn_id) {
+  auto iter = host.connections.find(conn_id);
+  if (iter == host.connections.end() || !iter->second.open || iter->second.gattc_if != gattc_if)
+    return nullptr;
+  return &iter->second;
+}
+
+esp_err_t write_value(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                      uint8_t *value, esp_gatt_write_type_t write_type, esp_gattc_cb_event_t event) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto *connection = find_connection(host, gattc_if, conn_id);
+  if (!connection)
+    return ESP_ERR_INVALID_STATE;
+
+  auto &peripheral = host.peripherals[connection->address];
+  bool response = write_type == ESP_GATT_WRITE_TYPE_RSP;
+  if (response && peripheral.unresponsive)
+    return ESP_OK;
+
+  // writes without response complete once sent
+  int64_t at = next_event(*connection, esp_timer_get_time());
+  if (response)
+    at += connection->interval_us;
+
+  esp_gatt_status_t status = ESP_GATT_INVALID_HANDLE;
+  for (size_t i = 0; i < peripheral.characteristics.size(); i++) {
+    if (handle == value_handle(i) || (event == ESP_GATTC_WRITE_DESCR_EVT && handle == value_handle(i) + 1))
+      status = ESP_GATT_OK;
+  }
+
+  std::vector<uint8_t> data(value, value + value_len);
+  auto address = connection->address;
+  schedule(host, at, [=]() {
+    auto &host = ::host();
+    if (status == ESP_GATT_OK && event == ESP_GATTC_WRITE_CHAR_EVT) {
+      std::function<std::vector<HostBTPeripheral::Value>(uint16_t, const HostBTPeripheral::Value &)> on_write;
+      {
+        std::lock_guard<std::mutex> guard(host.lock);
+        on_write = host.peripherals[address].on_write;
+      }
+      auto values = on_write ? on_write(handle, data) : std::vector<HostBTPeripheral::Value>();
+      std::lock_guard<std::mutex> guard(host.lock);
+      auto *connection = find_connection(host, gattc_if, conn_id);
+      if (connection)
+        schedule_notifications(host, *connection, handle, at + 1, values);
+    }
+
+    esp_ble_gattc_cb_param_t param = {};
+    param.write.status = status;
+    param.write.conn_id = conn_id;
+    param.write.handle = handle;
+    gattc_event(event, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+esp_err_t register_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle, bool enable) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto address = to_address(server_bda);
+  Connection *connection = nullptr;
+  for (auto &entry : host.connections) {
+    if (entry.second.open && entry.second.gattc_if == gattc_if && entry.second.address == address)
+      connection = &entry.second;
+  }
+  if (!connection)
+    return ESP_ERR_INVALID_STATE;
+
+  if (enable)
+    connection->notify_handles.insert(handle);
+  else
+    connection->notify_handles.erase(handle);
+
+  // only recorded by the stack, nothing goes over the air
+  schedule(host, esp_timer_get_time(), [=]() {
+    esp_ble_gattc_cb_param_t param = {};
+    param.reg_for_notify.status = ESP_GATT_OK;
+    param.reg_for_notify.handle = handle;
+    gattc_event(enable ? ESP_GATTC_REG_FOR_NOTIFY_EVT : ESP_GATTC_UNREG_FOR_NOTIFY_EVT, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+}  // namespace
+
+void host_bt_add_peripheral(const HostBTPeripheral &peripheral) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.peripherals[peripheral.address] = peripheral;
+}
+
+void host_bt_reset() {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.peripherals.clear();
+  host.preferred_intervals.clear();
+  host.max_connections = open_connections(host);
+}
+
+uint16_t host_bt_get_handle(uint64_t address, uint16_t characteristic_uuid) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto iter = host.peripherals.find(address);
+  if (iter == host.peripherals.end())
+    return 0;
+  auto &characteristics = iter->second.characteristics;
+  for (size_t i = 0; i < characteristics.size(); i++) {
+    if (characteristics[i] == characteristic_uuid)
+      return value_handle(i);
+  }
+  return 0;
+}
+
+void host_bt_notify(uint64_t address, uint16_t handle, const std::vector<uint8_t> &value, int count) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  for (auto &entry : host.connections) {
+    auto &connection = entry.second;
+    if (!connection.open || connection.address != address || !connection.notify_handles.count(handle))
+      continue;
+    auto gattc_if = connection.gattc_if;
+    auto conn_id = connection.conn_id;
+    schedule(host, esp_timer_get_time(), [=]() {
+      for (int i = 0; i < count; i++)
+        notify_event(gattc_if, conn_id, address, handle, value);
+    });
+  }
+}
+
+int64_t host_bt_get_last_event_us() { return host().last_event_us; }
+
+int host_bt_get_connections() {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  return open_connections(host);
+}
+
+int host_bt_get_max_connections() {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  return host.max_connections;
+}
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t *cfg) { return ESP_OK; }
+
+esp_err_t esp_bt_controller_deinit(void) { return ESP_OK; }
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.controller_enabled = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_bt_controller_disable(void) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.controller_enabled = false;
+  return ESP_OK;
+}
+
+esp_bt_controller_status_t esp_bt_controller_get_status(void) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  return host.controller_enabled ? ESP_BT_CONTROLLER_STATUS_ENABLED : ESP_BT_CONTROLLER_STATUS_IDLE;
+}
+
+bool btStarted(void) { return esp_bt_controller_get_status() == ESP_BT_CONTROLLER_STATUS_ENABLED; }
+
+esp_err_t esp_bluedroid_init(void) { return ESP_OK; }
+esp_err_t esp_bluedroid_enable(void) { return ESP_OK; }
+esp_err_t esp_bluedroid_disable(void) { return ESP_OK; }
+esp_err_t esp_bluedroid_deinit(void) { return ESP_OK; }
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.local_mtu = mtu;
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.gap_callback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_device_name(const char *name) { return ESP_OK; }
+
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t param_type, void *value, uint8_t len) { return ESP_OK; }
+
+esp_err_t esp_ble_gap_set_prefer_conn_params(esp_bd_addr_t bd_addr, uint16_t min_conn_int, uint16_t max_conn_int,
+                                             uint16_t slave_latency, uint16_t supervision_tout) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.preferred_intervals[to_address(bd_addr)] = max_conn_int * 1250;
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto address = to_address(params->bda);
+  for (auto &entry : host.connections) {
+    auto &connection = entry.second;
+    if (!connection.open || connection.address != address)
+      continue;
+
+    // takes effect a few connection events later
+    int64_t at = next_event(connection, esp_timer_get_time()) + 2 * connection.interval_us;
+    auto conn_id = connection.conn_id;
+    auto update = *params;
+    schedule(host, at, [=]() {
+      auto &host = ::host();
+      {
+        std::lock_guard<std::mutex> guard(host.lock);
+        auto iter = host.connections.find(conn_id);
+        if (iter == host.connections.end())
+          return;
+        iter->second.opened_at = at;
+        iter->second.interval_us = update.max_int * 1250;
+        iter->second.event_at = 0;
+        iter->second.event_packets = 0;
+      }
+
+      esp_ble_gap_cb_param_t param = {};
+      param.update_conn_params.status = ESP_BT_STATUS_SUCCESS;
+      memcpy(param.update_conn_params.bda, update.bda, sizeof(esp_bd_addr_t));
+      param.update_conn_params.min_int = update.min_int;
+      param.update_conn_params.max_int = update.max_int;
+      param.update_conn_params.latency = update.latency;
+      param.update_conn_params.conn_int = update.max_int;
+      param.update_conn_params.timeout = update.timeout;
+      gap_event(ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, &param);
+    });
+    return ESP_OK;
+  }
+  return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t callback) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  host.gattc_callback = callback;
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_app_register(uint16_t app_id) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+
+  esp_gatt_if_t gattc_if = FIRST_GATTC_IF;
+  while (host.apps.count(gattc_if))
+    gattc_if++;
+  if (gattc_if >= FIRST_GATTC_IF + MAX_APPS)
+    return ESP_ERR_NO_MEM;
+  host.apps[gattc_if] = app_id;
+
+  schedule(host, esp_timer_get_time(), [=]() {
+    esp_ble_gattc_cb_param_t param = {};
+    param.reg.status = ESP_GATT_OK;
+    param.reg.app_id = app_id;
+    gattc_event(ESP_GATTC_REG_EVT, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_app_unregister(esp_gatt_if_t gattc_if) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  if (!host.apps.erase(gattc_if))
+    return ESP_ERR_INVALID_ARG;
+
+  // links of the app are dropped with it
+  for (auto iter = host.connections.begin(); iter != host.connections.end();) {
+    if (iter->second.gattc_if == gattc_if)
+      iter = host.connections.erase(iter);
+    else
+      ++iter;
+  }
+
+  schedule(host, esp_timer_get_time(), [=]() {
+    esp_ble_gattc_cb_param_t param = {};
+    gattc_event(ESP_GATTC_UNREG_EVT, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, esp_ble_addr_type_t remote_addr_type,
+                             bool is_direct) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  if (!host.apps.count(gattc_if))
+    return ESP_ERR_INVALID_ARG;
+
+  auto address = to_address(remote_bda);
+  auto now = esp_timer_get_time();
+  auto peripheral = host.peripherals.find(address);
+  uint32_t interval = peripheral != host.peripherals.end() ? peripheral->second.interval_us : 7500;
+  if (host.preferred_intervals.count(address))
+    interval = host.preferred_intervals[address];
+
+  auto fail = [&](int64_t at, esp_gatt_status_t status) {
+    schedule(host, at, [=]() {
+      esp_ble_gattc_cb_param_t param = {};
+      param.open.status = status;
+      to_bda(address, param.open.remote_bda);
+      gattc_event(ESP_GATTC_OPEN_EVT, gattc_if, &param);
+    });
+    return ESP_OK;
+  };
+
+  // the controller has room for so many links
+  if (open_connections(host) >= CONFIG_BTDM_CTRL_BLE_MAX_CONN)
+    return fail(now, ESP_GATT_NO_RESOURCES);
+  if (peripheral == host.peripherals.end())
+    return fail(now + OPEN_ATTEMPT_EVENTS * interval, ESP_GATT_ERROR);
+
+  uint16_t conn_id = host.next_conn_id++;
+  auto &connection = host.connections[conn_id];
+  connection.conn_id = conn_id;
+  connection.gattc_if = gattc_if;
+  connection.address = address;
+  connection.interval_us = interval;
+  host.max_connections = std::max(host.max_connections, open_connections(host));
+
+  int64_t at = now + peripheral->second.open_events * interval;
+  schedule(host, at, [=]() {
+    auto &host = ::host();
+    {
+      std::lock_guard<std::mutex> guard(host.lock);
+      auto iter = host.connections.find(conn_id);
+      if (iter == host.connections.end())
+        return;
+      iter->second.open = true;
+      iter->second.opened_at = at;
+    }
+
+    esp_ble_gattc_cb_param_t param = {};
+    param.connect.conn_id = conn_id;
+    to_bda(address, param.connect.remote_bda);
+    gattc_event(ESP_GATTC_CONNECT_EVT, gattc_if, &param);
+
+    param = {};
+    param.open.status = ESP_GATT_OK;
+    param.open.conn_id = conn_id;
+    to_bda(address, param.open.remote_bda);
+    param.open.mtu = 23;
+    gattc_event(ESP_GATTC_OPEN_EVT, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_close(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto *connection = find_connection(host, gattc_if, conn_id);
+  if (!connection)
+    return ESP_ERR_INVALID_STATE;
+
+  auto address = connection->address;
+  schedule(host, next_event(*connection, esp_timer_get_time()), [=]() {
+    auto &host = ::host();
+    {
+      std::lock_guard<std::mutex> guard(host.lock);
+      host.connections.erase(conn_id);
+    }
+
+    esp_ble_gattc_cb_param_t param = {};
+    param.disconnect.conn_id = conn_id;
+    to_bda(address, param.disconnect.remote_bda);
+    gattc_event(ESP_GATTC_DISCONNECT_EVT, gattc_if, &param);
+
+    param = {};
+    param.close.status = ESP_GATT_OK;
+    param.close.conn_id = conn_id;
+    to_bda(address, param.close.remote_bda);
+    gattc_event(ESP_GATTC_CLOSE_EVT, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto *connection = find_connection(host, gattc_if, conn_id);
+  if (!connection)
+    return ESP_ERR_INVALID_STATE;
+
+  auto &peripheral = host.peripherals[connection->address];
+  if (peripheral.unresponsive)
+    return ESP_OK;
+
+  uint16_t mtu = std::min(host.local_mtu, peripheral.mtu);
+  connection->mtu = mtu;
+  schedule(host, next_event(*connection, esp_timer_get_time()) + connection->interval_us, [=]() {
+    esp_ble_gattc_cb_param_t param = {};
+    param.cfg_mtu.status = ESP_GATT_OK;
+    param.cfg_mtu.conn_id = conn_id;
+    param.cfg_mtu.mtu = mtu;
+    gattc_event(ESP_GATTC_CFG_MTU_EVT, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t *filter_uuid) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto *connection = find_connection(host, gattc_if, conn_id);
+  if (!connection)
+    return ESP_ERR_INVALID_STATE;
+
+  auto &peripheral = host.peripherals[connection->address];
+  if (peripheral.unresponsive)
+    return ESP_OK;
+
+  uint16_t service_uuid = peripheral.service_uuid;
+  uint16_t end_handle = service_end_handle(peripheral);
+  int64_t at = next_event(*connection, esp_timer_get_time()) + DISCOVERY_ROUND_TRIPS * connection->interval_us;
+  schedule(host, at, [=]() {
+    esp_ble_gattc_cb_param_t param = {};
+    param.search_res.conn_id = conn_id;
+    param.search_res.start_handle = 1;
+    param.search_res.end_handle = end_handle;
+    param.search_res.srvc_id.uuid.len = ESP_UUID_LEN_16;
+    param.search_res.srvc_id.uuid.uuid.uuid16 = service_uuid;
+    param.search_res.is_primary = true;
+    gattc_event(ESP_GATTC_SEARCH_RES_EVT, gattc_if, &param);
+
+    param = {};
+    param.search_cmpl.status = ESP_GATT_OK;
+    param.search_cmpl.conn_id = conn_id;
+    gattc_event(ESP_GATTC_SEARCH_CMPL_EVT, gattc_if, &param);
+  });
+  return ESP_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_char_by_uuid(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle,
+                                                 uint16_t end_handle, esp_bt_uuid_t char_uuid,
+                                                 esp_gattc_char_elem_t *result, uint16_t *count) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto *connection = find_connection(host, gattc_if, conn_id);
+  if (!connection)
+    return ESP_GATT_ERROR;
+
+  auto &characteristics = host.peripherals[connection->address].characteristics;
+  uint16_t found = 0;
+  for (size_t i = 0; i < characteristics.size() && found < *count; i++) {
+    auto handle = value_handle(i);
+    if (char_uuid.len != ESP_UUID_LEN_16 || char_uuid.uuid.uuid16 != characteristics[i] || handle < start_handle ||
+        handle > end_handle)
+      continue;
+    result[found] = {};
+    result[found].char_handle = handle;
+    result[found].uuid = char_uuid;
+    found++;
+  }
+  *count = found;
+  return ESP_GATT_OK;
+}
+
+esp_gatt_status_t esp_ble_gattc_get_all_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t char_handle,
+                                              esp_gattc_descr_elem_t *result, uint16_t *count, uint16_t offset) {
+  auto &host = ::host();
+  std::lock_guard<std::mutex> guard(host.lock);
+  auto *connection = find_connection(host, gattc_if, conn_id);
+  if (!connection)
+    return ESP_GATT_ERROR;
+
+  // the CCC descriptor is all there is
+  auto &characteristics = host.peripherals[connection->address].characteristics;
+  *count = 0;
+  for (size_t i = 0; i < characteristics.size(); i++) {
+    if (value_handle(i) != char_handle)
+      continue;
+    if (offset > 0)
+      return ESP_GATT_INVALID_HANDLE;
+    result[0] = {};
+    result[0].handle = char_handle + 1;
+    result[0].uuid.len = ESP_UUID_LEN_16;
+    result[0].uuid.uuid.uuid16 = 0x2902;
+    *count = 1;
+  }
+  return ESP_GATT_OK;
+}
+
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+                                   uint8_t *value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req) {
+  return write_value(gattc_if, conn_id, handle, value_len, value, write_type, ESP_GATTC_WRITE_CHAR_EVT);
+}
+
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+                                         uint16_t value_len, uint8_t *value, esp_gatt_write_type_t write_type,
+                                         esp_gatt_auth_req_t auth_req) {
+  return write_value(gattc_if, conn_id, handle, value_len, value, write_type, ESP_GATTC_WRITE_DESCR_EVT);
+}
+
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle) {
+  return register_notify(gattc_if, server_bda, handle, true);
+}
+
+esp_err_t esp_ble_gattc_unregister_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle) {
+  return register_notify(gattc_if, server_bda, handle, false);
+}
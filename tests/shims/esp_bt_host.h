@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Simulated BLE controller and peripherals behind the GATTC and GAP
+// shims. Events are delivered from a single callback thread, which
+// stands in for the BTC task of the device. Every connection has
+// connection events every interval: requests go out on the next one,
+// up to a few packets each, and responses come back one interval later.
+struct HostBTPeripheral {
+  typedef std::vector<uint8_t> Value;
+
+  uint64_t address{0};
+  // a single primary service, each characteristic with a CCC descriptor
+  uint16_t service_uuid{0x1800};
+  std::vector<uint16_t> characteristics;
+  uint16_t mtu{247};
+  // unless the connection asks for its own
+  uint32_t interval_us{7500};
+  // connection events it takes to open the link
+  int open_events{4};
+  // requests are accepted, but never answered
+  bool unresponsive{false};
+
+  // Called on the callback thread for every write of a characteristic,
+  // what it returns is notified on the following connection events
+  std::function<std::vector<Value>(uint16_t handle, const Value &value)> on_write;
+};
+
+void host_bt_add_peripheral(const HostBTPeripheral &peripheral);
+// Forgets the peripherals and the counters, links must be closed by then
+void host_bt_reset();
+
+// Value handle of a characteristic of the peripheral, 0 if there is none
+uint16_t host_bt_get_handle(uint64_t address, uint16_t characteristic_uuid);
+
+// Notifies the value count times, back to back on the callback thread,
+// to every connection that registered for it
+void host_bt_notify(uint64_t address, uint16_t handle, const std::vector<uint8_t> &value, int count = 1);
+
+// When the last GATTC event was handed to the callback, in us of esp_timer
+int64_t host_bt_get_last_event_us();
+int host_bt_get_connections();
+// Most links open at once since the reset
+int host_bt_get_max_connections();
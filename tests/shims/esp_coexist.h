@@ -0,0 +1,4 @@
+#pragma once
+
+// Host stand-in for the Wi-Fi and Bluetooth coexistence of ESP-IDF,
+// there is no shared radio on the host
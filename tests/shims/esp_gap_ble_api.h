@@ -0,0 +1,58 @@
+#pragma once
+
+// Host stand-in for the BLE GAP API of ESP-IDF, as far as connections
+// use it. The controller is simulated by esp_bt_host.h.
+
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ESP_GAP_BLE_SCAN_RESULT_EVT = 3,
+  ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT = 20,
+} esp_gap_ble_cb_event_t;
+
+typedef union {
+  struct ble_update_conn_params_evt_param {
+    esp_bt_status_t status;
+    esp_bd_addr_t bda;
+    uint16_t min_int;
+    uint16_t max_int;
+    uint16_t latency;
+    uint16_t conn_int;
+    uint16_t timeout;
+  } update_conn_params;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+typedef struct {
+  esp_bd_addr_t bda;
+  uint16_t min_int;
+  uint16_t max_int;
+  uint16_t latency;
+  uint16_t timeout;
+} esp_ble_conn_update_params_t;
+
+typedef uint8_t esp_ble_io_cap_t;
+#define ESP_IO_CAP_NONE 3
+
+typedef enum {
+  ESP_BLE_SM_PASSKEY = 0,
+  ESP_BLE_SM_AUTHEN_REQ_MODE,
+  ESP_BLE_SM_IOCAP_MODE,
+} esp_ble_sm_param_t;
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_set_device_name(const char *name);
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t param_type, void *value, uint8_t len);
+// Used for the next connection to the device, in units of 1.25ms and 10ms
+esp_err_t esp_ble_gap_set_prefer_conn_params(esp_bd_addr_t bd_addr, uint16_t min_conn_int, uint16_t max_conn_int,
+                                             uint16_t slave_latency, uint16_t supervision_tout);
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t *params);
+
+#ifdef __cplusplus
+}
+#endif
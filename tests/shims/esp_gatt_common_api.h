@@ -0,0 +1,16 @@
+#pragma once
+
+// Host stand-in for the GATT settings of ESP-IDF
+
+#include "esp_gatt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Offered by the client in esp_ble_gattc_send_mtu_req()
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+// Host stand-in for the GATT types of ESP-IDF
+
+#include "esp_bt_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t esp_gatt_if_t;
+#define ESP_GATT_IF_NONE 0xff
+
+typedef enum {
+  ESP_GATT_OK = 0x0,
+  ESP_GATT_INVALID_HANDLE = 0x01,
+  ESP_GATT_WRITE_NOT_PERMIT = 0x03,
+  ESP_GATT_NO_RESOURCES = 0x80,
+  ESP_GATT_INTERNAL_ERROR = 0x81,
+  ESP_GATT_ERROR = 0x85,
+  ESP_GATT_CONGESTED = 0x8f,
+} esp_gatt_status_t;
+
+typedef enum {
+  ESP_GATT_WRITE_TYPE_NO_RSP = 1,
+  ESP_GATT_WRITE_TYPE_RSP,
+} esp_gatt_write_type_t;
+
+typedef enum {
+  ESP_GATT_AUTH_REQ_NONE = 0,
+  ESP_GATT_AUTH_REQ_NO_MITM = 1,
+  ESP_GATT_AUTH_REQ_MITM = 2,
+} esp_gatt_auth_req_t;
+
+typedef struct {
+  esp_bt_uuid_t uuid;
+  uint8_t inst_id;
+} __attribute__((packed)) esp_gatt_id_t;
+
+typedef struct {
+  esp_gatt_id_t id;
+  bool is_primary;
+} __attribute__((packed)) esp_gatt_srvc_id_t;
+
+typedef struct {
+  uint16_t char_handle;
+  uint8_t properties;
+  esp_bt_uuid_t uuid;
+} esp_gattc_char_elem_t;
+
+typedef struct {
+  uint16_t handle;
+  esp_bt_uuid_t uuid;
+} esp_gattc_descr_elem_t;
+
+#ifdef __cplusplus
+}
+#endif
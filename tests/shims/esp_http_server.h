@@ -0,0 +1,6 @@
+#pragma once
+
+// The device build resolves this to the ESP-IDF component,
+// the host one to the copy vendored by esp32_camera_web_server3
+
+#include "esphome/components/esp32_camera_web_server3/idf/esp_http_server.h"
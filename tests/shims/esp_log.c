@@ -0,0 +1,62 @@
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static int log_level = -1;
+
+esp_log_level_t esp_log_level_get(void)
+{
+    if (log_level < 0) {
+        const char *env = getenv("HOST_LOG_LEVEL");
+        log_level = env ? atoi(env) : ESP_LOG_WARN;
+    }
+    return (esp_log_level_t) log_level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void) tag;
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    struct timespec ts;
+    char line[512];
+    va_list args;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    /* A single write, so that lines of concurrent threads do not mix */
+    fprintf(stderr, "%c (%ld.%03ld) %s: %s\n", letters[level], (long) ts.tv_sec, ts.tv_nsec / 1000000L, tag, line);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+// Host stand-in for the ESP-IDF high resolution timer
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline int64_t esp_timer_get_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,148 @@
+#include "esp32_camera.h"
+
+#include <img_converters.h>
+
+#include <chrono>
+#include <cstdlib>
+
+namespace esphome {
+namespace esp32_camera {
+
+// Long enough not to repeat within the change detection window
+static const uint32_t GENERATED_FRAMES = 32;
+
+ESP32Camera *global_esp32_camera = nullptr;
+
+ESP32Camera::ESP32Camera() { global_esp32_camera = this; }
+
+ESP32Camera::~ESP32Camera() {
+  this->on_shutdown();
+  if (global_esp32_camera == this)
+    global_esp32_camera = nullptr;
+}
+
+void ESP32Camera::set_frames(std::vector<std::vector<uint8_t>> frames) {
+  this->frames_.clear();
+  for (auto &frame : frames) {
+    this->frames_.push_back(std::make_shared<const std::vector<uint8_t>>(std::move(frame)));
+  }
+}
+
+std::vector<uint8_t> ESP32Camera::generate_frame(uint16_t width, uint16_t height, uint8_t quality, uint32_t index) {
+  std::vector<uint8_t> rgb((size_t) width * height * 2);
+  uint16_t size = height / 4;
+  uint16_t left = (index * width / GENERATED_FRAMES) % (width - size);
+  uint16_t top = (height - size) / 2;
+
+  for (uint16_t y = 0; y < height; y++) {
+    for (uint16_t x = 0; x < width; x++) {
+      bool square = x >= left && x < left + size && y >= top && y < top + size;
+      uint8_t r = square ? 255 : x * 255 / width;
+      uint8_t g = square ? 64 : y * 255 / height;
+      uint8_t b = square ? 32 : 128;
+      uint16_t pixel = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+      rgb[(y * width + x) * 2] = pixel >> 8;
+      rgb[(y * width + x) * 2 + 1] = pixel & 0xFF;
+    }
+  }
+
+  uint8_t *jpeg = nullptr;
+  size_t length = 0;
+  if (!fmt2jpg(rgb.data(), rgb.size(), width, height, PIXFORMAT_RGB565, quality, &jpeg, &length))
+    return {};
+
+  std::vector<uint8_t> data(jpeg, jpeg + length);
+  free(jpeg);
+  return data;
+}
+
+void ESP32Camera::setup() {
+  // encoded once, so that the capture costs no CPU of the benchmarks
+  if (this->frames_.empty()) {
+    for (uint32_t i = 0; i < GENERATED_FRAMES; i++) {
+      this->frames_.push_back(std::make_shared<const std::vector<uint8_t>>(
+          generate_frame(this->width_, this->height_, this->quality_, i)));
+    }
+  }
+
+  this->stopping_ = false;
+  this->thread_ = std::thread([this]() { this->capture_loop_(); });
+}
+
+void ESP32Camera::on_shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->stopping_ = true;
+  }
+  this->cond_.notify_all();
+  if (this->thread_.joinable())
+    this->thread_.join();
+}
+
+void ESP32Camera::add_image_callback(std::function<void(std::shared_ptr<CameraImage>)> &&callback) {
+  this->callbacks_.push_back(std::move(callback));
+}
+
+void ESP32Camera::start_stream(CameraRequester requester) {
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->streams_ |= 1 << requester;
+  }
+  this->cond_.notify_all();
+}
+
+void ESP32Camera::stop_stream(CameraRequester requester) {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  this->streams_ &= ~(1 << requester);
+}
+
+void ESP32Camera::request_image(CameraRequester requester) {
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->single_requests_ |= 1 << requester;
+  }
+  this->cond_.notify_all();
+}
+
+bool ESP32Camera::is_streaming() {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  return this->streams_ != 0;
+}
+
+void ESP32Camera::capture_loop_() {
+  auto interval = std::chrono::microseconds((int64_t) (1000000 / this->max_framerate_));
+  auto next = std::chrono::steady_clock::now();
+  uint32_t index = 0;
+
+  while (true) {
+    uint8_t requesters;
+
+    {
+      std::unique_lock<std::mutex> guard(this->lock_);
+      this->cond_.wait(guard, [this]() { return this->stopping_ || this->streams_ || this->single_requests_; });
+      if (this->stopping_)
+        return;
+
+      // a sensor delivers frames at its own pace, whoever asked
+      this->cond_.wait_until(guard, next, [this]() { return this->stopping_; });
+      if (this->stopping_)
+        return;
+
+      requesters = this->streams_ | this->single_requests_;
+      this->single_requests_ = 0;
+    }
+
+    next = std::max(next + interval, std::chrono::steady_clock::now());
+    if (!requesters)
+      continue;
+
+    auto image = std::make_shared<CameraImage>(this->frames_[index++ % this->frames_.size()], requesters);
+    this->frames_captured_++;
+    for (auto &callback : this->callbacks_) {
+      callback(image);
+    }
+  }
+}
+
+}  // namespace esp32_camera
+}  // namespace esphome
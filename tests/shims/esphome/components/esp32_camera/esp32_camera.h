@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "esphome/core/component.h"
+
+namespace esphome {
+namespace esp32_camera {
+
+enum CameraRequester { IDLE, API_REQUESTER, WEB_REQUESTER };
+
+// A captured JPEG together with whoever asked for it
+class CameraImage {
+ public:
+  CameraImage(std::shared_ptr<const std::vector<uint8_t>> data, uint8_t requesters)
+      : data_(std::move(data)), requesters_(requesters) {}
+
+  uint8_t *get_data_buffer() { return const_cast<uint8_t *>(this->data_->data()); }
+  size_t get_data_length() { return this->data_->size(); }
+  bool was_requested_by(CameraRequester requester) const { return this->requesters_ & (1 << requester); }
+
+ protected:
+  std::shared_ptr<const std::vector<uint8_t>> data_;
+  uint8_t requesters_;
+};
+
+// Synthetic camera for the host: plays a sequence of pre-encoded JPEGs
+// (by default a square moving over a gradient) at a fixed frame rate
+// while streaming, or a single one when requested. The callbacks are
+// called from the capture thread, which stands in for the main loop.
+class ESP32Camera : public Component {
+ public:
+  ESP32Camera();
+  ~ESP32Camera();
+
+  void set_resolution(uint16_t width, uint16_t height) {
+    this->width_ = width;
+    this->height_ = height;
+  }
+  void set_jpeg_quality(uint8_t quality) { this->quality_ = quality; }
+  void set_max_framerate(float max_framerate) { this->max_framerate_ = max_framerate; }
+  // Replaces the generated sequence, has to be called before setup()
+  void set_frames(std::vector<std::vector<uint8_t>> frames);
+
+  void setup() override;
+  void on_shutdown() override;
+
+  void add_image_callback(std::function<void(std::shared_ptr<CameraImage>)> &&callback);
+  void start_stream(CameraRequester requester);
+  void stop_stream(CameraRequester requester);
+  void request_image(CameraRequester requester);
+
+  bool is_streaming();
+  uint32_t get_frames_captured() const { return this->frames_captured_; }
+
+  // Encodes frame number index of the moving square sequence
+  static std::vector<uint8_t> generate_frame(uint16_t width, uint16_t height, uint8_t quality, uint32_t index);
+
+ protected:
+  void capture_loop_();
+
+  uint16_t width_{320};
+  uint16_t height_{240};
+  uint8_t quality_{80};
+  float max_framerate_{25};
+  std::vector<std::shared_ptr<const std::vector<uint8_t>>> frames_;
+  std::vector<std::function<void(std::shared_ptr<CameraImage>)>> callbacks_;
+
+  std::mutex lock_;
+  std::condition_variable cond_;
+  uint8_t streams_{0};
+  uint8_t single_requests_{0};
+  bool stopping_{false};
+  std::thread thread_;
+  std::atomic<uint32_t> frames_captured_{0};
+};
+
+extern ESP32Camera *global_esp32_camera;
+
+}  // namespace esp32_camera
+}  // namespace esphome
@@ -0,0 +1,28 @@
+#include "hal.h"
+
+#include <csignal>
+#include <chrono>
+#include <thread>
+
+namespace esphome {
+
+static const auto START = std::chrono::steady_clock::now();
+
+// lwIP has no signals, a send to a closed peer only fails with EPIPE
+static const auto IGNORE_SIGPIPE = std::signal(SIGPIPE, SIG_IGN);
+
+uint32_t millis() {
+  auto elapsed = std::chrono::steady_clock::now() - START;
+  return (uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+uint32_t micros() {
+  auto elapsed = std::chrono::steady_clock::now() - START;
+  return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+void delayMicroseconds(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+}  // namespace esphome
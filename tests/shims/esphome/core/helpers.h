@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+namespace esphome {
+
+template<typename T> std::string to_string(T value) { return std::to_string(value); }
+
+}  // namespace esphome
@@ -0,0 +1,12 @@
+#pragma once
+
+// Host stand-in for the esphome logger, on top of the ESP-IDF one
+
+#include <esp_log.h>
+
+#define ESP_LOGCONFIG(tag, format, ...) ESP_LOGI(tag, format, ##__VA_ARGS__)
+
+#define YESNO(b) ((b) ? "YES" : "NO")
+
+// where the esphome logger lives, for `using namespace esphome`
+namespace esphome {}
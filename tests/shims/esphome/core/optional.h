@@ -0,0 +1,10 @@
+#pragma once
+
+#include <optional>
+
+namespace esphome {
+
+// The esphome one predates C++17, and has the same interface
+template<typename T> using optional = std::optional<T>;
+
+}  // namespace esphome
@@ -0,0 +1,38 @@
+#pragma once
+
+// Host stand-in for FreeRTOS, tasks are threads and a tick is a millisecond
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "FreeRTOSConfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms) ((TickType_t) (((TickType_t) (ms) * (TickType_t) configTICK_RATE_HZ) / (TickType_t) 1000))
+
+#ifndef tskIDLE_PRIORITY
+#define tskIDLE_PRIORITY 0
+#endif
+#ifndef tskNO_AFFINITY
+#define tskNO_AFFINITY INT_MAX
+#endif
+
+#ifdef __cplusplus
+}
+#endif
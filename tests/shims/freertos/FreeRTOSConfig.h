@@ -0,0 +1,5 @@
+#pragma once
+
+#define configTICK_RATE_HZ 1000
+#define configMAX_PRIORITIES 25
+#define configBT_LE_MAX_CONNECTIONS 3
@@ -0,0 +1,237 @@
+#include "FreeRTOS.h"
+#include "event_groups.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <pthread.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct host_task {
+  pthread_t thread;
+  TaskFunction_t code;
+  void *arg;
+  std::string name;
+  std::mutex lock;
+  std::condition_variable cond;
+  uint32_t notifications{0};
+};
+
+struct host_queue {
+  std::mutex lock;
+  std::condition_variable cond;
+  UBaseType_t length;
+  UBaseType_t item_size;
+  // only the number of items is tracked for semaphores
+  UBaseType_t count{0};
+  std::deque<std::vector<uint8_t>> items;
+};
+
+struct host_event_group {
+  std::mutex lock;
+  std::condition_variable cond;
+  EventBits_t bits{0};
+};
+
+// Handles of tasks are never freed, since a deleted task
+// can be referenced by others for as long as on the device
+static thread_local host_task *current_task = nullptr;
+
+static const auto START = std::chrono::steady_clock::now();
+
+// Waits on cond until ready() for the number of ticks, or forever
+template<typename Lock, typename Predicate>
+static bool wait_ticks(std::condition_variable &cond, Lock &lock, TickType_t ticks, Predicate ready) {
+  if (ticks == portMAX_DELAY) {
+    cond.wait(lock, ready);
+    return true;
+  }
+  return cond.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready);
+}
+
+static void *task_trampoline(void *arg) {
+  auto *task = static_cast<host_task *>(arg);
+  current_task = task;
+  // visible in /proc/self/task/*/comm, which limits it to 15 characters
+  pthread_setname_np(pthread_self(), task->name.substr(0, 15).c_str());
+  task->code(task->arg);
+  // returning from a task function is a bug in FreeRTOS, but harmless here
+  return nullptr;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core_id) {
+  auto *task = new host_task();
+  task->code = code;
+  task->arg = arg;
+  task->name = name ? name : "";
+  // handle is published before the task runs, as tasks often read it
+  if (created)
+    *created = task;
+  if (pthread_create(&task->thread, nullptr, task_trampoline, task) != 0) {
+    if (created)
+      *created = nullptr;
+    delete task;
+    return pdFAIL;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *created) {
+  return xTaskCreatePinnedToCore(code, name, stack_depth, arg, priority, created, tskNO_AFFINITY);
+}
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t code, const char *name, uint32_t stack_depth, void *arg,
+                                UBaseType_t priority, TaskHandle_t *created, BaseType_t core_id) {
+  return xTaskCreatePinnedToCore(code, name, stack_depth, arg, priority, created, core_id);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == current_task) {
+    if (current_task != nullptr)
+      pthread_detach(current_task->thread);
+    pthread_exit(nullptr);
+  }
+  pthread_cancel(task->thread);
+  pthread_join(task->thread, nullptr);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  // a cancellation point, as vTaskDelete() of the task expects
+  struct timespec ts;
+  ts.tv_sec = ticks * portTICK_PERIOD_MS / 1000;
+  ts.tv_nsec = (long) (ticks * portTICK_PERIOD_MS % 1000) * 1000000L;
+  nanosleep(&ts, nullptr);
+}
+
+TickType_t xTaskGetTickCount(void) {
+  auto elapsed = std::chrono::steady_clock::now() - START;
+  return (TickType_t) (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  // threads not created as tasks, like the test itself, get a handle on first use
+  if (current_task == nullptr) {
+    current_task = new host_task();
+    current_task->thread = pthread_self();
+  }
+  return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+  }
+  task->cond.notify_all();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+  host_task *task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> guard(task->lock);
+  wait_ticks(task->cond, guard, ticks, [task]() { return task->notifications != 0; });
+  uint32_t value = task->notifications;
+  if (value)
+    task->notifications = clear_on_exit ? 0 : value - 1;
+  return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  auto *queue = new host_queue();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!wait_ticks(queue->cond, guard, ticks, [queue]() { return queue->count < queue->length; }))
+    return pdFALSE;
+  if (queue->item_size) {
+    const auto *data = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(data, data + queue->item_size);
+  }
+  queue->count++;
+  guard.unlock();
+  queue->cond.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!wait_ticks(queue->cond, guard, ticks, [queue]() { return queue->count != 0; }))
+    return pdFALSE;
+  if (queue->item_size) {
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+  }
+  queue->count--;
+  guard.unlock();
+  queue->cond.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return xSemaphoreCreateCounting(1, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return xSemaphoreCreateCounting(1, 0); }
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+  QueueHandle_t queue = xQueueCreate(max_count, 0);
+  queue->count = initial_count;
+  return queue;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) { return new host_event_group(); }
+
+void vEventGroupDelete(EventGroupHandle_t group) { delete group; }
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+  EventBits_t value;
+  {
+    std::lock_guard<std::mutex> guard(group->lock);
+    value = group->bits |= bits;
+  }
+  group->cond.notify_all();
+  return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+  std::lock_guard<std::mutex> guard(group->lock);
+  EventBits_t value = group->bits;
+  group->bits &= ~bits;
+  return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+  std::lock_guard<std::mutex> guard(group->lock);
+  return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+  std::unique_lock<std::mutex> guard(group->lock);
+  auto ready = [group, bits, wait_for_all]() {
+    return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+  };
+  bool met = wait_ticks(group->cond, guard, ticks, ready);
+  EventBits_t value = group->bits;
+  if (met && clear_on_exit)
+    group->bits &= ~bits;
+  return value;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Forced into the vendored esp_http_server sources on the host,
+// for what newlib and the lwIP headers provide on the device, but
+// glibc does not or not through the same headers
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HAVE_STRLCPY
+static inline size_t host_strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size) {
+        size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+#define strlcpy host_strlcpy
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,831 @@
+#include "http_parser.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+
+#ifndef ULLONG_MAX
+#define ULLONG_MAX ((uint64_t) -1)
+#endif
+
+enum state {
+    s_dead = 1,
+
+    s_start_req,
+    s_req_method,
+    s_req_spaces_before_url,
+    s_req_url,
+    s_req_http_start,
+    s_req_http_major,
+    s_req_http_dot,
+    s_req_http_minor,
+    s_req_http_end,
+    s_req_line_almost_done,
+
+    s_header_field_start,
+    s_header_field,
+    s_header_value_discard_ws,
+    s_header_value_discard_ws_almost_done,
+    s_header_value_discard_lws,
+    s_header_value,
+    s_header_almost_done,
+    s_header_value_lws,
+
+    s_headers_almost_done,
+    s_headers_done,
+
+    s_body_identity,
+    s_message_done,
+};
+
+enum header_states {
+    h_general = 0,
+    h_content_length,
+    h_transfer_encoding,
+    h_connection,
+    h_upgrade,
+};
+
+static const char *method_strings[] = {
+#define XX(num, name, string) #string,
+    HTTP_METHOD_MAP(XX)
+#undef XX
+};
+
+static const struct {
+    const char *name;
+    const char *description;
+} http_strerror_tab[] = {
+#define XX(n, s) { "HPE_" #n, s },
+    HTTP_ERRNO_MAP(XX)
+#undef XX
+};
+
+#define SET_ERRNO(e) (parser->http_errno = (e))
+
+/* Runs the data callback of a mark, or the notification callback, and
+ * returns ER from http_parser_execute() when it failed or paused */
+#define CALLBACK_DATA_(FOR, LEN, ER)                                      \
+    do {                                                                  \
+        if (FOR##_mark) {                                                 \
+            if (settings->on_##FOR &&                                     \
+                settings->on_##FOR(parser, FOR##_mark, (LEN)) != 0) {     \
+                SET_ERRNO(HPE_CB_##FOR);                                  \
+            }                                                             \
+            FOR##_mark = NULL;                                            \
+            if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {                    \
+                return (ER);                                              \
+            }                                                             \
+        }                                                                 \
+    } while (0)
+
+/* Including the current character */
+#define CALLBACK_DATA(FOR) CALLBACK_DATA_(FOR, p - FOR##_mark, p - data + 1)
+/* Excluding the current character */
+#define CALLBACK_DATA_NOADVANCE(FOR) CALLBACK_DATA_(FOR, p - FOR##_mark, p - data)
+
+#define CALLBACK_NOTIFY_(FOR, ER)                                         \
+    do {                                                                  \
+        if (settings->on_##FOR && settings->on_##FOR(parser) != 0) {      \
+            SET_ERRNO(HPE_CB_##FOR);                                      \
+        }                                                                 \
+        if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {                        \
+            return (ER);                                                  \
+        }                                                                 \
+    } while (0)
+
+#define CALLBACK_NOTIFY(FOR) CALLBACK_NOTIFY_(FOR, p - data + 1)
+#define CALLBACK_NOTIFY_NOADVANCE(FOR) CALLBACK_NOTIFY_(FOR, p - data)
+
+#define MARK(FOR) do { if (!FOR##_mark) FOR##_mark = p; } while (0)
+
+#define IS_URL_CHAR(c) ((unsigned char) (c) > 0x20 && (unsigned char) (c) != 0x7f)
+#define IS_HEADER_CHAR(c) ((c) == '\t' || ((unsigned char) (c) >= 0x20 && (unsigned char) (c) != 0x7f))
+
+static int is_token(char c)
+{
+    return isalnum((unsigned char) c) || (c && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+static enum header_states header_state_of(const http_parser *parser)
+{
+    static const struct {
+        const char *name;
+        enum header_states state;
+    } known[] = {
+        { "content-length", h_content_length },
+        { "transfer-encoding", h_transfer_encoding },
+        { "connection", h_connection },
+        { "upgrade", h_upgrade },
+    };
+
+    /* token_len beyond the buffer marks a name too long to be known */
+    if (parser->token_len >= sizeof(parser->token)) {
+        return h_general;
+    }
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+        if (strlen(known[i].name) == parser->token_len &&
+            memcmp(known[i].name, parser->token, parser->token_len) == 0) {
+            return known[i].state;
+        }
+    }
+    return h_general;
+}
+
+static int has_connection_token(const char *value, size_t len, const char *token)
+{
+    size_t token_len = strlen(token);
+    size_t pos = 0;
+
+    while (pos < len) {
+        while (pos < len && (value[pos] == ' ' || value[pos] == '\t' || value[pos] == ',')) {
+            pos++;
+        }
+        size_t start = pos;
+        while (pos < len && value[pos] != ',' && value[pos] != ' ' && value[pos] != '\t') {
+            pos++;
+        }
+        if (pos - start == token_len && strncasecmp(value + start, token, token_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Interprets the complete value of a header, returns the error if any */
+static enum http_errno finish_header(http_parser *parser)
+{
+    const char *value = parser->value;
+    size_t len = parser->value_len;
+
+    switch (parser->header_state) {
+    case h_content_length: {
+        if (parser->flags & F_CONTENTLENGTH) {
+            return HPE_UNEXPECTED_CONTENT_LENGTH;
+        }
+        while (len && (value[len - 1] == ' ' || value[len - 1] == '\t')) {
+            len--;
+        }
+        if (!len || len >= sizeof(parser->value)) {
+            return HPE_INVALID_CONTENT_LENGTH;
+        }
+        uint64_t content_length = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (!isdigit((unsigned char) value[i])) {
+                return HPE_INVALID_CONTENT_LENGTH;
+            }
+            uint64_t next = content_length * 10 + (value[i] - '0');
+            if (next < content_length || next == ULLONG_MAX) {
+                return HPE_INVALID_CONTENT_LENGTH;
+            }
+            content_length = next;
+        }
+        parser->content_length = content_length;
+        parser->flags |= F_CONTENTLENGTH;
+        break;
+    }
+
+    case h_transfer_encoding:
+        /* chunked request bodies are not supported by esp_http_server */
+        return HPE_INVALID_TRANSFER_ENCODING;
+
+    case h_connection:
+        if (has_connection_token(value, len, "upgrade")) {
+            parser->flags |= F_CONNECTION_UPGRADE;
+        }
+        if (has_connection_token(value, len, "close")) {
+            parser->flags |= F_CONNECTION_CLOSE;
+        }
+        if (has_connection_token(value, len, "keep-alive")) {
+            parser->flags |= F_CONNECTION_KEEP_ALIVE;
+        }
+        break;
+
+    case h_upgrade:
+        parser->flags |= F_UPGRADE;
+        break;
+
+    default:
+        break;
+    }
+    return HPE_OK;
+}
+
+static int method_of(const http_parser *parser)
+{
+    for (size_t i = 0; i < sizeof(method_strings) / sizeof(method_strings[0]); i++) {
+        if (strlen(method_strings[i]) == parser->token_len &&
+            memcmp(method_strings[i], parser->token, parser->token_len) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+size_t http_parser_execute(http_parser *parser, const http_parser_settings *settings,
+                           const char *data, size_t len)
+{
+    const char *p = data;
+    const char *header_field_mark = NULL;
+    const char *header_value_mark = NULL;
+    const char *url_mark = NULL;
+    const char *body_mark = NULL;
+    enum http_errno err;
+
+    /* We're in an error state. Don't bother doing anything. */
+    if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+        return 0;
+    }
+
+    if (len == 0) {
+        switch (parser->state) {
+        case s_dead:
+        case s_start_req:
+            return 0;
+        default:
+            SET_ERRNO(HPE_INVALID_EOF_STATE);
+            return 1;
+        }
+    }
+
+    /* Elements continuing from the previous block start right away */
+    if (parser->state == s_header_field) {
+        header_field_mark = data;
+    }
+    if (parser->state == s_header_value) {
+        header_value_mark = data;
+    }
+    if (parser->state == s_req_url) {
+        url_mark = data;
+    }
+
+    for (p = data; p != data + len; p++) {
+        char ch = *p;
+
+        if (parser->state <= s_headers_done) {
+            parser->nread++;
+        }
+
+reexecute:
+        switch (parser->state) {
+        case s_dead:
+            /* only a CRLF is allowed after a message closing the connection */
+            if (ch == '\r' || ch == '\n') {
+                break;
+            }
+            SET_ERRNO(HPE_CLOSED_CONNECTION);
+            goto error;
+
+        case s_start_req:
+            if (ch == '\r' || ch == '\n') {
+                break;
+            }
+            parser->flags = 0;
+            parser->upgrade = 0;
+            parser->content_length = ULLONG_MAX;
+            parser->nread = 1;
+            if (!isupper((unsigned char) ch)) {
+                SET_ERRNO(HPE_INVALID_METHOD);
+                goto error;
+            }
+            parser->token_len = 0;
+            parser->state = s_req_method;
+            CALLBACK_NOTIFY_NOADVANCE(message_begin);
+            goto reexecute;
+
+        case s_req_method:
+            if (ch == ' ') {
+                int method = method_of(parser);
+                if (method < 0) {
+                    SET_ERRNO(HPE_INVALID_METHOD);
+                    goto error;
+                }
+                parser->method = method;
+                parser->state = s_req_spaces_before_url;
+                break;
+            }
+            if ((!isupper((unsigned char) ch) && ch != '-') || parser->token_len >= sizeof(parser->token)) {
+                SET_ERRNO(HPE_INVALID_METHOD);
+                goto error;
+            }
+            parser->token[parser->token_len++] = ch;
+            break;
+
+        case s_req_spaces_before_url:
+            if (ch == ' ') {
+                break;
+            }
+            if (!IS_URL_CHAR(ch)) {
+                SET_ERRNO(HPE_INVALID_URL);
+                goto error;
+            }
+            MARK(url);
+            parser->state = s_req_url;
+            break;
+
+        case s_req_url:
+            if (ch == ' ') {
+                parser->state = s_req_http_start;
+                parser->index = 0;
+                CALLBACK_DATA(url);
+                break;
+            }
+            /* no HTTP/0.9 requests, which end with the URL */
+            if (!IS_URL_CHAR(ch)) {
+                SET_ERRNO(HPE_INVALID_URL);
+                goto error;
+            }
+            break;
+
+        case s_req_http_start:
+            if (ch == ' ' && parser->index == 0) {
+                break;
+            }
+            if (ch != "HTTP/"[parser->index]) {
+                SET_ERRNO(HPE_INVALID_CONSTANT);
+                goto error;
+            }
+            if (++parser->index == 5) {
+                parser->state = s_req_http_major;
+            }
+            break;
+
+        case s_req_http_major:
+            if (!isdigit((unsigned char) ch)) {
+                SET_ERRNO(HPE_INVALID_VERSION);
+                goto error;
+            }
+            parser->http_major = ch - '0';
+            parser->state = s_req_http_dot;
+            break;
+
+        case s_req_http_dot:
+            if (ch != '.') {
+                SET_ERRNO(HPE_INVALID_VERSION);
+                goto error;
+            }
+            parser->state = s_req_http_minor;
+            break;
+
+        case s_req_http_minor:
+            if (!isdigit((unsigned char) ch)) {
+                SET_ERRNO(HPE_INVALID_VERSION);
+                goto error;
+            }
+            parser->http_minor = ch - '0';
+            parser->state = s_req_http_end;
+            break;
+
+        case s_req_http_end:
+            if (ch == '\r') {
+                parser->state = s_req_line_almost_done;
+                break;
+            }
+            if (ch == '\n') {
+                parser->state = s_header_field_start;
+                break;
+            }
+            SET_ERRNO(HPE_INVALID_VERSION);
+            goto error;
+
+        case s_req_line_almost_done:
+            if (ch != '\n') {
+                SET_ERRNO(HPE_LF_EXPECTED);
+                goto error;
+            }
+            parser->state = s_header_field_start;
+            break;
+
+        case s_header_field_start:
+            if (ch == '\r') {
+                parser->state = s_headers_almost_done;
+                break;
+            }
+            if (ch == '\n') {
+                /* a bare LF terminating the headers */
+                parser->state = s_headers_almost_done;
+                goto reexecute;
+            }
+            if (!is_token(ch)) {
+                SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+                goto error;
+            }
+            MARK(header_field);
+            parser->token_len = 0;
+            parser->state = s_header_field;
+            goto reexecute;
+
+        case s_header_field:
+            if (ch == ':') {
+                parser->header_state = header_state_of(parser);
+                parser->value_len = 0;
+                parser->state = s_header_value_discard_ws;
+                CALLBACK_DATA(header_field);
+                break;
+            }
+            if (!is_token(ch)) {
+                SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+                goto error;
+            }
+            /* longer names are only counted past the buffer, to tell them apart */
+            if (parser->token_len < sizeof(parser->token)) {
+                parser->token[parser->token_len] = tolower((unsigned char) ch);
+            }
+            if (parser->token_len <= sizeof(parser->token)) {
+                parser->token_len++;
+            }
+            break;
+
+        case s_header_value_discard_ws:
+            if (ch == ' ' || ch == '\t') {
+                break;
+            }
+            if (ch == '\r') {
+                parser->state = s_header_value_discard_ws_almost_done;
+                break;
+            }
+            if (ch == '\n') {
+                parser->state = s_header_value_discard_lws;
+                break;
+            }
+            MARK(header_value);
+            parser->state = s_header_value;
+            goto reexecute;
+
+        case s_header_value_discard_ws_almost_done:
+            if (ch != '\n') {
+                SET_ERRNO(HPE_LF_EXPECTED);
+                goto error;
+            }
+            parser->state = s_header_value_discard_lws;
+            break;
+
+        case s_header_value_discard_lws:
+            /* obsolete line folding */
+            if (ch == ' ' || ch == '\t') {
+                SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+                goto error;
+            }
+            /* the value is empty, and reported so at the start of the next line */
+            if ((err = finish_header(parser)) != HPE_OK) {
+                SET_ERRNO(err);
+                goto error;
+            }
+            MARK(header_value);
+            parser->state = s_header_field_start;
+            CALLBACK_DATA_NOADVANCE(header_value);
+            goto reexecute;
+
+        case s_header_value:
+            if (ch == '\r' || ch == '\n') {
+                if ((err = finish_header(parser)) != HPE_OK) {
+                    SET_ERRNO(err);
+                    goto error;
+                }
+                parser->state = s_header_almost_done;
+                if (ch == '\r') {
+                    CALLBACK_DATA(header_value);
+                    break;
+                }
+                CALLBACK_DATA_NOADVANCE(header_value);
+                goto reexecute;
+            }
+            if (!IS_HEADER_CHAR(ch)) {
+                SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+                goto error;
+            }
+            if (parser->value_len < sizeof(parser->value)) {
+                parser->value[parser->value_len++] = ch;
+            }
+            break;
+
+        case s_header_almost_done:
+            if (ch != '\n') {
+                SET_ERRNO(HPE_LF_EXPECTED);
+                goto error;
+            }
+            parser->state = s_header_value_lws;
+            break;
+
+        case s_header_value_lws:
+            /* obsolete line folding */
+            if (ch == ' ' || ch == '\t') {
+                SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+                goto error;
+            }
+            parser->state = s_header_field_start;
+            goto reexecute;
+
+        case s_headers_almost_done:
+            if (ch != '\n') {
+                SET_ERRNO(HPE_LF_EXPECTED);
+                goto error;
+            }
+            parser->state = s_headers_done;
+
+            /* Set this here so that on_headers_complete() callbacks can see it */
+            parser->upgrade = ((parser->flags & (F_UPGRADE | F_CONNECTION_UPGRADE)) ==
+                               (F_UPGRADE | F_CONNECTION_UPGRADE)) ||
+                              parser->method == HTTP_CONNECT;
+
+            /* 0 continues, 1 skips the body, 2 also takes it as an upgrade */
+            if (settings->on_headers_complete) {
+                switch (settings->on_headers_complete(parser)) {
+                case 0:
+                    break;
+                case 2:
+                    parser->upgrade = 1;
+                    /* fall through */
+                case 1:
+                    parser->flags |= F_SKIPBODY;
+                    break;
+                default:
+                    SET_ERRNO(HPE_CB_headers_complete);
+                    return p - data;
+                }
+            }
+            if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+                return p - data;
+            }
+            goto reexecute;
+
+        case s_headers_done: {
+            int has_body = parser->content_length > 0 && parser->content_length != ULLONG_MAX;
+            parser->nread = 0;
+
+            if (parser->upgrade && (parser->method == HTTP_CONNECT ||
+                                    (parser->flags & F_SKIPBODY) || !has_body)) {
+                /* Exit, the rest of the message is in a different protocol */
+                parser->state = s_start_req;
+                CALLBACK_NOTIFY(message_complete);
+                return (p - data) + 1;
+            }
+
+            if ((parser->flags & F_SKIPBODY) || !has_body) {
+                parser->state = s_start_req;
+                CALLBACK_NOTIFY(message_complete);
+            } else {
+                parser->state = s_body_identity;
+            }
+            break;
+        }
+
+        case s_body_identity: {
+            uint64_t to_read = parser->content_length;
+            if (to_read > (uint64_t) ((data + len) - p)) {
+                to_read = (data + len) - p;
+            }
+            MARK(body);
+            parser->content_length -= to_read;
+            /* The loop moves past the last character read */
+            p += to_read - 1;
+            if (parser->content_length == 0) {
+                parser->state = s_message_done;
+                CALLBACK_DATA_(body, p - body_mark + 1, p - data);
+                goto reexecute;
+            }
+            break;
+        }
+
+        case s_message_done:
+            parser->state = s_start_req;
+            CALLBACK_NOTIFY(message_complete);
+            break;
+
+        default:
+            SET_ERRNO(HPE_INVALID_INTERNAL_STATE);
+            goto error;
+        }
+    }
+
+    /* Report the partial elements at the end of the block */
+    CALLBACK_DATA_NOADVANCE(header_field);
+    CALLBACK_DATA_NOADVANCE(header_value);
+    CALLBACK_DATA_NOADVANCE(url);
+    CALLBACK_DATA_NOADVANCE(body);
+    return len;
+
+error:
+    if (HTTP_PARSER_ERRNO(parser) == HPE_OK) {
+        SET_ERRNO(HPE_UNKNOWN);
+    }
+    return p - data;
+}
+
+unsigned long http_parser_version(void)
+{
+    return HTTP_PARSER_VERSION_MAJOR * 0x10000 |
+           HTTP_PARSER_VERSION_MINOR * 0x00100 |
+           HTTP_PARSER_VERSION_PATCH * 0x00001;
+}
+
+void http_parser_init(http_parser *parser, enum http_parser_type t)
+{
+    void *data = parser->data; /* preserve application data */
+    memset(parser, 0, sizeof(*parser));
+    parser->data = data;
+    parser->type = t;
+    parser->state = t == HTTP_REQUEST ? s_start_req : s_dead;
+    parser->http_errno = HPE_OK;
+}
+
+void http_parser_settings_init(http_parser_settings *settings)
+{
+    memset(settings, 0, sizeof(*settings));
+}
+
+int http_should_keep_alive(const http_parser *parser)
+{
+    if (parser->http_major > 0 && parser->http_minor > 0) {
+        /* HTTP/1.1 */
+        return !(parser->flags & F_CONNECTION_CLOSE);
+    }
+    /* HTTP/1.0 or earlier */
+    return (parser->flags & F_CONNECTION_KEEP_ALIVE) != 0;
+}
+
+const char *http_method_str(enum http_method m)
+{
+    if ((unsigned) m >= sizeof(method_strings) / sizeof(method_strings[0])) {
+        return "<unknown>";
+    }
+    return method_strings[m];
+}
+
+const char *http_errno_name(enum http_errno err)
+{
+    if ((unsigned) err >= sizeof(http_strerror_tab) / sizeof(http_strerror_tab[0])) {
+        return "HPE_UNKNOWN";
+    }
+    return http_strerror_tab[err].name;
+}
+
+const char *http_errno_description(enum http_errno err)
+{
+    if ((unsigned) err >= sizeof(http_strerror_tab) / sizeof(http_strerror_tab[0])) {
+        return "an unknown error occurred";
+    }
+    return http_strerror_tab[err].description;
+}
+
+void http_parser_url_init(struct http_parser_url *u)
+{
+    memset(u, 0, sizeof(*u));
+}
+
+static void set_field(struct http_parser_url *u, enum http_parser_url_fields field,
+                      const char *buf, const char *start, const char *end)
+{
+    if (end == start) {
+        return;
+    }
+    u->field_set |= 1 << field;
+    u->field_data[field].off = start - buf;
+    u->field_data[field].len = end - start;
+}
+
+/* Parses [userinfo@]host[:port] of the authority in start..end */
+static int parse_authority(const char *buf, const char *start, const char *end,
+                           int allow_userinfo, struct http_parser_url *u)
+{
+    const char *at = memchr(start, '@', end - start);
+    if (at) {
+        if (!allow_userinfo) {
+            return 1;
+        }
+        set_field(u, UF_USERINFO, buf, start, at);
+        start = at + 1;
+    }
+
+    const char *host_end;
+    const char *port = NULL;
+    if (start < end && *start == '[') {
+        const char *close = memchr(start, ']', end - start);
+        if (!close) {
+            return 1;
+        }
+        set_field(u, UF_HOST, buf, start + 1, close);
+        host_end = close + 1;
+        if (host_end < end) {
+            if (*host_end != ':') {
+                return 1;
+            }
+            port = host_end + 1;
+        }
+    } else {
+        host_end = memchr(start, ':', end - start);
+        if (host_end) {
+            port = host_end + 1;
+        } else {
+            host_end = end;
+        }
+        set_field(u, UF_HOST, buf, start, host_end);
+    }
+
+    if (!(u->field_set & (1 << UF_HOST))) {
+        return 1;
+    }
+
+    if (port) {
+        unsigned long value = 0;
+        if (port == end) {
+            return 1;
+        }
+        for (const char *c = port; c < end; c++) {
+            if (!isdigit((unsigned char) *c)) {
+                return 1;
+            }
+            value = value * 10 + (*c - '0');
+            if (value > 0xffff) {
+                return 1;
+            }
+        }
+        set_field(u, UF_PORT, buf, port, end);
+        u->port = (uint16_t) value;
+    }
+    return 0;
+}
+
+int http_parser_parse_url(const char *buf, size_t buflen, int is_connect, struct http_parser_url *u)
+{
+    const char *end = buf + buflen;
+    const char *p = buf;
+
+    u->port = u->field_set = 0;
+    if (buflen == 0) {
+        return 1;
+    }
+    for (const char *c = buf; c < end; c++) {
+        if (!IS_URL_CHAR(*c)) {
+            return 1;
+        }
+    }
+
+    /* CONNECT requests carry only the host and port */
+    if (is_connect) {
+        if (parse_authority(buf, buf, end, 0, u) != 0 || !(u->field_set & (1 << UF_PORT))) {
+            return 1;
+        }
+        return 0;
+    }
+
+    if (*p != '/' && *p != '*') {
+        /* absolute form, schema://authority/path */
+        const char *schema = p;
+        if (!isalpha((unsigned char) *p)) {
+            return 1;
+        }
+        while (p < end && (isalnum((unsigned char) *p) || *p == '+' || *p == '-' || *p == '.')) {
+            p++;
+        }
+        if (end - p < 3 || memcmp(p, "://", 3) != 0) {
+            return 1;
+        }
+        set_field(u, UF_SCHEMA, buf, schema, p);
+        p += 3;
+
+        const char *authority = p;
+        while (p < end && *p != '/' && *p != '?' && *p != '#') {
+            p++;
+        }
+        if (parse_authority(buf, authority, p, 1, u) != 0) {
+            return 1;
+        }
+    }
+
+    const char *path = p;
+    while (p < end && *p != '?' && *p != '#') {
+        p++;
+    }
+    set_field(u, UF_PATH, buf, path, p);
+
+    if (p < end && *p == '?') {
+        const char *query = ++p;
+        while (p < end && *p != '#') {
+            p++;
+        }
+        set_field(u, UF_QUERY, buf, query, p);
+    }
+
+    if (p < end && *p == '#') {
+        set_field(u, UF_FRAGMENT, buf, p + 1, end);
+    }
+    return 0;
+}
+
+void http_parser_pause(http_parser *parser, int paused)
+{
+    /* Users should only be pausing/unpausing a parser that is not in an error
+     * state. In non-debug builds, there's not much that we can do about this
+     * other than ignore it. */
+    if (HTTP_PARSER_ERRNO(parser) == HPE_OK ||
+        HTTP_PARSER_ERRNO(parser) == HPE_PAUSED) {
+        SET_ERRNO(paused ? HPE_PAUSED : HPE_OK);
+    }
+}
+
+int http_body_is_final(const struct http_parser *parser)
+{
+    return parser->state == s_message_done;
+}
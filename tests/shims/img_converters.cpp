@@ -0,0 +1,135 @@
+#include "img_converters.h"
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+
+#include <jpeglib.h>
+
+// libjpeg reports errors by exit(), a failed conversion has to return instead
+struct error_manager {
+  jpeg_error_mgr mgr;
+  jmp_buf jump;
+};
+
+static void error_exit(j_common_ptr cinfo) { longjmp(reinterpret_cast<error_manager *>(cinfo->err)->jump, 1); }
+
+static void output_message(j_common_ptr cinfo) {}
+
+// Kept out of the functions calling setjmp(), so that nothing is skipped by longjmp()
+static void decode_rows(jpeg_decompress_struct *cinfo, uint8_t *row, uint8_t *out, jpg_scale_t scale) {
+  // the device decoder drops partial blocks, libjpeg rounds up
+  unsigned width = cinfo->image_width >> scale;
+  unsigned height = cinfo->image_height >> scale;
+
+  while (cinfo->output_scanline < cinfo->output_height) {
+    JSAMPROW rows[] = {row};
+    unsigned y = cinfo->output_scanline;
+    jpeg_read_scanlines(cinfo, rows, 1);
+    if (y >= height)
+      continue;
+    for (unsigned x = 0; x < width; x++) {
+      const uint8_t *rgb = &row[x * 3];
+      uint16_t pixel = ((rgb[0] & 0xF8) << 8) | ((rgb[1] & 0xFC) << 3) | (rgb[2] >> 3);
+      uint8_t *dst = out + (y * width + x) * 2;
+      dst[0] = pixel >> 8;
+      dst[1] = pixel & 0xFF;
+    }
+  }
+}
+
+static void encode_rows(jpeg_compress_struct *cinfo, uint8_t *row, const uint8_t *src, size_t bpp) {
+  unsigned width = cinfo->image_width;
+
+  while (cinfo->next_scanline < cinfo->image_height) {
+    const uint8_t *line = src + (size_t) cinfo->next_scanline * width * bpp;
+    for (unsigned x = 0; x < width; x++) {
+      if (bpp == 1) {
+        row[x] = line[x];
+        continue;
+      }
+      uint16_t pixel = (line[x * 2] << 8) | line[x * 2 + 1];
+      row[x * 3] = (pixel >> 8) & 0xF8;
+      row[x * 3 + 1] = (pixel >> 3) & 0xFC;
+      row[x * 3 + 2] = (pixel << 3) & 0xF8;
+    }
+    JSAMPROW rows[] = {row};
+    jpeg_write_scanlines(cinfo, rows, 1);
+  }
+}
+
+bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t *out, jpg_scale_t scale) {
+  jpeg_decompress_struct cinfo;
+  error_manager err;
+  uint8_t *volatile row = nullptr;
+
+  cinfo.err = jpeg_std_error(&err.mgr);
+  err.mgr.error_exit = error_exit;
+  err.mgr.output_message = output_message;
+  jpeg_create_decompress(&cinfo);
+
+  if (setjmp(err.jump)) {
+    free(row);
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+
+  jpeg_mem_src(&cinfo, src, src_len);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 1 << scale;
+  jpeg_start_decompress(&cinfo);
+
+  row = (uint8_t *) malloc(cinfo.output_width * cinfo.output_components);
+  decode_rows(&cinfo, row, out, scale);
+  jpeg_finish_decompress(&cinfo);
+
+  free(row);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality,
+             uint8_t **out, size_t *out_len) {
+  size_t bpp = format == PIXFORMAT_GRAYSCALE ? 1 : format == PIXFORMAT_RGB565 ? 2 : 0;
+  if (!bpp || src_len < (size_t) width * height * bpp)
+    return false;
+
+  jpeg_compress_struct cinfo;
+  error_manager err;
+  unsigned char *buffer = nullptr;
+  unsigned long length = 0;
+  uint8_t *volatile row = nullptr;
+
+  cinfo.err = jpeg_std_error(&err.mgr);
+  err.mgr.error_exit = error_exit;
+  err.mgr.output_message = output_message;
+  jpeg_create_compress(&cinfo);
+
+  if (setjmp(err.jump)) {
+    free(row);
+    jpeg_destroy_compress(&cinfo);
+    free(buffer);
+    return false;
+  }
+
+  jpeg_mem_dest(&cinfo, &buffer, &length);
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = bpp == 1 ? 1 : 3;
+  cinfo.in_color_space = bpp == 1 ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  row = (uint8_t *) malloc(width * cinfo.input_components);
+  encode_rows(&cinfo, row, src, bpp);
+  jpeg_finish_compress(&cinfo);
+
+  free(row);
+  jpeg_destroy_compress(&cinfo);
+  *out = buffer;
+  *out_len = length;
+  return true;
+}
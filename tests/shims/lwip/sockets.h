@@ -0,0 +1,12 @@
+#pragma once
+
+// lwIP follows the BSD socket API, the host provides it natively
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
@@ -0,0 +1,78 @@
+#include "nvs.h"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Storage {
+  std::mutex lock;
+  // namespace, key and blob
+  std::map<std::string, std::map<std::string, std::vector<uint8_t>>> entries;
+  std::map<nvs_handle_t, std::string> handles;
+  nvs_handle_t next_handle{1};
+};
+
+Storage &storage() {
+  static Storage *storage = new Storage();
+  return *storage;
+}
+
+}  // namespace
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+  auto &storage = ::storage();
+  std::lock_guard<std::mutex> guard(storage.lock);
+  // as on the device, a namespace has to be written to before it can be read
+  if (open_mode == NVS_READONLY && !storage.entries.count(name))
+    return ESP_ERR_NVS_NOT_FOUND;
+  storage.entries[name];
+  *out_handle = storage.next_handle++;
+  storage.handles[*out_handle] = name;
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+  auto &storage = ::storage();
+  std::lock_guard<std::mutex> guard(storage.lock);
+  storage.handles.erase(handle);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+  auto &storage = ::storage();
+  std::lock_guard<std::mutex> guard(storage.lock);
+  auto &entries = storage.entries[storage.handles[handle]];
+  auto iter = entries.find(key);
+  if (iter == entries.end())
+    return ESP_ERR_NVS_NOT_FOUND;
+  if (out_value == nullptr) {
+    *length = iter->second.size();
+    return ESP_OK;
+  }
+  if (*length < iter->second.size())
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  memcpy(out_value, iter->second.data(), iter->second.size());
+  *length = iter->second.size();
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+  auto &storage = ::storage();
+  std::lock_guard<std::mutex> guard(storage.lock);
+  auto *data = static_cast<const uint8_t *>(value);
+  storage.entries[storage.handles[handle]][key].assign(data, data + length);
+  return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+  auto &storage = ::storage();
+  std::lock_guard<std::mutex> guard(storage.lock);
+  if (!storage.entries[storage.handles[handle]].erase(key))
+    return ESP_ERR_NVS_NOT_FOUND;
+  return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_OK; }
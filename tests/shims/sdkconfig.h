@@ -0,0 +1,15 @@
+#pragma once
+
+// Host stand-in for the generated ESP-IDF configuration,
+// with the esp_http_server and Bluetooth defaults of the device build
+
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 512
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_PURGE_BUF_LEN 32
+#define CONFIG_HTTPD_ERR_RESP_NO_DELAY 1
+#define CONFIG_HTTPD_VALIDATE_REQ 1
+
+#define CONFIG_ARDUINO_RUNNING_CORE 1
+
+// connections of the BLE controller
+#define CONFIG_BTDM_CTRL_BLE_MAX_CONN 3
@@ -0,0 +1,253 @@
+#include "http_client.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace test {
+
+int64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint16_t free_port() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+  getsockname(fd, (struct sockaddr *) &addr, &len);
+  ::close(fd);
+  return ntohs(addr.sin_port);
+}
+
+double percentile(std::vector<double> samples, double p) {
+  if (samples.empty())
+    return 0;
+  std::sort(samples.begin(), samples.end());
+  size_t index = std::min(samples.size() - 1, (size_t) (p * samples.size()));
+  return samples[index];
+}
+
+bool Connection::connect(uint16_t port, uint32_t timeout) {
+  this->close();
+  this->fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (this->fd_ < 0)
+    return false;
+
+  struct timeval tv = {(time_t) (timeout / 1000), (suseconds_t) (timeout % 1000) * 1000};
+  setsockopt(this->fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(this->fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  int enable = 1;
+  setsockopt(this->fd_, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (::connect(this->fd_, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    this->close();
+    return false;
+  }
+  return true;
+}
+
+void Connection::close() {
+  if (this->fd_ >= 0)
+    ::close(this->fd_);
+  this->fd_ = -1;
+  this->buffer_.clear();
+  this->received_ = 0;
+}
+
+bool Connection::send_all(const void *data, size_t length) {
+  const char *buf = (const char *) data;
+  while (length) {
+    ssize_t sent = ::send(this->fd_, buf, length, MSG_NOSIGNAL);
+    if (sent <= 0)
+      return false;
+    buf += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+bool Connection::fill_() {
+  char buf[16384];
+  ssize_t len = ::recv(this->fd_, buf, sizeof(buf), 0);
+  if (len <= 0)
+    return false;
+  this->buffer_.append(buf, len);
+  this->received_ += len;
+  return true;
+}
+
+bool Connection::read_line(std::string *line) {
+  size_t pos;
+  while ((pos = this->buffer_.find('\n')) == std::string::npos) {
+    if (!this->fill_())
+      return false;
+  }
+  line->assign(this->buffer_, 0, pos);
+  if (!line->empty() && line->back() == '\r')
+    line->pop_back();
+  this->buffer_.erase(0, pos + 1);
+  return true;
+}
+
+bool Connection::read_exact(size_t length, std::string *data) {
+  while (this->buffer_.size() < length) {
+    if (!this->fill_())
+      return false;
+  }
+  data->assign(this->buffer_, 0, length);
+  this->buffer_.erase(0, length);
+  return true;
+}
+
+bool Connection::read_until_close(std::string *data) {
+  while (this->fill_()) {
+  }
+  data->swap(this->buffer_);
+  this->buffer_.clear();
+  return true;
+}
+
+static std::string to_lower(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+  return value;
+}
+
+bool read_response_head(Connection &conn, Response *response) {
+  std::string line;
+  if (!conn.read_line(&line) || line.compare(0, 5, "HTTP/") != 0)
+    return false;
+  size_t space = line.find(' ');
+  if (space == std::string::npos)
+    return false;
+  response->status = atoi(line.c_str() + space + 1);
+
+  while (conn.read_line(&line)) {
+    if (line.empty())
+      return true;
+    size_t colon = line.find(':');
+    if (colon == std::string::npos)
+      return false;
+    size_t value = line.find_first_not_of(" \t", colon + 1);
+    response->headers[to_lower(line.substr(0, colon))] = value == std::string::npos ? "" : line.substr(value);
+  }
+  return false;
+}
+
+bool read_response(Connection &conn, Response *response) {
+  if (!read_response_head(conn, response))
+    return false;
+  auto length = response->headers.find("content-length");
+  if (length != response->headers.end())
+    return conn.read_exact(strtoul(length->second.c_str(), nullptr, 10), &response->body);
+  return conn.read_until_close(&response->body);
+}
+
+Response get(uint16_t port, const std::string &path, const std::string &headers) {
+  Response response;
+  Connection conn;
+  int64_t start = now_us();
+  if (!conn.connect(port) || !conn.send_all("GET " + path + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n"))
+    return response;
+  if (!read_response(conn, &response)) {
+    response.status = 0;
+    return response;
+  }
+  response.first_byte = now_us() - start;
+  return response;
+}
+
+bool MultipartReader::next_part(std::string *data) {
+  std::string line;
+
+  // the boundary, after the end of the previous part
+  do {
+    if (!this->conn_.read_line(&line))
+      return false;
+  } while (line.empty());
+  if (line.compare(0, 2, "--") != 0)
+    return false;
+
+  size_t length = std::string::npos;
+  while (this->conn_.read_line(&line) && !line.empty()) {
+    if (to_lower(line).compare(0, 15, "content-length:") == 0)
+      length = strtoul(line.c_str() + 15, nullptr, 10);
+  }
+  if (length == std::string::npos)
+    return false;
+  return this->conn_.read_exact(length, data);
+}
+
+bool WebSocketClient::connect(uint16_t port, const std::string &path) {
+  if (!this->conn_.connect(port))
+    return false;
+
+  std::string request = "GET " + path +
+                        " HTTP/1.1\r\n"
+                        "Host: localhost\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                        "Sec-WebSocket-Version: 13\r\n"
+                        "\r\n";
+  Response response;
+  return this->conn_.send_all(request) && read_response_head(this->conn_, &response) && response.status == 101 &&
+         response.headers["sec-websocket-accept"] == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+}
+
+bool WebSocketClient::send(Opcode opcode, const std::string &payload) {
+  std::string frame;
+  frame.push_back((char) (0x80 | opcode));
+  if (payload.size() < 126) {
+    frame.push_back((char) (0x80 | payload.size()));
+  } else {
+    frame.push_back((char) (0x80 | 126));
+    frame.push_back((char) (payload.size() >> 8));
+    frame.push_back((char) (payload.size() & 0xFF));
+  }
+  const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+  frame.append((const char *) mask, sizeof(mask));
+  for (size_t i = 0; i < payload.size(); i++) {
+    frame.push_back((char) (payload[i] ^ mask[i % 4]));
+  }
+  return this->conn_.send_all(frame);
+}
+
+bool WebSocketClient::recv(Opcode *opcode, std::string *payload) {
+  std::string head;
+  if (!this->conn_.read_exact(2, &head))
+    return false;
+  *opcode = (Opcode) (head[0] & 0x0F);
+  uint64_t length = head[1] & 0x7F;
+  std::string ext;
+  if (length == 126) {
+    if (!this->conn_.read_exact(2, &ext))
+      return false;
+    length = ((uint8_t) ext[0] << 8) | (uint8_t) ext[1];
+  } else if (length == 127) {
+    if (!this->conn_.read_exact(8, &ext))
+      return false;
+    length = 0;
+    for (char c : ext)
+      length = (length << 8) | (uint8_t) c;
+  }
+  // frames from the server are never masked
+  return this->conn_.read_exact(length, payload);
+}
+
+}  // namespace test
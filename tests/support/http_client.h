@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// A blocking HTTP/1.x and WebSocket client for driving the camera
+// web servers over loopback, with helpers for timing the results
+namespace test {
+
+int64_t now_us();
+
+// A port that was free a moment ago
+uint16_t free_port();
+
+// Value below which p (0..1) of the samples fall
+double percentile(std::vector<double> samples, double p);
+
+// Buffered reads from a socket, with a receive timeout in ms
+class Connection {
+ public:
+  Connection() = default;
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+  ~Connection() { this->close(); }
+
+  bool connect(uint16_t port, uint32_t timeout = 5000);
+  void close();
+  bool is_open() const { return this->fd_ >= 0; }
+  int get_fd() const { return this->fd_; }
+
+  bool send_all(const void *data, size_t length);
+  bool send_all(const std::string &data) { return this->send_all(data.data(), data.size()); }
+
+  // Line without the line terminator, false on close or timeout
+  bool read_line(std::string *line);
+  bool read_exact(size_t length, std::string *data);
+  // Everything until the peer closes
+  bool read_until_close(std::string *data);
+  // Bytes received so far, without waiting for more
+  size_t get_received() const { return this->received_; }
+
+ protected:
+  bool fill_();
+
+  int fd_{-1};
+  std::string buffer_;
+  size_t received_{0};
+};
+
+struct Response {
+  int status{0};
+  // names in lower case
+  std::map<std::string, std::string> headers;
+  std::string body;
+  // time to the first byte of the response, in us
+  int64_t first_byte{0};
+};
+
+// Reads the status line and the headers
+bool read_response_head(Connection &conn, Response *response);
+// Reads a complete response, the body as long as Content-Length says or until closed
+bool read_response(Connection &conn, Response *response);
+
+// Sends a GET with the given extra headers, on a fresh connection
+Response get(uint16_t port, const std::string &path, const std::string &headers = "");
+
+// Parts of a multipart/x-mixed-replace stream
+class MultipartReader {
+ public:
+  explicit MultipartReader(Connection &conn) : conn_(conn) {}
+  bool next_part(std::string *data);
+
+ protected:
+  Connection &conn_;
+};
+
+// Minimal WebSocket client, frames from the client are masked
+class WebSocketClient {
+ public:
+  enum Opcode : uint8_t { TEXT = 0x1, BINARY = 0x2, CLOSE = 0x8, PING = 0x9, PONG = 0xA };
+
+  bool connect(uint16_t port, const std::string &path);
+  bool send(Opcode opcode, const std::string &payload);
+  bool recv(Opcode *opcode, std::string *payload);
+  Connection &get_connection() { return this->conn_; }
+
+ protected:
+  Connection conn_;
+};
+
+}  // namespace test